@@ -0,0 +1,339 @@
+#include <GL/gl.h>
+#include <cmath>
+#include <vector>
+#include <string>
+#include <map>
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <limits>
+#include "CityWorld.h"
+#include "SignalControl.h"
+#include "FrameState.h"
+#include "Render.h"
+#include "InstancedMeshes.h"
+#include "SoftwareRasterizer.h"
+#include "OffscreenContext.h"
+#include "WindowLights.h"
+
+// --- Benchmark Suite ---
+// Times each simulation phase and each drawing function over a sweep of entity counts and
+// reports ns per entity. Drawing goes through an offscreen software GL context, so results
+// compare across machines with different GPUs, and the whole scene is also timed on the
+// software rasterizer. With --baseline, a case that got slower than
+// the baseline by more than --threshold fails the run.
+
+int windowWidth = 1000;
+int windowHeight = 600;
+CityWorld world(windowWidth, windowHeight);
+FrameState frame;
+
+struct BenchOptions {
+	long long maxCount;        // Largest simulation sweep entry
+	long long maxRenderCount;  // Largest drawing sweep entry; software GL is slow
+	double minSeconds;         // Each measurement repeats until it has run this long
+	double threshold;          // Allowed slowdown over the baseline (0.25 = 25%)
+	bool render;
+	std::string baselinePath;
+	std::string writePath;
+};
+
+struct BenchResult {
+	std::string name;
+	long long count;
+	double nsPerEntity;
+};
+
+// Best of three batches, each repeating fn until it has run minSeconds. The best batch is
+// the one least disturbed by the rest of the machine.
+static double NsPerCall(const std::function<void()>& fn, double minSeconds) {
+	fn(); // Warm caches and lazily built state
+	double best=1e300;
+	for(int batch=0; batch<3; ++batch) {
+		long long calls=0;
+		auto start=std::chrono::steady_clock::now();
+		double elapsed=0;
+		do {
+			fn();
+			calls++;
+			elapsed=std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+		}
+		while(elapsed<minSeconds/3);
+		best=std::min(best,elapsed*1e9/calls);
+	}
+	return best;
+}
+
+static std::vector<long long> SweepCounts(long long max) {
+	std::vector<long long> counts;
+	for(long long n=10; n<=max; n*=10) counts.push_back(n);
+	return counts;
+}
+
+// A world with the given fleet and crowd, and birds, clouds and sidewalk pedestrians
+// repeated from the generated ones up to the same count, spread across the screen.
+static void BuildWorld(CityWorld& w, long long count) {
+	w.seed=1;
+	w.numVehicles=(int)count;
+	w.numCrossingPedestrians=(int)count;
+	w.timeOfDay=0.4f;
+	w.startQueueLength=std::numeric_limits<float>::infinity();  // Every vehicle queues, however long the column
+	w.initialize();
+	auto spread=[&](float& x, size_t i) {
+		x=(float)((i*7919)%(size_t)(w.width+100))-50.0f;
+	};
+	if(w.birds.empty()) {
+		Bird b= {0,w.birdBaseY,1.2f,0,0.25f,0};
+		w.birds.push_back(b);
+	}
+	for(size_t i=w.birds.size(); i<(size_t)count; ++i) {
+		w.birds.push_back(w.birds[i%3]);
+		spread(w.birds.back().x,i);
+	}
+	for(size_t i=w.sidewalkPedestrians.size(); i<(size_t)count; ++i) {
+		w.sidewalkPedestrians.push_back(w.sidewalkPedestrians[i%NUM_SIDEWALK_PEDESTRIANS]);
+		spread(w.sidewalkPedestrians.back().x,i);
+	}
+	for(size_t i=w.clouds.size(); i<(size_t)count; ++i) {
+		w.clouds.push_back(w.clouds[i%NUM_CLOUDS]);
+		spread(w.clouds.back().pos.x,i);
+	}
+	w.birds.resize(count);
+	w.sidewalkPedestrians.resize(count);
+	w.clouds.resize(count);
+}
+
+// --- Simulation Cases ---
+
+static void BenchSimulation(const BenchOptions& options, std::vector<BenchResult>& results) {
+	for(long long n:SweepCounts(options.maxCount)) {
+		// Signals: n controllers on the default plan, offsets spread over the cycle
+		SignalSystem signals;
+		int plan=signals.addPlan(DefaultSignalPlan());
+		int cycle=signals.plans[plan].cycleLength();
+		for(long long c=0; c<n; ++c) signals.addController(plan,(int)((c*37)%cycle));
+		uint64_t tick=0;
+		results.push_back({"sim.signals",n,NsPerCall([&] {
+			signals.advanceTo(++tick);
+		},options.minSeconds)/n});
+
+		CityWorld w(windowWidth,windowHeight);
+		BuildWorld(w,n);
+		StopZone zone= {w.crossingFrontEdge,w.crossingBackEdge,GREEN,(float)GREEN_DURATION};
+		results.push_back({"sim.car_following",n,NsPerCall([&] {
+			for(const auto& lane:w.lanes) w.computeSpeedLimits(lane,0,lane.order.size(),zone);
+		},options.minSeconds)/n});
+		results.push_back({"sim.vehicles",n,NsPerCall([&] {
+			w.updateVehicles(1.0f);
+		},options.minSeconds)/n});
+		results.push_back({"sim.crossing_admission",n,NsPerCall([&] {
+			w.trafficLightState=RED;
+			w.updateCrossingPedestrians(1.0f,false);
+		},options.minSeconds)/n});
+		results.push_back({"sim.sidewalk_pedestrians",n,NsPerCall([&] {
+			w.updateSidewalkPedestrians(1.0f,false);
+		},options.minSeconds)/n});
+		results.push_back({"sim.cloud_wrapping",n,NsPerCall([&] {
+			w.updateClouds(1.0f,false);
+		},options.minSeconds)/n});
+		results.push_back({"sim.birds",n,NsPerCall([&] {
+			w.updateBirds(1.0f,false);
+		},options.minSeconds)/n});
+		// Window lights: n windows in one mask, the time of day moving a tick per call
+		WindowMask mask;
+		RandomStream windowRng(1,0,0,STREAM_WINDOW_SCENERY);
+		mask.build((size_t)n,windowRng);
+		float day=0.0f;
+		results.push_back({"sim.window_lights",n,NsPerCall([&] {
+			day+=w.timeSpeed;
+			if(day>=1.0f) day-=1.0f;
+			mask.update(WindowOccupancy(BUILDING_SLAB,day));
+		},options.minSeconds)/n});
+		double entities=(double)w.entityCount();
+		results.push_back({"sim.step",n,NsPerCall([&] {
+			w.step(SIM_TICK_SECONDS);
+		},options.minSeconds)/entities});
+	}
+}
+
+// --- Drawing Cases ---
+
+// Runs draw, submits the batch and waits for the rasterizer, so the time covers building
+// the vertices, the draw call and the pixels.
+static double NsPerDraw(const std::function<void()>& draw, double minSeconds) {
+	return NsPerCall([&] {
+		glClear(GL_COLOR_BUFFER_BIT);
+		draw();
+		sceneBatch.flush();
+		glFinish();
+	},minSeconds);
+}
+
+static void BenchRendering(const BenchOptions& options, std::vector<BenchResult>& results) {
+	OffscreenContext gl;
+	std::string error;
+	if(!gl.create(windowWidth,windowHeight,true,error)) {
+		std::cerr<<"skipping drawing cases: "<<error<<"\n";
+		return;
+	}
+	std::cout<<"renderer: "<<gl.renderer()<<"\n";
+	glViewport(0,0,windowWidth,windowHeight);
+	glMatrixMode(GL_PROJECTION);
+	glLoadIdentity();
+	glOrtho(0.0,(double)windowWidth,0.0,(double)windowHeight,-1.0,1.0);
+	glMatrixMode(GL_MODELVIEW);
+	glLoadIdentity();
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA,GL_ONE_MINUS_SRC_ALPHA);
+	SoftwareRasterizer rasterizer(1);
+	for(long long n:SweepCounts(options.maxRenderCount)) {
+		BuildWorld(world,n);
+		CaptureFrame(world,frame);
+		results.push_back({"draw.vehicle",n,NsPerDraw([&] {
+			for(size_t i=0; i<frame.vehicles.size(); ++i) DrawVehicle(frame.vehicles[i]);
+		},options.minSeconds)/n});
+		results.push_back({"draw.pedestrian",n,NsPerDraw([&] {
+			for(const auto& p:frame.sidewalkPedestrians) DrawPedestrian(p);
+		},options.minSeconds)/n});
+		results.push_back({"draw.ellipse",n,NsPerDraw([&] {
+			for(long long i=0; i<n; ++i) DrawEllipse((float)((i*7919)%windowWidth),windowHeight*0.75f,30.0f,18.0f);
+		},options.minSeconds)/n});
+		results.push_back({"draw.trees",n,NsPerDraw([&] {
+			Tree tree=world.trees.empty() ? Tree{{0.0f,0.0f},1.0f,{0.1f,0.5f,0.1f},{0.4f,0.25f,0.1f}} : world.trees[0];
+			for(long long i=0; i<n; ++i) {
+				tree.pos.x=(float)((i*7919)%windowWidth);
+				tree.scale=0.5f+(float)(i%8)*0.1f;
+				DrawTree(tree);
+			}
+		},options.minSeconds)/n});
+		results.push_back({"draw.clouds",n,NsPerDraw([&] {
+			for(const auto& c:frame.clouds) DrawClouds(c);
+		},options.minSeconds)/n});
+		results.push_back({"draw.bird",n,NsPerDraw([&] {
+			for(const auto& b:frame.birds) DrawBird(b);
+		},options.minSeconds)/n});
+		results.push_back({"draw.buildings",n,NsPerDraw([&] {
+			for(long long i=0; i<n; i+=4) {
+				float x=(float)((i*7919)%windowWidth);
+				DrawBuilding1(x,world.upperFootpathTopY,1.0f,nullptr);
+				DrawBuilding2(x,world.upperFootpathTopY,1.0f,nullptr);
+				DrawBuilding3(x,world.upperFootpathTopY,1.0f,nullptr);
+				DrawControlTower(x,world.upperFootpathTopY,1.0f);
+			}
+		},options.minSeconds)/n});
+		if(instancedMeshes.begin()) {
+			results.push_back({"draw.vehicle_instanced",n,NsPerDraw([&] {
+				instancedMeshes.begin();
+				for(size_t i=0; i<frame.vehicles.size(); ++i) instancedMeshes.addVehicle(frame.vehicles[i]);
+				instancedMeshes.submit();
+			},options.minSeconds)/n});
+			results.push_back({"draw.pedestrian_instanced",n,NsPerDraw([&] {
+				instancedMeshes.begin();
+				for(const auto& p:frame.sidewalkPedestrians) instancedMeshes.addPedestrian(p);
+				instancedMeshes.submit();
+			},options.minSeconds)/n});
+			results.push_back({"draw.trees_instanced",n,NsPerDraw([&] {
+				Tree tree=world.trees.empty() ? Tree{{0.0f,0.0f},1.0f,{0.1f,0.5f,0.1f},{0.4f,0.25f,0.1f}} : world.trees[0];
+				instancedMeshes.begin();
+				for(long long i=0; i<n; ++i) {
+					tree.pos.x=(float)((i*7919)%windowWidth);
+					tree.scale=0.5f+(float)(i%8)*0.1f;
+					instancedMeshes.addTree(tree);
+				}
+				instancedMeshes.submit();
+			},options.minSeconds)/n});
+		}
+		results.push_back({"draw.scene",n,NsPerDraw([&] {
+			DrawScene();
+		},options.minSeconds)/world.entityCount()});
+		// The same frame drawn by the CPU backend, on one thread so results compare across machines
+		batchTarget=&rasterizer;
+		results.push_back({"draw.scene_software",n,NsPerCall([&] {
+			DrawScene();
+		},options.minSeconds)/world.entityCount()});
+		batchTarget=&glBatchTarget;
+	}
+}
+
+// --- Baseline ---
+// One "name count ns_per_entity" line per result.
+
+static std::string Key(const std::string& name, long long count) {
+	return name+" "+std::to_string(count);
+}
+
+static bool WriteBaseline(const std::string& path, const std::vector<BenchResult>& results) {
+	std::ofstream out(path);
+	for(const auto& r:results) out<<r.name<<" "<<r.count<<" "<<std::setprecision(6)<<r.nsPerEntity<<"\n";
+	return (bool)out;
+}
+
+static bool ReadBaseline(const std::string& path, std::map<std::string,double>& baseline) {
+	std::ifstream in(path);
+	if(!in) return false;
+	std::string name;
+	long long count;
+	double ns;
+	while(in>>name>>count>>ns) baseline[Key(name,count)]=ns;
+	return true;
+}
+
+int main(int argc, char** argv) {
+	BenchOptions options= {1000000,10000,0.3,0.25,true,"",""};
+	for(int i=1; i<argc; ++i) {
+		if(strcmp(argv[i],"--max")==0&&i+1<argc) options.maxCount=atoll(argv[++i]);
+		else if(strcmp(argv[i],"--render-max")==0&&i+1<argc) options.maxRenderCount=atoll(argv[++i]);
+		else if(strcmp(argv[i],"--min-time")==0&&i+1<argc) options.minSeconds=atof(argv[++i]);
+		else if(strcmp(argv[i],"--threshold")==0&&i+1<argc) options.threshold=atof(argv[++i]);
+		else if(strcmp(argv[i],"--baseline")==0&&i+1<argc) options.baselinePath=argv[++i];
+		else if(strcmp(argv[i],"--write-baseline")==0&&i+1<argc) options.writePath=argv[++i];
+		else if(strcmp(argv[i],"--no-render")==0) options.render=false;
+		else {
+			std::cerr<<"usage: "<<argv[0]<<" [--max N] [--render-max N] [--min-time S] [--no-render]\n"
+			         <<"       [--baseline FILE [--threshold F]] [--write-baseline FILE]\n";
+			return 2;
+		}
+	}
+	std::map<std::string,double> baseline;
+	if(!options.baselinePath.empty()&&!ReadBaseline(options.baselinePath,baseline)) {
+		std::cerr<<"cannot read baseline "<<options.baselinePath<<"\n";
+		return 2;
+	}
+	std::vector<BenchResult> results;
+	BenchSimulation(options,results);
+	if(options.render) BenchRendering(options,results);
+
+	int regressions=0;
+	std::cout<<"vehicle kernel: "<<IntegrateVehiclesPath()<<"\n";
+	std::cout<<std::left<<std::setw(28)<<"case"<<std::right<<std::setw(10)<<"count"<<std::setw(14)<<"ns/entity";
+	if(!baseline.empty()) std::cout<<std::setw(14)<<"baseline"<<std::setw(10)<<"change";
+	std::cout<<"\n"<<std::fixed;
+	for(const auto& r:results) {
+		std::cout<<std::left<<std::setw(28)<<r.name<<std::right<<std::setw(10)<<r.count<<std::setw(14)<<std::setprecision(2)<<r.nsPerEntity;
+		auto base=baseline.find(Key(r.name,r.count));
+		if(base!=baseline.end()&&base->second>0) {
+			double change=r.nsPerEntity/base->second-1.0;
+			std::cout<<std::setw(14)<<base->second<<std::setw(9)<<std::setprecision(1)<<change*100.0<<"%";
+			if(change>options.threshold) {
+				std::cout<<"  REGRESSION";
+				regressions++;
+			}
+		}
+		std::cout<<"\n";
+	}
+	if(!options.writePath.empty()&&!WriteBaseline(options.writePath,results)) {
+		std::cerr<<"cannot write baseline "<<options.writePath<<"\n";
+		return 2;
+	}
+	if(regressions>0) {
+		std::cout<<regressions<<" case(s) slower than the baseline by more than "<<std::setprecision(0)<<options.threshold*100.0<<"%\n";
+		return 1;
+	}
+	return 0;
+}
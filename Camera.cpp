@@ -0,0 +1,48 @@
+#include "Camera.h"
+#include <algorithm>
+#include "Render.h"
+
+Camera camera;
+
+Camera::Camera() : reach(0.0f), left(0.0f), bottom(0.0f), scale(1.0f) {}
+
+void Camera::reset() {
+	left=bottom=0.0f;
+	scale=1.0f;
+}
+
+void Camera::pan(float dx, float dy) {
+	left+=dx/scale;
+	bottom+=dy/scale;
+}
+
+void Camera::zoomAt(float factor, float x, float y) {
+	float worldX=left+x/scale, worldY=bottom+y/scale;
+	scale=std::min(CAMERA_MAX_ZOOM,std::max(CAMERA_MIN_ZOOM,scale*factor));
+	left=worldX-x/scale;
+	bottom=worldY-y/scale;
+}
+
+// Applied when the view is read rather than when it moves, so a resized window is
+// clamped too.
+void Camera::clamp(float& x, float& y) const {
+	float w=(float)windowWidth, h=(float)windowHeight;
+	float viewW=w/scale, viewH=h/scale;
+	float beyond=(reach>0.0f) ? reach : w;
+	float minX=-beyond, maxX=w+beyond-viewW;
+	x=(minX<=maxX) ? std::min(maxX,std::max(minX,x)) : (w-viewW)*0.5f;
+	y=(viewH<h) ? std::min(h-viewH,std::max(0.0f,y)) : 0.0f;
+}
+
+ViewRect Camera::view() const {
+	float x=left, y=bottom;
+	clamp(x,y);
+	ViewRect r= {x,y,x+windowWidth/scale,y+windowHeight/scale};
+	return r;
+}
+
+void Camera::apply(DrawBatch& batch) const {
+	ViewRect r=view();
+	batch.translate(-r.x0*scale,-r.y0*scale);
+	batch.scale(scale,scale);
+}
@@ -0,0 +1,49 @@
+#ifndef CAMERA_H_INCLUDED
+#define CAMERA_H_INCLUDED
+
+#include "DrawBatch.h"
+
+// --- Camera ---
+// Pans and zooms the street. World units are the pixels of the unzoomed view, which shows
+// 0..windowWidth x 0..windowHeight as the scene always did. The view may pan reach past
+// either end (by default one window width, where vehicles queue before they enter; the
+// streamed city goes further), but never below the ground; zoomed out, the sky fills the
+// rest. The sky and the sun and moon stay fixed to
+// the window, everything else is drawn through apply().
+const float CAMERA_MIN_ZOOM = 0.35f;
+const float CAMERA_MAX_ZOOM = 8.0f;
+
+struct ViewRect {
+	float x0, y0, x1, y1;
+};
+
+class Camera {
+public:
+	Camera();
+
+	// Back to the unzoomed view of the whole window.
+	void reset();
+	// Moves the view by this many window pixels.
+	void pan(float dx, float dy);
+	// Zooms by factor, keeping the world point under window pixel (x, y) where it is.
+	void zoomAt(float factor, float x, float y);
+	float zoom() const {
+		return scale;
+	}
+	// The world rectangle the window shows.
+	ViewRect view() const;
+	// Multiplies batch's transform by the world-to-window mapping, as a translate and scale.
+	void apply(DrawBatch& batch) const;
+
+	float reach;  // How far past either side of the window the view may go; 0 for one window width
+
+private:
+	void clamp(float& x, float& y) const;
+
+	float left, bottom;  // World point at the window's bottom-left corner
+	float scale;         // Window pixels per world unit
+};
+
+extern Camera camera;
+
+#endif // CAMERA_H_INCLUDED
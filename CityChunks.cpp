@@ -0,0 +1,264 @@
+#include "CityChunks.h"
+#include <cmath>
+#include <algorithm>
+#include "Random.h"
+#include "Profiler.h"
+
+ChunkStreamer cityChunks;
+
+// --- Generation ---
+
+static const float HOME_CLEARANCE = 20.0f;  // Kept free between the chunks and the hand-placed scene
+
+static bool overlapsHome(const ChunkLayout& layout, float x0, float x1) {
+	return x1>layout.homeX0-HOME_CLEARANCE&&x0<layout.homeX1+HOME_CLEARANCE;
+}
+
+// Horizontal extent of each kind at scale 1, relative to the x its Draw* function takes.
+static void buildingExtent(BuildingKind kind, float& left, float& right) {
+	switch(kind) {
+	case BUILDING_SLAB:
+		left=-18.0f;  // The accent wing
+		right=60.0f;
+		break;
+	case BUILDING_GLASS:
+		left=0.0f;
+		right=80.0f;
+		break;
+	case BUILDING_TIERED:
+		left=0.0f;
+		right=100.0f;
+		break;
+	default:
+		left=-40.0f;  // The platform
+		right=40.0f;
+		break;
+	}
+}
+
+template<class T>
+static size_t vectorBytes(const std::vector<T>& v) {
+	return v.capacity()*sizeof(T);
+}
+
+void GenerateChunk(int index, const ChunkLayout& layout, CityChunk& chunk) {
+	PROFILE_ZONE("chunks.generate");
+	float x0=index*CHUNK_WIDTH, x1=x0+CHUNK_WIDTH;
+	chunk.index=index;
+	chunk.buildings.clear();
+	chunk.trees.clear();
+	chunk.streetLights.clear();
+
+	// One stream per kind of content, so a change to one leaves the others as they were
+	RandomStream roadRng(layout.seed,(uint32_t)index,0,STREAM_CHUNK_ROAD);
+	chunk.road.x0=x0;
+	chunk.road.x1=x1;
+	chunk.road.crossingX=NO_CROSSING;
+	if(randInt(roadRng,3)==0) {
+		float x=randFloat(roadRng,x0+layout.crossingWidth,x1-layout.crossingWidth);
+		if(!overlapsHome(layout,x-layout.crossingWidth,x+layout.crossingWidth)) chunk.road.crossingX=x;
+	}
+	auto nearCrossing=[&](float x, float factor) {
+		return fabs(x-chunk.road.crossingX)<layout.crossingWidth*factor;
+	};
+
+	// Buildings stand side by side along the upper footpath, none crossing the chunk's
+	// edges, with the odd gap for a small park
+	RandomStream buildingRng(layout.seed,(uint32_t)index,0,STREAM_CHUNK_BUILDING);
+	float cursor=x0+randFloat(buildingRng,10.0f,40.0f);
+	for(;;) {
+		if(randInt(buildingRng,4)==0) {
+			cursor+=randFloat(buildingRng,60.0f,160.0f);
+			if(cursor>=x1) break;
+			continue;
+		}
+		PlacedBuilding b;
+		b.kind=(BuildingKind)randInt(buildingRng,4);
+		b.scale=(b.kind==BUILDING_TOWER) ? randFloat(buildingRng,0.8f,1.4f) : randFloat(buildingRng,0.6f,1.2f);
+		float left, right;
+		buildingExtent(b.kind,left,right);
+		b.x=cursor-left*b.scale;
+		float end=b.x+right*b.scale;
+		if(end>x1-10.0f) break;
+		if(!overlapsHome(layout,cursor,end)) {
+			// The windows draw from their own stream, so the buildings stay as they were
+			RandomStream windowRng(layout.seed,(uint32_t)index,chunk.buildings.size(),STREAM_WINDOW_CHUNK);
+			chunk.buildings.emplace_back();
+			BuildLitBuilding(b,layout.upperFootpathTopY,windowRng,chunk.buildings.back());
+		}
+		cursor=end+randFloat(buildingRng,8.0f,40.0f);
+	}
+
+	// Trees and street lights as CityWorld::initialize() places them, kept off the crossing
+	RandomStream treeRng(layout.seed,(uint32_t)index,0,STREAM_CHUNK_TREE);
+	Color trunkC= {0.4f,0.2f,0.1f};
+	int trees=2+randInt(treeRng,4);
+	for(int i=0; i<trees; ++i) {
+		Tree t;
+		bool onUpper=(randInt(treeRng,2)==0);
+		t.pos.y=onUpper?layout.upperFootpathTopY:layout.lowerFootpathBottomY;
+		t.pos.x=randFloat(treeRng,x0+20.0f,x1-20.0f);
+		t.scale=randFloat(treeRng,0.8f,1.3f);
+		t.foliageColor= {randFloat(treeRng,0.0f,0.1f),randFloat(treeRng,0.3f,0.6f),randFloat(treeRng,0.0f,0.15f)};
+		t.trunkColor=trunkC;
+		if(!nearCrossing(t.pos.x,1.5f)&&!overlapsHome(layout,t.pos.x-30.0f*t.scale,t.pos.x+30.0f*t.scale)) chunk.trees.push_back(t);
+	}
+	RandomStream lightRng(layout.seed,(uint32_t)index,0,STREAM_CHUNK_STREETLIGHT);
+	const int lights=3;
+	for(int i=0; i<lights; ++i) {
+		StreetLight sl;
+		sl.onUpper=((index*lights+i)&1)==0;  // Alternating sides all along the street
+		sl.pos.y=sl.onUpper?layout.upperFootpathBottomY:layout.lowerFootpathBottomY;
+		sl.height=85.0f+randFloat(lightRng,-5.0f,5.0f);
+		sl.armLength=35.0f+randFloat(lightRng,-3.0f,8.0f);
+		sl.pos.x=x0+CHUNK_WIDTH*(i+0.5f)/lights+randFloat(lightRng,-35.0f,35.0f);
+		if(!nearCrossing(sl.pos.x,1.2f)&&!overlapsHome(layout,sl.pos.x-sl.armLength,sl.pos.x+sl.armLength)) chunk.streetLights.push_back(sl);
+	}
+
+	chunk.bytes=sizeof(CityChunk)+vectorBytes(chunk.buildings)+vectorBytes(chunk.trees)+vectorBytes(chunk.streetLights);
+	for(const LitBuilding& b:chunk.buildings) chunk.bytes+=vectorBytes(b.windows)+b.mask.bytes();
+}
+
+// --- Streaming ---
+
+ChunkStreamer::ChunkStreamer() : cityChunks(DEFAULT_CITY_CHUNKS), memoryBudget(DEFAULT_CHUNK_BUDGET), residentBytes(0), generated(0), evicted(0),
+	layout(), version(0), requestLayout(), requestVersion(0), stopping(false), threadCount(0) {}
+
+ChunkStreamer::~ChunkStreamer() {
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stopping=true;
+	}
+	wake.notify_all();
+	for(auto& t:workers) t.join();
+}
+
+void ChunkStreamer::setThreadCount(int threads) {
+	threadCount=threads;
+}
+
+void ChunkStreamer::start() {
+	int threads=threadCount>0 ? threadCount : (int)std::thread::hardware_concurrency()-1;
+	threads=std::max(1,threads);
+	for(int i=0; i<threads; ++i) workers.emplace_back(&ChunkStreamer::workerLoop,this);
+}
+
+void ChunkStreamer::workerLoop() {
+	SetProfileThreadName("chunks");
+	std::unique_lock<std::mutex> guard(lock);
+	for(;;) {
+		wake.wait(guard,[this] {
+			return stopping||!requests.empty();
+		});
+		if(stopping) return;
+		int index=requests.front();
+		requests.pop_front();
+		inFlight.push_back(index);
+		Finished done;
+		done.version=requestVersion;
+		ChunkLayout forLayout=requestLayout;
+		guard.unlock();
+		GenerateChunk(index,forLayout,done.chunk);
+		guard.lock();
+		inFlight.erase(std::find(inFlight.begin(),inFlight.end(),index));
+		finished.push_back(std::move(done));
+	}
+}
+
+// Appends [first, last] to wanted, nearest the middle first, skipping any already there.
+void ChunkStreamer::want(int first, int last) {
+	int lowest=-cityChunks, highest=(int)floorf((layout.homeX1+reach())/CHUNK_WIDTH);
+	first=std::max(first,lowest);
+	last=std::min(last,highest);
+	if(first>last) return;
+	int middle=first+(last-first)/2;
+	for(int step=0; middle-step>=first||middle+step+1<=last; ++step) {
+		for(int index: {middle-step,middle+step+1}) {
+			if(index<first||index>last) continue;
+			if(std::find(wanted.begin(),wanted.end(),index)==wanted.end()) wanted.push_back(index);
+		}
+	}
+}
+
+bool ChunkStreamer::update(float viewX0, float viewX1, float activeX0, float activeX1) {
+	PROFILE_ZONE("chunks.update");
+	ChunkLayout now;
+	now.seed=world.seed;
+	now.homeX0=0.0f;
+	now.homeX1=(float)windowWidth;
+	now.upperFootpathTopY=world.upperFootpathTopY;
+	now.upperFootpathBottomY=world.upperFootpathBottomY;
+	now.lowerFootpathBottomY=world.lowerFootpathBottomY;
+	now.crossingWidth=world.zebraCrossingWidth;
+	if(now.seed!=layout.seed||now.homeX0!=layout.homeX0||now.homeX1!=layout.homeX1||now.upperFootpathTopY!=layout.upperFootpathTopY||
+	        now.upperFootpathBottomY!=layout.upperFootpathBottomY||now.lowerFootpathBottomY!=layout.lowerFootpathBottomY||now.crossingWidth!=layout.crossingWidth) {
+		layout=now;
+		version++;
+		resident.clear();
+		lru.clear();
+		residentBytes=0;
+	}
+	if(workers.empty()&&cityChunks>0) start();
+
+	// The view first, then the simulated street, each with CHUNK_PREFETCH either side
+	wanted.clear();
+	int viewFirst=(int)floorf(viewX0/CHUNK_WIDTH), viewLast=(int)floorf(viewX1/CHUNK_WIDTH);
+	if(cityChunks>0) {
+		want(viewFirst,viewLast);
+		want(viewFirst-CHUNK_PREFETCH,viewLast+CHUNK_PREFETCH);
+		want((int)floorf(activeX0/CHUNK_WIDTH)-CHUNK_PREFETCH,(int)floorf(activeX1/CHUNK_WIDTH)+CHUNK_PREFETCH);
+	}
+
+	bool arrivedInView=false, requested=false;
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		for(Finished& done:finished) {
+			int index=done.chunk.index;
+			if(done.version!=version||resident.count(index)) continue;
+			Entry& entry=resident[index];
+			entry.chunk=std::move(done.chunk);
+			entry.age=lru.insert(lru.end(),index);
+			residentBytes+=entry.chunk.bytes;
+			generated++;
+			if(index>=viewFirst&&index<=viewLast) arrivedInView=true;
+		}
+		finished.clear();
+		requests.clear();
+		for(int index:wanted) {
+			if(!resident.count(index)&&std::find(inFlight.begin(),inFlight.end(),index)==inFlight.end()) requests.push_back(index);
+		}
+		requestLayout=layout;
+		requestVersion=version;
+		requested=!requests.empty();
+	}
+	if(requested) wake.notify_all();
+
+	// Wanted chunks move to the young end, so whatever is left at the old end is not wanted
+	size_t kept=0;
+	for(int index:wanted) {
+		auto found=resident.find(index);
+		if(found==resident.end()) continue;
+		lru.splice(lru.end(),lru,found->second.age);
+		kept++;
+	}
+	while(residentBytes>memoryBudget&&lru.size()>kept) {
+		auto found=resident.find(lru.front());
+		residentBytes-=found->second.chunk.bytes;
+		resident.erase(found);
+		lru.pop_front();
+		evicted++;
+	}
+
+	visible.clear();
+	for(int index=viewFirst; index<=viewLast; ++index) {
+		auto found=resident.find(index);
+		if(found!=resident.end()) visible.push_back(&found->second.chunk);
+	}
+	return arrivedInView;
+}
+
+size_t ChunkStreamer::lightWindows(float timeOfDay) {
+	size_t flipped=0;
+	for(const CityChunk* chunk:visible) flipped+=UpdateWindowLights(resident.at(chunk->index).chunk.buildings,timeOfDay);
+	return flipped;
+}
@@ -0,0 +1,132 @@
+#ifndef CITYCHUNKS_H_INCLUDED
+#define CITYCHUNKS_H_INCLUDED
+
+#include <vector>
+#include <deque>
+#include <list>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+#include <cstddef>
+#include "CityTypes.h"
+#include "Render.h"
+#include "WindowLights.h"
+
+// --- Streamed City Chunks ---
+// Past the hand-placed scene the street goes on as procedurally generated chunks,
+// CHUNK_WIDTH wide, each filled from a random stream keyed by the seed and the chunk's
+// index alone: the same chunk always comes out the same, whenever and on whichever thread
+// it is made, and nothing is made up front. update() is called once a frame with the view.
+// It asks the worker threads for the chunks within CHUNK_PREFETCH of the view or of the
+// simulated street, nearest first, takes in the ones they have finished, and evicts the
+// least recently wanted chunks once the resident ones pass memoryBudget bytes. A chunk the
+// view needs is drawn as soon as it arrives; until then that stretch shows bare street.
+const float CHUNK_WIDTH = 512.0f;
+const int CHUNK_PREFETCH = 2;                      // Chunks made ahead either side of what is wanted
+const int DEFAULT_CITY_CHUNKS = 256;               // Per side of the scene, so about 260k pixels of street
+const int MAX_CITY_CHUNKS = 4096;                  // Further out, float positions lose whole pixels at full zoom
+const size_t DEFAULT_CHUNK_BUDGET = 8u << 20;      // Bytes
+
+const float NO_CROSSING = -1.0e30f;
+
+struct RoadPiece {
+	float x0, x1;
+	float crossingX;       // Center of a zebra crossing, or NO_CROSSING
+};
+
+struct CityChunk {
+	int index;             // Covers [index*CHUNK_WIDTH, (index+1)*CHUNK_WIDTH)
+	std::vector<LitBuilding> buildings;  // Their masks are brought up to date while in view
+	std::vector<Tree> trees;
+	std::vector<StreetLight> streetLights;
+	RoadPiece road;
+	size_t bytes;          // What the chunk holds, counted against the budget
+};
+
+// What a chunk's contents depend on besides its index. Chunks made for another layout
+// are thrown away.
+struct ChunkLayout {
+	uint64_t seed;
+	float homeX0, homeX1;  // The hand-placed scene; chunks leave it empty
+	float upperFootpathTopY, upperFootpathBottomY, lowerFootpathBottomY;
+	float crossingWidth;
+};
+
+// Fills chunk index for layout; the workers call this, and so can anything else.
+void GenerateChunk(int index, const ChunkLayout& layout, CityChunk& chunk);
+
+class ChunkStreamer {
+public:
+	ChunkStreamer();
+	~ChunkStreamer();
+
+	// Starts the workers on first use; threads 0 means one less than the hardware threads.
+	void setThreadCount(int threads);
+	// Wants the chunks over [viewX0, viewX1] and [activeX0, activeX1], within the city's
+	// cityChunks chunks either side of the scene. True when a chunk in view arrived, so the
+	// cached scenery needs a bake.
+	bool update(float viewX0, float viewX1, float activeX0, float activeX1);
+	// The resident chunks overlapping the last update()'s view, left to right. Valid until
+	// the next update().
+	const std::vector<const CityChunk*>& inView() const {
+		return visible;
+	}
+	// Brings the window lights of the chunks in view to timeOfDay (WindowLights.h); the
+	// rest catch up when they come into view. Returns the number of windows changed.
+	size_t lightWindows(float timeOfDay);
+	// How far the city reaches past the scene on either side.
+	float reach() const {
+		return cityChunks*CHUNK_WIDTH;
+	}
+
+	int cityChunks;
+	size_t memoryBudget;
+	// For the stats overlay
+	size_t residentBytes;
+	long long generated;
+	long long evicted;
+	size_t residentCount() const {
+		return resident.size();
+	}
+
+private:
+	struct Entry {
+		CityChunk chunk;
+		std::list<int>::iterator age;  // Position in lru
+	};
+	struct Finished {
+		unsigned version;
+		CityChunk chunk;
+	};
+
+	void start();
+	void workerLoop();
+	void want(int first, int last);
+
+	// Drawing thread only
+	std::unordered_map<int, Entry> resident;
+	std::list<int> lru;             // Least recently wanted first
+	std::vector<int> wanted;        // Scratch for update()
+	std::vector<const CityChunk*> visible;
+	ChunkLayout layout;
+	unsigned version;               // Bumped when the layout changes
+
+	// Shared with the workers, under lock
+	std::mutex lock;
+	std::condition_variable wake;
+	std::deque<int> requests;       // Nearest first; replaced by each update()
+	std::vector<int> inFlight;      // Taken by a worker, not finished yet
+	std::vector<Finished> finished;
+	ChunkLayout requestLayout;
+	unsigned requestVersion;
+	bool stopping;
+
+	int threadCount;
+	std::vector<std::thread> workers;
+};
+
+extern ChunkStreamer cityChunks;
+
+#endif // CITYCHUNKS_H_INCLUDED
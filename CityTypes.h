@@ -0,0 +1,137 @@
+#ifndef CITYTYPES_H_INCLUDED
+#define CITYTYPES_H_INCLUDED
+
+#include <vector>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+// --- Configuration ---
+extern bool ENABLE_DAY_NIGHT_CYCLE;
+const int NUM_CARS = 8;
+const int NUM_SIDEWALK_PEDESTRIANS = 10;
+const int NUM_CROSSING_PEDESTRIANS = 6;
+const int NUM_TREES = 12;
+const int NUM_STREETLIGHTS = 6;
+const int NUM_CLOUDS = 5;
+const float PEDESTRIAN_WAIT_X_OFFSET = 15.0f;
+const float CAR_MIN_SAFE_DISTANCE = 25.0f;
+const float CAR_DECELERATION = 0.08f;
+const float CAR_ACCELERATION = 0.04f;
+const float STOP_LINE_DISTANCE_BEFORE_CROSSING = 15.0f;
+const float CAR_TIME_PREDICTION_FACTOR = 1.15f;
+const float NIGHT_START_TIME = 0.65f; // Adjust slightly for more overlap with sunset
+const float NIGHT_END_TIME = 0.18f;
+const float DAWN_DURATION = 0.1f; // Duration of dawn/dusk transition for clouds/lights
+const float DUSK_DURATION = 0.1f;
+const int RED_DURATION = 250;
+const int YELLOW_DURATION = 50;
+const int GREEN_DURATION = 500;
+const float SIM_TICK_SECONDS = 0.016f; // All per-tick constants above are tuned for this tick length
+const float TARGET_FRAME_SECONDS = 1.0f / 60.0f;
+const int MAX_CATCHUP_TICKS = 10;      // Most ticks one frame may run to catch up with real time
+const float DEFAULT_LANE_DEMAND = 12.0f; // Arrivals per lane per simulated minute
+const int MAX_PENDING_ARRIVALS = 4;    // Arrivals a blocked lane entry holds before dropping more
+const float SPAWN_MARGIN = 50.0f;      // Vehicles enter and leave this far past the screen edge
+const float START_QUEUE_LENGTH = 1500.0f; // Off-screen road each lane's starting vehicles may queue on
+const float MAX_VEHICLE_WIDTH = 120.0f; // Widest entry in VEHICLE_TRAITS
+const int MAX_CROSSING_PEDESTRIANS = 2; // Pedestrians allowed on one crosswalk at a time
+
+// --- Structures ---
+struct Point {
+	float x, y;
+};
+struct Color {
+	float r, g, b;
+};
+struct Bird {
+	float x,y,speed,flapPhase,flapSpeed,bobPhase;
+};
+enum VehicleType { CAR, BUS, TRUCK };
+struct VehicleTraits {
+	float width, height;
+	float minSpeed, maxSpeed;  // Range baseSpeed is drawn from
+};
+constexpr VehicleTraits VEHICLE_TRAITS[] = { // Indexed by VehicleType
+	{60.0f, 25.0f, 0.8f, 1.6f},   // CAR
+	{100.0f, 40.0f, 0.6f, 1.0f},  // BUS
+	{120.0f, 45.0f, 0.5f, 0.9f},  // TRUCK
+};
+struct Vehicle {
+	float x,y,speed,baseSpeed,width,height;
+	Color color;
+	VehicleType type;
+	int direction;
+	unsigned id;       // Stable identity, keys the vehicle's random streams
+};
+enum PedestrianState { WALKING_SIDEWALK, WAITING_TO_CROSS, CROSSING, FINISHED_CROSSING };
+struct Pedestrian {
+	float x,y,speed,targetY,legPhase,legSpeed;
+	PedestrianState state;
+	Color clothingColor;
+	bool onUpperPath;
+	int crosswalk;     // Crosswalk a crossing pedestrian uses
+};
+struct Tree {
+	Point pos;
+	float scale;
+	Color foliageColor;
+	Color trunkColor;
+};
+struct StreetLight {
+	Point pos;
+	float height;
+	float armLength;
+	bool onUpper;
+};
+struct WindowRect {
+	float x0, y0, x1, y1;
+};
+enum BuildingKind {
+	BUILDING_SLAB,         // DrawBuilding1
+	BUILDING_GLASS,        // DrawBuilding2
+	BUILDING_TIERED,       // DrawBuilding3
+	BUILDING_TOWER         // DrawControlTower, no windows
+};
+struct PlacedBuilding {
+	BuildingKind kind;
+	float x, scale;        // As the Draw* function takes them; it stands on the upper footpath
+};
+struct Cloud {
+	Point pos;
+	float speed;
+	float scale;
+	int numEllipses;
+	std::vector<Point> ellipseOffsets;
+	std::vector<float> ellipseRadiiX;
+	std::vector<float> ellipseRadiiY;
+	float shapePhase;
+	float alpha;
+}; // Added alpha
+enum LightState { RED, YELLOW, GREEN };
+// Poisson arrivals at a lane's upstream end. An arrival that finds the entry occupied
+// waits in pending; beyond MAX_PENDING_ARRIVALS further arrivals are dropped.
+struct ArrivalQueue {
+	double nextArrival;  // Tick clock time of the next arrival
+	unsigned draws;      // Gaps drawn so far; keys the next one
+	int pending;
+	long long spawned, dropped;
+};
+// Vehicles sharing a lane, kept in travel order: order[0] is furthest ahead,
+// so a vehicle's leader is simply the entry before it.
+struct Lane {
+	float y;
+	int direction;
+	std::vector<int> order;
+	ArrivalQueue arrivals;
+};
+
+// --- Helper Functions ---
+float lerp(float a, float b, float t);
+Color lerpColor(Color a, Color b, float t);
+float moveTowards(float current, float target, float maxDelta);
+// isNightTime remains simple for logic checks, fading handled separately
+bool isNightTime(float currentTimeOfDay);
+
+#endif // CITYTYPES_H_INCLUDED
@@ -0,0 +1,600 @@
+#include "CityWorld.h"
+#include "RoadNetwork.h"
+#include "Random.h"
+#include "Profiler.h"
+#include <cmath>
+#include <algorithm> // For std::min/max
+#include <limits>    // For numeric_limits
+
+bool ENABLE_DAY_NIGHT_CYCLE = true;
+
+// --- Helper Functions ---
+float lerp(float a, float b, float t) {
+	return a + t * (b - a);
+}
+Color lerpColor(Color a, Color b, float t) {
+	Color c;
+	c.r=lerp(a.r,b.r,t);
+	c.g=lerp(a.g,b.g,t);
+	c.b=lerp(a.b,b.b,t);
+	return c;
+}
+float moveTowards(float current, float target, float maxDelta) {
+	if (fabs(target - current) <= maxDelta) {
+		return target;
+	}
+	return current + ((target > current) ? 1 : -1) * maxDelta;
+}
+bool isNightTime(float currentTimeOfDay) {
+	return (currentTimeOfDay >= NIGHT_START_TIME || currentTimeOfDay <= NIGHT_END_TIME);
+}
+
+// --- Simulation State ---
+
+CityWorld::CityWorld(int w, int h) {
+	width = w;
+	height = h;
+	numVehicles = NUM_CARS;
+	timeOfDay = 0.15f;
+	timeSpeed = ENABLE_DAY_NIGHT_CYCLE ? 0.0001f : 0.0f;
+	tickClock = 0;
+	mainSignal = signals.addController(signals.addPlan(DefaultSignalPlan()), 0);
+	trafficLightState = signals.state(mainSignal);
+	trafficLightX = w * 0.4f;
+	zebraCrossingX = trafficLightX + 15;
+	zebraCrossingWidth = 40.0f;
+	crossingFrontEdge = zebraCrossingX - zebraCrossingWidth / 2.0f;
+	crossingBackEdge = zebraCrossingX + zebraCrossingWidth / 2.0f;
+	roadTopY = h * 0.30f;
+	roadBottomY = h * 0.15f;
+	footpathHeight = 30.0f;
+	upperFootpathBottomY = roadTopY;
+	upperFootpathTopY = upperFootpathBottomY + footpathHeight;
+	lowerFootpathTopY = roadBottomY;
+	lowerFootpathBottomY = 0;
+	upperSidewalkLevelY = upperFootpathBottomY + footpathHeight * 0.6f;
+	lowerSidewalkLevelY = lowerFootpathBottomY + footpathHeight * 0.4f;
+	crossingStartY = upperFootpathBottomY - 2;
+	crossingEndY = lowerFootpathTopY + 2;
+	crossingWalkX = zebraCrossingX;
+	laneY1 = roadBottomY + (roadTopY - roadBottomY) * 0.3f;
+	laneY2 = roadBottomY + (roadTopY - roadBottomY) * 0.7f;
+	birdBaseY = h*0.8f;
+	birdAmplitudeY = 15.0f;
+	seed = 1;
+	tick = 0;
+	laneDemand = DEFAULT_LANE_DEMAND;
+	startQueueLength = START_QUEUE_LENGTH;
+	numCrossingPedestrians = NUM_CROSSING_PEDESTRIANS;
+	crosswalk.frontEdge = crossingFrontEdge;
+	crosswalk.backEdge = crossingBackEdge;
+	crosswalk.crossing = 0;
+	crosswalk.waiting = 0;
+	activeVehicles = 0;
+	nextVehicleId = 0;
+	pool.reset(new ThreadPool(1));
+}
+
+void CityWorld::setThreadCount(int threads) {
+	pool.reset(new ThreadPool(threads));
+}
+
+void CityWorld::resize(int w, int h) {
+	width = w;
+	height = h;
+}
+
+size_t CityWorld::entityCount() const {
+	return activeVehicles + sidewalkPedestrians.size() + crossingPedestrians.size() + clouds.size() + birds.size();
+}
+
+void CityWorld::initializeClouds() {
+	clouds.clear();
+	float cloudBaseY=height*0.75f;
+	for(int i=0; i<NUM_CLOUDS; ++i) {
+		Cloud c;
+		RandomStream rng(seed,i,0,STREAM_SETUP_CLOUD);
+		c.pos= {randFloat(rng,-width*0.2f,width*1.2f),cloudBaseY+randFloat(rng,-height*0.05f,height*0.1f)};
+		c.speed=randFloat(rng,0.1f,0.4f);
+		c.scale=randFloat(rng,0.8f,1.6f);
+		c.numEllipses=3+randInt(rng,3);
+		c.shapePhase=randFloat(rng,0,2.0f*M_PI);
+		c.alpha = 0.0f; /*Start invisible*/ float totalWidth=0;
+		for(int j=0; j<c.numEllipses; ++j) {
+			float offsetX=totalWidth+randFloat(rng,-5,5);
+			float offsetY=randFloat(rng,-8,8);
+			float radiusX=randFloat(rng,25,40);
+			float radiusY=randFloat(rng,15,30);
+			c.ellipseOffsets.push_back({offsetX,offsetY});
+			c.ellipseRadiiX.push_back(radiusX);
+			c.ellipseRadiiY.push_back(radiusY);
+			totalWidth+=radiusX*randFloat(rng,0.6f,0.9f);
+		}
+		for(int j=0; j<c.numEllipses; ++j) {
+			c.ellipseOffsets[j].x-=totalWidth/2.2f;
+		}
+		clouds.push_back(c);
+	}
+}
+
+void CityWorld::initialize() {
+	tick=0;
+	birds.clear();
+	RandomStream worldRng(seed,0,0,STREAM_SETUP_WORLD);
+	int numBirds=3+randInt(worldRng,3);
+	if (!isNightTime(timeOfDay)) {
+		for(int i=0; i<numBirds; ++i) {
+			Bird b;
+			RandomStream rng(seed,i,0,STREAM_SETUP_BIRD);
+			b.x=randFloat(rng,0,width);
+			b.y=birdBaseY+randFloat(rng,-birdAmplitudeY,birdAmplitudeY);
+			b.speed=randFloat(rng,0.8f,1.8f);
+			b.flapPhase=randFloat(rng,0,2.0f*M_PI);
+			b.flapSpeed=randFloat(rng,0.15f,0.35f);
+			b.bobPhase=randFloat(rng,0,2.0f*M_PI);
+			birds.push_back(b);
+		}
+	}
+	vehicles.clear();
+	vehicles.reserve(numVehicles);
+	freeSlots.clear();
+	spawned.clear();
+	activeVehicles=0;
+	nextVehicleId=0;
+	// Queue each lane's starting vehicles off screen, one behind the other, as far back as
+	// startQueueLength. Those that do not fit are not made: from there the lanes' arrivals
+	// set the fleet.
+	float initialSpacing=150.0f;
+	float rightTail=-200.0f, leftTail=width+200.0f;
+	for(int i=0; i<numVehicles; ++i) {
+		RandomStream rng(seed,i,0,STREAM_SETUP_VEHICLE);
+		Vehicle v=RandomVehicle(rng);
+		bool goRight=(i%2==0);
+		v.y=goRight?laneY1:laneY2;
+		v.direction=goRight?1:-1;
+		v.speed=v.baseSpeed*randFloat(rng,0.5f,1.0f);
+		float gap=initialSpacing+randFloat(rng,0,50);
+		if(v.direction>0) {
+			v.x=rightTail-v.width;
+			if(v.x<-200.0f-startQueueLength) continue;
+			rightTail=v.x-gap;
+		}
+		else {
+			v.x=leftTail;
+			if(v.x+v.width>width+200.0f+startQueueLength) continue;
+			leftTail=v.x+v.width+gap;
+		}
+		v.id=nextVehicleId++;
+		spawnVehicle(v);
+	}
+	buildLaneIndex();
+	sidewalkPedestrians.clear();
+	for(int i=0; i<NUM_SIDEWALK_PEDESTRIANS; ++i) {
+		Pedestrian p;
+		RandomStream rng(seed,i,0,STREAM_SETUP_SIDEWALK);
+		p.crosswalk=-1;
+		p.onUpperPath=(randInt(rng,2)==0);
+		p.y=p.onUpperPath?upperSidewalkLevelY:lowerSidewalkLevelY;
+		p.x=randFloat(rng,0,width);
+		p.speed=randFloat(rng,0.3f,0.7f);
+		if(randInt(rng,2)==0) p.speed=-p.speed;
+		p.state=WALKING_SIDEWALK;
+		p.legPhase=randFloat(rng,0,2.0f*M_PI);
+		p.legSpeed=randFloat(rng,0.08f,0.15f);
+		p.clothingColor=randomColor(rng);
+		sidewalkPedestrians.push_back(p);
+	}
+	crossingPedestrians.clear();
+	float waitX=crossingWalkX;
+	crossingPedestrians.reserve(numCrossingPedestrians);
+	crosswalk.crossing=0;
+	crosswalk.waiting=numCrossingPedestrians;
+	for(int i=0; i<numCrossingPedestrians; ++i) {
+		Pedestrian p;
+		p.crosswalk=0;
+		RandomStream rng(seed,i,0,STREAM_SETUP_CROSSING);
+		p.onUpperPath=(i%2==0);
+		p.y=p.onUpperPath?upperSidewalkLevelY:lowerSidewalkLevelY;
+		p.x=waitX+randFloat(rng,-zebraCrossingWidth*0.3f,zebraCrossingWidth*0.3f);
+		p.speed=randFloat(rng,0.5f,0.8f);
+		p.state=WAITING_TO_CROSS;
+		p.targetY=p.onUpperPath?lowerSidewalkLevelY:upperSidewalkLevelY;
+		p.legPhase=randFloat(rng,0,2.0f*M_PI);
+		p.legSpeed=randFloat(rng,0.1f,0.18f);
+		p.clothingColor=randomColor(rng);
+		crossingPedestrians.push_back(p);
+	}
+	trees.clear();
+	Color trunkC= {0.4f,0.2f,0.1f};
+	for(int i=0; i<NUM_TREES; ++i) {
+		Tree t;
+		RandomStream rng(seed,i,0,STREAM_SETUP_TREE);
+		bool onUpper=(randInt(rng,2)==0);
+		t.pos.y=onUpper?upperFootpathTopY:lowerFootpathBottomY;
+		t.pos.x=randFloat(rng,20,width-20);
+		if(fabs(t.pos.x-zebraCrossingX)<zebraCrossingWidth*1.5) {
+			t.pos.x+=(t.pos.x>zebraCrossingX)?zebraCrossingWidth:-zebraCrossingWidth;
+		}
+		t.scale=randFloat(rng,0.8f,1.3f);
+		t.foliageColor= {randFloat(rng,0.0f,0.1f),randFloat(rng,0.3f,0.6f),randFloat(rng,0.0f,0.15f)};
+		t.trunkColor=trunkC;
+		trees.push_back(t);
+	}
+	streetLights.clear();
+	float poleBaseWidth=5.0f;
+	for(int i=0; i<NUM_STREETLIGHTS; ++i) {
+		StreetLight sl;
+		RandomStream rng(seed,i,0,STREAM_SETUP_STREETLIGHT);
+		sl.onUpper=(i%2==0);
+		sl.pos.y=sl.onUpper?upperFootpathBottomY:lowerFootpathBottomY;
+		sl.height=85.0f+randFloat(rng,-5.0f,5.0f);
+		sl.armLength=35.0f+randFloat(rng,-3.0f,8.0f);
+		sl.pos.x=(width/(NUM_STREETLIGHTS+1.0f))*(i+1.0f);
+		sl.pos.x+=randFloat(rng,-35.0f,35.0f);
+		if(fabs(sl.pos.x-zebraCrossingX)<zebraCrossingWidth*1.2) {
+			sl.pos.x+=(sl.pos.x>zebraCrossingX)?zebraCrossingWidth*0.8f:-zebraCrossingWidth*0.8f;
+		}
+		sl.pos.x=std::max(poleBaseWidth,std::min(width-poleBaseWidth,sl.pos.x));
+		streetLights.push_back(sl);
+	}
+	initializeClouds();
+}
+
+bool CityWorld::isCrossingBlocked() const {
+	return crosswalk.blocked();
+}
+
+void CityWorld::updateCrosswalkOccupancy() {
+	crosswalk.clear();
+	for(const auto& lane:lanes) {
+		AddLaneOccupancy(crosswalk,vehicles,lane.order.data(),lane.order.size(),lane.direction);
+	}
+}
+
+// --- Lane Index ---
+
+static float laneProgress(const VehicleStore& vs, int i) {
+	return vs.x[i]*vs.direction[i];
+}
+
+int CityWorld::laneFor(float y, int direction) {
+	for(size_t l=0; l<lanes.size(); ++l) {
+		if(fabs(lanes[l].y-y)<5.0f&&lanes[l].direction==direction) return (int)l;
+	}
+	Lane lane;
+	lane.y=y;
+	lane.direction=direction;
+	lane.arrivals= {0.0,0,0,0,0};
+	lanes.push_back(lane);
+	scheduleArrival(lanes.size()-1);
+	return (int)lanes.size()-1;
+}
+
+void CityWorld::buildLaneIndex() {
+	lanes.clear();
+	laneFor(laneY1,1);
+	laneFor(laneY2,-1);
+	for(size_t i=0; i<vehicles.size(); ++i) {
+		if(!vehicles.active[i]) continue;
+		lanes[laneFor(vehicles.y[i],(int)vehicles.direction[i])].order.push_back((int)i);
+	}
+	for(auto& lane:lanes) {
+		std::sort(lane.order.begin(),lane.order.end(),[this](int a,int b) {
+			return laneProgress(vehicles,a)>laneProgress(vehicles,b);
+		});
+	}
+	despawned.clear();
+}
+
+// Vehicles only creep forward between ticks, so each lane stays nearly sorted and an
+// insertion pass repairs it in O(n); lanes are repaired in parallel. Despawned vehicles
+// are dropped from their lane first.
+void CityWorld::updateLaneIndex() {
+	if(!despawned.empty()) {
+		leaving.assign(vehicles.size(),0);
+		for(int i:despawned) leaving[i]=1;
+	}
+	pool->parallelFor(lanes.size(),1,[this](size_t l0,size_t l1) {
+		for(size_t l=l0; l<l1; ++l) {
+			std::vector<int>& order=lanes[l].order;
+			if(!despawned.empty()) {
+				order.erase(std::remove_if(order.begin(),order.end(),[this](int i) {
+					return leaving[i]!=0;
+				}),order.end());
+			}
+			for(size_t a=1; a<order.size(); ++a) {
+				int idx=order[a];
+				float p=laneProgress(vehicles,idx);
+				size_t b=a;
+				while(b>0&&laneProgress(vehicles,order[b-1])<p) {
+					order[b]=order[b-1];
+					--b;
+				}
+				order[b]=idx;
+			}
+		}
+	});
+	despawned.clear();
+}
+
+// --- Vehicle Pool ---
+// Slots of despawned vehicles are parked (zero speed, off screen) and reused by the next
+// spawn, so once the fleet has reached its peak size nothing is allocated.
+
+int CityWorld::spawnVehicle(const Vehicle& v) {
+	int slot;
+	if(!freeSlots.empty()) {
+		slot=freeSlots.back();
+		freeSlots.pop_back();
+		vehicles.set(slot,v);
+		vehicles.speedLimit[slot]=v.baseSpeed;
+		vehicles.active[slot]=1;
+	}
+	else {
+		slot=(int)vehicles.size();
+		vehicles.add(v);
+	}
+	activeVehicles++;
+	spawned.push_back(slot);
+	return slot;
+}
+
+void CityWorld::despawnVehicle(int slot) {
+	vehicles.active[slot]=0;
+	vehicles.speed[slot]=0;
+	vehicles.baseSpeed[slot]=0;
+	vehicles.x[slot]=-1.0e6f;
+	freeSlots.push_back(slot);
+	despawned.push_back(slot);
+	activeVehicles--;
+}
+
+// Exponential gap to the lane's next arrival, keyed by how many it has drawn.
+void CityWorld::scheduleArrival(size_t l) {
+	ArrivalQueue& q=lanes[l].arrivals;
+	double rate=laneDemand/60.0*SIM_TICK_SECONDS; // Arrivals per tick
+	if(rate<=0) {
+		q.nextArrival=std::numeric_limits<double>::infinity();
+		return;
+	}
+	RandomStream rng(seed,(uint32_t)l,q.draws++,STREAM_ARRIVAL);
+	q.nextArrival=tickClock-log(1.0-randFloat(rng,0.0f,1.0f))/rate;
+}
+
+// Turns due arrivals into pending ones and spawns the oldest at the lane entry if the
+// vehicle there has moved far enough in; otherwise it waits for a later tick.
+void CityWorld::updateArrivals() {
+	for(size_t l=0; l<lanes.size(); ++l) {
+		Lane& lane=lanes[l];
+		ArrivalQueue& q=lane.arrivals;
+		while(q.nextArrival<=tickClock) {
+			if(q.pending<MAX_PENDING_ARRIVALS) q.pending++;
+			else q.dropped++;
+			scheduleArrival(l);
+		}
+		if(q.pending==0) continue;
+		RandomStream rng(seed,nextVehicleId,0,STREAM_SETUP_VEHICLE);
+		Vehicle v=RandomVehicle(rng);
+		v.y=lane.y;
+		v.direction=lane.direction;
+		v.x=(lane.direction>0)?-v.width-SPAWN_MARGIN:width+SPAWN_MARGIN;
+		v.speed=v.baseSpeed*randFloat(rng,0.5f,0.8f);
+		if(!lane.order.empty()) {
+			int tail=lane.order.back();
+			float room=(lane.direction>0)?vehicles.x[tail]-(v.x+v.width):v.x-(vehicles.x[tail]+vehicles.width[tail]);
+			if(room<CAR_MIN_SAFE_DISTANCE) continue;
+		}
+		v.id=nextVehicleId++;
+		lane.order.push_back(spawnVehicle(v));
+		q.pending--;
+		q.spawned++;
+	}
+}
+
+// Speed limit for lane.order[begin,end) from the signal and the car ahead. Reads only
+// start-of-tick state and writes only speedLimit, so lane segments can run in parallel.
+void CityWorld::computeSpeedLimits(const Lane& lane, size_t begin, size_t end, const StopZone& zone) {
+	VehicleStore& vs=vehicles;
+	for(size_t r=begin; r<end; ++r) {
+		int i=lane.order[r];
+		float x=vs.x[i], w=vs.width[i], speed=vs.speed[i], baseSpeed=vs.baseSpeed[i];
+		float maxSpeedTraffic=SignalSpeedLimit(zone,x,w,speed,baseSpeed,lane.direction);
+		float minDistAhead=std::numeric_limits<float>::max(), aheadSpeed=0;
+		if(r>0) {
+			int ahead=lane.order[r-1];
+			if(lane.direction>0&&vs.x[ahead]>x) minDistAhead=vs.x[ahead]-(x+w);
+			else if(lane.direction<0&&vs.x[ahead]<x) minDistAhead=x-(vs.x[ahead]+vs.width[ahead]);
+			aheadSpeed=vs.speed[ahead];
+		}
+		vs.speedLimit[i]=std::min(maxSpeedTraffic,FollowingSpeedLimit(minDistAhead,speed,baseSpeed,aheadSpeed));
+	}
+}
+
+void CityWorld::step(float dt) {
+	PROFILE_ZONE("sim.step");
+	float k = dt / SIM_TICK_SECONDS; // Per-tick quantities scale with the fraction of a tick simulated
+	spawned.clear();
+	bool night = isNightTime(timeOfDay);
+	if(ENABLE_DAY_NIGHT_CYCLE) {
+		timeOfDay+=timeSpeed*k;
+		if(timeOfDay>=1.0f) timeOfDay-=1.0f;
+	}
+	updateSignals(k);
+	updateVehicles(k);
+	updateBirds(k,night);
+	updateSidewalkPedestrians(k,night);
+	updateCrossingPedestrians(k,night);
+	updateClouds(k,night);
+	tick++;
+}
+
+void CityWorld::updateSignals(float k) {
+	PROFILE_ZONE("sim.signals");
+	tickClock+=k;
+	signals.advanceTo((uint64_t)tickClock);
+	trafficLightState=signals.state(mainSignal);
+}
+
+// Every tick reads the previous state (x, speed) and writes the next (nextX, nextSpeed):
+// lane segments first work out each vehicle's speed limit from the signal and the car
+// ahead, then the SIMD kernel integrates index ranges, both spread over the pool. Respawn
+// draws are keyed by vehicle id and tick, so any thread count gives the same result.
+void CityWorld::updateVehicles(float k) {
+	PROFILE_ZONE("sim.vehicles");
+	float remainingTimeInPhase=signals.remaining(mainSignal,tickClock);
+	VehicleStore& vs=vehicles;
+	laneChunks.clear();
+	const size_t laneChunkSize=2048;
+	for(size_t l=0; l<lanes.size(); ++l) {
+		for(size_t b=0; b<lanes[l].order.size(); b+=laneChunkSize) {
+			laneChunks.push_back({(int)l,b,std::min(lanes[l].order.size(),b+laneChunkSize)});
+		}
+	}
+	StopZone zone= {crossingFrontEdge, crossingBackEdge, trafficLightState, remainingTimeInPhase};
+	pool->parallelFor(laneChunks.size(),1,[&](size_t c0,size_t c1) {
+		PROFILE_ZONE("sim.vehicles.speed_limits");
+		for(size_t c=c0; c<c1; ++c) {
+			const LaneChunk& chunk=laneChunks[c];
+			computeSpeedLimits(lanes[chunk.lane],chunk.begin,chunk.end,zone);
+		}
+	});
+	pool->parallelFor(vs.size(),8192,[&](size_t b,size_t e) {
+		PROFILE_ZONE("sim.vehicles.integrate");
+		IntegrateVehicles(vs.x.data()+b,vs.speed.data()+b,vs.baseSpeed.data()+b,vs.speedLimit.data()+b,vs.direction.data()+b,
+		                  vs.nextX.data()+b,vs.nextSpeed.data()+b,e-b,CAR_ACCELERATION,CAR_DECELERATION,k);
+	});
+	vs.swapBuffers();
+	for(size_t i=0; i<vs.size(); ++i) {
+		if(!vs.active[i]) continue;
+		bool exitedRight=vs.direction[i]>0&&vs.x[i]>width+SPAWN_MARGIN;
+		bool exitedLeft=vs.direction[i]<0&&vs.x[i]+vs.width[i]<-SPAWN_MARGIN;
+		if(exitedRight||exitedLeft) despawnVehicle((int)i);
+	}
+	updateLaneIndex();
+	updateArrivals();
+	updateCrosswalkOccupancy();
+}
+
+void CityWorld::updateBirds(float k, bool night) {
+	PROFILE_ZONE("sim.birds");
+	if(night) return;
+	for(size_t i=0; i<birds.size(); ++i) {
+		Bird& b=birds[i];
+		b.x+=b.speed*k;
+		b.flapPhase+=b.flapSpeed*k;
+		if(b.flapPhase>2.0f*M_PI)b.flapPhase-=2.0f*M_PI;
+		b.bobPhase+=b.speed*0.01f*k;
+		b.y=birdBaseY+birdAmplitudeY*sin(b.bobPhase);
+		if(b.x>width+50) {
+			b.x=-50.0f;
+			RandomStream rng(seed,(uint32_t)i,tick,STREAM_BIRD_WRAP);
+			b.y=birdBaseY+randFloat(rng,-birdAmplitudeY,birdAmplitudeY);
+			b.bobPhase=randFloat(rng,0,2.0f*M_PI);
+		}
+	}
+}
+
+void CityWorld::updateSidewalkPedestrians(float k, bool night) {
+	PROFILE_ZONE("sim.sidewalk_pedestrians");
+	for(auto& p:sidewalkPedestrians) {
+		if(!night) {
+			p.x+=p.speed*k;
+			p.legPhase+=p.legSpeed*fabs(p.speed)*k;
+			if(p.legPhase>2.0f*M_PI)p.legPhase-=2.0f*M_PI;
+			if(p.speed > 0 && p.x > width + 10) p.x = -10;
+			if(p.speed < 0 && p.x < -10) p.x = width + 10;
+		}
+		else {
+			p.legPhase = 0;
+		}
+		p.y = p.onUpperPath ? upperSidewalkLevelY : lowerSidewalkLevelY;
+	}
+}
+
+// Admission reads the occupancy updateVehicles() built and the running count of pedestrians
+// on the crossing; those who finish this tick still count until the end.
+void CityWorld::updateCrossingPedestrians(float k, bool night) {
+	PROFILE_ZONE("sim.crossing_pedestrians");
+	bool admitting=!night&&trafficLightState==RED;
+	int finishedCrossing=0;
+	for(size_t i=0; i<crossingPedestrians.size(); ++i) {
+		Pedestrian& p=crossingPedestrians[i];
+		float moveDelta=p.speed*k;
+		float currentLegSpeedFactor=0.1f;
+		switch(p.state) {
+		case WAITING_TO_CROSS:
+			if(admitting&&crosswalk.admits()) {
+				p.state=CROSSING;
+				crosswalk.crossing++;
+				crosswalk.waiting--;
+			}
+			break;
+		case CROSSING:
+			currentLegSpeedFactor=1.0f;
+			p.x=moveTowards(p.x,crossingWalkX,moveDelta*0.2f);
+			p.y=moveTowards(p.y,p.targetY,moveDelta);
+			if(fabs(p.y-p.targetY)<1.0f) {
+				p.state=FINISHED_CROSSING;
+				finishedCrossing++;
+				p.y=p.targetY;
+				RandomStream rng(seed,(uint32_t)i,tick,STREAM_CROSSING_OFFSET);
+				p.x=crossingWalkX+randFloat(rng,-zebraCrossingWidth*0.3f,zebraCrossingWidth*0.3f);
+			}
+			break;
+		case FINISHED_CROSSING:
+			if(trafficLightState!=RED) {
+				p.state=WAITING_TO_CROSS;
+				crosswalk.waiting++;
+				p.onUpperPath=!p.onUpperPath;
+				p.targetY=p.onUpperPath?lowerSidewalkLevelY:upperSidewalkLevelY;
+				RandomStream rng(seed,(uint32_t)i,tick,STREAM_CROSSING_OFFSET);
+				p.x=crossingWalkX+randFloat(rng,-zebraCrossingWidth*0.3f,zebraCrossingWidth*0.3f);
+			}
+			break;
+		case WALKING_SIDEWALK:
+			break;
+		}
+		if(p.state==CROSSING) {
+			currentLegSpeedFactor=1.0f;
+		}
+		p.legPhase+=p.legSpeed*currentLegSpeedFactor*k;
+		if(p.legPhase>2.0f*M_PI)p.legPhase-=2.0f*M_PI;
+	}
+	crosswalk.crossing-=finishedCrossing;
+}
+
+// Clouds drift (not at night), fade in at dawn and out at dusk, and wrap at the right edge.
+void CityWorld::updateClouds(float k, bool night) {
+	PROFILE_ZONE("sim.clouds");
+	for (size_t i = 0; i < clouds.size(); ++i) {
+		Cloud& cloud = clouds[i];
+		if (!night) cloud.pos.x += cloud.speed*k; // Only move if not night
+		cloud.shapePhase += 0.01f*k;
+		if (cloud.shapePhase > 2.0f * M_PI) cloud.shapePhase -= 2.0f * M_PI;
+
+		// Cloud Alpha Fading Logic
+		float dawnEndTime = NIGHT_END_TIME + DAWN_DURATION;
+		float duskStartTime = NIGHT_START_TIME - DUSK_DURATION;
+
+		if (timeOfDay > NIGHT_END_TIME && timeOfDay < dawnEndTime) { // Fading in (Dawn)
+			cloud.alpha = (timeOfDay - NIGHT_END_TIME) / DAWN_DURATION;
+		} else if (timeOfDay > duskStartTime && timeOfDay < NIGHT_START_TIME) { // Fading out (Dusk)
+			cloud.alpha = 1.0f - (timeOfDay - duskStartTime) / DUSK_DURATION;
+		} else if (timeOfDay >= dawnEndTime && timeOfDay <= duskStartTime) { // Full Day
+			cloud.alpha = 1.0f;
+		} else { // Full Night
+			cloud.alpha = 0.0f;
+		}
+		cloud.alpha = std::max(0.0f, std::min(1.0f, cloud.alpha)); // Clamp alpha
+
+		// Wrapping Logic
+		float approxCloudWidth=0;
+		for(float r:cloud.ellipseRadiiX) approxCloudWidth+=r*cloud.scale*0.6f;
+		if (cloud.pos.x - approxCloudWidth > width) {
+			RandomStream rng(seed, (uint32_t)i, tick, STREAM_CLOUD_WRAP);
+			cloud.pos.x = -approxCloudWidth - randFloat(rng, 50, 150);
+			cloud.pos.y = height * 0.75f + randFloat(rng, -height*0.05f, height*0.1f);
+		}
+	}
+}
+
@@ -0,0 +1,110 @@
+#ifndef CITYWORLD_H_INCLUDED
+#define CITYWORLD_H_INCLUDED
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include "CityTypes.h"
+#include "VehicleStore.h"
+#include "ThreadPool.h"
+#include "RoadNetwork.h"
+#include "SignalControl.h"
+
+// --- Simulation State ---
+// Everything the traffic model needs to advance, with no GL/GLUT dependency.
+// Layout is fixed from the size given at construction; width/height are the
+// wrap-around bounds and follow the window when one exists.
+struct CityWorld {
+	CityWorld(int width, int height);
+
+	void initialize();
+	void initializeClouds();
+	// Advances the model by dt seconds (one legacy tick is SIM_TICK_SECONDS).
+	void step(float dt);
+	// The phases of step(), in order; k is the fraction of a tick simulated.
+	void updateSignals(float k);
+	void updateVehicles(float k);
+	void updateBirds(float k, bool night);
+	void updateSidewalkPedestrians(float k, bool night);
+	void updateCrossingPedestrians(float k, bool night);
+	void updateClouds(float k, bool night);
+	void resize(int w, int h);
+	bool isCrossingBlocked() const;
+	void updateCrosswalkOccupancy();
+	size_t entityCount() const;
+	int laneFor(float y, int direction);
+	void buildLaneIndex();
+	void updateLaneIndex();
+	int spawnVehicle(const Vehicle& v);
+	void despawnVehicle(int slot);
+	void scheduleArrival(size_t lane);
+	void updateArrivals();
+	void computeSpeedLimits(const Lane& lane, size_t begin, size_t end, const StopZone& zone);
+	// Vehicle updates are split over this many threads; results do not depend on it.
+	void setThreadCount(int threads);
+	int threadCount() const {
+		return pool->threadCount();
+	}
+
+	int width;
+	int height;
+	int numVehicles;
+	int numCrossingPedestrians;
+	float timeOfDay;
+	float timeSpeed;
+	LightState trafficLightState;  // State of mainSignal as of the last step
+	SignalSystem signals;
+	int mainSignal;
+	double tickClock;              // Simulated time in ticks; signals and arrivals run off it
+	uint64_t seed;  // Keys every random draw (see Random.h); same seed, same run
+	uint64_t tick;  // Steps taken since initialize()
+
+	// Layout
+	float trafficLightX;
+	float zebraCrossingX;
+	float zebraCrossingWidth;
+	float crossingFrontEdge;
+	float crossingBackEdge;
+	float roadTopY;
+	float roadBottomY;
+	float footpathHeight;
+	float upperFootpathBottomY;
+	float upperFootpathTopY;
+	float lowerFootpathTopY;
+	float lowerFootpathBottomY;
+	float upperSidewalkLevelY;
+	float lowerSidewalkLevelY;
+	float crossingStartY;
+	float crossingEndY;
+	float crossingWalkX;
+	float laneY1;
+	float laneY2;
+	float birdBaseY;
+	float birdAmplitudeY;
+
+	std::vector<Bird> birds;
+	VehicleStore vehicles;
+	std::vector<Lane> lanes;
+	struct LaneChunk {
+		int lane;
+		size_t begin, end;
+	};
+	std::vector<LaneChunk> laneChunks; // Lane segments handed to the pool each tick
+	std::unique_ptr<ThreadPool> pool;
+	std::vector<int> freeSlots;  // Pooled vehicle slots ready for reuse
+	std::vector<int> despawned;  // Vehicles that left this tick, dropped from their lane
+	std::vector<char> leaving;
+	std::vector<int> spawned;    // Slots filled during the last step (read by the recorder)
+	size_t activeVehicles;
+	unsigned nextVehicleId;
+	float laneDemand;            // Arrivals per lane per simulated minute
+	float startQueueLength;      // How far upstream initialize() queues the starting fleet
+	std::vector<Pedestrian> sidewalkPedestrians;
+	std::vector<Pedestrian> crossingPedestrians;
+	CrosswalkOccupancy crosswalk;  // Vehicles over the zebra crossing as of this tick
+	std::vector<Tree> trees;
+	std::vector<StreetLight> streetLights;
+	std::vector<Cloud> clouds;
+};
+
+#endif // CITYWORLD_H_INCLUDED
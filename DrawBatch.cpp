@@ -0,0 +1,204 @@
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include <GL/gl.h>
+#include <cmath>
+#include <algorithm>
+#include "DrawBatch.h"
+
+DrawBatch::DrawBatch(size_t reserveVertices) : drawCalls(0), trackingRows(false), anyRows(false), rowsMin(0.0f), rowsMax(0.0f) {
+	transform= {1.0f,0.0f,0.0f,1.0f,0.0f,0.0f};
+	setColor(1.0f,1.0f,1.0f,1.0f);
+	vertices.reserve(reserveVertices);
+}
+
+void DrawBatch::setColor(float r, float g, float b, float a) {
+	auto toByte=[](float c) {
+		return (uint8_t)(std::min(1.0f,std::max(0.0f,c))*255.0f+0.5f);
+	};
+	color[0]=toByte(r);
+	color[1]=toByte(g);
+	color[2]=toByte(b);
+	color[3]=toByte(a);
+}
+
+// --- Circle Tessellation ---
+
+// A chord across 2*pi/n of a circle of radius r lies r*(1-cos(pi/n)) inside the edge at
+// its middle; solve that for the smallest n within tolerance.
+int CircleSegments(float radiusPixels) {
+	if(!(radiusPixels>CIRCLE_TOLERANCE_PIXELS)) return MIN_CIRCLE_SEGMENTS;
+	float segments=ceilf((float)M_PI/acosf(1.0f-CIRCLE_TOLERANCE_PIXELS/radiusPixels));
+	return (int)std::min((float)MAX_CIRCLE_SEGMENTS,std::max((float)MIN_CIRCLE_SEGMENTS,segments));
+}
+
+const Point* UnitCircle(int segments) {
+	static std::vector<std::vector<Point>> tables(MAX_CIRCLE_SEGMENTS+1);
+	segments=std::min(MAX_CIRCLE_SEGMENTS,std::max(MIN_CIRCLE_SEGMENTS,segments));
+	std::vector<Point>& table=tables[segments];
+	if(table.empty()) {
+		table.resize(segments+1);
+		for(int i=0; i<segments; ++i) {
+			double theta=2.0*M_PI*i/segments;
+			table[i]= {(float)cos(theta),(float)sin(theta)};
+		}
+		table[segments]=table[0];  // Closes the fan exactly
+	}
+	return table.data();
+}
+
+// --- Transform Stack ---
+
+void DrawBatch::pushTransform() {
+	stack.push_back(transform);
+}
+
+void DrawBatch::popTransform() {
+	if(stack.empty()) return;
+	transform=stack.back();
+	stack.pop_back();
+}
+
+void DrawBatch::translate(float x, float y) {
+	transform.tx+=transform.a*x+transform.c*y;
+	transform.ty+=transform.b*x+transform.d*y;
+}
+
+void DrawBatch::scale(float sx, float sy) {
+	transform.a*=sx;
+	transform.b*=sx;
+	transform.c*=sy;
+	transform.d*=sy;
+}
+
+void DrawBatch::rotate(float degrees) {
+	float rad=degrees*(float)M_PI/180.0f, cs=cosf(rad), sn=sinf(rad);
+	BatchTransform t=transform;
+	transform.a=t.a*cs+t.c*sn;
+	transform.b=t.b*cs+t.d*sn;
+	transform.c=t.c*cs-t.a*sn;
+	transform.d=t.d*cs-t.b*sn;
+}
+
+// --- Shapes ---
+
+void DrawBatch::triangle(float x0, float y0, float x1, float y1, float x2, float y2) {
+	vertex(x0,y0);
+	vertex(x1,y1);
+	vertex(x2,y2);
+}
+
+void DrawBatch::quad(float x0, float y0, float x1, float y1, float x2, float y2, float x3, float y3) {
+	triangle(x0,y0,x1,y1,x2,y2);
+	triangle(x0,y0,x2,y2,x3,y3);
+}
+
+void DrawBatch::rect(float x0, float y0, float x1, float y1) {
+	quad(x0,y0,x1,y0,x1,y1,x0,y1);
+}
+
+void DrawBatch::polygon(const Point* points, int count) {
+	for(int i=1; i+1<count; ++i) triangle(points[0].x,points[0].y,points[i].x,points[i].y,points[i+1].x,points[i+1].y);
+}
+
+void DrawBatch::ellipse(float cx, float cy, float rx, float ry) {
+	// The transform is affine, so the unit circle maps to center + cos*axisX + sin*axisY
+	float axisXx=transform.a*rx, axisXy=transform.b*rx, axisYx=transform.c*ry, axisYy=transform.d*ry;
+	float radius=std::max(sqrtf(axisXx*axisXx+axisXy*axisXy),sqrtf(axisYx*axisYx+axisYy*axisYy));
+	int segments=CircleSegments(radius);
+	const Point* unit=UnitCircle(segments);
+	size_t count=3*(size_t)segments;
+	if(vertices.size()+count>BATCH_FLUSH_VERTICES&&vertices.size()%3==0) flush();
+
+	BatchVertex center;
+	center.x=transform.a*cx+transform.c*cy+transform.tx;
+	center.y=transform.b*cx+transform.d*cy+transform.ty;
+	center.r=color[0];
+	center.g=color[1];
+	center.b=color[2];
+	center.a=color[3];
+	BatchVertex previous=center, next=center;
+	previous.x+=axisXx;
+	previous.y+=axisXy;
+	size_t base=vertices.size();
+	vertices.resize(base+count);
+	BatchVertex* out=&vertices[base];
+	for(int i=1; i<=segments; ++i) {
+		next.x=center.x+unit[i].x*axisXx+unit[i].y*axisYx;
+		next.y=center.y+unit[i].x*axisXy+unit[i].y*axisYy;
+		out[0]=center;
+		out[1]=previous;
+		out[2]=next;
+		out+=3;
+		previous=next;
+	}
+}
+
+void DrawBatch::line(float x0, float y0, float x1, float y1, float width) {
+	float dx=x1-x0, dy=y1-y0, len=sqrtf(dx*dx+dy*dy);
+	if(len<=0.0f) return;
+	float nx=-dy/len*width*0.5f, ny=dx/len*width*0.5f;
+	quad(x0+nx,y0+ny,x1+nx,y1+ny,x1-nx,y1-ny,x0-nx,y0-ny);
+}
+
+// --- Submission ---
+
+void DrawBatch::addPendingRows() {
+	for(const BatchVertex& v:vertices) {
+		if(!anyRows) {
+			rowsMin=rowsMax=v.y;
+			anyRows=true;
+		}
+		rowsMin=std::min(rowsMin,v.y);
+		rowsMax=std::max(rowsMax,v.y);
+	}
+}
+
+void DrawBatch::beginRows() {
+	trackingRows=true;
+	anyRows=false;
+}
+
+bool DrawBatch::endRows(float& minY, float& maxY) {
+	addPendingRows();
+	trackingRows=false;
+	minY=rowsMin;
+	maxY=rowsMax;
+	return anyRows;
+}
+
+void DrawBatch::takeVertices(std::vector<BatchVertex>& out) {
+	out.insert(out.end(),vertices.begin(),vertices.end());
+	vertices.clear();
+}
+
+void DrawBatch::flush() {
+	if(vertices.empty()) return;
+	if(trackingRows) addPendingRows();
+	batchTarget->drawTriangles(vertices.data(),vertices.size());
+	drawCalls++;
+	vertices.clear();
+}
+
+// --- GL Target ---
+
+GLBatchTarget glBatchTarget;
+BatchTarget* batchTarget=&glBatchTarget;
+
+void GLBatchTarget::beginFrame() {
+	glClear(GL_COLOR_BUFFER_BIT);
+	glMatrixMode(GL_MODELVIEW);
+	glLoadIdentity();
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_SRC_ALPHA,GL_ONE_MINUS_SRC_ALPHA);
+}
+
+void GLBatchTarget::drawTriangles(const BatchVertex* vertices, size_t count) {
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_COLOR_ARRAY);
+	glVertexPointer(2,GL_FLOAT,sizeof(BatchVertex),&vertices[0].x);
+	glColorPointer(4,GL_UNSIGNED_BYTE,sizeof(BatchVertex),&vertices[0].r);
+	glDrawArrays(GL_TRIANGLES,0,(GLsizei)count);
+	glDisableClientState(GL_COLOR_ARRAY);
+	glDisableClientState(GL_VERTEX_ARRAY);
+}
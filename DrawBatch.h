@@ -0,0 +1,143 @@
+#ifndef DRAWBATCH_H_INCLUDED
+#define DRAWBATCH_H_INCLUDED
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include "CityTypes.h"
+
+// --- Batched Drawing ---
+// Collects colored triangles in a client-side vertex array and submits them with a single
+// glDrawArrays per flush(), instead of a glBegin/glEnd pair per shape. The calls mirror the
+// immediate-mode ones they replace: a current color, a matrix stack (applied on the CPU as
+// vertices are added), quads and polygons split into triangles, wide lines as quads. All
+// triangles in one flush share the blend state current at the time, so flush before
+// changing it. Draw order within a batch is kept.
+const size_t BATCH_FLUSH_VERTICES = 1 << 18;  // Flush early past this, bounding memory at any scene size
+
+// --- Circle Tessellation ---
+// Ellipses are fanned from precomputed unit-circle tables. The segment count comes from the
+// radius on screen (after the current transform), picked so that no chord strays more than
+// CIRCLE_TOLERANCE_PIXELS inside the true edge: small wheels and heads get a handful of
+// segments, the sun and large clouds a few dozen.
+const float CIRCLE_TOLERANCE_PIXELS = 0.5f;
+const int MIN_CIRCLE_SEGMENTS = 6;
+const int MAX_CIRCLE_SEGMENTS = 256;
+
+// Segments needed for a circle of this radius in pixels.
+int CircleSegments(float radiusPixels);
+// segments+1 points around the unit circle from angle 0, the last repeating the first.
+// Built on first use and kept; the pointer stays valid for the life of the program.
+const Point* UnitCircle(int segments);
+
+struct BatchVertex {
+	float x, y;
+	uint8_t r, g, b, a;
+};
+
+struct BatchTransform {  // x' = a*x + c*y + tx, y' = b*x + d*y + ty
+	float a, b, c, d, tx, ty;
+};
+
+// --- Batch Targets ---
+// Where flush() sends its triangles. GLBatchTarget, the default, draws them with
+// glDrawArrays into the current context; SoftwareRasterizer (SoftwareRasterizer.h) draws
+// them into memory with no GL at all. DrawScene() brackets each frame with beginFrame() and
+// endFrame(). Coordinates are window pixels, y up, as the ortho projection sets them.
+class BatchTarget {
+public:
+	virtual ~BatchTarget() {}
+	// The GL-only layers (instanced meshes, the scenery texture, the light map) check this
+	// and fall back to drawing through the batch when it is false.
+	virtual bool isGL() const = 0;
+	// Clears the frame (GL: to the clear color, opaque black in every program) for
+	// SRC_ALPHA, ONE_MINUS_SRC_ALPHA blending, the only state the batch is drawn with.
+	virtual void beginFrame() = 0;
+	virtual void drawTriangles(const BatchVertex* vertices, size_t count) = 0;
+	// Every triangle drawn is in the framebuffer after this.
+	virtual void endFrame() = 0;
+};
+
+class GLBatchTarget : public BatchTarget {
+public:
+	bool isGL() const override {
+		return true;
+	}
+	void beginFrame() override;
+	void drawTriangles(const BatchVertex* vertices, size_t count) override;
+	void endFrame() override {}
+};
+
+extern GLBatchTarget glBatchTarget;
+extern BatchTarget* batchTarget;  // &glBatchTarget unless a program switches it
+
+class DrawBatch {
+public:
+	explicit DrawBatch(size_t reserveVertices = BATCH_FLUSH_VERTICES);
+
+	void setColor(float r, float g, float b, float a = 1.0f);
+	void setColor(const Color& c, float a = 1.0f) {
+		setColor(c.r,c.g,c.b,a);
+	}
+
+	// Like glPushMatrix/glPopMatrix/glTranslatef/glScalef/glRotatef on the modelview matrix.
+	void pushTransform();
+	void popTransform();
+	void translate(float x, float y);
+	void scale(float sx, float sy);
+	void rotate(float degrees);
+	// Where vertex() currently maps a point, for layers that place shapes themselves.
+	const BatchTransform& currentTransform() const {
+		return transform;
+	}
+
+	// One vertex in the current color and transform; every three make a triangle.
+	void vertex(float x, float y) {
+		if(vertices.size()>=BATCH_FLUSH_VERTICES&&vertices.size()%3==0) flush();
+		BatchVertex v;
+		v.x=transform.a*x+transform.c*y+transform.tx;
+		v.y=transform.b*x+transform.d*y+transform.ty;
+		v.r=color[0];
+		v.g=color[1];
+		v.b=color[2];
+		v.a=color[3];
+		vertices.push_back(v);
+	}
+	void triangle(float x0, float y0, float x1, float y1, float x2, float y2);
+	// Corners in drawing order, as given to GL_QUADS.
+	void quad(float x0, float y0, float x1, float y1, float x2, float y2, float x3, float y3);
+	// Axis-aligned rectangle between two corners, as glRectf.
+	void rect(float x0, float y0, float x1, float y1);
+	// Fanned from the first point, which is how GL_POLYGON is rasterized.
+	void polygon(const Point* points, int count);
+	// Segments chosen from the transformed radii, vertices written straight into the batch.
+	void ellipse(float cx, float cy, float rx, float ry);
+	// A line width pixels wide, as GL_LINES after glLineWidth(width).
+	void line(float x0, float y0, float x1, float y1, float width);
+
+	// Draws everything collected so far in one call and empties the batch.
+	void flush();
+	size_t pendingVertices() const {
+		return vertices.size();
+	}
+	// Between these, the vertical extent of every vertex added is kept, flushed or not.
+	// endRows() gives it; false when nothing was added.
+	void beginRows();
+	bool endRows(float& minY, float& maxY);
+	// Hands the collected vertices to out instead of drawing them; used to build meshes.
+	void takeVertices(std::vector<BatchVertex>& out);
+	long long drawCalls;  // Batches flush() sent to batchTarget, for the stats overlay
+
+private:
+	void addPendingRows();
+
+	std::vector<BatchVertex> vertices;
+	std::vector<BatchTransform> stack;
+	BatchTransform transform;
+	uint8_t color[4];
+	bool trackingRows;
+	bool anyRows;
+	float rowsMin, rowsMax;
+};
+
+#endif // DRAWBATCH_H_INCLUDED
@@ -0,0 +1,69 @@
+#include "FrameClock.h"
+#include <cmath>
+#include <cstdio>
+#include <algorithm> // For std::min/max
+
+// --- Fixed Timestep ---
+
+FixedTimestep::FixedTimestep(double tickSeconds, int maxTicksPerFrame)
+	: tickSeconds(tickSeconds), maxTicksPerFrame(maxTicksPerFrame), accumulator(0), ticks(0), droppedTicks(0) {
+}
+
+int FixedTimestep::advance(double frameSeconds) {
+	accumulator+=std::max(0.0,frameSeconds);
+	long long due=(long long)floor(accumulator/tickSeconds);
+	accumulator-=due*tickSeconds;
+	if(due>maxTicksPerFrame) {
+		droppedTicks+=due-maxTicksPerFrame;
+		due=maxTicksPerFrame;
+	}
+	ticks+=due;
+	return (int)due;
+}
+
+float FixedTimestep::alpha() const {
+	return (float)std::min(1.0,accumulator/tickSeconds);
+}
+
+// --- Frame-Time Histogram ---
+
+FrameHistogram::FrameHistogram() {
+	reset();
+}
+
+void FrameHistogram::reset() {
+	std::fill(buckets,buckets+FRAME_HISTOGRAM_BUCKETS,0LL);
+	count=0;
+	totalMs=0;
+	maxMs=0;
+}
+
+void FrameHistogram::record(double seconds) {
+	double ms=seconds*1000.0;
+	int b=std::min(FRAME_HISTOGRAM_BUCKETS-1,(int)ms);
+	buckets[std::max(0,b)]++;
+	count++;
+	totalMs+=ms;
+	maxMs=std::max(maxMs,ms);
+}
+
+float FrameHistogram::percentileMs(float p) const {
+	if(count==0) return 0;
+	long long target=(long long)ceil(p*count), seen=0;
+	for(int b=0; b<FRAME_HISTOGRAM_BUCKETS; ++b) {
+		seen+=buckets[b];
+		if(seen>=target) return (float)(b+1);
+	}
+	return (float)FRAME_HISTOGRAM_BUCKETS;
+}
+
+float FrameHistogram::meanMs() const {
+	return count?(float)(totalMs/count):0.0f;
+}
+
+std::string FrameHistogram::summary() const {
+	char text[128];
+	snprintf(text,sizeof(text),"frame ms  mean %.1f  p50 %.0f  p99 %.0f  max %.1f  (%lld frames)",
+	         meanMs(),percentileMs(0.5f),percentileMs(0.99f),maxMs,count);
+	return text;
+}
@@ -0,0 +1,45 @@
+#ifndef FRAMECLOCK_H_INCLUDED
+#define FRAMECLOCK_H_INCLUDED
+
+#include <string>
+
+// --- Fixed Timestep ---
+// Real time goes into an accumulator that is paid out in whole ticks, so the model
+// advances at the same rate however fast frames come. A frame never runs more than
+// maxTicksPerFrame ticks; time beyond that budget is dropped (and counted) instead of
+// letting a slow machine fall into a spiral of ever longer catch-up frames.
+struct FixedTimestep {
+	FixedTimestep(double tickSeconds, int maxTicksPerFrame);
+	// Ticks to simulate for frameSeconds of real time.
+	int advance(double frameSeconds);
+	// Fraction of a tick still in the accumulator, for drawing between ticks.
+	float alpha() const;
+
+	double tickSeconds;
+	int maxTicksPerFrame;
+	double accumulator;
+	long long ticks;        // Ticks paid out so far
+	long long droppedTicks; // Ticks skipped because a frame went over budget
+};
+
+// --- Frame-Time Histogram ---
+// Frame intervals in 1 ms buckets up to FRAME_HISTOGRAM_BUCKETS ms; longer frames go
+// into the last bucket.
+const int FRAME_HISTOGRAM_BUCKETS = 50;
+
+struct FrameHistogram {
+	FrameHistogram();
+	void reset();
+	void record(double seconds);
+	// Upper edge, in ms, of the bucket holding the p-th fraction of frames.
+	float percentileMs(float p) const;
+	float meanMs() const;
+	std::string summary() const;
+
+	long long buckets[FRAME_HISTOGRAM_BUCKETS];
+	long long count;
+	double totalMs;
+	double maxMs;
+};
+
+#endif // FRAMECLOCK_H_INCLUDED
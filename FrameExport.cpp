@@ -0,0 +1,300 @@
+#include "GLExtensions.h"
+#include <zlib.h>
+#include <sys/stat.h>
+#include <cerrno>
+#include <cstring>
+#include <cmath>
+#include <chrono>
+#include <numeric>
+#include <algorithm>
+#include "FrameExport.h"
+#include "Profiler.h"
+
+FrameExporter::FrameExporter() : captureSeconds(0), stallSeconds(0), format(ExportFormat::PNG), width(0), height(0), readbackReady(false), pixelBuffers(false),
+	captured(0), writerRunning(false), closing(false), frames(0), bytes(0), failed(false), video(nullptr) {
+	memset(readback,0,sizeof(readback));
+}
+
+FrameExporter::~FrameExporter() {
+	close();
+}
+
+bool FrameExporter::open(const std::string& dir, ExportFormat fmt, int w, int h, double framesPerSecond, int encoders, std::string& openError) {
+	close();
+	if(mkdir(dir.c_str(),0755)!=0&&errno!=EEXIST) {
+		openError="cannot create "+dir;
+		return false;
+	}
+	directory=dir;
+	format=fmt;
+	width=w;
+	height=h;
+	if(format==ExportFormat::Y4M) {
+		std::string path=directory+"/frames.y4m";
+		video=fopen(path.c_str(),"wb");
+		if(!video) {
+			openError="cannot open "+path+" for writing";
+			return false;
+		}
+		// The rate as a fraction, e.g. 62.5 fps is F125:2
+		long long num=llround(framesPerSecond*1000.0), den=1000, common=std::gcd(num,den);
+		fprintf(video,"YUV4MPEG2 W%d H%d F%lld:%lld Ip A1:1 C420jpeg\n",width,height,num/common,den/common);
+	}
+	readbackReady=false;
+	pixelBuffers=false;
+	encoders=std::max(1,encoders);
+	pool.reset(new ThreadPool(encoders));
+	captured=0;
+	captureSeconds=0;
+	stallSeconds=0;
+	frames=0;
+	bytes=0;
+	failed=false;
+	closing=false;
+	error.clear();
+	int b;
+	while(filled.pop(b)) {}
+	while(empty.pop(b)) {}
+	// One batch being encoded and one queued behind it keep every encoder busy
+	for(int i=0; i<std::min(BUFFER_COUNT,2*encoders+EXPORT_READBACK_BUFFERS); ++i) empty.push(i);
+	writer=std::thread(&FrameExporter::writerLoop,this);
+	writerRunning=true;
+	return true;
+}
+
+// --- Readback ---
+
+void FrameExporter::queue(const uint8_t* pixels, uint64_t index) {
+	auto start=std::chrono::steady_clock::now();
+	int b;
+	while(!empty.pop(b)) std::this_thread::yield(); // Writer is a whole pool behind
+	auto copyStart=std::chrono::steady_clock::now();
+	Frame& f=buffers[b];
+	f.index=index;
+	f.pixels.resize((size_t)width*height*4);
+	if(pixels) memcpy(f.pixels.data(),pixels,f.pixels.size());
+	else glReadPixels(0,0,width,height,GL_RGBA,GL_UNSIGNED_BYTE,f.pixels.data());
+	filled.push(b);
+	auto end=std::chrono::steady_clock::now();
+	stallSeconds+=std::chrono::duration<double>(copyStart-start).count();
+	captureSeconds+=std::chrono::duration<double>(end-copyStart).count();
+}
+
+void FrameExporter::capture() {
+	if(!writerRunning) return;
+	PROFILE_ZONE("export.capture");
+	if(!readbackReady) {
+		// Set up here rather than in open(), which may have no context to ask
+		pixelBuffers=LoadPixelBuffers();
+		if(pixelBuffers) {
+			glGenBuffers(EXPORT_READBACK_BUFFERS,readback);
+			for(int i=0; i<EXPORT_READBACK_BUFFERS; ++i) {
+				glBindBuffer(GL_PIXEL_PACK_BUFFER,readback[i]);
+				glBufferData(GL_PIXEL_PACK_BUFFER,(size_t)width*height*4,nullptr,GL_STREAM_READ);
+			}
+			glBindBuffer(GL_PIXEL_PACK_BUFFER,0);
+		}
+		readbackReady=true;
+	}
+	glPixelStorei(GL_PACK_ALIGNMENT,1);
+	if(!pixelBuffers) {
+		queue(nullptr,captured);
+		captured++;
+		return;
+	}
+	// The buffer about to be reused holds the oldest frame still in flight
+	glBindBuffer(GL_PIXEL_PACK_BUFFER,readback[captured%EXPORT_READBACK_BUFFERS]);
+	if(captured>=(uint64_t)EXPORT_READBACK_BUFFERS) {
+		const uint8_t* pixels=(const uint8_t*)glMapBuffer(GL_PIXEL_PACK_BUFFER,GL_READ_ONLY);
+		if(pixels) queue(pixels,captured-EXPORT_READBACK_BUFFERS);
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	}
+	glReadPixels(0,0,width,height,GL_RGBA,GL_UNSIGNED_BYTE,nullptr);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER,0);
+	captured++;
+}
+
+void FrameExporter::capture(const uint8_t* pixels) {
+	if(!writerRunning) return;
+	PROFILE_ZONE("export.capture");
+	queue(pixels,captured);
+	captured++;
+}
+
+bool FrameExporter::close() {
+	if(!writerRunning) return true;
+	if(pixelBuffers) {
+		// Frames still in the readback buffers, oldest first
+		uint64_t first=captured>(uint64_t)EXPORT_READBACK_BUFFERS ? captured-EXPORT_READBACK_BUFFERS : 0;
+		for(uint64_t i=first; i<captured; ++i) {
+			glBindBuffer(GL_PIXEL_PACK_BUFFER,readback[i%EXPORT_READBACK_BUFFERS]);
+			const uint8_t* pixels=(const uint8_t*)glMapBuffer(GL_PIXEL_PACK_BUFFER,GL_READ_ONLY);
+			if(pixels) queue(pixels,i);
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER,0);
+		glDeleteBuffers(EXPORT_READBACK_BUFFERS,readback);
+		pixelBuffers=false;
+	}
+	closing=true;
+	writer.join();
+	writerRunning=false;
+	pool.reset();
+	bool ok=!failed;
+	if(video) {
+		ok=(fclose(video)==0)&&ok;
+		video=nullptr;
+	}
+	return ok;
+}
+
+// --- Encoding ---
+
+// Big-endian chunk: length, type, data, CRC of type and data.
+static void AppendChunk(std::vector<uint8_t>& out, const char* type, const uint8_t* data, size_t size) {
+	uint8_t length[4]= {(uint8_t)(size>>24),(uint8_t)(size>>16),(uint8_t)(size>>8),(uint8_t)size};
+	out.insert(out.end(),length,length+4);
+	size_t start=out.size();
+	out.insert(out.end(),type,type+4);
+	if(size>0) out.insert(out.end(),data,data+size);
+	uLong crc=crc32(0L,out.data()+start,(uInt)(size+4));
+	uint8_t crcBytes[4]= {(uint8_t)(crc>>24),(uint8_t)(crc>>16),(uint8_t)(crc>>8),(uint8_t)crc};
+	out.insert(out.end(),crcBytes,crcBytes+4);
+}
+
+// 8-bit RGB, every scanline with the Up filter: the flat sky and road become zero runs.
+void FrameExporter::encodePNG(Frame& f) {
+	size_t stride=(size_t)width*3+1;
+	f.filtered.resize(stride*height);
+	for(int y=0; y<height; ++y) {
+		const uint8_t* row=&f.pixels[(size_t)(height-1-y)*width*4];  // PNG stores the top row first
+		const uint8_t* above=y>0 ? row+(size_t)width*4 : nullptr;
+		uint8_t* out=&f.filtered[stride*y];
+		*out++=2;
+		if(above) {
+			for(int x=0; x<width; ++x, row+=4, above+=4, out+=3) {
+				out[0]=row[0]-above[0];
+				out[1]=row[1]-above[1];
+				out[2]=row[2]-above[2];
+			}
+		}
+		else {
+			for(int x=0; x<width; ++x, row+=4, out+=3) {
+				out[0]=row[0];
+				out[1]=row[1];
+				out[2]=row[2];
+			}
+		}
+	}
+	uLongf packedSize=compressBound((uLong)f.filtered.size());
+	std::vector<uint8_t>& out=f.encoded;
+	out.clear();
+	static const uint8_t SIGNATURE[8]= {0x89,'P','N','G','\r','\n',0x1a,'\n'};
+	out.insert(out.end(),SIGNATURE,SIGNATURE+8);
+	uint8_t header[13]= {(uint8_t)(width>>24),(uint8_t)(width>>16),(uint8_t)(width>>8),(uint8_t)width,
+	                     (uint8_t)(height>>24),(uint8_t)(height>>16),(uint8_t)(height>>8),(uint8_t)height,
+	                     8,2,0,0,0  // Bit depth, RGB, deflate, adaptive filtering, no interlace
+	                    };
+	AppendChunk(out,"IHDR",header,sizeof(header));
+	std::vector<uint8_t> packed(packedSize);
+	if(compress2(packed.data(),&packedSize,f.filtered.data(),(uLong)f.filtered.size(),PNG_COMPRESSION_LEVEL)!=Z_OK) {
+		out.clear();
+		return;
+	}
+	AppendChunk(out,"IDAT",packed.data(),packedSize);
+	AppendChunk(out,"IEND",nullptr,0);
+}
+
+// Full-range BT.601 (what C420jpeg means), in 16.16 fixed point. Chroma is taken from the
+// average of each 2x2 block; an odd last row or column averages with itself.
+void FrameExporter::encodeY4M(Frame& f) {
+	int chromaW=(width+1)/2, chromaH=(height+1)/2;
+	static const char FRAME_HEADER[]="FRAME\n";
+	size_t headerSize=sizeof(FRAME_HEADER)-1, lumaSize=(size_t)width*height, chromaSize=(size_t)chromaW*chromaH;
+	f.encoded.resize(headerSize+lumaSize+2*chromaSize);
+	memcpy(f.encoded.data(),FRAME_HEADER,headerSize);
+	uint8_t* luma=f.encoded.data()+headerSize;
+	uint8_t* cb=luma+lumaSize;
+	uint8_t* cr=cb+chromaSize;
+	for(int y=0; y<height; ++y) {
+		const uint8_t* row=&f.pixels[(size_t)(height-1-y)*width*4];  // Y4M stores the top row first
+		uint8_t* out=luma+(size_t)y*width;
+		for(int x=0; x<width; ++x, row+=4) out[x]=(uint8_t)((19595*row[0]+38470*row[1]+7471*row[2]+32768)>>16);
+	}
+	for(int cy=0; cy<chromaH; ++cy) {
+		int y0=2*cy, y1=std::min(y0+1,height-1);
+		const uint8_t* top=&f.pixels[(size_t)(height-1-y0)*width*4];
+		const uint8_t* bottom=&f.pixels[(size_t)(height-1-y1)*width*4];
+		for(int cx=0; cx<chromaW; ++cx) {
+			int x0=2*cx*4, x1=std::min(2*cx+1,width-1)*4;
+			int r=top[x0]+top[x1]+bottom[x0]+bottom[x1];
+			int g=top[x0+1]+top[x1+1]+bottom[x0+1]+bottom[x1+1];
+			int b=top[x0+2]+top[x1+2]+bottom[x0+2]+bottom[x1+2];
+			// Sums of four pixels, so the coefficients carry an extra /4
+			size_t i=(size_t)cy*chromaW+cx;
+			cb[i]=(uint8_t)std::min(255,std::max(0,(128<<16)+(-11059*r-21709*g+32768*b)/4+32768)>>16);
+			cr[i]=(uint8_t)std::min(255,std::max(0,(128<<16)+(32768*r-27439*g-5329*b)/4+32768)>>16);
+		}
+	}
+}
+
+// --- Writer ---
+
+bool FrameExporter::write(Frame& f) {
+	if(f.encoded.empty()) {
+		error="cannot compress frame "+std::to_string(f.index);
+		return false;
+	}
+	if(format==ExportFormat::Y4M) {
+		if(fwrite(f.encoded.data(),1,f.encoded.size(),video)!=f.encoded.size()) {
+			error="cannot write "+directory+"/frames.y4m";
+			return false;
+		}
+	}
+	else {
+		char name[32];
+		snprintf(name,sizeof(name),"/frame_%06llu.png",(unsigned long long)f.index);
+		std::string path=directory+name;
+		FILE* file=fopen(path.c_str(),"wb");
+		bool ok=file&&fwrite(f.encoded.data(),1,f.encoded.size(),file)==f.encoded.size();
+		if(file) ok=(fclose(file)==0)&&ok;
+		if(!ok) {
+			error="cannot write "+path;
+			return false;
+		}
+	}
+	bytes+=f.encoded.size();
+	frames++;
+	return true;
+}
+
+void FrameExporter::writerLoop() {
+	SetProfileThreadName("frame writer");
+	std::vector<int> batch;
+	for(;;) {
+		batch.clear();
+		int b;
+		while((int)batch.size()<pool->threadCount()&&filled.pop(b)) batch.push_back(b);
+		if(batch.empty()) {
+			if(!closing.load()) {
+				std::this_thread::sleep_for(std::chrono::microseconds(200));
+				continue;
+			}
+			if(!filled.pop(b)) return; // Closing and drained
+			batch.push_back(b);
+		}
+		pool->parallelFor(batch.size(),1,[&](size_t begin, size_t end) {
+			for(size_t i=begin; i<end; ++i) {
+				PROFILE_ZONE("export.encode");
+				Frame& f=buffers[batch[i]];
+				if(format==ExportFormat::Y4M) encodeY4M(f);
+				else encodePNG(f);
+			}
+		});
+		// In capture order, which the Y4M stream needs; after a failure the rest are dropped
+		for(int i:batch) {
+			if(!failed&&!write(buffers[i])) failed=true;
+			empty.push(i);
+		}
+	}
+}
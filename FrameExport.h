@@ -0,0 +1,97 @@
+#ifndef FRAMEEXPORT_H_INCLUDED
+#define FRAMEEXPORT_H_INCLUDED
+
+#include <vector>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <cstdio>
+#include <cstdint>
+#include "SpscRing.h"
+#include "ThreadPool.h"
+
+// --- Offscreen Frame Export ---
+// Writes the frames drawn into the current context as numbered PNG files or one Y4M video.
+// capture() maps the oldest of EXPORT_READBACK_BUFFERS pixel buffer objects, whose
+// glReadPixels the GL has long finished, copies it into a pooled frame buffer, then starts
+// the new frame's readback into it. The writer thread takes the queued frames in batches of
+// one per encoder, compresses a batch across a ThreadPool and writes it in order. If the
+// writer falls a whole pool behind, capture() waits rather than dropping frames. Without
+// pixel buffer objects (GL 2.1) the readback is synchronous. Frames the software rasterizer
+// drew are copied straight from memory.
+enum class ExportFormat {
+	PNG,  // dir/frame_000000.png, ...
+	Y4M   // dir/frames.y4m, 4:2:0 full-range YUV, one frame per capture
+};
+
+const int EXPORT_READBACK_BUFFERS = 3;
+const int PNG_COMPRESSION_LEVEL = 1;  // zlib level; higher levels shrink files ~35% at 2-3x the encode time
+
+class FrameExporter {
+public:
+	FrameExporter();
+	~FrameExporter();
+
+	// framesPerSecond only goes into the Y4M header. encoders is the ThreadPool size.
+	bool open(const std::string& directory, ExportFormat format, int width, int height, double framesPerSecond, int encoders, std::string& error);
+	// Call after each frame is drawn, with the context current.
+	void capture();
+	// The same for a frame drawn in memory (width*height RGBA, bottom row first), no GL needed.
+	void capture(const uint8_t* pixels);
+	// Reads back the frames still in flight and drains the queue; false if any write failed.
+	bool close();
+	bool isOpen() const {
+		return writerRunning;
+	}
+
+	uint64_t framesWritten() const {
+		return frames.load();
+	}
+	uint64_t bytesWritten() const {
+		return bytes.load();
+	}
+	const std::string& lastError() const {  // Read after close()
+		return error;
+	}
+	double captureSeconds;  // Time capture() spent reading back and copying on the drawing thread
+	double stallSeconds;    // Time capture() spent waiting for the writer to free a buffer
+
+private:
+	static const int BUFFER_COUNT = 64;
+	struct Frame {
+		uint64_t index;
+		std::vector<uint8_t> pixels;   // RGBA, bottom row first as GL reads them
+		std::vector<uint8_t> filtered; // PNG scanlines before compression
+		std::vector<uint8_t> encoded;  // What goes to disk
+	};
+
+	void queue(const uint8_t* pixels, uint64_t index);  // Reads the framebuffer when pixels is null
+	void writerLoop();
+	void encodePNG(Frame& f);
+	void encodeY4M(Frame& f);
+	bool write(Frame& f);
+
+	ExportFormat format;
+	std::string directory;
+	int width;
+	int height;
+	bool readbackReady;  // The first GL capture() has set up the readback
+	bool pixelBuffers;
+	unsigned readback[EXPORT_READBACK_BUFFERS];
+	uint64_t captured;
+	Frame buffers[BUFFER_COUNT];
+	SpscRing<int,BUFFER_COUNT+1> filled;  // Captured, waiting for the writer
+	SpscRing<int,BUFFER_COUNT+1> empty;   // Written, ready for reuse
+	std::unique_ptr<ThreadPool> pool;
+	std::thread writer;
+	bool writerRunning;
+	std::atomic<bool> closing;
+	std::atomic<uint64_t> frames;
+	std::atomic<uint64_t> bytes;
+	std::atomic<bool> failed;
+	std::string error;  // Set by the writer thread, read after it joins
+	FILE* video;        // Y4M only
+};
+
+#endif // FRAMEEXPORT_H_INCLUDED
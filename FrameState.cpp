@@ -0,0 +1,93 @@
+#include "FrameState.h"
+#include <cmath>
+
+// --- Frame Snapshot ---
+
+void CaptureFrame(const CityWorld& world, FrameState& frame) {
+	frame.timeOfDay=world.timeOfDay;
+	frame.trafficLightState=world.trafficLightState;
+	frame.vehicles.resize(world.vehicles.size());
+	for(size_t i=0; i<world.vehicles.size(); ++i) frame.vehicles[i]=world.vehicles.get(i);
+	frame.vehicleActive=world.vehicles.active;
+	frame.vehicleSlots=world.vehicles.size();
+	frame.birds=world.birds;
+	frame.sidewalkPedestrians=world.sidewalkPedestrians;
+	frame.crossingPedestrians=world.crossingPedestrians;
+	frame.clouds=world.clouds;
+	CaptureScenery(world,frame);
+}
+
+void CaptureScenery(const CityWorld& world, FrameState& frame) {
+	frame.trees=world.trees;
+	frame.streetLights=world.streetLights;
+}
+
+static float lerpSnap(float a, float b, float t, float maxJump) {
+	return (fabs(b-a)>maxJump)?b:lerp(a,b,t);
+}
+
+static const float MAX_MOVE_PER_TICK = 50.0f; // Larger steps are wrap-arounds, not motion
+static const float MAX_PHASE_PER_TICK = (float)M_PI;
+
+static Vehicle interpolateVehicle(const FrameState& a, const FrameState& b, size_t i, float t) {
+	Vehicle v=b.vehicles[i];
+	if(a.vehicles.size()==b.vehicles.size()&&a.vehicleActive[i]&&a.vehicles[i].id==v.id) v.x=lerpSnap(a.vehicles[i].x,v.x,t,MAX_MOVE_PER_TICK);
+	return v;
+}
+
+static Pedestrian interpolatePedestrian(const std::vector<Pedestrian>& a, const std::vector<Pedestrian>& b, size_t i, float t) {
+	Pedestrian p=b[i];
+	if(a.size()!=b.size()) return p;
+	p.x=lerpSnap(a[i].x,p.x,t,MAX_MOVE_PER_TICK);
+	p.y=lerpSnap(a[i].y,p.y,t,MAX_MOVE_PER_TICK);
+	p.legPhase=lerpSnap(a[i].legPhase,p.legPhase,t,MAX_PHASE_PER_TICK);
+	return p;
+}
+
+// Everything but the vehicles and pedestrians.
+static void interpolateShared(const FrameState& a, const FrameState& b, float t, FrameState& out) {
+	out.timeOfDay=lerpSnap(a.timeOfDay,b.timeOfDay,t,0.5f);
+	out.trafficLightState=b.trafficLightState;
+	out.vehicleSlots=b.vehicleSlots;
+	out.birds=b.birds;
+	if(a.birds.size()==b.birds.size()) {
+		for(size_t i=0; i<b.birds.size(); ++i) {
+			out.birds[i].x=lerpSnap(a.birds[i].x,b.birds[i].x,t,MAX_MOVE_PER_TICK);
+			out.birds[i].y=lerpSnap(a.birds[i].y,b.birds[i].y,t,MAX_MOVE_PER_TICK);
+			out.birds[i].flapPhase=lerpSnap(a.birds[i].flapPhase,b.birds[i].flapPhase,t,MAX_PHASE_PER_TICK);
+		}
+	}
+	out.clouds=b.clouds;
+	if(a.clouds.size()==b.clouds.size()) {
+		for(size_t i=0; i<b.clouds.size(); ++i) {
+			out.clouds[i].pos.x=lerpSnap(a.clouds[i].pos.x,b.clouds[i].pos.x,t,MAX_MOVE_PER_TICK);
+			out.clouds[i].pos.y=lerpSnap(a.clouds[i].pos.y,b.clouds[i].pos.y,t,MAX_MOVE_PER_TICK);
+			out.clouds[i].shapePhase=lerpSnap(a.clouds[i].shapePhase,b.clouds[i].shapePhase,t,MAX_PHASE_PER_TICK);
+			out.clouds[i].alpha=lerp(a.clouds[i].alpha,b.clouds[i].alpha,t);
+		}
+	}
+	out.trees=b.trees;
+	out.streetLights=b.streetLights;
+}
+
+void InterpolateFrame(const FrameState& a, const FrameState& b, float t, FrameState& out) {
+	interpolateShared(a,b,t,out);
+	out.vehicles.resize(b.vehicles.size());
+	for(size_t i=0; i<b.vehicles.size(); ++i) out.vehicles[i]=interpolateVehicle(a,b,i,t);
+	out.vehicleActive=b.vehicleActive;
+	out.sidewalkPedestrians.resize(b.sidewalkPedestrians.size());
+	for(size_t i=0; i<b.sidewalkPedestrians.size(); ++i) out.sidewalkPedestrians[i]=interpolatePedestrian(a.sidewalkPedestrians,b.sidewalkPedestrians,i,t);
+	out.crossingPedestrians.resize(b.crossingPedestrians.size());
+	for(size_t i=0; i<b.crossingPedestrians.size(); ++i) out.crossingPedestrians[i]=interpolatePedestrian(a.crossingPedestrians,b.crossingPedestrians,i,t);
+}
+
+void InterpolateSelection(const FrameState& a, const FrameState& b, float t, const FrameSelection& selection, FrameState& out) {
+	interpolateShared(a,b,t,out);
+	out.vehicles.resize(selection.vehicles.size());
+	for(size_t i=0; i<selection.vehicles.size(); ++i) out.vehicles[i]=interpolateVehicle(a,b,selection.vehicles[i],t);
+	out.vehicleActive.assign(selection.vehicles.size(),1);
+	out.sidewalkPedestrians.resize(selection.sidewalkPedestrians.size());
+	for(size_t i=0; i<selection.sidewalkPedestrians.size(); ++i) out.sidewalkPedestrians[i]=interpolatePedestrian(a.sidewalkPedestrians,b.sidewalkPedestrians,selection.sidewalkPedestrians[i],t);
+	out.crossingPedestrians.resize(selection.crossingPedestrians.size());
+	for(size_t i=0; i<selection.crossingPedestrians.size(); ++i) out.crossingPedestrians[i]=interpolatePedestrian(a.crossingPedestrians,b.crossingPedestrians,selection.crossingPedestrians[i],t);
+}
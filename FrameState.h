@@ -0,0 +1,45 @@
+#ifndef FRAMESTATE_H_INCLUDED
+#define FRAMESTATE_H_INCLUDED
+
+#include <vector>
+#include <cstdint>
+#include "CityTypes.h"
+#include "CityWorld.h"
+
+// --- Frame Snapshot ---
+// The scene as drawing needs it. The layout and seed are read from CityWorld directly: they
+// only change when a snapshot is loaded, and the window stops the simulation thread for
+// that. Trees and street lights also change with a load but are carried here, since
+// recordings bring their own, so drawing never reads a world the simulation is changing.
+struct FrameState {
+	float timeOfDay;
+	LightState trafficLightState;
+	std::vector<Vehicle> vehicles;     // Every pool slot, so indices line up between ticks
+	std::vector<char> vehicleActive;
+	size_t vehicleSlots;               // The pool's size, also when vehicles holds only a selection
+	std::vector<Bird> birds;
+	std::vector<Pedestrian> sidewalkPedestrians;
+	std::vector<Pedestrian> crossingPedestrians;
+	std::vector<Cloud> clouds;
+	std::vector<Tree> trees;
+	std::vector<StreetLight> streetLights;
+};
+
+void CaptureFrame(const CityWorld& world, FrameState& frame);
+// Just the trees and street lights, for frames that come from a recording.
+void CaptureScenery(const CityWorld& world, FrameState& frame);
+// Blends two consecutive ticks: t=0 gives a, t=1 gives b. Anything that jumped
+// (a wrap-around or respawn) snaps to b rather than sliding across the screen.
+void InterpolateFrame(const FrameState& a, const FrameState& b, float t, FrameState& out);
+
+// Indices into b's vehicles and pedestrian lists, ascending, as SpatialGrid::query() gives them.
+struct FrameSelection {
+	std::vector<uint32_t> vehicles;
+	std::vector<uint32_t> sidewalkPedestrians;
+	std::vector<uint32_t> crossingPedestrians;
+};
+// Like InterpolateFrame, but out holds only the selected vehicles (all active) and
+// pedestrians, in the order given, so the cost follows the selection, not the world.
+void InterpolateSelection(const FrameState& a, const FrameState& b, float t, const FrameSelection& selection, FrameState& out);
+
+#endif // FRAMESTATE_H_INCLUDED
@@ -0,0 +1,71 @@
+#include "GLExtensions.h"
+#include <cstring>
+#include <cstdio>
+
+#ifdef _WIN32
+#define GL_DEFINE_EXTENSION(type, name) type name = nullptr;
+GL_EXTENSION_FUNCTIONS(GL_DEFINE_EXTENSION)
+#undef GL_DEFINE_EXTENSION
+#endif
+
+// False without a current context.
+static bool ContextVersion(int& major, int& minor) {
+	const char* version=(const char*)glGetString(GL_VERSION);
+	major=minor=0;
+	return version&&sscanf(version,"%d.%d",&major,&minor)>=1;
+}
+
+static bool HasExtension(const char* name) {
+	const char* extensions=(const char*)glGetString(GL_EXTENSIONS);
+	return extensions&&strstr(extensions,name);
+}
+
+bool LoadFramebufferObjects() {
+	int major, minor;
+	if(!ContextVersion(major,minor)) return false;
+	bool supported=major>=3||HasExtension("GL_ARB_framebuffer_object");
+#ifdef _WIN32
+	bool loaded=true;
+#define GL_LOAD_EXTENSION(type, name) \
+	name=(type)wglGetProcAddress(#name); \
+	if(!name) loaded=false;
+	GL_FRAMEBUFFER_FUNCTIONS(GL_LOAD_EXTENSION)
+#undef GL_LOAD_EXTENSION
+	supported=supported&&loaded;
+#endif
+	return supported;
+}
+
+bool LoadInstancing() {
+	int major, minor;
+	if(!ContextVersion(major,minor)) return false;
+	bool supported=major>3||(major==3&&minor>=3)||
+		(major>=2&&HasExtension("GL_ARB_instanced_arrays")&&HasExtension("GL_ARB_draw_instanced"));
+#ifdef _WIN32
+	bool loaded=true;
+#define GL_LOAD_EXTENSION(type, name) \
+	name=(type)wglGetProcAddress(#name); \
+	if(!name) loaded=false;
+	GL_BUFFER_FUNCTIONS(GL_LOAD_EXTENSION)
+	GL_INSTANCING_FUNCTIONS(GL_LOAD_EXTENSION)
+#undef GL_LOAD_EXTENSION
+	supported=supported&&loaded;
+#endif
+	return supported;
+}
+
+bool LoadPixelBuffers() {
+	int major, minor;
+	if(!ContextVersion(major,minor)) return false;
+	bool supported=major>2||(major==2&&minor>=1)||HasExtension("GL_ARB_pixel_buffer_object");
+#ifdef _WIN32
+	bool loaded=true;
+#define GL_LOAD_EXTENSION(type, name) \
+	name=(type)wglGetProcAddress(#name); \
+	if(!name) loaded=false;
+	GL_BUFFER_FUNCTIONS(GL_LOAD_EXTENSION)
+#undef GL_LOAD_EXTENSION
+	supported=supported&&loaded;
+#endif
+	return supported;
+}
@@ -0,0 +1,73 @@
+#ifndef GLEXTENSIONS_H_INCLUDED
+#define GLEXTENSIONS_H_INCLUDED
+
+// --- GL Entry Points Past 1.1 ---
+// Include this instead of <GL/gl.h> wherever these functions are called. Linux's libGL
+// exports them, so they are declared and called directly. Windows' opengl32 stops at GL 1.1,
+// so there they are function pointers filled by the Load* functions once a context is current.
+#ifdef _WIN32
+#include <windows.h>
+#else
+#ifndef GL_GLEXT_PROTOTYPES
+#define GL_GLEXT_PROTOTYPES 1
+#endif
+#endif
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+#define GL_FRAMEBUFFER_FUNCTIONS(X) \
+	X(PFNGLGENFRAMEBUFFERSPROC, glGenFramebuffers) \
+	X(PFNGLDELETEFRAMEBUFFERSPROC, glDeleteFramebuffers) \
+	X(PFNGLBINDFRAMEBUFFERPROC, glBindFramebuffer) \
+	X(PFNGLFRAMEBUFFERTEXTURE2DPROC, glFramebufferTexture2D) \
+	X(PFNGLCHECKFRAMEBUFFERSTATUSPROC, glCheckFramebufferStatus) \
+	X(PFNGLBLENDFUNCSEPARATEPROC, glBlendFuncSeparate)
+
+#define GL_BUFFER_FUNCTIONS(X) \
+	X(PFNGLGENBUFFERSPROC, glGenBuffers) \
+	X(PFNGLDELETEBUFFERSPROC, glDeleteBuffers) \
+	X(PFNGLBINDBUFFERPROC, glBindBuffer) \
+	X(PFNGLBUFFERDATAPROC, glBufferData) \
+	X(PFNGLMAPBUFFERPROC, glMapBuffer) \
+	X(PFNGLUNMAPBUFFERPROC, glUnmapBuffer)
+
+#define GL_INSTANCING_FUNCTIONS(X) \
+	X(PFNGLCREATESHADERPROC, glCreateShader) \
+	X(PFNGLSHADERSOURCEPROC, glShaderSource) \
+	X(PFNGLCOMPILESHADERPROC, glCompileShader) \
+	X(PFNGLGETSHADERIVPROC, glGetShaderiv) \
+	X(PFNGLGETSHADERINFOLOGPROC, glGetShaderInfoLog) \
+	X(PFNGLDELETESHADERPROC, glDeleteShader) \
+	X(PFNGLCREATEPROGRAMPROC, glCreateProgram) \
+	X(PFNGLATTACHSHADERPROC, glAttachShader) \
+	X(PFNGLBINDATTRIBLOCATIONPROC, glBindAttribLocation) \
+	X(PFNGLLINKPROGRAMPROC, glLinkProgram) \
+	X(PFNGLGETPROGRAMIVPROC, glGetProgramiv) \
+	X(PFNGLGETPROGRAMINFOLOGPROC, glGetProgramInfoLog) \
+	X(PFNGLUSEPROGRAMPROC, glUseProgram) \
+	X(PFNGLGETUNIFORMLOCATIONPROC, glGetUniformLocation) \
+	X(PFNGLUNIFORM3FPROC, glUniform3f) \
+	X(PFNGLVERTEXATTRIBPOINTERPROC, glVertexAttribPointer) \
+	X(PFNGLENABLEVERTEXATTRIBARRAYPROC, glEnableVertexAttribArray) \
+	X(PFNGLDISABLEVERTEXATTRIBARRAYPROC, glDisableVertexAttribArray) \
+	X(PFNGLVERTEXATTRIBDIVISORPROC, glVertexAttribDivisor) \
+	X(PFNGLDRAWARRAYSINSTANCEDPROC, glDrawArraysInstanced)
+
+#define GL_EXTENSION_FUNCTIONS(X) \
+	GL_FRAMEBUFFER_FUNCTIONS(X) \
+	GL_BUFFER_FUNCTIONS(X) \
+	GL_INSTANCING_FUNCTIONS(X)
+
+#ifdef _WIN32
+#define GL_DECLARE_EXTENSION(type, name) extern type name;
+GL_EXTENSION_FUNCTIONS(GL_DECLARE_EXTENSION)
+#undef GL_DECLARE_EXTENSION
+#endif
+
+// Call with the context current. Each returns false when the context lacks the feature;
+// callers then fall back to the GL 1.1 path.
+bool LoadFramebufferObjects();  // GL 3.0 or ARB_framebuffer_object
+bool LoadInstancing();          // GL 3.3, or GL 2.0 with ARB_instanced_arrays and ARB_draw_instanced
+bool LoadPixelBuffers();        // GL 2.1 or ARB_pixel_buffer_object
+
+#endif // GLEXTENSIONS_H_INCLUDED
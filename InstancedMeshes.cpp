@@ -0,0 +1,373 @@
+#include "GLExtensions.h"
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <algorithm>
+#include "InstancedMeshes.h"
+#include "Render.h"
+#include "LightMap.h"
+
+InstancedMeshes instancedMeshes;
+
+// --- Meshes ---
+// Vehicles by type and direction, then the pedestrian poses, the street light parts and the
+// tree. submit() draws them in this order.
+enum {
+	MESH_VEHICLES = 0,                    // 2*type, +1 when heading right
+	MESH_PEDESTRIANS = MESH_VEHICLES + 6,
+	MESH_POLE = MESH_PEDESTRIANS + PEDESTRIAN_POSES,
+	MESH_ARM,
+	MESH_LAMP,
+	MESH_GLOW,
+	MESH_TREE,
+	MESH_COUNT
+};
+
+// Which color a vertex takes: its own, the instance's paint or trim, or its own blended
+// toward the headlight color by the instance's glow.
+enum : uint8_t { SLOT_FIXED, SLOT_PAINT, SLOT_TRIM, SLOT_GLOW };
+
+// Attribute locations, fixed before linking.
+enum { ATTRIB_POSITION, ATTRIB_COLOR, ATTRIB_SLOT, ATTRIB_OFFSET, ATTRIB_AXES, ATTRIB_PAINT, ATTRIB_TRIM, ATTRIB_GLOW, ATTRIB_COUNT };
+
+static const char* VERTEX_SHADER =
+	"#version 120\n"
+	"attribute vec2 position;\n"
+	"attribute vec4 color;\n"
+	"attribute float slot;\n"
+	"attribute vec2 offset;\n"
+	"attribute vec4 axes;\n"
+	"attribute vec4 paint;\n"
+	"attribute vec4 trim;\n"
+	"attribute float glow;\n"
+	"uniform vec3 glowColor;\n"
+	"varying vec4 shade;\n"
+	"void main() {\n"
+	"	vec2 p=offset+axes.xy*position.x+axes.zw*position.y;\n"
+	"	gl_Position=gl_ModelViewProjectionMatrix*vec4(p,0.0,1.0);\n"
+	"	vec3 rgb=color.rgb;\n"
+	"	if(slot==1.0) rgb=paint.rgb;\n"
+	"	else if(slot==2.0) rgb=trim.rgb;\n"
+	"	else if(slot==3.0) rgb=mix(color.rgb,glowColor,glow);\n"
+	"	shade=vec4(rgb,color.a*paint.a);\n"
+	"}\n";
+
+static const char* FRAGMENT_SHADER =
+	"#version 120\n"
+	"varying vec4 shade;\n"
+	"void main() {\n"
+	"	gl_FragColor=shade;\n"
+	"}\n";
+
+static const char* ATTRIB_NAMES[ATTRIB_COUNT]= {"position","color","slot","offset","axes","paint","trim","glow"};
+
+static GLuint CompileShader(GLenum type, const char* source) {
+	GLuint shader=glCreateShader(type);
+	glShaderSource(shader,1,&source,nullptr);
+	glCompileShader(shader);
+	GLint ok=GL_FALSE;
+	glGetShaderiv(shader,GL_COMPILE_STATUS,&ok);
+	if(!ok) {
+		char log[1024];
+		glGetShaderInfoLog(shader,sizeof(log),nullptr,log);
+		std::cerr<<"instanced meshes: shader did not compile: "<<log<<"\n";
+		glDeleteShader(shader);
+		return 0;
+	}
+	return shader;
+}
+
+static GLuint LinkProgram() {
+	GLuint vertex=CompileShader(GL_VERTEX_SHADER,VERTEX_SHADER);
+	GLuint fragment=CompileShader(GL_FRAGMENT_SHADER,FRAGMENT_SHADER);
+	if(!vertex||!fragment) return 0;
+	GLuint program=glCreateProgram();
+	glAttachShader(program,vertex);
+	glAttachShader(program,fragment);
+	for(int i=0; i<ATTRIB_COUNT; ++i) glBindAttribLocation(program,i,ATTRIB_NAMES[i]);
+	glLinkProgram(program);
+	glDeleteShader(vertex);
+	glDeleteShader(fragment);
+	GLint ok=GL_FALSE;
+	glGetProgramiv(program,GL_LINK_STATUS,&ok);
+	if(!ok) {
+		char log[1024];
+		glGetProgramInfoLog(program,sizeof(log),nullptr,log);
+		std::cerr<<"instanced meshes: program did not link: "<<log<<"\n";
+		return 0;
+	}
+	return program;
+}
+
+static void ToBytes(const Color& c, float alpha, uint8_t out[4]) {
+	auto toByte=[](float v) {
+		return (uint8_t)(std::min(1.0f,std::max(0.0f,v))*255.0f+0.5f);
+	};
+	out[0]=toByte(c.r);
+	out[1]=toByte(c.g);
+	out[2]=toByte(c.b);
+	out[3]=toByte(alpha);
+}
+
+InstancedMeshes::InstancedMeshes() : enabled(true), drawCalls(0), checked(false), supported(false), program(0), meshBuffer(0), instanceBuffer(0),
+	glowColorLocation(-1), built(false), builtDarkness(0.0f), darkness(0.0f), headlight(0.0f), lamp(0.0f), builder(1024),
+	instances(MESH_COUNT), trackingRows(false), anyRows(false), rowsMin(0.0f), rowsMax(0.0f) {}
+
+// Compiles the program and makes the buffers on first use, with a context current.
+bool InstancedMeshes::prepare() {
+	if(checked) return supported;
+	checked=true;
+	if(!LoadInstancing()) return false;
+	program=LinkProgram();
+	if(!program) return false;
+	glowColorLocation=glGetUniformLocation(program,"glowColor");
+	glGenBuffers(1,&meshBuffer);
+	glGenBuffers(1,&instanceBuffer);
+	supported=true;
+	return true;
+}
+
+void InstancedMeshes::startMesh() {
+	Mesh mesh= {(int)meshVertices.size(),0,0.0f,0.0f,0.0f,0.0f};
+	meshes.push_back(mesh);
+}
+
+void InstancedMeshes::addPart(uint8_t slot) {
+	part.clear();
+	builder.takeVertices(part);
+	for(const BatchVertex& v:part) {
+		MeshVertex m= {v.x,v.y,v.r,v.g,v.b,v.a,slot,{0,0,0}};
+		meshVertices.push_back(m);
+	}
+}
+
+void InstancedMeshes::endMesh() {
+	Mesh& mesh=meshes.back();
+	mesh.count=(int)meshVertices.size()-mesh.first;
+	for(int i=mesh.first; i<mesh.first+mesh.count; ++i) {
+		const MeshVertex& v=meshVertices[i];
+		if(i==mesh.first) {
+			mesh.minX=mesh.maxX=v.x;
+			mesh.minY=mesh.maxY=v.y;
+		}
+		mesh.minX=std::min(mesh.minX,v.x);
+		mesh.maxX=std::max(mesh.maxX,v.x);
+		mesh.minY=std::min(mesh.minY,v.y);
+		mesh.maxY=std::max(mesh.maxY,v.y);
+	}
+}
+
+// Draws every shape once, in the colors darkness gives the parts that are the same for all
+// instances, and uploads the result.
+void InstancedMeshes::build(float darkness) {
+	meshVertices.clear();
+	meshes.clear();
+	VehicleColors colors=vehicleColors(darkness);
+	for(int type=0; type<3; ++type) {
+		for(int direction=-1; direction<=1; direction+=2) {
+			Vehicle v= {};
+			v.type=(VehicleType)type;
+			v.width=VEHICLE_TRAITS[type].width;
+			v.height=VEHICLE_TRAITS[type].height;
+			v.direction=direction;
+			startMesh();
+			builder.setColor(1.0f,1.0f,1.0f);
+			VehicleBodyShape(builder,v);
+			addPart(SLOT_PAINT);
+			builder.setColor(colors.window);
+			VehicleWindowShape(builder,v);
+			addPart(SLOT_FIXED);
+			builder.setColor(colors.wheel);
+			VehicleWheelShape(builder,v,1.0f);
+			addPart(SLOT_FIXED);
+			builder.setColor(colors.hubcap);
+			VehicleWheelShape(builder,v,0.4f);
+			addPart(SLOT_FIXED);
+			builder.setColor(colors.headlightOff);
+			VehicleHeadlightShape(builder,v);
+			addPart(SLOT_GLOW);
+			endMesh();
+		}
+	}
+	for(int pose=0; pose<PEDESTRIAN_POSES; ++pose) {
+		startMesh();
+		builder.setColor(pedestrianSkinColor(darkness));
+		PedestrianHeadShape(builder);
+		addPart(SLOT_FIXED);
+		builder.setColor(1.0f,1.0f,1.0f);
+		PedestrianBodyShape(builder,2.0f*(float)M_PI*pose/PEDESTRIAN_POSES);
+		addPart(SLOT_PAINT);
+		endMesh();
+	}
+	// Street light parts are unit sized; each instance stretches them to its height and arm
+	startMesh();
+	builder.setColor(streetLightPoleColor(darkness));
+	StreetLightPoleShape(builder,1.0f);
+	addPart(SLOT_FIXED);
+	endMesh();
+	startMesh();
+	builder.setColor(streetLightPoleColor(darkness));
+	StreetLightArmShape(builder,1.0f);
+	addPart(SLOT_FIXED);
+	endMesh();
+	startMesh();
+	builder.setColor(streetLightLampColor(darkness));
+	StreetLightLampShape(builder);
+	addPart(SLOT_FIXED);
+	endMesh();
+	startMesh();
+	StreetLightGlowShape(builder,lampBrightness(darkness));
+	addPart(SLOT_FIXED);
+	endMesh();
+	startMesh();
+	builder.setColor(1.0f,1.0f,1.0f);
+	TreeTrunkShape(builder, {0.0f,0.0f},1.0f);
+	addPart(SLOT_TRIM);
+	TreeFoliageShape(builder, {0.0f,0.0f},1.0f);
+	addPart(SLOT_PAINT);
+	endMesh();
+
+	glBindBuffer(GL_ARRAY_BUFFER,meshBuffer);
+	glBufferData(GL_ARRAY_BUFFER,meshVertices.size()*sizeof(MeshVertex),meshVertices.data(),GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER,0);
+	glUseProgram(program);
+	glUniform3f(glowColorLocation,colors.headlightOn.r,colors.headlightOn.g,colors.headlightOn.b);
+	glUseProgram(0);
+	built=true;
+	builtDarkness=darkness;
+}
+
+bool InstancedMeshes::begin() {
+	if(!enabled||!batchTarget->isGL()||!prepare()) return false;
+	darkness=getDarknessFactor();
+	headlight=headlightBrightness(darkness);
+	lamp=lampBrightness(darkness);
+	if(!built||darkness!=builtDarkness) build(darkness);
+	for(auto& list:instances) list.clear();
+	return true;
+}
+
+// --- Instances ---
+
+// The placement goes through sceneBatch's current transform (the camera), as the batch
+// would take the same shape's vertices.
+void InstancedMeshes::add(int mesh, const MeshInstance& placed) {
+	const BatchTransform& t=sceneBatch.currentTransform();
+	MeshInstance instance=placed;
+	instance.x=t.a*placed.x+t.c*placed.y+t.tx;
+	instance.y=t.b*placed.x+t.d*placed.y+t.ty;
+	instance.ax=t.a*placed.ax+t.c*placed.ay;
+	instance.ay=t.b*placed.ax+t.d*placed.ay;
+	instance.bx=t.a*placed.bx+t.c*placed.by;
+	instance.by=t.b*placed.bx+t.d*placed.by;
+	instances[mesh].push_back(instance);
+	if(!trackingRows) return;
+	const Mesh& m=meshes[mesh];
+	float low=instance.y+std::min(instance.ay*m.minX,instance.ay*m.maxX)+std::min(instance.by*m.minY,instance.by*m.maxY);
+	float high=instance.y+std::max(instance.ay*m.minX,instance.ay*m.maxX)+std::max(instance.by*m.minY,instance.by*m.maxY);
+	if(!anyRows) {
+		rowsMin=low;
+		rowsMax=high;
+		anyRows=true;
+	}
+	rowsMin=std::min(rowsMin,low);
+	rowsMax=std::max(rowsMax,high);
+}
+
+static MeshInstance Placed(float x, float y, float ax, float ay, float bx, float by) {
+	MeshInstance instance= {x,y,ax,ay,bx,by,{255,255,255,255},{255,255,255,255},0.0f};
+	return instance;
+}
+
+void InstancedMeshes::addVehicle(const Vehicle& v) {
+	MeshInstance instance=Placed(v.x,v.y,1.0f,0.0f,0.0f,1.0f);
+	ToBytes(vehicleBodyColor(v,darkness),1.0f,instance.paint);
+	instance.glow=headlight;
+	add(MESH_VEHICLES+2*(int)v.type+(v.direction<0 ? 0 : 1),instance);
+}
+
+void InstancedMeshes::addPedestrian(const Pedestrian& p) {
+	float turns=p.legPhase/(2.0f*(float)M_PI);
+	int pose=(int)lroundf((turns-floorf(turns))*PEDESTRIAN_POSES)%PEDESTRIAN_POSES;
+	MeshInstance instance=Placed(p.x,p.y,1.0f,0.0f,0.0f,1.0f);
+	ToBytes(pedestrianClothesColor(p,darkness),pedestrianAlpha(p,darkness),instance.paint);
+	add(MESH_PEDESTRIANS+pose,instance);
+}
+
+void InstancedMeshes::addTree(const Tree& tree) {
+	MeshInstance instance=Placed(tree.pos.x,tree.pos.y,tree.scale,0.0f,0.0f,tree.scale);
+	ToBytes(darkenedColor(tree.foliageColor,darkness),1.0f,instance.paint);
+	ToBytes(darkenedColor(tree.trunkColor,darkness),1.0f,instance.trim);
+	add(MESH_TREE,instance);
+}
+
+// Same placement as DrawStreetLight: the pole stretched to the light's height, then the
+// arm, lamp and glow in the arm's rotated frame at the pole top.
+void InstancedMeshes::addStreetLight(const StreetLight& light) {
+	StreetLightLayout layout=LayoutStreetLight(light);
+	float rad=layout.armAngle*(float)M_PI/180.0f, cs=cosf(rad), sn=sinf(rad);
+	float topX=light.pos.x, topY=light.pos.y+light.height;
+	auto toScene=[&](float x, float y, float& outX, float& outY) {
+		outX=topX+cs*x-sn*y;
+		outY=topY+sn*x+cs*y;
+	};
+	add(MESH_POLE,Placed(light.pos.x,light.pos.y,1.0f,0.0f,0.0f,light.height));
+	add(MESH_ARM,Placed(topX,topY,cs*layout.armLength,sn*layout.armLength,-sn,cs));
+	float x, y;
+	toScene(layout.lampX,layout.lampY,x,y);
+	add(MESH_LAMP,Placed(x,y,cs,sn,-sn,cs));
+	if(lamp>0.01f&&!lightMap.available()) {
+		toScene(layout.glowX,layout.glowY,x,y);
+		add(MESH_GLOW,Placed(x,y,cs,sn,-sn,cs));
+	}
+}
+
+// --- Submission ---
+
+void InstancedMeshes::submit() {
+	sceneBatch.flush();
+	upload.clear();
+	for(const auto& list:instances) upload.insert(upload.end(),list.begin(),list.end());
+	if(upload.empty()) return;
+	glUseProgram(program);
+	glBindBuffer(GL_ARRAY_BUFFER,meshBuffer);
+	glVertexAttribPointer(ATTRIB_POSITION,2,GL_FLOAT,GL_FALSE,sizeof(MeshVertex),(const void*)offsetof(MeshVertex,x));
+	glVertexAttribPointer(ATTRIB_COLOR,4,GL_UNSIGNED_BYTE,GL_TRUE,sizeof(MeshVertex),(const void*)offsetof(MeshVertex,r));
+	glVertexAttribPointer(ATTRIB_SLOT,1,GL_UNSIGNED_BYTE,GL_FALSE,sizeof(MeshVertex),(const void*)offsetof(MeshVertex,slot));
+	glBindBuffer(GL_ARRAY_BUFFER,instanceBuffer);
+	glBufferData(GL_ARRAY_BUFFER,upload.size()*sizeof(MeshInstance),upload.data(),GL_STREAM_DRAW);
+	for(int i=0; i<ATTRIB_COUNT; ++i) glEnableVertexAttribArray(i);
+	for(int i=ATTRIB_OFFSET; i<ATTRIB_COUNT; ++i) glVertexAttribDivisor(i,1);
+	size_t first=0;
+	for(int m=0; m<MESH_COUNT; ++m) {
+		size_t count=instances[m].size();
+		if(count==0) continue;
+		size_t base=first*sizeof(MeshInstance);
+		glVertexAttribPointer(ATTRIB_OFFSET,2,GL_FLOAT,GL_FALSE,sizeof(MeshInstance),(const void*)(base+offsetof(MeshInstance,x)));
+		glVertexAttribPointer(ATTRIB_AXES,4,GL_FLOAT,GL_FALSE,sizeof(MeshInstance),(const void*)(base+offsetof(MeshInstance,ax)));
+		glVertexAttribPointer(ATTRIB_PAINT,4,GL_UNSIGNED_BYTE,GL_TRUE,sizeof(MeshInstance),(const void*)(base+offsetof(MeshInstance,paint)));
+		glVertexAttribPointer(ATTRIB_TRIM,4,GL_UNSIGNED_BYTE,GL_TRUE,sizeof(MeshInstance),(const void*)(base+offsetof(MeshInstance,trim)));
+		glVertexAttribPointer(ATTRIB_GLOW,1,GL_FLOAT,GL_FALSE,sizeof(MeshInstance),(const void*)(base+offsetof(MeshInstance,glow)));
+		glDrawArraysInstanced(GL_TRIANGLES,meshes[m].first,meshes[m].count,(GLsizei)count);
+		drawCalls++;
+		first+=count;
+	}
+	// Leave the arrays as the fixed-function batch expects them
+	for(int i=ATTRIB_OFFSET; i<ATTRIB_COUNT; ++i) glVertexAttribDivisor(i,0);
+	for(int i=0; i<ATTRIB_COUNT; ++i) glDisableVertexAttribArray(i);
+	glBindBuffer(GL_ARRAY_BUFFER,0);
+	glUseProgram(0);
+}
+
+void InstancedMeshes::beginRows() {
+	trackingRows=true;
+	anyRows=false;
+}
+
+bool InstancedMeshes::endRows(float& minY, float& maxY) {
+	trackingRows=false;
+	minY=rowsMin;
+	maxY=rowsMax;
+	return anyRows;
+}
@@ -0,0 +1,92 @@
+#ifndef INSTANCEDMESHES_H_INCLUDED
+#define INSTANCEDMESHES_H_INCLUDED
+
+#include <vector>
+#include <cstdint>
+#include "CityTypes.h"
+#include "DrawBatch.h"
+
+// --- Instanced Meshes ---
+// Vehicles, pedestrians, trees and street lights are drawn from one mesh per shape instead
+// of being rebuilt per entity: a mesh per vehicle type and direction, per pedestrian pose
+// (legPhase rounded to one of PEDESTRIAN_POSES steps), one tree, and the pole, arm, lamp and
+// glow of a street light. Each entity adds an instance (placement, paint and trim colors,
+// headlight intensity) and submit() draws each mesh with one glDrawArraysInstanced, so the
+// draw calls per frame do not grow with the number of entities. The meshes are rebuilt from
+// the Render.h shapes whenever darkness changes. Without instancing (GL 3.3, or 2.0 with
+// ARB_instanced_arrays), with enabled cleared, or when batchTarget is not GL, begin()
+// returns false and callers draw through sceneBatch instead.
+const int PEDESTRIAN_POSES = 16;
+
+struct MeshInstance {
+	float x, y;           // Where the mesh origin goes
+	float ax, ay, bx, by; // Where the mesh's x and y axes go
+	uint8_t paint[4];     // Body color; its alpha fades the whole instance
+	uint8_t trim[4];      // Second color (tree trunks)
+	float glow;           // Headlight intensity
+};
+
+class InstancedMeshes {
+public:
+	InstancedMeshes();
+
+	// Starts collecting instances; false when instanced drawing is off or not supported.
+	bool begin();
+	void addVehicle(const Vehicle& v);
+	void addPedestrian(const Pedestrian& p);
+	void addTree(const Tree& tree);
+	void addStreetLight(const StreetLight& light);
+	// Flushes sceneBatch, which lies behind, then draws what was added, mesh by mesh.
+	void submit();
+
+	// Like DrawBatch::beginRows/endRows, for the instances submitted in between.
+	void beginRows();
+	bool endRows(float& minY, float& maxY);
+
+	bool enabled;
+	long long drawCalls;  // glDrawArraysInstanced calls made by submit(), for the stats overlay
+
+private:
+	struct MeshVertex {
+		float x, y;
+		uint8_t r, g, b, a;
+		uint8_t slot, pad[3];  // Which color the vertex takes; see InstancedMeshes.cpp
+	};
+	struct Mesh {
+		int first, count;              // Range in the vertex buffer
+		float minX, minY, maxX, maxY;  // Bounds, for the row tracking
+	};
+	bool prepare();
+	void build(float darkness);
+	void startMesh();
+	void addPart(uint8_t slot);
+	void endMesh();
+	void add(int mesh, const MeshInstance& instance);
+
+	bool checked;     // prepare() ran: the extensions were looked up
+	bool supported;
+	unsigned program;
+	unsigned meshBuffer;
+	unsigned instanceBuffer;
+	int glowColorLocation;
+	bool built;
+	float builtDarkness;
+	float darkness;      // Of the frame being collected
+	float headlight;
+	float lamp;
+
+	DrawBatch builder;   // Shapes are drawn into this and taken out as mesh parts
+	std::vector<BatchVertex> part;
+	std::vector<MeshVertex> meshVertices;
+	std::vector<Mesh> meshes;
+	std::vector<std::vector<MeshInstance>> instances;  // Per mesh
+	std::vector<MeshInstance> upload;
+
+	bool trackingRows;
+	bool anyRows;
+	float rowsMin, rowsMax;
+};
+
+extern InstancedMeshes instancedMeshes;
+
+#endif // INSTANCEDMESHES_H_INCLUDED
@@ -0,0 +1,81 @@
+#include <cmath>
+#include <vector>
+#include <iostream>
+#include "VehicleStore.h"
+#include "Random.h"
+
+// --- Kinematics Kernel Test ---
+// Runs IntegrateVehicles (whichever of AVX2, SSE2 or scalar this machine picks) against
+// IntegrateVehiclesScalar on random fleets. The counts include every remainder the vector
+// loops hand to their tails, the arrays start off their natural alignment, and the update
+// is also run in place. Exits with status 1 if any result differs by more than TOLERANCE.
+
+static const float TOLERANCE = 1e-5f;  // Relative to the value, or absolute below 1
+
+struct Fleet {
+	std::vector<float> x, speed, baseSpeed, speedLimit, direction;
+};
+
+// n vehicles starting offset floats into each array, so the kernel sees unaligned data.
+static Fleet RandomFleet(size_t n, size_t offset, uint32_t draw) {
+	RandomStream rng(1,draw,0,STREAM_SETUP_VEHICLE);
+	Fleet f;
+	for(std::vector<float>* v: {&f.x,&f.speed,&f.baseSpeed,&f.speedLimit,&f.direction}) v->resize(offset+n);
+	for(size_t i=offset; i<offset+n; ++i) {
+		f.x[i]=randFloat(rng,-200.0f,1200.0f);
+		f.speed[i]=randFloat(rng,0.0f,2.0f);
+		f.baseSpeed[i]=randFloat(rng,0.5f,1.6f);
+		// Stopped, crawling and unlimited vehicles, as signals and leaders give them
+		int kind=randInt(rng,3);
+		f.speedLimit[i]=kind==0 ? 0.0f : kind==1 ? randFloat(rng,0.0f,1.0f) : 1e30f;
+		f.direction[i]=randInt(rng,2) ? 1.0f : -1.0f;
+	}
+	return f;
+}
+
+static bool Close(float a, float b) {
+	return fabsf(a-b)<=TOLERANCE*std::max(1.0f,fabsf(b));
+}
+
+// Compares n results; prints the first mismatch.
+static bool Compare(const char* what, size_t n, size_t offset, bool inPlace, const float* got, const float* want) {
+	for(size_t i=0; i<n; ++i) {
+		if(Close(got[i],want[i])) continue;
+		std::cout<<"FAIL "<<what<<" n="<<n<<" offset="<<offset<<(inPlace?" in place":"")<<" at "<<i<<": "<<got[i]<<" expected "<<want[i]<<"\n";
+		return false;
+	}
+	return true;
+}
+
+// One fleet through both kernels; false if they disagree.
+static bool RunCase(size_t n, size_t offset, float k, bool inPlace, uint32_t draw) {
+	Fleet f=RandomFleet(n,offset,draw);
+	std::vector<float> wantX(n), wantSpeed(n);
+	IntegrateVehiclesScalar(f.x.data()+offset,f.speed.data()+offset,f.baseSpeed.data()+offset,f.speedLimit.data()+offset,f.direction.data()+offset,
+	                        wantX.data(),wantSpeed.data(),n,CAR_ACCELERATION,CAR_DECELERATION,k);
+	std::vector<float> gotX(offset+n), gotSpeed(offset+n);
+	float* outX=inPlace ? f.x.data() : gotX.data();
+	float* outSpeed=inPlace ? f.speed.data() : gotSpeed.data();
+	IntegrateVehicles(f.x.data()+offset,f.speed.data()+offset,f.baseSpeed.data()+offset,f.speedLimit.data()+offset,f.direction.data()+offset,
+	                  outX+offset,outSpeed+offset,n,CAR_ACCELERATION,CAR_DECELERATION,k);
+	bool ok=Compare("x",n,offset,inPlace,outX+offset,wantX.data());
+	return Compare("speed",n,offset,inPlace,outSpeed+offset,wantSpeed.data())&&ok;
+}
+
+int main() {
+	const size_t COUNTS[]= {0,1,2,3,4,5,6,7,8,9,11,12,13,15,16,17,23,24,25,31,32,33,63,64,65,1000,1023,4099};
+	const float STEPS[]= {1.0f,0.5f,2.5f};  // Fractions of a tick
+	int cases=0, failures=0;
+	for(size_t n:COUNTS) {
+		for(size_t offset=0; offset<4; ++offset) {
+			for(float k:STEPS) {
+				for(bool inPlace: {false,true}) {
+					if(!RunCase(n,offset,k,inPlace,(uint32_t)cases)) failures++;
+					cases++;
+				}
+			}
+		}
+	}
+	std::cout<<"kernel: "<<IntegrateVehiclesPath()<<"  cases: "<<cases<<"  failures: "<<failures<<"\n";
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,146 @@
+#include "GLExtensions.h"
+#include <cmath>
+#include "LightMap.h"
+#include "Camera.h"
+#include "CityChunks.h"
+
+LightMap lightMap;
+
+LightMap::LightMap() : enabled(true), lightsDrawn(0), checked(false), supported(false), framebuffer(0), texture(0), width(0), height(0),
+	splats(1 << 14) {}
+
+bool LightMap::available() {
+	if(!enabled||!batchTarget->isGL()) return false;
+	if(!checked) {
+		checked=true;
+		supported=LoadFramebufferObjects();
+		if(supported) {
+			glGenTextures(1,&texture);
+			glGenFramebuffers(1,&framebuffer);
+		}
+	}
+	return supported;
+}
+
+// Sizes the texture to the window, rounding up so the last partial block is covered.
+bool LightMap::prepare() {
+	if(!available()) return false;
+	int w=(windowWidth+LIGHTMAP_DOWNSCALE-1)/LIGHTMAP_DOWNSCALE, h=(windowHeight+LIGHTMAP_DOWNSCALE-1)/LIGHTMAP_DOWNSCALE;
+	if(w!=width||h!=height) {
+		width=w;
+		height=h;
+		glBindTexture(GL_TEXTURE_2D,texture);
+		glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_S,GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_WRAP_T,GL_CLAMP_TO_EDGE);
+		glTexImage2D(GL_TEXTURE_2D,0,GL_RGBA8,width,height,0,GL_RGBA,GL_UNSIGNED_BYTE,nullptr);
+		GLint previous=0;
+		glGetIntegerv(GL_FRAMEBUFFER_BINDING,&previous);
+		glBindFramebuffer(GL_FRAMEBUFFER,framebuffer);
+		glFramebufferTexture2D(GL_FRAMEBUFFER,GL_COLOR_ATTACHMENT0,GL_TEXTURE_2D,texture,0);
+		supported=glCheckFramebufferStatus(GL_FRAMEBUFFER)==GL_FRAMEBUFFER_COMPLETE;
+		glBindFramebuffer(GL_FRAMEBUFFER,previous);
+	}
+	return supported;
+}
+
+// A soft blob: full color at the center, falling linearly to nothing at the rim.
+void LightMap::splat(float x, float y, float rx, float ry, float r, float g, float b) {
+	const Point* unit=UnitCircle(LIGHT_SPLAT_SEGMENTS);
+	for(int i=0; i<LIGHT_SPLAT_SEGMENTS; ++i) {
+		splats.setColor(r,g,b);
+		splats.vertex(x,y);
+		splats.setColor(0.0f,0.0f,0.0f,0.0f);
+		splats.vertex(x+rx*unit[i].x,y+ry*unit[i].y);
+		splats.vertex(x+rx*unit[i+1].x,y+ry*unit[i+1].y);
+	}
+	lightsDrawn++;
+}
+
+// Screen blend, scene + light - scene*light: brightens without clipping to white.
+void LightMap::composite() {
+	float w=(float)windowWidth, h=(float)windowHeight;
+	float corners[8]= {0.0f,0.0f,w,0.0f,w,h,0.0f,h};
+	float texCoords[8]= {0.0f,0.0f,1.0f,0.0f,1.0f,1.0f,0.0f,1.0f};
+	glEnable(GL_TEXTURE_2D);
+	glBindTexture(GL_TEXTURE_2D,texture);
+	glColor4f(1.0f,1.0f,1.0f,1.0f);
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+	glVertexPointer(2,GL_FLOAT,0,corners);
+	glTexCoordPointer(2,GL_FLOAT,0,texCoords);
+	glBlendFunc(GL_ONE,GL_ONE_MINUS_SRC_COLOR);
+	glDrawArrays(GL_TRIANGLE_FAN,0,4);
+	glBlendFunc(GL_SRC_ALPHA,GL_ONE_MINUS_SRC_ALPHA);
+	glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+	glDisableClientState(GL_VERTEX_ARRAY);
+	glDisable(GL_TEXTURE_2D);
+}
+
+void LightMap::draw() {
+	lightsDrawn=0;
+	if(!prepare()) return;
+	float darkness=getDarknessFactor();
+	float lamp=lampBrightness(darkness), headlight=headlightBrightness(darkness);
+	if(lamp<=0.01f&&headlight<=0.01f) return;
+
+	// Bound first, so the batch's early flushes on a busy night also land in the light map
+	GLint previous=0, viewport[4];
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING,&previous);
+	glGetIntegerv(GL_VIEWPORT,viewport);
+	GLfloat clearColor[4];
+	glGetFloatv(GL_COLOR_CLEAR_VALUE,clearColor);
+	glBindFramebuffer(GL_FRAMEBUFFER,framebuffer);
+	glViewport(0,0,width,height);  // Same projection, so scene coordinates land scaled down
+	glClearColor(0.0f,0.0f,0.0f,0.0f);
+	glClear(GL_COLOR_BUFFER_BIT);
+	glClearColor(clearColor[0],clearColor[1],clearColor[2],clearColor[3]);
+	glBlendFunc(GL_ONE,GL_ONE);
+
+	splats.pushTransform();
+	camera.apply(splats);
+	if(lamp>0.01f) {
+		auto lampSplat=[&](const StreetLight& light) {
+			StreetLightLayout layout=LayoutStreetLight(light);
+			float rad=layout.armAngle*(float)M_PI/180.0f;
+			float x=light.pos.x+cosf(rad)*layout.lampX-sinf(rad)*layout.lampY;
+			float y=light.pos.y+light.height+sinf(rad)*layout.lampX+cosf(rad)*layout.lampY;
+			// The light falls downward, so the blob hangs below the lamp
+			splat(x,y-25.0f,50.0f,65.0f,0.35f*lamp,0.33f*lamp,0.25f*lamp);
+		};
+		for(const StreetLight& light:frame.streetLights) lampSplat(light);
+		for(const CityChunk* chunk:cityChunks.inView()) {
+			for(const StreetLight& light:chunk->streetLights) lampSplat(light);
+		}
+		// Only the lit windows glow
+		auto windowSplats=[&](const std::vector<LitBuilding>& buildings) {
+			for(const LitBuilding& b:buildings) {
+				if(b.mask.litCount()==0) continue;
+				for(size_t i=0; i<b.windows.size(); ++i) {
+					if(!b.mask.lit(i)) continue;
+					const WindowRect& w=b.windows[i];
+					float rx=(w.x1-w.x0)*1.5f+3.0f, ry=(w.y1-w.y0)*1.5f+3.0f;
+					splat((w.x0+w.x1)*0.5f,(w.y0+w.y1)*0.5f,rx,ry,0.16f*lamp,0.16f*lamp,0.1f*lamp);
+				}
+			}
+		};
+		windowSplats(windowLights.scenery());
+		for(const CityChunk* chunk:cityChunks.inView()) windowSplats(chunk->buildings);
+	}
+	if(headlight>0.01f) {
+		for(size_t i=0; i<frame.vehicles.size(); ++i) {
+			if(!frame.vehicleActive[i]) continue;
+			const Vehicle& v=frame.vehicles[i];
+			float front=v.direction>0 ? v.x+v.width : v.x;
+			splat(front+v.direction*35.0f,v.y+v.height*0.25f,40.0f,12.0f,0.5f*headlight,0.5f*headlight,0.35f*headlight);
+		}
+	}
+
+	splats.popTransform();
+	splats.flush();
+	glBlendFunc(GL_SRC_ALPHA,GL_ONE_MINUS_SRC_ALPHA);
+	glBindFramebuffer(GL_FRAMEBUFFER,previous);
+	glViewport(viewport[0],viewport[1],viewport[2],viewport[3]);
+	composite();
+}
@@ -0,0 +1,48 @@
+#ifndef LIGHTMAP_H_INCLUDED
+#define LIGHTMAP_H_INCLUDED
+
+#include <vector>
+#include "DrawBatch.h"
+#include "Render.h"
+
+// --- Night Light Map ---
+// Street lamps, headlight beams and lit windows are splatted as soft additive blobs into a
+// texture LIGHTMAP_DOWNSCALE times smaller than the window on each axis. The texture is then
+// laid over the finished scene once, with a screen blend. The fill cost is one small target
+// plus one full-window pass, however many lights there are. Lamps and the windows
+// windowLights has lit follow lampBrightness(), headlights headlightBrightness(); in
+// daylight the pass is skipped. It replaces the per-lamp glow fans, which are drawn again
+// when the context has no framebuffer objects, when batchTarget is not GL, or when enabled
+// is cleared.
+const int LIGHTMAP_DOWNSCALE = 4;
+const int LIGHT_SPLAT_SEGMENTS = 12;
+
+class LightMap {
+public:
+	LightMap();
+
+	// True when draw() will light the scene; the street lights then leave out their glow.
+	bool available();
+	// Lays the lights over everything drawn so far; call after the scene is flushed.
+	void draw();
+
+	bool enabled;
+	long long lightsDrawn;  // Splats in the last draw(), for the stats overlay
+
+private:
+	bool prepare();
+	void splat(float x, float y, float rx, float ry, float r, float g, float b);
+	void composite();
+
+	bool checked;    // The extensions were looked up
+	bool supported;
+	unsigned framebuffer;
+	unsigned texture;
+	int width;       // Of the light texture
+	int height;
+	DrawBatch splats;
+};
+
+extern LightMap lightMap;
+
+#endif // LIGHTMAP_H_INCLUDED
@@ -0,0 +1,73 @@
+#include "OffscreenContext.h"
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GL/gl.h>
+#include <cstdlib>
+
+OffscreenContext::OffscreenContext() : width(0), height(0), display(EGL_NO_DISPLAY), surface(EGL_NO_SURFACE), context(EGL_NO_CONTEXT) {}
+
+OffscreenContext::~OffscreenContext() {
+	destroy();
+}
+
+bool OffscreenContext::create(int w, int h, bool software, std::string& error) {
+	destroy();
+	if(software) setenv("LIBGL_ALWAYS_SOFTWARE","1",1);
+	// Prefer Mesa's surfaceless platform so no X or Wayland server is needed
+	EGLDisplay dpy=EGL_NO_DISPLAY;
+	PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay=(PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+	if(getPlatformDisplay) dpy=getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA,EGL_DEFAULT_DISPLAY,nullptr);
+	if(dpy==EGL_NO_DISPLAY) dpy=eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	EGLint major, minor;
+	if(dpy==EGL_NO_DISPLAY||!eglInitialize(dpy,&major,&minor)) {
+		error="no EGL display";
+		return false;
+	}
+	display=dpy;
+	const EGLint configAttribs[]= {
+		EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+		EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8, EGL_ALPHA_SIZE, 8,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_NONE
+	};
+	EGLConfig config;
+	EGLint configs=0;
+	if(!eglChooseConfig(dpy,configAttribs,&config,1,&configs)||configs==0) {
+		error="no EGL config with desktop GL pbuffers";
+		destroy();
+		return false;
+	}
+	const EGLint pbufferAttribs[]= {EGL_WIDTH, w, EGL_HEIGHT, h, EGL_NONE};
+	surface=eglCreatePbufferSurface(dpy,config,pbufferAttribs);
+	if(surface==EGL_NO_SURFACE) {
+		error="cannot create a pbuffer";
+		destroy();
+		return false;
+	}
+	eglBindAPI(EGL_OPENGL_API);
+	context=eglCreateContext(dpy,config,EGL_NO_CONTEXT,nullptr);
+	if(context==EGL_NO_CONTEXT||!eglMakeCurrent(dpy,(EGLSurface)surface,(EGLSurface)surface,(EGLContext)context)) {
+		error="cannot create a desktop GL context";
+		destroy();
+		return false;
+	}
+	width=w;
+	height=h;
+	return true;
+}
+
+void OffscreenContext::destroy() {
+	if(display==EGL_NO_DISPLAY) return;
+	eglMakeCurrent((EGLDisplay)display,EGL_NO_SURFACE,EGL_NO_SURFACE,EGL_NO_CONTEXT);
+	if(context!=EGL_NO_CONTEXT) eglDestroyContext((EGLDisplay)display,(EGLContext)context);
+	if(surface!=EGL_NO_SURFACE) eglDestroySurface((EGLDisplay)display,(EGLSurface)surface);
+	eglTerminate((EGLDisplay)display);
+	display=EGL_NO_DISPLAY;
+	surface=EGL_NO_SURFACE;
+	context=EGL_NO_CONTEXT;
+}
+
+std::string OffscreenContext::renderer() const {
+	const GLubyte* name=glGetString(GL_RENDERER);
+	return name?(const char*)name:"";
+}
@@ -0,0 +1,29 @@
+#ifndef OFFSCREENCONTEXT_H_INCLUDED
+#define OFFSCREENCONTEXT_H_INCLUDED
+
+#include <string>
+
+// --- Offscreen GL Context ---
+// A desktop GL (compatibility profile) context on an EGL pbuffer, with no window or display
+// server. With software set, Mesa's llvmpipe is requested so timings do not depend on the
+// machine's GPU. Linux only; Render.cpp draws into it the same way as into the window.
+class OffscreenContext {
+public:
+	OffscreenContext();
+	~OffscreenContext();
+
+	bool create(int width, int height, bool software, std::string& error);
+	void destroy();
+	// Renderer string of the current context, e.g. "llvmpipe (LLVM 15.0.6, 256 bits)".
+	std::string renderer() const;
+
+	int width;
+	int height;
+
+private:
+	void* display;  // EGLDisplay, EGLSurface and EGLContext, kept opaque to keep EGL headers local
+	void* surface;
+	void* context;
+};
+
+#endif // OFFSCREENCONTEXT_H_INCLUDED
@@ -0,0 +1,148 @@
+#include "Profiler.h"
+#include <mutex>
+#include <memory>
+#include <map>
+#include <unordered_map>
+#include <algorithm>
+#include <cstdio>
+#include <cerrno>
+#include <cstring>
+
+namespace {
+	// Made on first use and never destroyed: threads that globals in other files start
+	// (the snapshot writer, say) can register before this file's globals are constructed
+	// and push samples after they would be destroyed.
+	struct Registry {
+		std::chrono::steady_clock::time_point epoch=std::chrono::steady_clock::now();
+		std::mutex lock;
+		std::vector<std::unique_ptr<ProfileRing>> rings;  // Guarded by lock
+	};
+	Registry& TheRegistry() {
+		static Registry* registry=new Registry;
+		return *registry;
+	}
+
+	// Snapshot of the ring pointers, so readers do not hold the lock while copying.
+	std::vector<ProfileRing*> AllRings() {
+		Registry& registry=TheRegistry();
+		std::lock_guard<std::mutex> guard(registry.lock);
+		std::vector<ProfileRing*> all;
+		for(auto& r:registry.rings) all.push_back(r.get());
+		return all;
+	}
+
+	void WriteJsonString(FILE* f, const std::string& s) {
+		fputc('"',f);
+		for(char c:s) {
+			if(c=='"'||c=='\\') fputc('\\',f);
+			if((unsigned char)c>=0x20) fputc(c,f);
+		}
+		fputc('"',f);
+	}
+}
+
+ProfileRing::ProfileRing(int id, const std::string& threadName) : id(id), threadName(threadName), samples(PROFILE_RING_SIZE), head(0) {}
+
+void ProfileRing::copySince(uint64_t since, std::vector<ZoneSample>& out) const {
+	uint64_t h=head.load(std::memory_order_acquire);
+	size_t first=out.size();
+	// A thread pushes in end-time order, so walk back until a sample ends before since
+	uint64_t i=h;
+	while(i>0&&h-i<(uint64_t)PROFILE_RING_SIZE) {
+		const ZoneSample& s=samples[(i-1)&(PROFILE_RING_SIZE-1)];
+		if(s.end<since) break;
+		out.push_back(s);
+		--i;
+	}
+	// Drop whatever the owner overwrote while we were copying (the oldest we took)
+	uint64_t after=head.load(std::memory_order_acquire);
+	uint64_t oldestValid=after>(uint64_t)PROFILE_RING_SIZE?after-PROFILE_RING_SIZE:0;
+	size_t keep=out.size()-first;
+	if(i<oldestValid) keep=(size_t)std::min<uint64_t>(keep,h>oldestValid?h-oldestValid:0);
+	out.resize(first+keep);
+	std::reverse(out.begin()+first,out.end());
+}
+
+uint64_t ProfileNow() {
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now()-TheRegistry().epoch).count();
+}
+
+#if PROFILE_ZONES
+ProfileRing& RegisterProfileThread() {
+	Registry& registry=TheRegistry();
+	std::lock_guard<std::mutex> guard(registry.lock);
+	int id=(int)registry.rings.size();
+	registry.rings.emplace_back(new ProfileRing(id,"thread "+std::to_string(id)));
+	return *registry.rings.back();
+}
+
+void SetProfileThreadName(const std::string& name) {
+	ProfileRing& ring=ThreadProfileRing();
+	std::lock_guard<std::mutex> guard(TheRegistry().lock);
+	ring.threadName=name;
+}
+#endif
+
+// --- Reports ---
+
+void SummarizeZones(double windowSeconds, std::vector<ZoneStats>& out) {
+	out.clear();
+	uint64_t now=ProfileNow();
+	uint64_t window=(uint64_t)(windowSeconds*1e9);
+	uint64_t since=now>window?now-window:0;
+	std::vector<ZoneSample> samples;
+	for(ProfileRing* ring:AllRings()) ring->copySince(since,samples);
+	// Literals are grouped by pointer first; the same name from two files may differ
+	std::unordered_map<const char*,ZoneStats> byPointer;
+	for(const ZoneSample& s:samples) {
+		ZoneStats& z=byPointer[s.name];
+		z.calls++;
+		z.totalMs+=(s.end-s.start)*1e-6;
+	}
+	std::map<std::string,ZoneStats> byName;
+	for(auto& entry:byPointer) {
+		ZoneStats& z=byName[entry.first];
+		z.name=entry.first;
+		z.calls+=entry.second.calls;
+		z.totalMs+=entry.second.totalMs;
+	}
+	for(auto& entry:byName) out.push_back(entry.second);
+	std::sort(out.begin(),out.end(),[](const ZoneStats& a, const ZoneStats& b) {
+		return a.totalMs>b.totalMs;
+	});
+}
+
+bool WriteChromeTrace(const std::string& path, std::string& error) {
+	FILE* f=fopen(path.c_str(),"w");
+	if(!f) {
+		error=path+": "+strerror(errno);
+		return false;
+	}
+	fprintf(f,"{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	bool first=true;
+	std::vector<ZoneSample> samples;
+	for(ProfileRing* ring:AllRings()) {
+		std::string threadName;
+		{
+			std::lock_guard<std::mutex> guard(TheRegistry().lock);
+			threadName=ring->threadName;
+		}
+		fprintf(f,"%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":",first?"":",\n",ring->id);
+		WriteJsonString(f,threadName);
+		fprintf(f,"}}");
+		first=false;
+		samples.clear();
+		ring->copySince(0,samples);
+		for(const ZoneSample& s:samples) {
+			fprintf(f,",\n{\"ph\":\"X\",\"name\":");
+			WriteJsonString(f,s.name);
+			fprintf(f,",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",ring->id,s.start*1e-3,(s.end-s.start)*1e-3);
+		}
+	}
+	fprintf(f,"\n]}\n");
+	if(ferror(f)|fclose(f)) {
+		error=path+": write failed";
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,100 @@
+#ifndef PROFILER_H_INCLUDED
+#define PROFILER_H_INCLUDED
+
+#include <vector>
+#include <string>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+// --- Profiling Zones ---
+// PROFILE_ZONE("name") times the rest of the enclosing scope. Each thread appends its
+// samples to its own ring (no locks, no allocation), keeping the last PROFILE_RING_SIZE;
+// the HUD and the trace writer read every thread's ring. Build with -DPROFILE_ZONES=0 to
+// compile the zones out: the macro then expands to nothing and no thread allocates a ring.
+#ifndef PROFILE_ZONES
+#define PROFILE_ZONES 1
+#endif
+
+const int PROFILE_RING_SIZE = 1 << 15;  // Samples kept per thread (a power of two)
+
+struct ZoneSample {
+	const char* name;  // String literal, so samples never own memory
+	uint64_t start;    // ns since the profiler's epoch
+	uint64_t end;
+};
+
+// One thread's samples. Only the owning thread pushes; readers copy out recent samples
+// and drop any the owner overwrote while they were copying.
+class ProfileRing {
+public:
+	ProfileRing(int id, const std::string& threadName);
+	void push(const char* name, uint64_t start, uint64_t end) {
+		uint64_t h=head.load(std::memory_order_relaxed);
+		samples[h&(PROFILE_RING_SIZE-1)]= {name,start,end};
+		head.store(h+1,std::memory_order_release);
+	}
+	// Appends the samples that ended at or after since, oldest first.
+	void copySince(uint64_t since, std::vector<ZoneSample>& out) const;
+
+	int id;
+	std::string threadName;
+
+private:
+	std::vector<ZoneSample> samples;
+	std::atomic<uint64_t> head;
+};
+
+uint64_t ProfileNow();
+
+#if PROFILE_ZONES
+// The calling thread's ring, created and registered on first use. Rings are never freed,
+// so readers stay safe after their thread exits.
+ProfileRing& RegisterProfileThread();
+inline ProfileRing& ThreadProfileRing() {
+	static thread_local ProfileRing* ring=nullptr;
+	if(!ring) ring=&RegisterProfileThread();
+	return *ring;
+}
+// Names the calling thread in the HUD and the trace ("main", "worker 2", ...).
+void SetProfileThreadName(const std::string& name);
+
+class ProfileZone {
+public:
+	explicit ProfileZone(const char* name) : name(name), start(ProfileNow()) {}
+	~ProfileZone() {
+		ThreadProfileRing().push(name,start,ProfileNow());
+	}
+	ProfileZone(const ProfileZone&) = delete;
+	ProfileZone& operator=(const ProfileZone&) = delete;
+
+private:
+	const char* name;
+	uint64_t start;
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_ZONE(name) ProfileZone PROFILE_CONCAT(profileZone, __LINE__)(name)
+#else
+// No thread registers a ring, so the reports below come out empty.
+inline void SetProfileThreadName(const std::string&) {}
+#define PROFILE_ZONE(name)
+#endif
+
+// --- Reports ---
+
+struct ZoneStats {
+	std::string name;
+	long long calls;
+	double totalMs;
+};
+
+// Per-zone totals over the last windowSeconds across all threads, busiest first. A zone
+// that runs on several threads at once can add up to more than windowSeconds.
+void SummarizeZones(double windowSeconds, std::vector<ZoneStats>& out);
+// Writes every thread's retained samples as Chrome trace_event JSON (chrome://tracing,
+// Perfetto). False with a message if the file could not be written.
+bool WriteChromeTrace(const std::string& path, std::string& error);
+
+#endif // PROFILER_H_INCLUDED
@@ -0,0 +1,31 @@
+#include "Random.h"
+
+// --- Counter-Based Random Numbers ---
+
+// SplitMix64 finaliser: a bijective 64-bit mix with full avalanche.
+static uint64_t Mix64(uint64_t z) {
+	z=(z^(z>>30))*0xBF58476D1CE4E5B9ULL;
+	z=(z^(z>>27))*0x94D049BB133111EBULL;
+	return z^(z>>31);
+}
+
+RandomStream::RandomStream(uint64_t seed, uint32_t entity, uint64_t tick, uint32_t stream) : counter(0) {
+	key=Mix64(seed+0x9E3779B97F4A7C15ULL);
+	key=Mix64(key^entity);
+	key=Mix64(key^tick);
+	key=Mix64(key^((uint64_t)stream<<32));
+}
+
+uint32_t RandomStream::next() {
+	return (uint32_t)(Mix64(key+(uint64_t)(++counter)*0x9E3779B97F4A7C15ULL)>>32);
+}
+
+float randFloat(RandomStream& rng, float min, float max) {
+	return min+(rng.next()>>8)*(1.0f/16777216.0f)*(max-min);
+}
+int randInt(RandomStream& rng, int n) {
+	return (int)(((uint64_t)rng.next()*(uint64_t)n)>>32);
+}
+Color randomColor(RandomStream& rng) {
+	return {randFloat(rng,0.2f,0.9f), randFloat(rng,0.2f,0.9f), randFloat(rng,0.2f,0.9f)};
+}
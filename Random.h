@@ -0,0 +1,45 @@
+#ifndef RANDOM_H_INCLUDED
+#define RANDOM_H_INCLUDED
+
+#include <cstdint>
+#include "CityTypes.h"
+
+// --- Counter-Based Random Numbers ---
+// A stream is keyed by (seed, entity id, tick, stream id) and its nth draw is a hash of
+// the key and n. Nothing is shared between streams, so a draw gives the same value
+// whichever thread makes it and in whatever order entities are visited.
+enum RandomStreamId {
+	STREAM_SETUP_WORLD,
+	STREAM_SETUP_BIRD,
+	STREAM_SETUP_VEHICLE,
+	STREAM_SETUP_SIDEWALK,
+	STREAM_SETUP_CROSSING,
+	STREAM_SETUP_TREE,
+	STREAM_SETUP_STREETLIGHT,
+	STREAM_SETUP_CLOUD,
+	STREAM_ARRIVAL,
+	STREAM_BIRD_WRAP,
+	STREAM_CROSSING_OFFSET,
+	STREAM_CLOUD_WRAP,
+	STREAM_ROUTE,
+	STREAM_CHUNK_BUILDING,   // Keyed by chunk index, see CityChunks.h
+	STREAM_CHUNK_TREE,
+	STREAM_CHUNK_STREETLIGHT,
+	STREAM_CHUNK_ROAD,
+	STREAM_WINDOW_SCENERY,   // Keyed by building, see WindowLights.h
+	STREAM_WINDOW_CHUNK      // Keyed by chunk index, the building in tick
+};
+
+struct RandomStream {
+	RandomStream(uint64_t seed, uint32_t entity, uint64_t tick, uint32_t stream);
+	uint32_t next();
+
+	uint64_t key;
+	uint32_t counter;
+};
+
+float randFloat(RandomStream& rng, float min, float max); // [min, max)
+int randInt(RandomStream& rng, int n);                   // [0, n)
+Color randomColor(RandomStream& rng);
+
+#endif // RANDOM_H_INCLUDED
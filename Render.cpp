@@ -0,0 +1,729 @@
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include <GL/gl.h>
+#include <cmath>
+#include <algorithm>
+#include "Render.h"
+#include "Profiler.h"
+#include "SceneryCache.h"
+#include "InstancedMeshes.h"
+#include "LightMap.h"
+#include "Camera.h"
+#include "CityChunks.h"
+
+DrawBatch sceneBatch;
+
+// --- Helper Functions ---
+void DrawEllipse(float cx, float cy, float rx, float ry) {
+	sceneBatch.ellipse(cx,cy,rx,ry);
+}
+void DrawCircle(float cx, float cy, float r) {
+	DrawEllipse(cx, cy, r, r);
+}
+float getDarknessFactor() {
+	if (!ENABLE_DAY_NIGHT_CYCLE) return 0.0f;
+	float sunAngle=frame.timeOfDay*M_PI;
+	float sunHeightFactor=sin(sunAngle);
+	float darkness=1.0f-std::max(0.0f,sunHeightFactor);
+	return std::min(1.0f,darkness*1.5f);
+}
+// --- Drawing Functions ---
+
+void DrawSkyAndSunMoon(float time) {
+	/* ... Same ... */ Color dayTop= {0.2f,0.6f,0.9f},dayBottom= {0.5f,0.8f,1.0f},nightTop= {0.05f,0.0f,0.15f},nightBottom= {0.1f,0.05f,0.25f},topColor,bottomColor;
+	float darkness=getDarknessFactor();
+	if(ENABLE_DAY_NIGHT_CYCLE) {
+		topColor=lerpColor(dayTop,nightTop,darkness);
+		bottomColor=lerpColor(dayBottom,nightBottom,darkness);
+	}
+	else {
+		topColor=dayTop;
+		bottomColor=dayBottom;
+	}
+	// Vertical gradient: top corners in one color, bottom corners in the other
+	sceneBatch.setColor(topColor.r,topColor.g,topColor.b);
+	sceneBatch.vertex(0,windowHeight);
+	sceneBatch.vertex(windowWidth,windowHeight);
+	sceneBatch.setColor(bottomColor.r,bottomColor.g,bottomColor.b);
+	sceneBatch.vertex(windowWidth,0);
+	sceneBatch.setColor(topColor.r,topColor.g,topColor.b);
+	sceneBatch.vertex(0,windowHeight);
+	sceneBatch.setColor(bottomColor.r,bottomColor.g,bottomColor.b);
+	sceneBatch.vertex(windowWidth,0);
+	sceneBatch.vertex(0,0);
+	float horizonY=world.upperFootpathTopY;
+	float skyHeight=windowHeight-horizonY,skyWidth=windowWidth,sunRadius=40.0f,moonRadius=30.0f;
+	if(ENABLE_DAY_NIGHT_CYCLE) {
+		float sunAngle=time*M_PI,sunX=skyWidth*0.5f-skyWidth*0.48f*cos(sunAngle),sunY=horizonY+skyHeight*0.8f*sin(sunAngle),moonAngle=time*M_PI+M_PI,moonX=skyWidth*0.5f-skyWidth*0.48f*cos(moonAngle),moonY=horizonY+skyHeight*0.8f*sin(moonAngle);
+		if(sin(sunAngle)>0.05) {
+			sceneBatch.setColor(1.0f,1.0f,0.1f);
+			DrawCircle(sunX,sunY,sunRadius);
+		}
+		if(sin(moonAngle)>0.05) {
+			sceneBatch.setColor(0.9f,0.9f,0.95f);
+			DrawCircle(moonX,moonY,moonRadius);
+			sceneBatch.setColor(0.7f,0.7f,0.75f);
+			DrawCircle(moonX+moonRadius*0.3f,moonY+moonRadius*0.1f,moonRadius*0.2f);
+			DrawCircle(moonX-moonRadius*0.4f,moonY-moonRadius*0.2f,moonRadius*0.15f);
+		}
+	}
+	else {
+		sceneBatch.setColor(1.0f,1.0f,0.0f);
+		DrawCircle(windowWidth*0.5f,windowHeight*0.85f,sunRadius);
+	}
+}
+void DrawMountains() {
+	/* ... Same ... */ float darkness=getDarknessFactor();
+	Color baseColorDay= {0.1f,0.35f,0.1f},baseColorNight= {0.02f,0.08f,0.02f},baseColor=lerpColor(baseColorDay,baseColorNight,darkness);
+	Color midColorDay= {0.15f,0.45f,0.15f},midColorNight= {0.03f,0.12f,0.03f},midColor=lerpColor(midColorDay,midColorNight,darkness);
+	Color topColorDay= {0.2f,0.5f,0.2f},topColorNight= {0.05f,0.15f,0.05f},topColor=lerpColor(topColorDay,topColorNight,darkness);
+	sceneBatch.setColor(baseColor.r,baseColor.g,baseColor.b);
+	Point base[]= {{windowWidth*0.3f,world.upperFootpathTopY},{windowWidth*0.45f,windowHeight*0.55f},{windowWidth*0.6f,windowHeight*0.4f},{windowWidth*0.7f,windowHeight*0.65f},{windowWidth*0.9f,windowHeight*0.5f},{windowWidth*1.1f,world.upperFootpathTopY}};
+	sceneBatch.polygon(base,6);
+	sceneBatch.setColor(midColor.r,midColor.g,midColor.b);
+	Point mid[]= {{windowWidth*0.45f,world.upperFootpathTopY},{windowWidth*0.6f,windowHeight*0.5f},{windowWidth*0.75f,windowHeight*0.35f},{windowWidth*0.85f,windowHeight*0.6f},{windowWidth*1.0f,world.upperFootpathTopY}};
+	sceneBatch.polygon(mid,5);
+	sceneBatch.setColor(topColor.r,topColor.g,topColor.b);
+	Point top[]= {{windowWidth*0.65f,world.upperFootpathTopY},{windowWidth*0.8f,windowHeight*0.45f},{windowWidth*0.95f,world.upperFootpathTopY}};
+	sceneBatch.polygon(top,3);
+}
+void DrawFootpath() {
+	/* ... Same ... */ float darkness = getDarknessFactor();
+	Color pathDay = {0.7f, 0.7f, 0.7f};
+	Color pathNight = {0.3f, 0.3f, 0.3f};
+	Color pathColor = lerpColor(pathDay, pathNight, darkness);
+	sceneBatch.setColor(pathColor.r, pathColor.g, pathColor.b);
+	ViewRect view=camera.view();  // The ground runs on past the window, as far as the camera shows
+	float x0=std::min(0.0f,view.x0), x1=std::max((float)windowWidth,view.x1);
+	sceneBatch.quad(x0, world.upperFootpathTopY,x1, world.upperFootpathTopY,x1, world.upperFootpathBottomY,x0, world.upperFootpathBottomY);
+	sceneBatch.quad(x0, world.lowerFootpathTopY,x1, world.lowerFootpathTopY,x1, world.lowerFootpathBottomY,x0, world.lowerFootpathBottomY);
+}
+void DrawRoad() {
+	/* ... Same ... */ float darkness=getDarknessFactor();
+	Color roadColorDay= {0.3f,0.3f,0.3f},roadColorNight= {0.1f,0.1f,0.1f},roadColor=lerpColor(roadColorDay,roadColorNight,darkness);
+	sceneBatch.setColor(roadColor.r,roadColor.g,roadColor.b);
+	ViewRect view=camera.view();
+	float x0=std::min(0.0f,view.x0), x1=std::max((float)windowWidth,view.x1);
+	sceneBatch.quad(x0,world.roadTopY,x1,world.roadTopY,x1,world.roadBottomY,x0,world.roadBottomY);
+}
+// The center line scrolls with the time of day, so it is not part of the cached backdrop.
+void DrawLaneMarkings() {
+	float darkness=getDarknessFactor();
+	Color lineDay= {0.9f,0.9f,0.9f},lineNight= {0.4f,0.4f,0.4f},lineColor=lerpColor(lineDay,lineNight,darkness);
+	sceneBatch.setColor(lineColor.r,lineColor.g,lineColor.b);
+	float dashLength=40.0f,gapLength=30.0f,lineY=(world.roadTopY+world.roadBottomY)/2.0f;
+	float startOffset=(frame.vehicleSlots==0?0.0f:fmod(-frame.timeOfDay*50.0f,dashLength+gapLength));
+	ViewRect view=camera.view();
+	float period=dashLength+gapLength, first=startOffset-period;
+	first+=floorf((view.x0-first)/period)*period;  // From the first dash in view, either side of the window
+	float last=std::max((float)windowWidth,view.x1);
+	for(float x=first; x<last; x+=period) {
+		sceneBatch.line(x,lineY,x+dashLength,lineY,3.0f);
+	}
+}
+static void DrawZebraStripes(float centerX) {
+	float stripeWidth=8.0f,gapWidth=6.0f,startY=world.roadBottomY+2,endY=world.roadTopY-2,startX=centerX-world.zebraCrossingWidth/2.0f;
+	for(float x=startX; x<startX+world.zebraCrossingWidth; x+=stripeWidth+gapWidth) {
+		sceneBatch.quad(x,endY,x+stripeWidth,endY,x+stripeWidth,startY,x,startY);
+	}
+}
+// The scene's own crossing, then those of the chunks in view.
+void DrawZebraCrossing() {
+	/* ... Same ... */ float darkness=getDarknessFactor();
+	Color stripeDay= {0.9f,0.9f,0.9f},stripeNight= {0.5f,0.5f,0.5f},stripeColor=lerpColor(stripeDay,stripeNight,darkness);
+	sceneBatch.setColor(stripeColor.r,stripeColor.g,stripeColor.b);
+	DrawZebraStripes(world.zebraCrossingX);
+	for(const CityChunk* chunk:cityChunks.inView()) {
+		if(chunk->road.crossingX!=NO_CROSSING) DrawZebraStripes(chunk->road.crossingX);
+	}
+}
+
+// --- Building Windows ---
+
+void Building1Windows(float x, float y, float scale, std::vector<WindowRect>& out) {
+	float baseW=60*scale, baseH=250*scale;
+	int rows=10,cols=3;
+	float winW=baseW/cols*0.6f,winH=baseH/rows*0.6f;
+	for(int r=0; r<rows; ++r) for(int c=0; c<cols; ++c) {
+			float winX=x+(c+0.2f)*(baseW/cols),winY=y+(r+0.2f)*(baseH/rows);
+			out.push_back({winX,winY,winX+winW,winY+winH});
+		}
+}
+void Building2Windows(float x, float y, float scale, std::vector<WindowRect>& out) {
+	float baseW=80*scale, baseH=300*scale;
+	int cols=6, rows=15;  // The panes between the frame lines
+	for(int r=0; r<rows; ++r) for(int c=0; c<cols; ++c) {
+			out.push_back({x+c*(baseW/cols),y+r*(baseH/rows),x+(c+1)*(baseW/cols),y+(r+1)*(baseH/rows)});
+		}
+}
+void Building3Windows(float x, float y, float scale, std::vector<WindowRect>& out) {
+	float currentW=100*scale, currentH=60*scale, currentY=y;
+	int segments=6;
+	for(int i=0; i<segments; ++i) {
+		int numWindows=5-i;
+		float winW=currentW*0.1f, winH=currentH*0.5f, winY=currentY+currentH*0.25f;
+		float spacing=(currentW-numWindows*winW)/(numWindows+1);
+		for(int w=0; w<numWindows; ++w) {
+			float winX=x+spacing*(w+1)+winW*w;
+			out.push_back({winX,winY,winX+winW,winY+winH});
+		}
+		currentY+=currentH;
+		x+=currentW*0.1f;
+		currentW*=0.8f;
+		currentH*=0.95f;
+	}
+}
+void BuildingWindows(const PlacedBuilding& b, float y, std::vector<WindowRect>& out) {
+	if(b.kind==BUILDING_SLAB) Building1Windows(b.x,y,b.scale,out);
+	else if(b.kind==BUILDING_GLASS) Building2Windows(b.x,y,b.scale,out);
+	else if(b.kind==BUILDING_TIERED) Building3Windows(b.x,y,b.scale,out);
+}
+void SceneryBuildings(std::vector<PlacedBuilding>& out) {
+	out.push_back({BUILDING_SLAB,windowWidth*BUILDING1_X,1.0f});
+	out.push_back({BUILDING_GLASS,windowWidth*BUILDING2_X,1.0f});
+	out.push_back({BUILDING_TIERED,windowWidth*BUILDING3_X,1.0f});
+	out.push_back({BUILDING_TOWER,windowWidth*CONTROL_TOWER_X,1.0f});
+}
+
+// Lit windows in the night color, dark ones in the day color, dimmed at night so the lit
+// ones stand out. With skipDark the dark ones are left to whatever is behind.
+static void DrawWindows(const std::vector<WindowRect>& windows, const WindowMask* lit, Color day, Color night, bool skipDark) {
+	Color dark=isNightTime(frame.timeOfDay) ? darkenedColor(day,getDarknessFactor()) : day;
+	for(size_t i=0; i<windows.size(); ++i) {
+		bool on=lit&&lit->lit(i);
+		if(!on&&skipDark) continue;
+		const Color& c=on ? night : dark;
+		sceneBatch.setColor(c.r,c.g,c.b);
+		sceneBatch.rect(windows[i].x0,windows[i].y0,windows[i].x1,windows[i].y1);
+	}
+}
+
+void DrawBuilding1(float x, float y, float scale, const WindowMask* lit) {
+	/* ... Same ... */ float baseW=60*scale, baseH=250*scale, topH=40*scale;
+	float darkness=getDarknessFactor();
+	Color mainDay= {0.7f,0.7f,0.2f}, mainNight= {0.3f,0.3f,0.1f}, mainColor=lerpColor(mainDay,mainNight,darkness);
+	Color accentDay= {0.2f,0.6f,0.4f}, accentNight= {0.1f,0.3f,0.2f}, accentColor=lerpColor(accentDay,accentNight,darkness);
+	Color windowDay= {0.1f,0.1f,0.1f}, windowNight= {0.8f,0.8f,0.5f};
+	sceneBatch.setColor(mainColor.r,mainColor.g,mainColor.b);
+	sceneBatch.quad(x,y+baseH,x+baseW,y+baseH,x+baseW,y,x,y);
+	sceneBatch.setColor(accentColor.r,accentColor.g,accentColor.b);
+	sceneBatch.quad(x-baseW*0.3f,y+baseH*0.9f,x,y+baseH,x,y,x-baseW*0.3f,y+baseH*0.1f);
+	sceneBatch.triangle(x-baseW*0.3f,y+baseH*0.9f,x-baseW*0.15f,y+baseH*0.9f+topH,x,y+baseH);
+	std::vector<WindowRect> windows;
+	Building1Windows(x,y,scale,windows);
+	DrawWindows(windows,lit,windowDay,windowNight,false);
+}
+void DrawBuilding2(float x, float y, float scale, const WindowMask* lit) {
+	/* ... Same ... */ float baseW=80*scale, baseH=300*scale, topH=60*scale;
+	float darkness=getDarknessFactor();
+	Color mainDay= {0.9f,0.9f,0.9f}, mainNight= {0.4f,0.4f,0.4f}, mainColor=lerpColor(mainDay,mainNight,darkness);
+	Color frameDay= {0.1f,0.1f,0.1f}, frameNight= {0.05f,0.05f,0.05f}, frameColor=lerpColor(frameDay,frameNight,darkness);
+	bool isNight=isNightTime(frame.timeOfDay);
+	Color windowDay= {0.4f,0.5f,0.6f}, windowNight= {0.8f,0.8f,0.5f}, windowColor=isNight?darkenedColor(windowDay,darkness):windowDay;
+	sceneBatch.setColor(windowColor.r,windowColor.g,windowColor.b);
+	sceneBatch.quad(x,y+baseH,x+baseW,y+baseH,x+baseW,y,x,y);
+	// The dark panes are the face itself; the frame lines go over the lit ones
+	if(lit&&lit->litCount()>0) {
+		std::vector<WindowRect> panes;
+		Building2Windows(x,y,scale,panes);
+		DrawWindows(panes,lit,windowDay,windowNight,true);
+	}
+	sceneBatch.setColor(frameColor.r,frameColor.g,frameColor.b);
+	int vLines=6;
+	for(int i=0; i<=vLines; ++i) {
+		float lineX=x+i*(baseW/vLines);
+		sceneBatch.line(lineX,y,lineX,y+baseH,2.0f);
+	}
+	int hLines=15;
+	for(int i=0; i<=hLines; ++i) {
+		float lineY=y+i*(baseH/hLines);
+		sceneBatch.line(x,lineY,x+baseW,lineY,2.0f);
+	}
+	sceneBatch.setColor(mainColor.r,mainColor.g,mainColor.b);
+	sceneBatch.triangle(x,y+baseH,x+baseW/2,y+baseH+topH,x+baseW,y+baseH);
+	sceneBatch.setColor(frameColor.r,frameColor.g,frameColor.b);
+	sceneBatch.line(x+baseW/2,y+baseH,x+baseW/2,y+baseH+topH,1.0f);
+}
+void DrawBuilding3(float x, float y, float scale, const WindowMask* lit) {
+	/* ... Same ... */ float currentW=100*scale, currentH=60*scale, currentY=y, startX=x;
+	int segments=6;
+	float darkness=getDarknessFactor();
+	Color mainDay= {0.2f,0.4f,0.7f}, mainNight= {0.1f,0.2f,0.35f}, mainColor=lerpColor(mainDay,mainNight,darkness);
+	Color windowDay= {0.9f,0.5f,0.1f}, windowNight= {1.0f,0.8f,0.3f};
+	sceneBatch.setColor(mainColor.r,mainColor.g,mainColor.b);
+	for(int i=0; i<segments; ++i) {
+		sceneBatch.quad(x,currentY+currentH,x+currentW,currentY+currentH,x+currentW,currentY,x,currentY);
+		currentY+=currentH;
+		x+=currentW*0.1f;
+		currentW*=0.8f;
+		currentH*=0.95f;
+	}
+	// The tiers do not overlap, so their windows can follow all of them
+	std::vector<WindowRect> windows;
+	Building3Windows(startX,y,scale,windows);
+	DrawWindows(windows,lit,windowDay,windowNight,false);
+	sceneBatch.setColor(0.5f,0.5f,0.5f);
+	sceneBatch.quad(x+currentW/2-2*scale,currentY+20*scale,x+currentW/2+2*scale,currentY+20*scale,x+currentW/2+2*scale,currentY,x+currentW/2-2*scale,currentY);
+}
+void DrawControlTower(float x, float y, float scale) {
+	/* ... Same ... */ float baseH=80*scale, baseW=20*scale, platform1R=40*scale, platform1H=10*scale;
+	float platform2R=30*scale, platform2H=8*scale, topR=10*scale;
+	float darkness=getDarknessFactor();
+	Color baseDay= {0.4f,0.4f,0.45f}, baseNight= {0.15f,0.15f,0.2f}, baseColor=lerpColor(baseDay,baseNight,darkness);
+	Color plat1Day= {0.6f,0.6f,0.6f}, plat1Night= {0.3f,0.3f,0.3f}, plat1Color=lerpColor(plat1Day,plat1Night,darkness);
+	Color plat2Day= {0.8f,0.8f,0.3f}, plat2Night= {0.4f,0.4f,0.15f}, plat2Color=lerpColor(plat2Day,plat2Night,darkness);
+	Color topDay= {0.3f,0.8f,0.8f}, topNight= {0.15f,0.4f,0.4f}, topColor=lerpColor(topDay,topNight,darkness);
+	sceneBatch.setColor(baseColor.r,baseColor.g,baseColor.b);
+	sceneBatch.quad(x-baseW/2,y+baseH,x+baseW/2,y+baseH,x+baseW/2,y,x-baseW/2,y);
+	float plat1Y=y+baseH;
+	sceneBatch.setColor(plat1Color.r,plat1Color.g,plat1Color.b);
+	sceneBatch.quad(x-platform1R,plat1Y+platform1H,x+platform1R,plat1Y+platform1H,x+platform1R,plat1Y,x-platform1R,plat1Y);
+	float plat2Y=plat1Y+platform1H;
+	sceneBatch.setColor(plat2Color.r,plat2Color.g,plat2Color.b);
+	sceneBatch.quad(x-platform2R,plat2Y+platform2H,x+platform2R,plat2Y+platform2H,x+platform2R,plat2Y,x-platform2R,plat2Y);
+	float topY=plat2Y+platform2H;
+	sceneBatch.setColor(topColor.r,topColor.g,topColor.b);
+	DrawCircle(x,topY+topR,topR);
+	sceneBatch.setColor(0.8f,0.8f,0.8f);
+	sceneBatch.line(x,topY+topR*2,x,topY+topR*2+10*scale,1.0f);
+}
+void DrawTrafficLight(float x, float y, float scale) {
+	/* ... Same ... */ float poleW=8*scale, poleH=70*scale, boxW=25*scale, boxH=60*scale, lightR=7*scale;
+	sceneBatch.setColor(0.2f,0.2f,0.2f);
+	sceneBatch.quad(x-poleW/2,y+poleH,x+poleW/2,y+poleH,x+poleW/2,y,x-poleW/2,y);
+	float boxY=y+poleH*0.3f;
+	sceneBatch.setColor(0.1f,0.1f,0.1f);
+	sceneBatch.quad(x-boxW/2,boxY+boxH,x+boxW/2,boxY+boxH,x+boxW/2,boxY,x-boxW/2,boxY);
+	float lightSpacing=boxH/4.0f, lightX=x;
+	float redY=boxY+lightSpacing*3, yellowY=boxY+lightSpacing*2, greenY=boxY+lightSpacing*1;
+	sceneBatch.setColor(0.3f,0.0f,0.0f);
+	DrawCircle(lightX,redY,lightR);
+	sceneBatch.setColor(0.3f,0.3f,0.0f);
+	DrawCircle(lightX,yellowY,lightR);
+	sceneBatch.setColor(0.0f,0.3f,0.0f);
+	DrawCircle(lightX,greenY,lightR);
+	switch(frame.trafficLightState) {
+	case RED:
+		sceneBatch.setColor(1.0f,0.0f,0.0f);
+		DrawCircle(lightX,redY,lightR);
+		break;
+	case YELLOW:
+		sceneBatch.setColor(1.0f,1.0f,0.0f);
+		DrawCircle(lightX,yellowY,lightR);
+		break;
+	case GREEN:
+		sceneBatch.setColor(0.0f,1.0f,0.0f);
+		DrawCircle(lightX,greenY,lightR);
+		break;
+	}
+}
+// --- Entity Shapes ---
+
+void VehicleBodyShape(DrawBatch& batch, const Vehicle& v) {
+	if(v.type==BUS) {
+		batch.quad(0,v.height,v.width,v.height,v.width*0.98f,0,v.width*0.02f,0);
+	}
+	else if(v.type==TRUCK) {
+		float cabW=v.width*0.4f,cabH=v.height*0.9f;
+		if(v.direction<0) {
+			batch.quad(0,v.height,cabW,v.height,cabW,v.height-cabH,0,v.height-cabH);
+			batch.quad(cabW*1.1f,v.height*0.85f,v.width,v.height*0.85f,v.width,0,cabW*1.1f,0);
+		}
+		else {
+			batch.quad(v.width-cabW,v.height,v.width,v.height,v.width,v.height-cabH,v.width-cabW,v.height-cabH);
+			batch.quad(0,v.height*0.85f,v.width-cabW*1.1f,v.height*0.85f,v.width-cabW*1.1f,0,0,0);
+		}
+	}
+	else {
+		// The car outline was always drawn as GL_QUADS, which only fills its first four corners
+		batch.quad(v.width*0.1f,v.height,v.width*0.9f,v.height,v.width,v.height*0.5f,v.width,0);
+	}
+}
+void VehicleWindowShape(DrawBatch& batch, const Vehicle& v) {
+	if(v.type==BUS) {
+		float winH=v.height*0.4f,winY=v.height*0.4f,winW=v.width*0.12f,spacing=v.width*0.04f;
+		for(int i=0; i<5; ++i) batch.rect(v.width*0.1f+i*(winW+spacing),winY,v.width*0.1f+i*(winW+spacing)+winW,winY+winH);
+		batch.rect(v.width*0.1f+5*(winW+spacing),winY,v.width*0.9f,winY+winH);
+	}
+	else if(v.type==TRUCK) {
+		if(v.direction<0) batch.rect(v.width*0.05f,v.height*0.4f,v.width*0.35f,v.height*0.9f);
+		else batch.rect(v.width*0.65f,v.height*0.4f,v.width*0.95f,v.height*0.9f);
+	}
+	else {
+		batch.quad(v.width*0.15f,v.height*0.9f,v.width*0.85f,v.height*0.9f,v.width*0.9f,v.height*0.5f,v.width*0.1f,v.height*0.5f);
+	}
+}
+void VehicleWheelShape(DrawBatch& batch, const Vehicle& v, float radiusFactor) {
+	float wheelR=v.height*0.2f, frontWheelX, backWheelX;
+	if(v.type==TRUCK) {
+		frontWheelX=v.direction<0 ? v.width*0.2f : v.width*0.8f;
+		backWheelX=v.direction<0 ? v.width*0.8f : v.width*0.2f;
+	}
+	else {
+		frontWheelX=v.direction<0 ? v.width*0.25f : v.width*0.75f;
+		backWheelX=v.direction<0 ? v.width*0.75f : v.width*0.25f;
+	}
+	float r=wheelR*radiusFactor;
+	batch.ellipse(frontWheelX,wheelR,r,r);
+	batch.ellipse(backWheelX,wheelR,r,r);
+	if(v.type==TRUCK) batch.ellipse(backWheelX + (v.direction<0 ? wheelR*2.2f : -wheelR*2.2f),wheelR,r,r);
+}
+void VehicleHeadlightShape(DrawBatch& batch, const Vehicle& v) {
+	float headLightSize=4.0f;
+	if(v.direction>0) {
+		if(v.type!=TRUCK) {
+			batch.rect(v.width-headLightSize-3,v.height*0.2f,v.width-3,v.height*0.2f+headLightSize);
+			batch.rect(v.width-headLightSize*2.5f-3,v.height*0.2f,v.width-headLightSize*1.5f-3,v.height*0.2f+headLightSize);
+		}
+		else {
+			batch.rect(v.width-headLightSize-3,v.height*0.3f,v.width-3,v.height*0.3f+headLightSize);
+		}
+	}
+	else {
+		if(v.type!=TRUCK) {
+			batch.rect(3,v.height*0.2f,3+headLightSize,v.height*0.2f+headLightSize);
+			batch.rect(3+headLightSize*1.5f,v.height*0.2f,3+headLightSize*2.5f,v.height*0.2f+headLightSize);
+		}
+		else {
+			batch.rect(3,v.height*0.3f,3+headLightSize,v.height*0.3f+headLightSize);
+		}
+	}
+}
+void PedestrianHeadShape(DrawBatch& batch) {
+	float headR=4.0f, bodyH=12.0f, legH=8.0f;
+	batch.ellipse(0,bodyH+legH+headR,headR,headR);
+}
+void PedestrianBodyShape(DrawBatch& batch, float legPhase) {
+	float bodyH=12.0f, bodyW=5.0f, legH=8.0f, legW=2.0f;
+	batch.quad(-bodyW/2,legH+bodyH,bodyW/2,legH+bodyH,bodyW/2,legH,-bodyW/2,legH);
+	float legOffset=2.5f*sin(legPhase);
+	batch.quad(-legW*1.5f,legH,-legW*0.5f,legH,-legW*0.5f+legOffset,0,-legW*1.5f+legOffset,0);
+	batch.quad(legW*0.5f,legH,legW*1.5f,legH,legW*1.5f-legOffset,0,legW*0.5f-legOffset,0);
+}
+void TreeTrunkShape(DrawBatch& batch, Point pos, float scale) {
+	float trunkWidth=10.0f*scale,trunkHeight=40.0f*scale;
+	batch.quad(pos.x-trunkWidth/2,pos.y+trunkHeight,pos.x+trunkWidth/2,pos.y+trunkHeight,pos.x+trunkWidth/2,pos.y,pos.x-trunkWidth/2,pos.y);
+}
+void TreeFoliageShape(DrawBatch& batch, Point pos, float scale) {
+	float foliageRadius=25.0f*scale,foliageCenterY=pos.y+40.0f*scale;
+	batch.ellipse(pos.x,foliageCenterY,foliageRadius,foliageRadius);
+	batch.ellipse(pos.x-foliageRadius*0.4f,foliageCenterY+foliageRadius*0.1f,foliageRadius*0.7f,foliageRadius*0.7f);
+	batch.ellipse(pos.x+foliageRadius*0.4f,foliageCenterY+foliageRadius*0.1f,foliageRadius*0.7f,foliageRadius*0.7f);
+	batch.ellipse(pos.x,foliageCenterY+foliageRadius*0.5f,foliageRadius*0.6f,foliageRadius*0.6f);
+}
+StreetLightLayout LayoutStreetLight(const StreetLight& light) {
+	StreetLightLayout layout;
+	layout.armAngle=light.onUpper ? -25.0f : 25.0f;
+	layout.armLength=light.onUpper ? -light.armLength : light.armLength;
+	layout.lampX=layout.armLength;
+	layout.lampY=-STREETLIGHT_LAMP_HEIGHT*0.5f;  // Hangs below the arm
+	// The glow was always placed from the lamp's scene position but drawn inside the arm's
+	// rotated frame, so it lands well away from the lamp; kept as it has always looked.
+	float angleRad=layout.armAngle*M_PI/180.0f;
+	layout.glowX=light.pos.x+cos(angleRad)*layout.lampX;
+	layout.glowY=light.pos.y+light.height+sin(angleRad)*layout.lampX+layout.lampY;
+	return layout;
+}
+void StreetLightPoleShape(DrawBatch& batch, float height) {
+	float poleWidth=5.0f;
+	batch.quad(-poleWidth/2,height,poleWidth/2,height,poleWidth/2,0,-poleWidth/2,0);
+}
+void StreetLightArmShape(DrawBatch& batch, float length) {
+	batch.line(0,0,length,0,3.0f);
+}
+void StreetLightLampShape(DrawBatch& batch) {
+	float lampWidth=10.0f;
+	batch.rect(-lampWidth/2,-STREETLIGHT_LAMP_HEIGHT/2,lampWidth/2,STREETLIGHT_LAMP_HEIGHT/2);
+}
+void StreetLightGlowShape(DrawBatch& batch, float lampBrightness) {
+	int glowSegments = 20;
+	float maxRadius = 70.0f;
+	float prevX = -maxRadius * 0.7f, prevY = 0.0f;
+	for (int i = 1; i <= glowSegments; ++i) {
+		float angle = M_PI + M_PI * (float)i / (float)glowSegments;
+		float edgeX = maxRadius * cos(angle) * 0.7f, edgeY = maxRadius * sin(angle) * 1.1f;
+		batch.setColor(1.0f, 0.95f, 0.7f, 0.25f * lampBrightness); // Center alpha depends on brightness
+		batch.vertex(0.0f, 0.0f);
+		batch.setColor(1.0f, 0.9f, 0.6f, 0.0f); // Edge always transparent
+		batch.vertex(prevX, prevY);
+		batch.vertex(edgeX, edgeY);
+		prevX = edgeX;
+		prevY = edgeY;
+	}
+}
+
+// --- Entity Colors ---
+
+float headlightBrightness(float darkness) {
+	return std::min(1.0f,std::max(0.0f,(darkness-0.5f)*2.0f)); // Start fading in after half dark
+}
+float lampBrightness(float darkness) {
+	return std::max(0.0f,std::min(1.0f,(darkness-0.4f)*(1.0f/0.5f))); // Fade in between darkness 0.4 and 0.9
+}
+VehicleColors vehicleColors(float darkness) {
+	VehicleColors c;
+	c.window=lerpColor({0.2f,0.2f,0.3f}, {0.1f,0.1f,0.1f},darkness*0.8f);
+	c.wheel=lerpColor({0.1f,0.1f,0.1f}, {0.05f,0.05f,0.05f},darkness);
+	c.hubcap=lerpColor({0.6f,0.6f,0.6f}, {0.3f,0.3f,0.3f},darkness);
+	c.headlightOff= {0.3f,0.3f,0.3f};
+	c.headlightOn= {1.0f,1.0f,0.7f};
+	return c;
+}
+Color vehicleBodyColor(const Vehicle& v, float darkness) {
+	return lerpColor(v.color, {v.color.r*0.4f,v.color.g*0.4f,v.color.b*0.4f},darkness);
+}
+Color pedestrianSkinColor(float darkness) {
+	return lerpColor({0.9f,0.7f,0.5f}, {0.5f,0.4f,0.3f},darkness);
+}
+Color pedestrianClothesColor(const Pedestrian& p, float darkness) {
+	return lerpColor(p.clothingColor, {p.clothingColor.r*0.4f,p.clothingColor.g*0.4f,p.clothingColor.b*0.4f},darkness);
+}
+float pedestrianAlpha(const Pedestrian& p, float darkness) {
+	if(p.state!=WALKING_SIDEWALK) return 1.0f;
+	// Start fading when darkness > 0.5, fully faded (alpha=0.1) when darkness = 1.0
+	return 1.0f - std::max(0.0f, std::min(1.0f, (darkness - 0.5f) * 2.0f)) * 0.9f;
+}
+Color darkenedColor(const Color& c, float darkness) {
+	return lerpColor(c, {c.r*0.3f,c.g*0.3f,c.b*0.3f},darkness);
+}
+Color streetLightPoleColor(float darkness) {
+	Color roadColorDay= {0.3f,0.3f,0.3f},roadColorNight= {0.1f,0.1f,0.1f};
+	return lerpColor(roadColorDay,roadColorNight,darkness);
+}
+Color streetLightLampColor(float darkness) {
+	Color lampColorOff= {0.2f,0.2f,0.2f},lampColorOn= {1.0f,0.95f,0.75f};
+	return lerpColor(lampColorOff,lampColorOn,lampBrightness(darkness));
+}
+
+// --- Entities ---
+
+void DrawVehicle(const Vehicle& v) { // *** Fading Headlights ***
+	float darkness=getDarknessFactor();
+	VehicleColors colors=vehicleColors(darkness);
+	sceneBatch.pushTransform();
+	sceneBatch.translate(v.x,v.y);
+	sceneBatch.setColor(vehicleBodyColor(v,darkness));
+	VehicleBodyShape(sceneBatch,v);
+	sceneBatch.setColor(colors.window);
+	VehicleWindowShape(sceneBatch,v);
+	sceneBatch.setColor(colors.wheel);
+	VehicleWheelShape(sceneBatch,v,1.0f);
+	sceneBatch.setColor(colors.hubcap);
+	VehicleWheelShape(sceneBatch,v,0.4f);
+	sceneBatch.setColor(lerpColor(colors.headlightOff,colors.headlightOn,headlightBrightness(darkness)));
+	VehicleHeadlightShape(sceneBatch,v);
+	sceneBatch.popTransform();
+}
+void DrawBird(const Bird& bird) {
+	/* ... Same ... */ float darkness=getDarknessFactor()*0.8f;
+	Color birdColor=lerpColor({0.1f,0.1f,0.1f}, {0.05f,0.05f,0.05f},darkness);
+	Color beakColor=lerpColor({1.0f,0.2f,0.1f}, {0.5f,0.1f,0.05f},darkness);
+	Color wingColor=lerpColor({0.9f,0.9f,0.9f}, {0.5f,0.5f,0.5f},darkness);
+	sceneBatch.pushTransform();
+	sceneBatch.translate(bird.x,bird.y);
+	sceneBatch.scale(0.8f,0.8f);
+	sceneBatch.setColor(birdColor.r,birdColor.g,birdColor.b);
+	Point outline[]= {{-15,0},{0,5},{10,3},{15,-2},{0,-5}};
+	sceneBatch.polygon(outline,5);
+	sceneBatch.setColor(beakColor.r,beakColor.g,beakColor.b);
+	sceneBatch.triangle(15,-2,22,0,15,1);
+	float wingYOffset=2.0f, wingTipY;
+	float phase=fmod(bird.flapPhase,2.0f*M_PI);
+	wingTipY=10.0f+5.0f*sin(phase);
+	sceneBatch.setColor(birdColor.r,birdColor.g,birdColor.b);
+	sceneBatch.triangle(-8,wingYOffset,8,wingYOffset,0,wingYOffset+wingTipY);
+	sceneBatch.setColor(wingColor.r,wingColor.g,wingColor.b);
+	sceneBatch.triangle(-3,wingYOffset+wingTipY*0.7f,3,wingYOffset+wingTipY*0.7f,0,wingYOffset+wingTipY);
+	sceneBatch.popTransform();
+}
+void DrawPedestrian(const Pedestrian& p) { // *** Use darknessFactor for fading alpha ***
+	float darkness=getDarknessFactor();
+	float alpha=pedestrianAlpha(p,darkness);
+	sceneBatch.pushTransform();
+	sceneBatch.translate(p.x,p.y);
+	sceneBatch.setColor(pedestrianSkinColor(darkness),alpha);
+	PedestrianHeadShape(sceneBatch);
+	sceneBatch.setColor(pedestrianClothesColor(p,darkness),alpha);
+	PedestrianBodyShape(sceneBatch,p.legPhase);
+	sceneBatch.popTransform();
+}
+void DrawTree(const Tree& tree) {
+	float darkness=getDarknessFactor();
+	sceneBatch.setColor(darkenedColor(tree.trunkColor,darkness));
+	TreeTrunkShape(sceneBatch,tree.pos,tree.scale);
+	sceneBatch.setColor(darkenedColor(tree.foliageColor,darkness));
+	TreeFoliageShape(sceneBatch,tree.pos,tree.scale);
+}
+void DrawStreetLight(const StreetLight& light) { // *** Simplified Glow ***
+	float darkness = getDarknessFactor();
+	StreetLightLayout layout=LayoutStreetLight(light);
+	Color poleColor=streetLightPoleColor(darkness);
+	sceneBatch.setColor(poleColor);
+	sceneBatch.pushTransform();
+	sceneBatch.translate(light.pos.x,light.pos.y);
+	StreetLightPoleShape(sceneBatch,light.height);
+	sceneBatch.popTransform();
+	sceneBatch.pushTransform();
+	sceneBatch.translate(light.pos.x,light.pos.y+light.height);
+	sceneBatch.rotate(layout.armAngle);
+	StreetLightArmShape(sceneBatch,layout.armLength);
+	sceneBatch.setColor(streetLightLampColor(darkness));
+	sceneBatch.pushTransform();
+	sceneBatch.translate(layout.lampX,layout.lampY);
+	StreetLightLampShape(sceneBatch);
+	sceneBatch.popTransform();
+	// Glow Effect (Fades with lamp brightness)
+	float brightness=lampBrightness(darkness);
+	if (brightness > 0.01f && !lightMap.available()) { // Only draw glow if lamp is somewhat on and the light map is not lighting it
+		sceneBatch.translate(layout.glowX,layout.glowY);
+		StreetLightGlowShape(sceneBatch,brightness);
+	}
+	sceneBatch.popTransform();
+}
+void DrawClouds(const Cloud& cloud) { // Takes a single cloud
+	// Cloud color with fading alpha
+	sceneBatch.setColor(1.0f, 1.0f, 1.0f, cloud.alpha); // Use cloud's alpha
+
+	sceneBatch.pushTransform();
+	sceneBatch.translate(cloud.pos.x, cloud.pos.y);
+	sceneBatch.scale(cloud.scale, cloud.scale);
+	for (int i = 0; i < cloud.numEllipses; ++i) {
+		float shapeChangeX=1.0f+0.05f*sin(cloud.shapePhase+i*0.8f);
+		float shapeChangeY=1.0f+0.05f*cos(cloud.shapePhase+i*1.1f);
+		DrawEllipse(cloud.ellipseOffsets[i].x, cloud.ellipseOffsets[i].y, cloud.ellipseRadiiX[i]*shapeChangeX, cloud.ellipseRadiiY[i]*shapeChangeY);
+	}
+	sceneBatch.popTransform();
+}
+
+// --- Scene ---
+
+void DrawBuilding(const LitBuilding& b) {
+	const PlacedBuilding& p=b.placed;
+	switch(p.kind) {
+	case BUILDING_SLAB:
+		DrawBuilding1(p.x, world.upperFootpathTopY, p.scale, &b.mask);
+		break;
+	case BUILDING_GLASS:
+		DrawBuilding2(p.x, world.upperFootpathTopY, p.scale, &b.mask);
+		break;
+	case BUILDING_TIERED:
+		DrawBuilding3(p.x, world.upperFootpathTopY, p.scale, &b.mask);
+		break;
+	default:
+		DrawControlTower(p.x, world.upperFootpathTopY, p.scale);
+		break;
+	}
+}
+
+void DrawStaticScenery() {
+	const std::vector<const CityChunk*>& chunks=cityChunks.inView();
+	DrawMountains();
+	for(const LitBuilding& b:windowLights.scenery()) DrawBuilding(b);
+	for(const CityChunk* chunk:chunks) {
+		for(const LitBuilding& b:chunk->buildings) DrawBuilding(b);
+	}
+	DrawFootpath();
+	if(instancedMeshes.begin()) {
+		for(const auto& sl:frame.streetLights) instancedMeshes.addStreetLight(sl);
+		for(const auto& t:frame.trees) instancedMeshes.addTree(t);
+		for(const CityChunk* chunk:chunks) {
+			for(const auto& sl:chunk->streetLights) instancedMeshes.addStreetLight(sl);
+			for(const auto& t:chunk->trees) instancedMeshes.addTree(t);
+		}
+		instancedMeshes.submit();
+	}
+	else {
+		for (const auto& sl : frame.streetLights) {
+			DrawStreetLight(sl);
+		}
+		for (const auto& t : frame.trees) {
+			DrawTree(t);
+		}
+		for(const CityChunk* chunk:chunks) {
+			for(const auto& sl:chunk->streetLights) DrawStreetLight(sl);
+			for(const auto& t:chunk->trees) DrawTree(t);
+		}
+	}
+	DrawRoad();
+}
+
+void DrawScene() {
+	bool night = isNightTime(frame.timeOfDay);
+	// Every layer uses the same blend state, so the whole scene goes out in one draw call
+	batchTarget->beginFrame();
+	{
+		PROFILE_ZONE("draw.sky");
+		DrawSkyAndSunMoon(frame.timeOfDay);
+	}
+	// The sky stays put; everything in front of it moves with the camera
+	sceneBatch.pushTransform();
+	camera.apply(sceneBatch);
+	{
+		PROFILE_ZONE("draw.clouds");
+		// Draw Clouds (with alpha)
+		for(const auto& cloud : frame.clouds) {
+			if (cloud.alpha > 0.01f) DrawClouds(cloud);    // Only draw if visible
+		}
+	}
+	{
+		PROFILE_ZONE("draw.scenery");
+		if(windowLights.update(frame.timeOfDay)) sceneryCache.invalidate();
+		sceneryCache.draw();
+	}
+	{
+		PROFILE_ZONE("draw.road");
+		DrawLaneMarkings();
+		DrawZebraCrossing();  // Drawn live so the zebra stays on top of the scrolling center line
+	}
+	{
+		PROFILE_ZONE("draw.vehicles");
+		if(instancedMeshes.begin()) {
+			for(size_t i=0; i<frame.vehicles.size(); ++i) {
+				if(frame.vehicleActive[i]) instancedMeshes.addVehicle(frame.vehicles[i]);
+			}
+			instancedMeshes.submit();
+		}
+		else {
+			for(size_t i=0; i<frame.vehicles.size(); ++i) {
+				if(frame.vehicleActive[i]) DrawVehicle(frame.vehicles[i]);
+			}
+		}
+		DrawTrafficLight(world.trafficLightX, world.upperFootpathBottomY, 1.0f);
+	}
+	{
+		PROFILE_ZONE("draw.pedestrians");
+		bool instanced=instancedMeshes.begin();
+		auto draw=[instanced](const Pedestrian& p) {
+			if(instanced) instancedMeshes.addPedestrian(p);
+			else DrawPedestrian(p);
+		};
+		for(const auto& p:frame.crossingPedestrians) {
+			if(p.state==CROSSING) draw(p);
+		}
+		for(const auto& p:frame.sidewalkPedestrians) {
+			draw(p);
+		}
+		for(const auto& p:frame.crossingPedestrians) {
+			if(p.state==WAITING_TO_CROSS || p.state==FINISHED_CROSSING) draw(p);
+		}
+		if(instanced) instancedMeshes.submit();
+	}
+	if(!night) {
+		PROFILE_ZONE("draw.birds");
+		for(const auto& bird:frame.birds) {
+			DrawBird(bird);    // Only draw birds if not night
+		}
+	}
+	sceneBatch.popTransform();
+	{
+		PROFILE_ZONE("draw.submit");
+		sceneBatch.flush();
+	}
+	{
+		PROFILE_ZONE("draw.lights");
+		lightMap.draw();
+	}
+	PROFILE_ZONE("draw.finish");
+	batchTarget->endFrame();
+}
@@ -0,0 +1,115 @@
+#ifndef RENDER_H_INCLUDED
+#define RENDER_H_INCLUDED
+
+#include <vector>
+#include "CityTypes.h"
+#include "CityWorld.h"
+#include "FrameState.h"
+#include "DrawBatch.h"
+#include "WindowLights.h"
+
+// --- Scene Drawing ---
+// Drawing of the street scene into the current GL context. Layout, trees and street lights
+// come from world, everything that moves from frame, and the viewport size from
+// windowWidth/windowHeight. Each program that draws defines these. The Draw* functions add
+// triangles to sceneBatch; nothing reaches GL until sceneBatch.flush(). DrawScene() sends
+// vehicles, pedestrians, trees and street lights through instancedMeshes instead when the
+// context can draw instanced. Everything but the sky is drawn through camera (Camera.h);
+// frame need only hold the entities in its view.
+extern int windowWidth;
+extern int windowHeight;
+extern CityWorld world;
+extern FrameState frame;
+extern DrawBatch sceneBatch;
+
+// Segment counts follow the on-screen size; see CircleSegments().
+void DrawEllipse(float cx, float cy, float rx, float ry);
+void DrawCircle(float cx, float cy, float r);
+float getDarknessFactor();
+
+void DrawSkyAndSunMoon(float time);
+void DrawMountains();
+void DrawFootpath();
+void DrawRoad();
+void DrawLaneMarkings();
+void DrawZebraCrossing();
+// Where DrawStaticScenery() puts the buildings, as fractions of the window width.
+const float BUILDING1_X = 0.1f;
+const float BUILDING2_X = 0.2f;
+const float BUILDING3_X = 0.45f;
+const float CONTROL_TOWER_X = 0.85f;
+// The windows DrawBuilding1/3 draw and the glass panes of DrawBuilding2, appended to out.
+void Building1Windows(float x, float y, float scale, std::vector<WindowRect>& out);
+void Building2Windows(float x, float y, float scale, std::vector<WindowRect>& out);
+void Building3Windows(float x, float y, float scale, std::vector<WindowRect>& out);
+// Whichever of the above b's kind has, for b standing on y; none for the control tower.
+void BuildingWindows(const PlacedBuilding& b, float y, std::vector<WindowRect>& out);
+// The buildings of the hand-placed scene, where DrawStaticScenery() draws them.
+void SceneryBuildings(std::vector<PlacedBuilding>& out);
+// Windows are lit where lit has their bit set (in the order Building*Windows() gives
+// them) and dark everywhere with no mask.
+void DrawBuilding1(float x, float y, float scale, const WindowMask* lit);
+void DrawBuilding2(float x, float y, float scale, const WindowMask* lit);
+void DrawBuilding3(float x, float y, float scale, const WindowMask* lit);
+void DrawControlTower(float x, float y, float scale);
+void DrawBuilding(const LitBuilding& b);  // On the upper footpath
+void DrawTrafficLight(float x, float y, float scale);
+void DrawVehicle(const Vehicle& v);
+void DrawBird(const Bird& bird);
+void DrawPedestrian(const Pedestrian& p);
+void DrawTree(const Tree& tree);
+void DrawStreetLight(const StreetLight& light);
+void DrawClouds(const Cloud& cloud);
+
+// --- Entity Shapes ---
+// The parts of each entity in drawing order, each in one color: the batch's current one,
+// except the glow, which sets its own. They are in the entity's own frame, origin at its
+// position, apart from the tree parts, which take the position and scale. The Draw*
+// functions above color and place them; InstancedMeshes builds its meshes from them.
+void VehicleBodyShape(DrawBatch& batch, const Vehicle& v);
+void VehicleWindowShape(DrawBatch& batch, const Vehicle& v);
+void VehicleWheelShape(DrawBatch& batch, const Vehicle& v, float radiusFactor);  // 0.4 gives the hubcaps
+void VehicleHeadlightShape(DrawBatch& batch, const Vehicle& v);
+void PedestrianHeadShape(DrawBatch& batch);
+void PedestrianBodyShape(DrawBatch& batch, float legPhase);
+void TreeTrunkShape(DrawBatch& batch, Point pos, float scale);
+void TreeFoliageShape(DrawBatch& batch, Point pos, float scale);
+
+const float STREETLIGHT_LAMP_HEIGHT = 4.0f;
+// Where a street light's parts go. The arm, lamp and glow are drawn in a frame at the pole
+// top rotated by armAngle; armLength is negative for lights whose arm points left.
+struct StreetLightLayout {
+	float armAngle, armLength;
+	float lampX, lampY;  // Lamp center in the arm's frame
+	float glowX, glowY;  // Glow center in the arm's frame
+};
+StreetLightLayout LayoutStreetLight(const StreetLight& light);
+void StreetLightPoleShape(DrawBatch& batch, float height);  // Base at the origin
+void StreetLightArmShape(DrawBatch& batch, float length);   // Along x from the origin
+void StreetLightLampShape(DrawBatch& batch);               // Centered on the origin
+void StreetLightGlowShape(DrawBatch& batch, float lampBrightness);
+
+// --- Entity Colors ---
+// How darkness tints each entity.
+struct VehicleColors {
+	Color window, wheel, hubcap;
+	Color headlightOff, headlightOn;  // Blended by headlightBrightness()
+};
+float headlightBrightness(float darkness);
+float lampBrightness(float darkness);
+VehicleColors vehicleColors(float darkness);
+Color vehicleBodyColor(const Vehicle& v, float darkness);
+Color pedestrianSkinColor(float darkness);
+Color pedestrianClothesColor(const Pedestrian& p, float darkness);
+float pedestrianAlpha(const Pedestrian& p, float darkness);
+Color darkenedColor(const Color& c, float darkness);  // Trunks and foliage
+Color streetLightPoleColor(float darkness);
+Color streetLightLampColor(float darkness);
+
+// Everything that only changes with darkness, night, the window lights and window size;
+// SceneryCache bakes it. Includes the streamed chunks in view (CityChunks.h).
+void DrawStaticScenery();
+// The whole scene, back to front. Expects a pixel-aligned orthographic projection.
+void DrawScene();
+
+#endif // RENDER_H_INCLUDED
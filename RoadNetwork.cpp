@@ -0,0 +1,431 @@
+#include "RoadNetwork.h"
+#include "Random.h"
+#include "Profiler.h"
+#include <cmath>
+#include <algorithm> // For std::min/max
+#include <limits>    // For numeric_limits
+
+// --- Stop Logic ---
+
+float StopLine(const StopZone& zone, int direction) {
+	return (direction>0)?zone.frontEdge-STOP_LINE_DISTANCE_BEFORE_CROSSING:zone.backEdge+STOP_LINE_DISTANCE_BEFORE_CROSSING;
+}
+
+float SignalSpeedLimit(const StopZone& zone, float x, float w, float speed, float baseSpeed, int direction) {
+	float relevantStopLine=StopLine(zone,direction);
+	float effectiveFrontX=(direction>0)?x+w:x;
+	bool shouldConsiderStopping=false;
+	if(zone.state!=GREEN) {
+		shouldConsiderStopping=true;
+	}
+	else {
+		float predictionSpeed=std::max(0.5f,baseSpeed);
+		float distanceToClearCrossing=(direction>0)?zone.backEdge-x:(x+w)-zone.frontEdge;
+		float timeToClear=(predictionSpeed>0.1f)?(fabs(distanceToClearCrossing)/predictionSpeed):9999.0f;
+		float decisionPoint=relevantStopLine-direction*predictionSpeed*60.0f;
+		if((timeToClear*CAR_TIME_PREDICTION_FACTOR>zone.remainingTimeInPhase && ((direction>0&&effectiveFrontX>decisionPoint)||(direction<0&&effectiveFrontX<decisionPoint))) || (zone.remainingTimeInPhase<40&&fabs(effectiveFrontX-relevantStopLine)<50.0f)) {
+			shouldConsiderStopping=true;
+		}
+	}
+	float maxSpeedTraffic=baseSpeed;
+	if(shouldConsiderStopping) {
+		float distToStop=fabs(relevantStopLine-effectiveFrontX);
+		bool isBeforeStopLine=(direction>0&&effectiveFrontX<relevantStopLine)||(direction<0&&effectiveFrontX>relevantStopLine);
+		if(!isBeforeStopLine&&fabs(effectiveFrontX-relevantStopLine)<10.0f) {
+			maxSpeedTraffic=0.0f;
+		}
+		else if(isBeforeStopLine) {
+			float brakeFactor=std::max(0.0f,std::min(1.0f,distToStop/100.0f));
+			maxSpeedTraffic=std::min(maxSpeedTraffic,baseSpeed*brakeFactor*brakeFactor);
+			maxSpeedTraffic=std::max(0.0f,maxSpeedTraffic);
+		}
+		else {
+			if(speed<0.1f) maxSpeedTraffic=0.0f;
+		}
+		bool frontNearCrossing=(direction>0&&effectiveFrontX+w>=zone.frontEdge-2.0f)||(direction<0&&effectiveFrontX<=zone.backEdge+2.0f);
+		bool rearBeforeCrossing=(direction>0&&x<zone.backEdge)||(direction<0&&x+w>zone.frontEdge);
+		if(isBeforeStopLine&&frontNearCrossing&&rearBeforeCrossing) {
+			maxSpeedTraffic = std::min(maxSpeedTraffic, 0.0f);
+		}
+	}
+	return maxSpeedTraffic;
+}
+
+float FollowingSpeedLimit(float gap, float speed, float baseSpeed, float aheadSpeed) {
+	float maxSpeedAhead=baseSpeed*1.5f;
+	float safeDist=CAR_MIN_SAFE_DISTANCE+speed*5.0f;
+	if(gap<safeDist) {
+		if(gap<CAR_MIN_SAFE_DISTANCE) {
+			maxSpeedAhead=std::min(aheadSpeed*0.8f,speed*0.5f);
+		}
+		else {
+			maxSpeedAhead=aheadSpeed;
+		}
+		maxSpeedAhead=std::max(0.0f,maxSpeedAhead);
+	}
+	return maxSpeedAhead;
+}
+
+// --- Crosswalk Occupancy ---
+
+void CrosswalkOccupancy::addExtent(float begin, float end) {
+	begin=std::max(begin,frontEdge);
+	end=std::min(end,backEdge);
+	if(begin>=end) return;
+	size_t first=0;
+	while(first<extents.size()&&extents[first].end<begin) first++;
+	size_t last=first;
+	while(last<extents.size()&&extents[last].begin<=end) {
+		begin=std::min(begin,extents[last].begin);
+		end=std::max(end,extents[last].end);
+		last++;
+	}
+	extents.erase(extents.begin()+first,extents.begin()+last);
+	extents.insert(extents.begin()+first,{begin,end});
+}
+
+void AddLaneOccupancy(CrosswalkOccupancy& occupancy, const VehicleStore& vs, const int* order, size_t count, int direction) {
+	// Only vehicles with x in (frontEdge-MAX_VEHICLE_WIDTH, backEdge) can overlap. Along the lane
+	// x runs downwards when direction>0 and upwards otherwise; find where that window starts.
+	float lowX=occupancy.frontEdge-MAX_VEHICLE_WIDTH, highX=occupancy.backEdge;
+	size_t lo=0, hi=count;
+	while(lo<hi) {
+		size_t mid=(lo+hi)/2;
+		float x=vs.x[order?order[mid]:mid];
+		if(direction>0?x>=highX:x<=lowX) lo=mid+1;
+		else hi=mid;
+	}
+	for(size_t r=lo; r<count; ++r) {
+		size_t i=order?order[r]:r;
+		float x=vs.x[i];
+		if(direction>0?x<=lowX:x>=highX) break;
+		occupancy.addExtent(x,x+vs.width[i]);
+	}
+}
+
+// --- Network ---
+
+const float NETWORK_BOX_HALF = 20.0f;        // Half the intersection box, where segments overlap
+const float NETWORK_CROSSWALK_WIDTH = 40.0f;
+const float NETWORK_CROSSING_LENGTH = 30.0f;  // Kerb to kerb across one lane
+
+RoadNetwork::RoadNetwork() : signalClock(0), seed(1), tick(0) {
+	pool.reset(new ThreadPool(1));
+}
+
+void RoadNetwork::setThreadCount(int threads) {
+	pool.reset(new ThreadPool(threads));
+}
+
+size_t RoadNetwork::pedestriansCrossing() const {
+	size_t n=0;
+	for(const auto& cw:crosswalks) n+=cw.occupancy.crossing;
+	return n;
+}
+
+size_t RoadNetwork::vehicleCount() const {
+	size_t n=0;
+	for(const auto& seg:segments) n+=seg.vehicles.size();
+	return n;
+}
+
+Point RoadNetwork::worldPosition(const RoadSegment& seg, float s) const {
+	return {seg.start.x+seg.heading.x*s, seg.start.y+seg.heading.y*s};
+}
+
+// Intersections on a rows x cols grid, each joined to its neighbours by a segment in
+// both directions. East-west and north-south approaches get opposite signal phases.
+void RoadNetwork::buildGrid(int rows, int cols, float spacing) {
+	intersections.clear();
+	segments.clear();
+	pedestrians.clear();
+	signals.clear();
+	signalClock=0;
+	// East-west runs green, yellow, then red while north-south has its green and yellow;
+	// north-south runs the same plan half a cycle behind.
+	SignalPlan plan;
+	plan.phases= {{GREEN,GREEN_DURATION},{YELLOW,YELLOW_DURATION},{RED,GREEN_DURATION+YELLOW_DURATION}};
+	int planId=signals.addPlan(plan);
+	crosswalks.clear();
+	for(int r=0; r<rows; ++r) {
+		for(int c=0; c<cols; ++c) {
+			Intersection in;
+			in.pos= {c*spacing, r*spacing};
+			in.signals[0]=signals.addController(planId,0);
+			in.signals[1]=signals.addController(planId,GREEN_DURATION+YELLOW_DURATION);
+			intersections.push_back(in);
+		}
+	}
+	auto connect=[&](int a,int b,int axis) {
+		RoadSegment seg;
+		seg.from=a;
+		seg.to=b;
+		seg.axis=axis;
+		seg.start=intersections[a].pos;
+		float dx=intersections[b].pos.x-seg.start.x, dy=intersections[b].pos.y-seg.start.y;
+		seg.length=sqrtf(dx*dx+dy*dy);
+		seg.heading= {dx/seg.length, dy/seg.length};
+		seg.entryGap=seg.length;
+		Crosswalk cw;
+		cw.segment=(int)segments.size();
+		cw.signal=intersections[b].signals[axis];
+		cw.occupancy.backEdge=seg.length-NETWORK_BOX_HALF;
+		cw.occupancy.frontEdge=cw.occupancy.backEdge-NETWORK_CROSSWALK_WIDTH;
+		cw.occupancy.crossing=0;
+		cw.occupancy.waiting=0;
+		cw.firstPedestrian=0;
+		cw.pedestrianCount=0;
+		seg.crosswalk=(int)crosswalks.size();
+		crosswalks.push_back(cw);
+		intersections[a].outgoing.push_back((int)segments.size());
+		segments.push_back(seg);
+	};
+	for(int r=0; r<rows; ++r) {
+		for(int c=0; c<cols; ++c) {
+			int id=r*cols+c;
+			if(c+1<cols) {
+				connect(id,id+1,0);
+				connect(id+1,id,0);
+			}
+			if(r+1<rows) {
+				connect(id,id+cols,1);
+				connect(id+cols,id,1);
+			}
+		}
+	}
+}
+
+// Straight on is twice as likely as a turn; U-turns only at dead ends.
+int RoadNetwork::chooseNext(int segment, unsigned vehicle) const {
+	const RoadSegment& seg=segments[segment];
+	const std::vector<int>& out=intersections[seg.to].outgoing;
+	int options[8], weights[8], total=0, n=0;
+	for(int o:out) {
+		if(segments[o].to==seg.from) continue;
+		options[n]=o;
+		weights[n]=(segments[o].axis==seg.axis)?2:1;
+		total+=weights[n++];
+	}
+	if(n==0) {
+		for(int o:out) {
+			if(segments[o].to==seg.from) return o;
+		}
+		return -1;
+	}
+	RandomStream rng(seed,vehicle,tick,STREAM_ROUTE);
+	int pick=randInt(rng,total);
+	for(int i=0; i<n; ++i) {
+		if(pick<weights[i]) return options[i];
+		pick-=weights[i];
+	}
+	return options[n-1];
+}
+
+// A front vehicle that is held back by a full next segment picks another exit that has room,
+// which keeps rings of full segments around a block from locking up.
+int RoadNetwork::reroute(int segment, int current, float needed) const {
+	const RoadSegment& seg=segments[segment];
+	for(int o:intersections[seg.to].outgoing) {
+		if(o==current||segments[o].to==seg.from) continue;
+		if(segments[o].entryGap>=needed) return o;
+	}
+	return current;
+}
+
+int RoadNetwork::populate(int count) {
+	for(auto& seg:segments) {
+		seg.vehicles.clear();
+		seg.nextSegment.clear();
+	}
+	tick=0;
+	if(segments.empty()) return 0;
+	// Fill segments round-robin from their downstream end, one car length plus a gap apart.
+	std::vector<float> tail(segments.size());
+	for(size_t s=0; s<segments.size(); ++s) tail[s]=segments[s].length-NETWORK_BOX_HALF-NETWORK_CROSSWALK_WIDTH-STOP_LINE_DISTANCE_BEFORE_CROSSING;
+	size_t s=0, misses=0;
+	unsigned attempt=0;
+	int placed=0;
+	for(; placed<count&&misses<segments.size(); s=(s+1)%segments.size(), attempt++) {
+		RoadSegment& seg=segments[s];
+		RandomStream rng(seed,attempt,0,STREAM_SETUP_VEHICLE);
+		Vehicle v=RandomVehicle(rng);
+		v.id=placed;
+		v.x=tail[s]-v.width;
+		if(v.x<NETWORK_BOX_HALF) {
+			misses++;
+			continue;
+		}
+		misses=0;
+		tail[s]=v.x-CAR_MIN_SAFE_DISTANCE*2.0f;
+		v.y=0;
+		v.direction=1;
+		v.speed=v.baseSpeed*randFloat(rng,0.5f,1.0f);
+		seg.vehicles.add(v);
+		seg.nextSegment.push_back(chooseNext((int)s,v.id));
+		placed++;
+	}
+	return placed;
+}
+
+void RoadNetwork::populatePedestrians(int count) {
+	pedestrians.clear();
+	if(crosswalks.empty()) return;
+	pedestrians.reserve(count);
+	for(size_t c=0; c<crosswalks.size(); ++c) {
+		Crosswalk& cw=crosswalks[c];
+		cw.firstPedestrian=pedestrians.size();
+		cw.pedestrianCount=count/crosswalks.size()+(c<count%crosswalks.size()?1:0);
+		cw.occupancy.crossing=0;
+		cw.occupancy.waiting=(int)cw.pedestrianCount;
+		for(size_t i=0; i<cw.pedestrianCount; ++i) {
+			RandomStream rng(seed,(uint32_t)pedestrians.size(),0,STREAM_SETUP_CROSSING);
+			Pedestrian p;
+			p.crosswalk=(int)c;
+			p.onUpperPath=(i%2==0);
+			p.y=p.onUpperPath?0.0f:NETWORK_CROSSING_LENGTH;
+			p.targetY=p.onUpperPath?NETWORK_CROSSING_LENGTH:0.0f;
+			p.x=0;
+			p.speed=randFloat(rng,0.5f,0.8f);
+			p.state=WAITING_TO_CROSS;
+			p.legPhase=0;
+			p.legSpeed=0;
+			p.clothingColor=randomColor(rng);
+			pedestrians.push_back(p);
+		}
+	}
+}
+
+// The street scene's crossing rules for one crosswalk's crowd: wait for red and a clear
+// crosswalk (at most MAX_CROSSING_PEDESTRIANS at once), cross, then wait for the next red.
+void RoadNetwork::updatePedestrians(Crosswalk& cw, float k) {
+	if(cw.pedestrianCount==0) return;
+	LightState state=signals.state(cw.signal);
+	CrosswalkOccupancy& occ=cw.occupancy;
+	int finished=0;
+	for(size_t i=cw.firstPedestrian; i<cw.firstPedestrian+cw.pedestrianCount; ++i) {
+		Pedestrian& p=pedestrians[i];
+		switch(p.state) {
+		case WAITING_TO_CROSS:
+			if(state==RED&&occ.admits()) {
+				p.state=CROSSING;
+				occ.crossing++;
+				occ.waiting--;
+			}
+			break;
+		case CROSSING:
+			p.y=moveTowards(p.y,p.targetY,p.speed*k);
+			if(fabs(p.y-p.targetY)<1.0f) {
+				p.state=FINISHED_CROSSING;
+				p.y=p.targetY;
+				finished++;
+			}
+			break;
+		case FINISHED_CROSSING:
+			if(state!=RED) {
+				p.state=WAITING_TO_CROSS;
+				p.onUpperPath=!p.onUpperPath;
+				p.targetY=p.onUpperPath?NETWORK_CROSSING_LENGTH:0.0f;
+				occ.waiting++;
+			}
+			break;
+		case WALKING_SIDEWALK:
+			break;
+		}
+	}
+	occ.crossing-=finished;
+}
+
+// Speed limits and integration for one segment, then the occupancy of its crosswalk. Reads
+// the tick-start state of this segment and of the entry gap of the next ones, writes only
+// this segment and its crosswalk.
+void RoadNetwork::updateSegment(RoadSegment& seg, float k) {
+	VehicleStore& vs=seg.vehicles;
+	size_t n=vs.size();
+	if(seg.crosswalk>=0) crosswalks[seg.crosswalk].occupancy.clear();
+	if(n==0) return;
+	StopZone zone= {0, 0, GREEN, 0};
+	if(seg.crosswalk>=0) {
+		const Crosswalk& cw=crosswalks[seg.crosswalk];
+		zone= {cw.occupancy.frontEdge, cw.occupancy.backEdge, signals.state(cw.signal), signals.remaining(cw.signal,signalClock)};
+	}
+	for(size_t i=0; i<n; ++i) {
+		float x=vs.x[i], w=vs.width[i], speed=vs.speed[i], baseSpeed=vs.baseSpeed[i];
+		float limit=baseSpeed;
+		if(seg.crosswalk>=0) limit=SignalSpeedLimit(zone,x,w,speed,baseSpeed,1);
+		float gap=std::numeric_limits<float>::max(), aheadSpeed=0;
+		if(i>0) {
+			gap=vs.x[i-1]-(x+w);
+			aheadSpeed=vs.speed[i-1];
+		}
+		else if(seg.nextSegment[i]>=0) {
+			// Spillback: the car ahead is the tail of the segment we are about to enter.
+			gap=(seg.length-(x+w))+segments[seg.nextSegment[i]].entryGap;
+			if(gap<CAR_MIN_SAFE_DISTANCE+speed*5.0f) aheadSpeed=0;
+		}
+		vs.speedLimit[i]=std::min(limit,FollowingSpeedLimit(gap,speed,baseSpeed,aheadSpeed));
+	}
+	IntegrateVehicles(vs.x.data(),vs.speed.data(),vs.baseSpeed.data(),vs.speedLimit.data(),vs.direction.data(),
+	                  vs.nextX.data(),vs.nextSpeed.data(),n,CAR_ACCELERATION,CAR_DECELERATION,k);
+	vs.swapBuffers();
+	if(seg.crosswalk>=0) AddLaneOccupancy(crosswalks[seg.crosswalk].occupancy,vs,nullptr,n,1);
+}
+
+// Moves vehicles that passed the downstream end onto their next segment. Runs serially in
+// segment order so the outcome does not depend on the thread count.
+void RoadNetwork::transferVehicles() {
+	for(size_t s=0; s<segments.size(); ++s) {
+		RoadSegment& seg=segments[s];
+		size_t leaving=0;
+		while(leaving<seg.vehicles.size()&&seg.vehicles.x[leaving]>=seg.length&&seg.nextSegment[leaving]>=0) {
+			RoadSegment& next=segments[seg.nextSegment[leaving]];
+			Vehicle v=seg.vehicles.get(leaving);
+			v.x-=seg.length;
+			if(!next.vehicles.empty()) {
+				size_t last=next.vehicles.size()-1;
+				if(v.x+v.width>next.vehicles.x[last]) break; // No room yet: hold at the end of this segment
+			}
+			next.vehicles.add(v);
+			next.nextSegment.push_back(chooseNext(seg.nextSegment[leaving],v.id));
+			leaving++;
+		}
+		if(leaving>0) {
+			seg.vehicles.erase(0,leaving);
+			seg.nextSegment.erase(seg.nextSegment.begin(),seg.nextSegment.begin()+leaving);
+		}
+		if(!seg.vehicles.empty()&&seg.vehicles.speed[0]<0.1f&&seg.nextSegment[0]>=0) {
+			float needed=seg.vehicles.width[0]+CAR_MIN_SAFE_DISTANCE*2.0f;
+			if(segments[seg.nextSegment[0]].entryGap<needed) seg.nextSegment[0]=reroute((int)s,seg.nextSegment[0],needed);
+		}
+		for(size_t i=0; i<seg.vehicles.size()&&seg.vehicles.x[i]+seg.vehicles.width[i]>seg.length; ++i) {
+			if(seg.vehicles.x[i]>=seg.length) {
+				seg.vehicles.x[i]=seg.length;
+				seg.vehicles.speed[i]=0;
+			}
+		}
+	}
+}
+
+void RoadNetwork::step(float dt) {
+	PROFILE_ZONE("net.step");
+	float k=dt/SIM_TICK_SECONDS;
+	{
+		PROFILE_ZONE("net.signals");
+		signalClock+=k;
+		signals.advanceTo((uint64_t)signalClock);
+	}
+	for(auto& seg:segments) {
+		seg.entryGap=seg.vehicles.empty()?seg.length:seg.vehicles.x[seg.vehicles.size()-1];
+	}
+	pool->parallelFor(segments.size(),256,[&](size_t b,size_t e) {
+		PROFILE_ZONE("net.segments");
+		for(size_t s=b; s<e; ++s) {
+			updateSegment(segments[s],k);
+			if(segments[s].crosswalk>=0) updatePedestrians(crosswalks[segments[s].crosswalk],k);
+		}
+	});
+	{
+		PROFILE_ZONE("net.transfer");
+		transferVehicles();
+	}
+	tick++;
+}
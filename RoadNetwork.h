@@ -0,0 +1,124 @@
+#ifndef ROADNETWORK_H_INCLUDED
+#define ROADNETWORK_H_INCLUDED
+
+#include <vector>
+#include <memory>
+#include <cstddef>
+#include <cstdint>
+#include "CityTypes.h"
+#include "VehicleStore.h"
+#include "ThreadPool.h"
+#include "SignalControl.h"
+
+// --- Stop Logic ---
+// A crossing on a lane and the signal guarding it, in the lane's own coordinates.
+// This is the single-road stop line / zebra crossing generalised to any approach.
+struct StopZone {
+	float frontEdge;             // Crossing extent along the lane
+	float backEdge;
+	LightState state;
+	float remainingTimeInPhase;  // Ticks left in the current phase
+};
+float StopLine(const StopZone& zone, int direction);
+// Highest speed the signal allows a vehicle occupying [x, x+w] moving in direction.
+float SignalSpeedLimit(const StopZone& zone, float x, float w, float speed, float baseSpeed, int direction);
+// Highest speed that keeps a safe gap to the vehicle ahead. Callers with no vehicle ahead
+// pass std::numeric_limits<float>::max() as the gap.
+float FollowingSpeedLimit(float gap, float speed, float baseSpeed, float aheadSpeed);
+
+// --- Crosswalk Occupancy ---
+// Vehicle extents over one crosswalk, clipped and merged into sorted disjoint intervals.
+// It is rebuilt once per tick after vehicles move, so admitting a pedestrian is a
+// constant-time check instead of a scan over every vehicle.
+struct Extent {
+	float begin, end;
+};
+struct CrosswalkOccupancy {
+	float frontEdge;
+	float backEdge;
+	std::vector<Extent> extents;
+	int crossing;  // Pedestrians on the crosswalk now
+	int waiting;   // Pedestrians at either kerb
+	void clear() {
+		extents.clear();
+	}
+	bool blocked() const {
+		return !extents.empty();
+	}
+	bool admits() const {
+		return crossing<MAX_CROSSING_PEDESTRIANS&&extents.empty();
+	}
+	// Adds the vehicle span [begin, end); spans that miss the crosswalk are ignored.
+	void addExtent(float begin, float end);
+};
+// Adds the vehicles of one lane that overlap the crosswalk. The lane is vs indices order[0..count)
+// (or 0..count when order is null) sorted by descending x*direction, so the overlapping run is
+// found by binary search rather than by scanning the lane.
+void AddLaneOccupancy(CrosswalkOccupancy& occupancy, const VehicleStore& vs, const int* order, size_t count, int direction);
+
+// --- Network ---
+struct Crosswalk {
+	int segment;        // Segment whose traffic it crosses
+	int signal;         // Controller in RoadNetwork::signals
+	CrosswalkOccupancy occupancy;  // Extent along that segment and what is on it
+	size_t firstPedestrian;        // This crosswalk's run of RoadNetwork::pedestrians
+	size_t pedestrianCount;
+};
+struct Intersection {
+	Point pos;
+	int signals[2];                // Controllers for [0] east-west approaches, [1] north-south
+	std::vector<int> outgoing;
+};
+// One lane between two intersections. Positions run from 0 at the upstream
+// intersection to length at the downstream one, so every segment travels in +x.
+struct RoadSegment {
+	int from, to;
+	int axis;                      // 0 east-west, 1 north-south; picks the signal group at `to`
+	Point start;
+	Point heading;                 // Unit vector from start towards `to`
+	float length;
+	int crosswalk;                 // Crosswalk before the downstream intersection, -1 for none
+	VehicleStore vehicles;         // Front first: index 0 is nearest the downstream end
+	std::vector<int> nextSegment;  // Route choice for each vehicle, parallel to vehicles
+	float entryGap;                // Free space behind the last vehicle at the start of the tick
+};
+
+// A grid of signalised intersections joined by one-lane segments each way.
+// Each tick updates segments independently (in parallel), then moves vehicles
+// that crossed their downstream intersection onto their next segment.
+class RoadNetwork {
+public:
+	RoadNetwork();
+
+	void buildGrid(int rows, int cols, float spacing);
+	// Places up to count vehicles, round-robin from each segment's downstream end, until
+	// every segment is full. Returns the number placed.
+	int populate(int count);
+	// Spreads count pedestrians evenly over the crosswalks, all waiting at a kerb.
+	void populatePedestrians(int count);
+	void step(float dt);
+	void setThreadCount(int threads);
+	size_t vehicleCount() const;
+	size_t pedestriansCrossing() const;
+	Point worldPosition(const RoadSegment& seg, float s) const;
+
+	std::vector<Intersection> intersections;
+	std::vector<RoadSegment> segments;
+	SignalSystem signals;
+	double signalClock;  // Simulated time in ticks; signals run to its whole part
+	std::vector<Crosswalk> crosswalks;
+	std::vector<Pedestrian> pedestrians;  // Grouped by crosswalk; y runs across the road
+	uint64_t seed;  // Keys vehicle setup and route choice (see Random.h)
+	uint64_t tick;
+
+private:
+	int chooseNext(int segment, unsigned vehicle) const;
+	int reroute(int segment, int current, float needed) const;
+	void updateSegment(RoadSegment& seg, float k);
+	void updatePedestrians(Crosswalk& cw, float k);
+	void transferVehicles();
+
+	std::unique_ptr<ThreadPool> pool;
+};
+
+#endif // ROADNETWORK_H_INCLUDED
@@ -0,0 +1,131 @@
+#include "GLExtensions.h"
+#include <cmath>
+#include <algorithm>
+#include <cstring>
+#include "SceneryCache.h"
+#include "Render.h"
+#include "Profiler.h"
+#include "InstancedMeshes.h"
+
+SceneryCache sceneryCache;
+
+SceneryCache::SceneryCache() : darknessQuantum(SCENERY_DARKNESS_QUANTUM), bakes(0), checked(false), supported(false), valid(false),
+	framebuffer(0), texture(0), width(0), height(0), bakedDarkness(0.0f), bakedNight(false), bakedTransform(), bottomRow(0.0f), topRow(0.0f) {}
+
+// Looks the extensions up on first use (a context is current by then) and sizes the
+// texture to the window.
+bool SceneryCache::prepare() {
+	if(!checked) {
+		checked=true;
+		supported=LoadFramebufferObjects();
+		if(supported) {
+			glGenTextures(1,&texture);
+			glGenFramebuffers(1,&framebuffer);
+		}
+	}
+	if(!supported) return false;
+	if(width!=windowWidth||height!=windowHeight) {
+		width=windowWidth;
+		height=windowHeight;
+		glBindTexture(GL_TEXTURE_2D,texture);
+		glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MIN_FILTER,GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_NEAREST);
+		glTexImage2D(GL_TEXTURE_2D,0,GL_RGBA8,width,height,0,GL_RGBA,GL_UNSIGNED_BYTE,nullptr);
+		GLint previous=0;
+		glGetIntegerv(GL_FRAMEBUFFER_BINDING,&previous);
+		glBindFramebuffer(GL_FRAMEBUFFER,framebuffer);
+		glFramebufferTexture2D(GL_FRAMEBUFFER,GL_COLOR_ATTACHMENT0,GL_TEXTURE_2D,texture,0);
+		supported=glCheckFramebufferStatus(GL_FRAMEBUFFER)==GL_FRAMEBUFFER_COMPLETE;
+		glBindFramebuffer(GL_FRAMEBUFFER,previous);
+		valid=false;
+	}
+	return supported;
+}
+
+// Draws the backdrop into the texture as premultiplied color and alpha, so compositing it
+// with (ONE, ONE_MINUS_SRC_ALPHA) gives what drawing it straight onto the sky would.
+void SceneryCache::bake(float darkness, bool night) {
+	PROFILE_ZONE("draw.scenery_bake");
+	GLint previous=0;
+	glGetIntegerv(GL_FRAMEBUFFER_BINDING,&previous);
+	GLfloat clearColor[4];
+	glGetFloatv(GL_COLOR_CLEAR_VALUE,clearColor);
+	glBindFramebuffer(GL_FRAMEBUFFER,framebuffer);
+	glClearColor(0.0f,0.0f,0.0f,0.0f);
+	glClear(GL_COLOR_BUFFER_BIT);
+	glClearColor(clearColor[0],clearColor[1],clearColor[2],clearColor[3]);
+	glBlendFuncSeparate(GL_SRC_ALPHA,GL_ONE_MINUS_SRC_ALPHA,GL_ONE,GL_ONE_MINUS_SRC_ALPHA);
+	sceneBatch.beginRows();
+	instancedMeshes.beginRows();
+	DrawStaticScenery();
+	float instancedBottom, instancedTop;
+	bool drawn=sceneBatch.endRows(bottomRow,topRow);
+	if(instancedMeshes.endRows(instancedBottom,instancedTop)) {
+		bottomRow=drawn ? std::min(bottomRow,instancedBottom) : instancedBottom;
+		topRow=drawn ? std::max(topRow,instancedTop) : instancedTop;
+		drawn=true;
+	}
+	if(drawn) {
+		bottomRow=std::max(0.0f,floorf(bottomRow));
+		topRow=std::min((float)height,ceilf(topRow));
+	}
+	else {
+		bottomRow=topRow=0.0f;
+	}
+	sceneBatch.flush();
+	glBlendFunc(GL_SRC_ALPHA,GL_ONE_MINUS_SRC_ALPHA);
+	glBindFramebuffer(GL_FRAMEBUFFER,previous);
+	bakedDarkness=darkness;
+	bakedNight=night;
+	bakedTransform=sceneBatch.currentTransform();
+	valid=true;
+	bakes++;
+}
+
+// The footpaths and the road cover every pixel of the rows below the upper footpath's top
+// edge, so those rows are copied without blending; only the rows above need it.
+void SceneryCache::composite() {
+	if(topRow<=bottomRow) return;
+	const BatchTransform& t=bakedTransform;
+	float opaqueRow=std::max(bottomRow,std::min(topRow,floorf(t.d*world.upperFootpathTopY+t.ty)));
+	float rows[3]= {bottomRow,opaqueRow,topRow};
+	float corners[16], texCoords[16];
+	for(int band=0; band<2; ++band) {
+		float y0=rows[band], y1=rows[band+1], v0=y0/height, v1=y1/height;
+		float c[8]= {0.0f,y0,(float)width,y0,(float)width,y1,0.0f,y1};
+		float t[8]= {0.0f,v0,1.0f,v0,1.0f,v1,0.0f,v1};
+		std::copy(c,c+8,corners+band*8);
+		std::copy(t,t+8,texCoords+band*8);
+	}
+	glEnable(GL_TEXTURE_2D);
+	glBindTexture(GL_TEXTURE_2D,texture);
+	glColor4f(1.0f,1.0f,1.0f,1.0f);
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+	glVertexPointer(2,GL_FLOAT,0,corners);
+	glTexCoordPointer(2,GL_FLOAT,0,texCoords);
+	glDisable(GL_BLEND);
+	if(opaqueRow>bottomRow) glDrawArrays(GL_TRIANGLE_FAN,0,4);
+	glEnable(GL_BLEND);
+	glBlendFunc(GL_ONE,GL_ONE_MINUS_SRC_ALPHA);
+	if(topRow>opaqueRow) glDrawArrays(GL_TRIANGLE_FAN,4,4);
+	glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+	glDisableClientState(GL_VERTEX_ARRAY);
+	glBlendFunc(GL_SRC_ALPHA,GL_ONE_MINUS_SRC_ALPHA);
+	glDisable(GL_TEXTURE_2D);
+}
+
+void SceneryCache::draw() {
+	if(darknessQuantum<=0.0f||!batchTarget->isGL()||!prepare()) {
+		DrawStaticScenery();
+		return;
+	}
+	float darkness=getDarknessFactor();
+	bool night=isNightTime(frame.timeOfDay);
+	// Full day and full night are held for long stretches, so reach them exactly
+	bool atEnd=(darkness==0.0f||darkness==1.0f)&&darkness!=bakedDarkness;
+	bool moved=memcmp(&sceneBatch.currentTransform(),&bakedTransform,sizeof(BatchTransform))!=0;
+	sceneBatch.flush();
+	if(!valid||moved||night!=bakedNight||atEnd||fabs(darkness-bakedDarkness)>=darknessQuantum) bake(darkness,night);
+	composite();
+}
@@ -0,0 +1,51 @@
+#ifndef SCENERYCACHE_H_INCLUDED
+#define SCENERYCACHE_H_INCLUDED
+
+#include "DrawBatch.h"
+
+// --- Static Scenery Cache ---
+// The backdrop (mountains, buildings, control tower, footpaths, street lights, trees, road
+// surface) only changes with the darkness factor, the night window lights, the window size
+// and the camera. It is baked once into a texture through a framebuffer object and
+// composited each frame over the rows it covers. The bake is redone when darkness has moved
+// darknessQuantum away from the baked value, when night starts or ends, when the window
+// size or the camera (sceneBatch's transform) changes, or after invalidate(). Without framebuffer objects, with a quantum of 0, or
+// when batchTarget is not GL, the backdrop is drawn directly every frame instead.
+const float SCENERY_DARKNESS_QUANTUM = 1.0f / 64.0f;
+
+class SceneryCache {
+public:
+	SceneryCache();
+
+	// Draws the backdrop into the scene. Whatever sceneBatch holds so far (the sky and the
+	// clouds) is flushed first, since it lies behind.
+	void draw();
+	// Forces a bake on the next draw(); call after the world's layout changes.
+	void invalidate() {
+		valid=false;
+	}
+
+	float darknessQuantum;
+	long long bakes;  // For the stats overlay
+
+private:
+	bool prepare();
+	void bake(float darkness, bool night);
+	void composite();
+
+	bool checked;    // prepare() ran: the extensions were looked up
+	bool supported;
+	bool valid;
+	unsigned framebuffer;
+	unsigned texture;
+	int width;
+	int height;
+	float bakedDarkness;
+	bool bakedNight;
+	BatchTransform bakedTransform;  // The camera the bake was drawn with
+	float bottomRow, topRow;  // Rows the backdrop covers; the composite skips the empty sky above
+};
+
+extern SceneryCache sceneryCache;
+
+#endif // SCENERYCACHE_H_INCLUDED
@@ -0,0 +1,125 @@
+#include "SignalControl.h"
+
+// --- Timing Wheel ---
+
+TimingWheel::TimingWheel() : current(0) {
+}
+
+void TimingWheel::clear() {
+	for(int l=0; l<LEVELS; ++l) {
+		for(int s=0; s<SLOTS; ++s) slots[l][s].clear();
+	}
+	current=0;
+}
+
+void TimingWheel::reset(uint64_t now) {
+	clear();
+	current=now;
+}
+
+// Files a timer at the lowest level whose span still reaches its due tick. Timers beyond
+// the top level's span wait in its furthest slot and are re-filed when it cascades.
+void TimingWheel::place(const Timer& t) {
+	uint64_t delta=t.due-current;
+	for(int l=0; l<LEVELS; ++l) {
+		if(delta<((uint64_t)1<<(SLOT_BITS*(l+1)))||l==LEVELS-1) {
+			uint64_t slot=(t.due>>(SLOT_BITS*l))&(SLOTS-1);
+			if(l==LEVELS-1&&delta>=((uint64_t)1<<(SLOT_BITS*LEVELS))) slot=((current>>(SLOT_BITS*l))-1)&(SLOTS-1);
+			slots[l][slot].push_back(t);
+			return;
+		}
+	}
+}
+
+void TimingWheel::schedule(int id, uint64_t due) {
+	if(due<=current) due=current+1;
+	place({id,due});
+}
+
+// Re-files the level's slot for the current tick one or more levels down.
+void TimingWheel::cascade(int level) {
+	std::vector<Timer>& slot=slots[level][(current>>(SLOT_BITS*level))&(SLOTS-1)];
+	std::vector<Timer> moving;
+	moving.swap(slot);
+	for(const Timer& t:moving) place(t);
+}
+
+void TimingWheel::tick(std::vector<int>& fired) {
+	current++;
+	for(int l=1; l<LEVELS; ++l) {
+		if(((current>>(SLOT_BITS*(l-1)))&(SLOTS-1))!=0) break;
+		cascade(l);
+	}
+	std::vector<Timer>& slot=slots[0][current&(SLOTS-1)];
+	for(const Timer& t:slot) fired.push_back(t.id);
+	slot.clear();
+}
+
+// --- Signal Controllers ---
+
+int SignalPlan::cycleLength() const {
+	int total=0;
+	for(const auto& p:phases) total+=p.duration;
+	return total;
+}
+
+SignalSystem::SignalSystem() : phaseChanges(0) {
+}
+
+void SignalSystem::clear() {
+	plans.clear();
+	controllers.clear();
+	wheel.clear();
+	phaseChanges=0;
+}
+
+int SignalSystem::addPlan(const SignalPlan& plan) {
+	plans.push_back(plan);
+	return (int)plans.size()-1;
+}
+
+int SignalSystem::addController(int plan, int offset) {
+	const SignalPlan& p=plans[plan];
+	int cycle=p.cycleLength();
+	int into=cycle>0?((offset%cycle)+cycle)%cycle:0;
+	SignalController c;
+	c.plan=plan;
+	c.phase=0;
+	while(into>=p.phases[c.phase].duration) {
+		into-=p.phases[c.phase].duration;
+		c.phase++;
+	}
+	c.state=p.phases[c.phase].state;
+	c.phaseEnd=wheel.now()+(p.phases[c.phase].duration-into);
+	controllers.push_back(c);
+	wheel.schedule((int)controllers.size()-1,c.phaseEnd);
+	return (int)controllers.size()-1;
+}
+
+void SignalSystem::advanceTo(uint64_t tick) {
+	while(wheel.now()<tick) {
+		fired.clear();
+		wheel.tick(fired);
+		for(int id:fired) {
+			SignalController& c=controllers[id];
+			const SignalPlan& p=plans[c.plan];
+			c.phase=(c.phase+1)%(int)p.phases.size();
+			c.state=p.phases[c.phase].state;
+			c.phaseEnd=wheel.now()+p.phases[c.phase].duration;
+			wheel.schedule(id,c.phaseEnd);
+		}
+		phaseChanges+=fired.size();
+	}
+}
+
+void SignalSystem::restore(uint64_t now) {
+	wheel.reset(now);
+	for(size_t c=0; c<controllers.size(); ++c) wheel.schedule((int)c,controllers[c].phaseEnd);
+	phaseChanges=0;
+}
+
+SignalPlan DefaultSignalPlan() {
+	SignalPlan plan;
+	plan.phases= {{GREEN,GREEN_DURATION},{YELLOW,YELLOW_DURATION},{RED,RED_DURATION}};
+	return plan;
+}
@@ -0,0 +1,96 @@
+#ifndef SIGNALCONTROL_H_INCLUDED
+#define SIGNALCONTROL_H_INCLUDED
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include "CityTypes.h"
+
+// --- Timing Wheel ---
+// Hierarchical wheel of 256-slot levels (Varghese & Lauck). Level 0 holds timers due
+// within 256 ticks, one slot per tick; each higher level covers 256 times the span of
+// the one below and is cascaded down a level whenever the level beneath wraps. Advancing
+// one tick costs O(1) plus the timers that fire, however many are pending.
+class TimingWheel {
+public:
+	TimingWheel();
+	void clear();
+	// Empties the wheel and sets its clock, for re-filing timers restored from a snapshot.
+	void reset(uint64_t now);
+	uint64_t now() const {
+		return current;
+	}
+	// Schedules id for tick due; anything not in the future fires on the next tick.
+	void schedule(int id, uint64_t due);
+	// Moves the wheel forward one tick and appends the ids due on it to fired.
+	void tick(std::vector<int>& fired);
+
+private:
+	static const int LEVELS = 4;
+	static const int SLOT_BITS = 8;
+	static const int SLOTS = 1 << SLOT_BITS;
+	struct Timer {
+		int id;
+		uint64_t due;
+	};
+	void place(const Timer& t);
+	void cascade(int level);
+
+	std::vector<Timer> slots[LEVELS][SLOTS];
+	uint64_t current;
+};
+
+// --- Signal Controllers ---
+// A plan is a cycle of phases; a controller runs a plan from an offset into its cycle.
+// Controllers only do work when the wheel says their phase ends, so idle signals cost
+// nothing per tick. All times are in simulation ticks.
+struct SignalPhase {
+	LightState state;
+	int duration;
+};
+struct SignalPlan {
+	std::vector<SignalPhase> phases;
+	int cycleLength() const;
+};
+struct SignalController {
+	int plan;
+	int phase;          // Index into the plan's phases
+	LightState state;
+	uint64_t phaseEnd;  // Tick the current phase hands over to the next
+};
+
+class SignalSystem {
+public:
+	SignalSystem();
+	void clear();
+	int addPlan(const SignalPlan& plan);
+	// offset is how far into the plan's cycle the controller is at the current tick.
+	int addController(int plan, int offset);
+	// Runs the wheel up to tick, switching every controller whose phase ends on the way.
+	void advanceTo(uint64_t tick);
+	// Re-files every controller's phase end after plans/controllers were loaded wholesale.
+	void restore(uint64_t now);
+	LightState state(int controller) const {
+		return controllers[controller].state;
+	}
+	// Ticks left in the controller's current phase at time (a fractional tick count).
+	float remaining(int controller, double time) const {
+		return (float)((double)controllers[controller].phaseEnd-time);
+	}
+	size_t size() const {
+		return controllers.size();
+	}
+
+	std::vector<SignalPlan> plans;
+	std::vector<SignalController> controllers;
+	size_t phaseChanges;  // Controllers touched since construction/clear (for tuning)
+
+private:
+	TimingWheel wheel;
+	std::vector<int> fired;
+};
+
+// The single-road plan: green, yellow, red with the legacy durations.
+SignalPlan DefaultSignalPlan();
+
+#endif // SIGNALCONTROL_H_INCLUDED
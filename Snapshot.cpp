@@ -0,0 +1,602 @@
+#include "Snapshot.h"
+#include "Profiler.h"
+#include <cstring>
+#include <cmath>
+#include <cstdio>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// --- File Layout ---
+
+enum SnapshotSectionId {
+	SECTION_VEHICLE_X,
+	SECTION_VEHICLE_SPEED,
+	SECTION_VEHICLE_BASE_SPEED,
+	SECTION_VEHICLE_WIDTH,
+	SECTION_VEHICLE_DIRECTION,
+	SECTION_VEHICLE_SPEED_LIMIT,
+	SECTION_VEHICLE_Y,
+	SECTION_VEHICLE_HEIGHT,
+	SECTION_VEHICLE_COLOR,
+	SECTION_VEHICLE_TYPE,
+	SECTION_VEHICLE_ID,
+	SECTION_VEHICLE_ACTIVE,
+	SECTION_FREE_SLOTS,
+	SECTION_LANES,
+	SECTION_LANE_ORDER,
+	SECTION_BIRDS,
+	SECTION_SIDEWALK_PEDESTRIANS,
+	SECTION_CROSSING_PEDESTRIANS,
+	SECTION_CLOUDS,
+	SECTION_CLOUD_OFFSETS,
+	SECTION_CLOUD_RADII_X,
+	SECTION_CLOUD_RADII_Y,
+	SECTION_TREES,
+	SECTION_STREETLIGHTS,
+	SECTION_SIGNAL_PLANS,
+	SECTION_SIGNAL_PHASES,
+	SECTION_SIGNAL_CONTROLLERS,
+	SECTION_COUNT
+};
+
+// Layout is fixed at construction, so a snapshot carries it rather than the window size.
+static float CityWorld::* const LAYOUT_FIELDS[] = {
+	&CityWorld::trafficLightX, &CityWorld::zebraCrossingX, &CityWorld::zebraCrossingWidth,
+	&CityWorld::crossingFrontEdge, &CityWorld::crossingBackEdge, &CityWorld::roadTopY,
+	&CityWorld::roadBottomY, &CityWorld::footpathHeight, &CityWorld::upperFootpathBottomY,
+	&CityWorld::upperFootpathTopY, &CityWorld::lowerFootpathTopY, &CityWorld::lowerFootpathBottomY,
+	&CityWorld::upperSidewalkLevelY, &CityWorld::lowerSidewalkLevelY, &CityWorld::crossingStartY,
+	&CityWorld::crossingEndY, &CityWorld::crossingWalkX, &CityWorld::laneY1,
+	&CityWorld::laneY2, &CityWorld::birdBaseY, &CityWorld::birdAmplitudeY,
+};
+static const int LAYOUT_FIELD_COUNT = sizeof(LAYOUT_FIELDS)/sizeof(LAYOUT_FIELDS[0]);
+
+struct SnapshotScalars {
+	int32_t width, height;
+	int32_t numVehicles, numCrossingPedestrians;
+	float timeOfDay, timeSpeed;
+	int32_t trafficLightState, mainSignal;
+	double tickClock;
+	uint64_t seed, tick;
+	uint64_t activeVehicles;
+	uint32_t nextVehicleId;
+	float laneDemand;
+	int32_t pedestriansCrossing, pedestriansWaiting;
+	float layout[LAYOUT_FIELD_COUNT];
+};
+
+struct SnapshotHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t sectionCount;
+	SnapshotScalars world;
+};
+
+struct SnapshotSection {
+	uint32_t id;
+	uint32_t elementSize;
+	uint64_t offset;  // From the start of the file
+	uint64_t count;
+};
+
+static const char SNAPSHOT_MAGIC[8] = {'A','C','S','N','A','P','\0','\0'};
+static const size_t SNAPSHOT_ALIGN = 16;
+
+// Clouds, lanes and plans hold vectors, so they are stored as fixed records indexing
+// into flat arrays of their contents.
+struct CloudRecord {
+	Point pos;
+	float speed, scale, shapePhase, alpha;
+	int32_t numEllipses;
+	uint32_t firstEllipse;
+};
+struct LaneRecord {
+	float y;
+	int32_t direction;
+	uint64_t firstOrder, orderCount;
+	ArrivalQueue arrivals;
+};
+struct PlanRecord {
+	uint32_t firstPhase, phaseCount;
+};
+
+// --- Writing ---
+
+namespace {
+struct SectionSource {
+	uint32_t id;
+	uint32_t elementSize;
+	const void* data;
+	uint64_t count;
+};
+
+template<class T> SectionSource Source(uint32_t id, const std::vector<T>& v) {
+	return {id, (uint32_t)sizeof(T), v.data(), (uint64_t)v.size()};
+}
+
+size_t AlignUp(size_t n) {
+	return (n+SNAPSHOT_ALIGN-1)&~(SNAPSHOT_ALIGN-1);
+}
+
+// Copies records field by field into zeroed storage, so whatever padding they have is
+// written as 0 and the same state always gives the same file.
+template<class T, class Fields> void ZeroPadded(const std::vector<T>& in, std::vector<T>& out, Fields fields) {
+	out.resize(in.size());
+	if(!out.empty()) memset((void*)out.data(),0,out.size()*sizeof(T));
+	for(size_t i=0; i<in.size(); ++i) fields(out[i],in[i]);
+}
+
+void CopyPedestrian(Pedestrian& to, const Pedestrian& from) {
+	to.x=from.x;
+	to.y=from.y;
+	to.speed=from.speed;
+	to.targetY=from.targetY;
+	to.legPhase=from.legPhase;
+	to.legSpeed=from.legSpeed;
+	to.state=from.state;
+	to.clothingColor=from.clothingColor;
+	to.onUpperPath=from.onUpperPath;
+	to.crosswalk=from.crosswalk;
+}
+}
+
+void SerializeSnapshot(const CityWorld& world, std::vector<char>& out) {
+	SnapshotHeader header;
+	memset(&header,0,sizeof(header));
+	memcpy(header.magic,SNAPSHOT_MAGIC,sizeof(header.magic));
+	header.version=SNAPSHOT_VERSION;
+	header.sectionCount=SECTION_COUNT;
+	SnapshotScalars& s=header.world;
+	s.width=world.width;
+	s.height=world.height;
+	s.numVehicles=world.numVehicles;
+	s.numCrossingPedestrians=world.numCrossingPedestrians;
+	s.timeOfDay=world.timeOfDay;
+	s.timeSpeed=world.timeSpeed;
+	s.trafficLightState=world.trafficLightState;
+	s.mainSignal=world.mainSignal;
+	s.tickClock=world.tickClock;
+	s.seed=world.seed;
+	s.tick=world.tick;
+	s.activeVehicles=world.activeVehicles;
+	s.nextVehicleId=world.nextVehicleId;
+	s.laneDemand=world.laneDemand;
+	s.pedestriansCrossing=world.crosswalk.crossing;
+	s.pedestriansWaiting=world.crosswalk.waiting;
+	for(int f=0; f<LAYOUT_FIELD_COUNT; ++f) s.layout[f]=world.*LAYOUT_FIELDS[f];
+
+	std::vector<CloudRecord> clouds;
+	std::vector<Point> cloudOffsets;
+	std::vector<float> cloudRadiiX, cloudRadiiY;
+	for(const auto& c:world.clouds) {
+		clouds.push_back({c.pos,c.speed,c.scale,c.shapePhase,c.alpha,c.numEllipses,(uint32_t)cloudOffsets.size()});
+		cloudOffsets.insert(cloudOffsets.end(),c.ellipseOffsets.begin(),c.ellipseOffsets.end());
+		cloudRadiiX.insert(cloudRadiiX.end(),c.ellipseRadiiX.begin(),c.ellipseRadiiX.end());
+		cloudRadiiY.insert(cloudRadiiY.end(),c.ellipseRadiiY.begin(),c.ellipseRadiiY.end());
+	}
+	std::vector<LaneRecord> lanes;
+	size_t orderTotal=0;
+	for(const auto& l:world.lanes) orderTotal+=l.order.size();
+	std::vector<int> laneOrder;
+	laneOrder.reserve(orderTotal);
+	lanes.resize(world.lanes.size());
+	if(!lanes.empty()) memset((void*)lanes.data(),0,lanes.size()*sizeof(LaneRecord));
+	for(size_t i=0; i<world.lanes.size(); ++i) {
+		const Lane& l=world.lanes[i];
+		LaneRecord& r=lanes[i];
+		r.y=l.y;
+		r.direction=l.direction;
+		r.firstOrder=laneOrder.size();
+		r.orderCount=l.order.size();
+		r.arrivals.nextArrival=l.arrivals.nextArrival;
+		r.arrivals.draws=l.arrivals.draws;
+		r.arrivals.pending=l.arrivals.pending;
+		r.arrivals.spawned=l.arrivals.spawned;
+		r.arrivals.dropped=l.arrivals.dropped;
+		laneOrder.insert(laneOrder.end(),l.order.begin(),l.order.end());
+	}
+	std::vector<Pedestrian> sidewalk, crossing;
+	ZeroPadded(world.sidewalkPedestrians,sidewalk,CopyPedestrian);
+	ZeroPadded(world.crossingPedestrians,crossing,CopyPedestrian);
+	std::vector<StreetLight> streetLights;
+	ZeroPadded(world.streetLights,streetLights,[](StreetLight& to, const StreetLight& from) {
+		to.pos=from.pos;
+		to.height=from.height;
+		to.armLength=from.armLength;
+		to.onUpper=from.onUpper;
+	});
+	std::vector<SignalController> controllers;
+	ZeroPadded(world.signals.controllers,controllers,[](SignalController& to, const SignalController& from) {
+		to.plan=from.plan;
+		to.phase=from.phase;
+		to.state=from.state;
+		to.phaseEnd=from.phaseEnd;
+	});
+	std::vector<PlanRecord> plans;
+	std::vector<SignalPhase> phases;
+	for(const auto& p:world.signals.plans) {
+		plans.push_back({(uint32_t)phases.size(),(uint32_t)p.phases.size()});
+		phases.insert(phases.end(),p.phases.begin(),p.phases.end());
+	}
+
+	const VehicleStore& vs=world.vehicles;
+	SectionSource sources[SECTION_COUNT]= {
+		Source(SECTION_VEHICLE_X,vs.x),
+		Source(SECTION_VEHICLE_SPEED,vs.speed),
+		Source(SECTION_VEHICLE_BASE_SPEED,vs.baseSpeed),
+		Source(SECTION_VEHICLE_WIDTH,vs.width),
+		Source(SECTION_VEHICLE_DIRECTION,vs.direction),
+		Source(SECTION_VEHICLE_SPEED_LIMIT,vs.speedLimit),
+		Source(SECTION_VEHICLE_Y,vs.y),
+		Source(SECTION_VEHICLE_HEIGHT,vs.height),
+		Source(SECTION_VEHICLE_COLOR,vs.color),
+		Source(SECTION_VEHICLE_TYPE,vs.type),
+		Source(SECTION_VEHICLE_ID,vs.id),
+		Source(SECTION_VEHICLE_ACTIVE,vs.active),
+		Source(SECTION_FREE_SLOTS,world.freeSlots),
+		Source(SECTION_LANES,lanes),
+		Source(SECTION_LANE_ORDER,laneOrder),
+		Source(SECTION_BIRDS,world.birds),
+		Source(SECTION_SIDEWALK_PEDESTRIANS,sidewalk),
+		Source(SECTION_CROSSING_PEDESTRIANS,crossing),
+		Source(SECTION_CLOUDS,clouds),
+		Source(SECTION_CLOUD_OFFSETS,cloudOffsets),
+		Source(SECTION_CLOUD_RADII_X,cloudRadiiX),
+		Source(SECTION_CLOUD_RADII_Y,cloudRadiiY),
+		Source(SECTION_TREES,world.trees),
+		Source(SECTION_STREETLIGHTS,streetLights),
+		Source(SECTION_SIGNAL_PLANS,plans),
+		Source(SECTION_SIGNAL_PHASES,phases),
+		Source(SECTION_SIGNAL_CONTROLLERS,controllers),
+	};
+
+	SnapshotSection table[SECTION_COUNT];
+	size_t offset=AlignUp(sizeof(SnapshotHeader)+sizeof(table));
+	for(int i=0; i<SECTION_COUNT; ++i) {
+		table[i]= {sources[i].id,sources[i].elementSize,(uint64_t)offset,sources[i].count};
+		offset=AlignUp(offset+sources[i].elementSize*sources[i].count);
+	}
+	out.assign(offset,0);
+	memcpy(out.data(),&header,sizeof(header));
+	memcpy(out.data()+sizeof(header),table,sizeof(table));
+	for(int i=0; i<SECTION_COUNT; ++i) {
+		if(sources[i].count) memcpy(out.data()+table[i].offset,sources[i].data,sources[i].elementSize*sources[i].count);
+	}
+}
+
+static bool WriteFile(const std::vector<char>& bytes, const std::string& path, std::string& error) {
+	std::string temp=path+".tmp";
+	FILE* f=fopen(temp.c_str(),"wb");
+	if(!f) {
+		error="cannot open "+temp+" for writing";
+		return false;
+	}
+	bool ok=fwrite(bytes.data(),1,bytes.size(),f)==bytes.size();
+	ok=(fclose(f)==0)&&ok;
+	if(!ok) {
+		error="short write to "+temp;
+		remove(temp.c_str());
+		return false;
+	}
+#ifdef _WIN32
+	remove(path.c_str()); // rename() does not replace an existing file on Windows
+#endif
+	if(rename(temp.c_str(),path.c_str())!=0) {
+		error="cannot rename "+temp+" to "+path;
+		return false;
+	}
+	return true;
+}
+
+bool SaveSnapshot(const CityWorld& world, const std::string& path, std::string& error) {
+	std::vector<char> bytes;
+	SerializeSnapshot(world,bytes);
+	return WriteFile(bytes,path,error);
+}
+
+// --- Loading ---
+
+namespace {
+// Read-only view of a whole file, mapped rather than read.
+struct MappedFile {
+	const char* data;
+	size_t size;
+#ifdef _WIN32
+	HANDLE file, mapping;
+#endif
+
+	MappedFile() : data(nullptr), size(0) {
+#ifdef _WIN32
+		file=INVALID_HANDLE_VALUE;
+		mapping=nullptr;
+#endif
+	}
+	~MappedFile() {
+#ifdef _WIN32
+		if(data) UnmapViewOfFile(data);
+		if(mapping) CloseHandle(mapping);
+		if(file!=INVALID_HANDLE_VALUE) CloseHandle(file);
+#else
+		if(data) munmap((void*)data,size);
+#endif
+	}
+	bool open(const std::string& path) {
+#ifdef _WIN32
+		file=CreateFileA(path.c_str(),GENERIC_READ,FILE_SHARE_READ,nullptr,OPEN_EXISTING,FILE_ATTRIBUTE_NORMAL,nullptr);
+		if(file==INVALID_HANDLE_VALUE) return false;
+		LARGE_INTEGER length;
+		if(!GetFileSizeEx(file,&length)||length.QuadPart==0) return false;
+		size=(size_t)length.QuadPart;
+		mapping=CreateFileMappingA(file,nullptr,PAGE_READONLY,0,0,nullptr);
+		if(!mapping) return false;
+		data=(const char*)MapViewOfFile(mapping,FILE_MAP_READ,0,0,0);
+		return data!=nullptr;
+#else
+		int fd=::open(path.c_str(),O_RDONLY);
+		if(fd<0) return false;
+		struct stat st;
+		if(fstat(fd,&st)!=0||st.st_size==0) {
+			::close(fd);
+			return false;
+		}
+		size=(size_t)st.st_size;
+		void* p=mmap(nullptr,size,PROT_READ,MAP_PRIVATE,fd,0);
+		::close(fd);
+		if(p==MAP_FAILED) return false;
+		data=(const char*)p;
+		return true;
+#endif
+	}
+};
+
+struct SnapshotView {
+	const MappedFile& file;
+	const SnapshotSection* table;
+
+	template<class T> bool read(uint32_t id, std::vector<T>& out) const {
+		const SnapshotSection& s=table[id];
+		if(s.id!=id||s.elementSize!=sizeof(T)) return false;
+		if(s.offset>file.size||s.count>(file.size-s.offset)/sizeof(T)) return false;
+		const T* first=reinterpret_cast<const T*>(file.data+s.offset);
+		out.assign(first,first+s.count);
+		return true;
+	}
+};
+}
+
+bool LoadSnapshot(const std::string& path, CityWorld& world, std::string& error) {
+	MappedFile file;
+	if(!file.open(path)) {
+		error="cannot map "+path;
+		return false;
+	}
+	if(file.size<sizeof(SnapshotHeader)+SECTION_COUNT*sizeof(SnapshotSection)) {
+		error=path+" is too short to be a snapshot";
+		return false;
+	}
+	SnapshotHeader header;
+	memcpy(&header,file.data,sizeof(header));
+	if(memcmp(header.magic,SNAPSHOT_MAGIC,sizeof(header.magic))!=0) {
+		error=path+" is not a snapshot";
+		return false;
+	}
+	if(header.version!=SNAPSHOT_VERSION||header.sectionCount!=SECTION_COUNT) {
+		error=path+" was written by an incompatible version";
+		return false;
+	}
+	SnapshotView view= {file,reinterpret_cast<const SnapshotSection*>(file.data+sizeof(SnapshotHeader))};
+
+	// Read everything into temporaries first so a bad file leaves the world untouched.
+	VehicleStore vs;
+	std::vector<int> freeSlots, laneOrder;
+	std::vector<LaneRecord> lanes;
+	std::vector<Bird> birds;
+	std::vector<Pedestrian> sidewalk, crossing;
+	std::vector<CloudRecord> clouds;
+	std::vector<Point> cloudOffsets;
+	std::vector<float> cloudRadiiX, cloudRadiiY;
+	std::vector<Tree> trees;
+	std::vector<StreetLight> streetLights;
+	std::vector<PlanRecord> plans;
+	std::vector<SignalPhase> phases;
+	std::vector<SignalController> controllers;
+	bool ok=view.read(SECTION_VEHICLE_X,vs.x)&&view.read(SECTION_VEHICLE_SPEED,vs.speed)&&
+	        view.read(SECTION_VEHICLE_BASE_SPEED,vs.baseSpeed)&&view.read(SECTION_VEHICLE_WIDTH,vs.width)&&
+	        view.read(SECTION_VEHICLE_DIRECTION,vs.direction)&&view.read(SECTION_VEHICLE_SPEED_LIMIT,vs.speedLimit)&&
+	        view.read(SECTION_VEHICLE_Y,vs.y)&&view.read(SECTION_VEHICLE_HEIGHT,vs.height)&&
+	        view.read(SECTION_VEHICLE_COLOR,vs.color)&&view.read(SECTION_VEHICLE_TYPE,vs.type)&&
+	        view.read(SECTION_VEHICLE_ID,vs.id)&&view.read(SECTION_VEHICLE_ACTIVE,vs.active)&&
+	        view.read(SECTION_FREE_SLOTS,freeSlots)&&view.read(SECTION_LANES,lanes)&&
+	        view.read(SECTION_LANE_ORDER,laneOrder)&&view.read(SECTION_BIRDS,birds)&&
+	        view.read(SECTION_SIDEWALK_PEDESTRIANS,sidewalk)&&view.read(SECTION_CROSSING_PEDESTRIANS,crossing)&&
+	        view.read(SECTION_CLOUDS,clouds)&&view.read(SECTION_CLOUD_OFFSETS,cloudOffsets)&&
+	        view.read(SECTION_CLOUD_RADII_X,cloudRadiiX)&&view.read(SECTION_CLOUD_RADII_Y,cloudRadiiY)&&
+	        view.read(SECTION_TREES,trees)&&view.read(SECTION_STREETLIGHTS,streetLights)&&
+	        view.read(SECTION_SIGNAL_PLANS,plans)&&view.read(SECTION_SIGNAL_PHASES,phases)&&
+	        view.read(SECTION_SIGNAL_CONTROLLERS,controllers);
+	size_t n=vs.x.size();
+	ok=ok&&vs.speed.size()==n&&vs.baseSpeed.size()==n&&vs.width.size()==n&&vs.direction.size()==n&&
+	   vs.speedLimit.size()==n&&vs.y.size()==n&&vs.height.size()==n&&vs.color.size()==n&&
+	   vs.type.size()==n&&vs.id.size()==n&&vs.active.size()==n;
+	for(const auto& l:lanes) ok=ok&&l.firstOrder<=laneOrder.size()&&l.orderCount<=laneOrder.size()-l.firstOrder;
+	for(int i:laneOrder) ok=ok&&i>=0&&(size_t)i<n;
+	// Each listed vehicle must be active, listed once, and in the lane its y and direction put it
+	if(ok) {
+		std::vector<char> listed(n,0);
+		for(const auto& l:lanes) {
+			for(uint64_t k=l.firstOrder; ok&&k<l.firstOrder+l.orderCount; ++k) {
+				int i=laneOrder[k];
+				ok=vs.active[i]&&!listed[i]&&fabs(l.y-vs.y[i])<5.0f&&l.direction==(int)vs.direction[i];
+				listed[i]=1;
+			}
+		}
+	}
+	for(int i:freeSlots) ok=ok&&i>=0&&(size_t)i<n&&!vs.active[i];
+	for(const auto& c:clouds) ok=ok&&c.numEllipses>=0&&c.firstEllipse+(size_t)c.numEllipses<=cloudOffsets.size()&&
+		                             cloudOffsets.size()==cloudRadiiX.size()&&cloudOffsets.size()==cloudRadiiY.size();
+	for(const auto& p:plans) ok=ok&&p.phaseCount>0&&(size_t)p.firstPhase+p.phaseCount<=phases.size();
+	for(const auto& p:phases) ok=ok&&p.duration>0;
+	for(const auto& c:controllers) ok=ok&&c.plan>=0&&(size_t)c.plan<plans.size()&&c.phase>=0&&(uint32_t)c.phase<plans[c.plan].phaseCount;
+	const SnapshotScalars& s=header.world;
+	ok=ok&&s.mainSignal>=0&&(size_t)s.mainSignal<controllers.size();
+	if(!ok) {
+		error=path+" is damaged";
+		return false;
+	}
+
+	world.width=s.width;
+	world.height=s.height;
+	world.numVehicles=s.numVehicles;
+	world.numCrossingPedestrians=s.numCrossingPedestrians;
+	world.timeOfDay=s.timeOfDay;
+	world.timeSpeed=s.timeSpeed;
+	world.trafficLightState=(LightState)s.trafficLightState;
+	world.mainSignal=s.mainSignal;
+	world.tickClock=s.tickClock;
+	world.seed=s.seed;
+	world.tick=s.tick;
+	world.activeVehicles=(size_t)s.activeVehicles;
+	world.nextVehicleId=s.nextVehicleId;
+	world.laneDemand=s.laneDemand;
+	for(int f=0; f<LAYOUT_FIELD_COUNT; ++f) world.*LAYOUT_FIELDS[f]=s.layout[f];
+
+	vs.nextX=vs.x;
+	vs.nextSpeed=vs.speed;
+	world.vehicles.x.swap(vs.x);
+	world.vehicles.speed.swap(vs.speed);
+	world.vehicles.baseSpeed.swap(vs.baseSpeed);
+	world.vehicles.width.swap(vs.width);
+	world.vehicles.direction.swap(vs.direction);
+	world.vehicles.speedLimit.swap(vs.speedLimit);
+	world.vehicles.nextX.swap(vs.nextX);
+	world.vehicles.nextSpeed.swap(vs.nextSpeed);
+	world.vehicles.y.swap(vs.y);
+	world.vehicles.height.swap(vs.height);
+	world.vehicles.color.swap(vs.color);
+	world.vehicles.type.swap(vs.type);
+	world.vehicles.id.swap(vs.id);
+	world.vehicles.active.swap(vs.active);
+	world.freeSlots.swap(freeSlots);
+	world.lanes.resize(lanes.size());
+	for(size_t l=0; l<lanes.size(); ++l) {
+		Lane& lane=world.lanes[l];
+		lane.y=lanes[l].y;
+		lane.direction=lanes[l].direction;
+		lane.arrivals=lanes[l].arrivals;
+		lane.order.assign(laneOrder.begin()+lanes[l].firstOrder,laneOrder.begin()+lanes[l].firstOrder+lanes[l].orderCount);
+	}
+	world.birds.swap(birds);
+	world.sidewalkPedestrians.swap(sidewalk);
+	world.crossingPedestrians.swap(crossing);
+	world.clouds.resize(clouds.size());
+	for(size_t i=0; i<clouds.size(); ++i) {
+		const CloudRecord& r=clouds[i];
+		Cloud& c=world.clouds[i];
+		c.pos=r.pos;
+		c.speed=r.speed;
+		c.scale=r.scale;
+		c.shapePhase=r.shapePhase;
+		c.alpha=r.alpha;
+		c.numEllipses=r.numEllipses;
+		c.ellipseOffsets.assign(cloudOffsets.begin()+r.firstEllipse,cloudOffsets.begin()+r.firstEllipse+r.numEllipses);
+		c.ellipseRadiiX.assign(cloudRadiiX.begin()+r.firstEllipse,cloudRadiiX.begin()+r.firstEllipse+r.numEllipses);
+		c.ellipseRadiiY.assign(cloudRadiiY.begin()+r.firstEllipse,cloudRadiiY.begin()+r.firstEllipse+r.numEllipses);
+	}
+	world.trees.swap(trees);
+	world.streetLights.swap(streetLights);
+	world.signals.plans.resize(plans.size());
+	for(size_t p=0; p<plans.size(); ++p) {
+		world.signals.plans[p].phases.assign(phases.begin()+plans[p].firstPhase,phases.begin()+plans[p].firstPhase+plans[p].phaseCount);
+	}
+	world.signals.controllers.swap(controllers);
+	world.signals.restore((uint64_t)world.tickClock);
+
+	world.despawned.clear();
+	world.spawned.clear();
+	world.leaving.clear();
+	world.laneChunks.clear();
+	world.crosswalk.frontEdge=world.crossingFrontEdge;
+	world.crosswalk.backEdge=world.crossingBackEdge;
+	world.crosswalk.crossing=s.pedestriansCrossing;
+	world.crosswalk.waiting=s.pedestriansWaiting;
+	world.updateCrosswalkOccupancy();
+	return true;
+}
+
+// --- Background Writer ---
+
+SnapshotWriter::SnapshotWriter() : hasPending(false), busy(false), stopping(false), written(0) {
+	writer=std::thread(&SnapshotWriter::writerLoop,this);
+}
+
+SnapshotWriter::~SnapshotWriter() {
+	flush();
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		stopping=true;
+	}
+	wake.notify_all();
+	writer.join();
+}
+
+void SnapshotWriter::save(const CityWorld& world, const std::string& path) {
+	SerializeSnapshot(world,staging);
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		pending.swap(staging);
+		pendingPath=path;
+		hasPending=true;
+	}
+	wake.notify_all();
+}
+
+void SnapshotWriter::flush() {
+	std::unique_lock<std::mutex> guard(lock);
+	idle.wait(guard,[this] {
+		return !hasPending&&!busy;
+	});
+}
+
+std::string SnapshotWriter::lastError() {
+	std::lock_guard<std::mutex> guard(lock);
+	return error;
+}
+
+size_t SnapshotWriter::writtenCount() {
+	std::lock_guard<std::mutex> guard(lock);
+	return written;
+}
+
+void SnapshotWriter::writerLoop() {
+	SetProfileThreadName("snapshot writer");
+	std::unique_lock<std::mutex> guard(lock);
+	for(;;) {
+		wake.wait(guard,[this] {
+			return stopping||hasPending;
+		});
+		if(!hasPending) return;
+		writing.swap(pending);
+		std::string path=pendingPath;
+		hasPending=false;
+		busy=true;
+		guard.unlock();
+		std::string writeError;
+		bool ok;
+		{
+			PROFILE_ZONE("snapshot.write");
+			ok=WriteFile(writing,path,writeError);
+		}
+		guard.lock();
+		busy=false;
+		if(ok) written++;
+		error=ok?std::string():writeError;
+		idle.notify_all();
+	}
+}
@@ -0,0 +1,59 @@
+#ifndef SNAPSHOT_H_INCLUDED
+#define SNAPSHOT_H_INCLUDED
+
+#include <vector>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+#include "CityWorld.h"
+
+// --- World Snapshots ---
+// A flat binary file: a fixed header with the world's scalar state, a section table, then
+// each section's array bytes exactly as they sit in memory (16-byte aligned). Every section
+// records its element size, so a file from a build with a different struct layout or
+// version is rejected instead of misread. Loading maps the file and copies each section
+// into its array in one block; nothing is parsed per entity. Derived state (the signal
+// timing wheel, crosswalk occupancy, scratch buffers) is rebuilt after loading.
+const uint32_t SNAPSHOT_VERSION = 1;
+
+void SerializeSnapshot(const CityWorld& world, std::vector<char>& out);
+bool SaveSnapshot(const CityWorld& world, const std::string& path, std::string& error);
+bool LoadSnapshot(const std::string& path, CityWorld& world, std::string& error);
+
+// Writes snapshots from a background thread. save() copies the world into a buffer on the
+// calling thread (bulk array copies only) and returns; the file is written to path.tmp
+// and renamed into place by the writer. A save queued while another is still waiting to
+// start replaces it, so a slow disk never builds a backlog.
+class SnapshotWriter {
+public:
+	SnapshotWriter();
+	~SnapshotWriter();
+
+	void save(const CityWorld& world, const std::string& path);
+	// Blocks until every queued snapshot is on disk.
+	void flush();
+	// Last write error, empty when all writes succeeded.
+	std::string lastError();
+	size_t writtenCount();
+
+private:
+	void writerLoop();
+
+	std::thread writer;
+	std::mutex lock;
+	std::condition_variable wake;
+	std::condition_variable idle;
+	std::vector<char> staging;   // Filled by save() on the caller's thread
+	std::vector<char> pending;   // Queued for the writer
+	std::vector<char> writing;   // Owned by the writer while it writes
+	std::string pendingPath;
+	bool hasPending;
+	bool busy;
+	bool stopping;
+	std::string error;
+	size_t written;
+};
+
+#endif // SNAPSHOT_H_INCLUDED
@@ -0,0 +1,250 @@
+#include "SoftwareRasterizer.h"
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include "Render.h"
+#include "Profiler.h"
+
+#if defined(__GNUC__) && defined(__SSE2__)
+#define SOFTWARE_RASTER_X86 1
+#include <immintrin.h>
+#endif
+
+const uint32_t CLEAR_PIXEL = 0xff000000u;  // Opaque black, as initGL() clears
+
+// --- Span Filling ---
+// Every channel, alpha included, becomes (src*a + dst*(255-a)) / 255, rounded: GL's
+// SRC_ALPHA, ONE_MINUS_SRC_ALPHA on an 8-bit framebuffer. x/255 is (t + (t>>8)) >> 8 with
+// t = x + 128, exact over the whole range.
+
+static inline uint32_t BlendPixel(uint32_t src, uint32_t dst, int a) {
+	uint32_t out=0;
+	for(int shift=0; shift<32; shift+=8) {
+		int t=(int)((src>>shift)&0xff)*a+(int)((dst>>shift)&0xff)*(255-a)+128;
+		out|=(uint32_t)((t+(t>>8))>>8)<<shift;
+	}
+	return out;
+}
+
+static inline uint32_t PackColor(const float c[4]) {
+	uint32_t out=0;
+	for(int i=0; i<4; ++i) out|=(uint32_t)lrintf(std::min(255.0f,std::max(0.0f,c[i])))<<(8*i);
+	return out;
+}
+
+#ifdef SOFTWARE_RASTER_X86
+static void FillSpanSSE(uint32_t* dst, int n, uint32_t color) {
+	int a=(int)(color>>24);
+	int i=0;
+	if(a==255) {
+		__m128i c=_mm_set1_epi32((int)color);
+		for(; i+4<=n; i+=4) _mm_storeu_si128((__m128i*)(dst+i),c);
+		for(; i<n; ++i) dst[i]=color;
+		return;
+	}
+	// Two pixels' channels as 16-bit lanes; src*a+128 is the same for every pixel
+	__m128i zero=_mm_setzero_si128();
+	__m128i src=_mm_unpacklo_epi8(_mm_set1_epi32((int)color),zero);
+	__m128i srcTerm=_mm_add_epi16(_mm_mullo_epi16(src,_mm_set1_epi16((short)a)),_mm_set1_epi16(128));
+	__m128i inv=_mm_set1_epi16((short)(255-a));
+	for(; i+4<=n; i+=4) {
+		__m128i d=_mm_loadu_si128((const __m128i*)(dst+i));
+		__m128i lo=_mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(d,zero),inv),srcTerm);
+		__m128i hi=_mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(d,zero),inv),srcTerm);
+		lo=_mm_srli_epi16(_mm_add_epi16(lo,_mm_srli_epi16(lo,8)),8);
+		hi=_mm_srli_epi16(_mm_add_epi16(hi,_mm_srli_epi16(hi,8)),8);
+		_mm_storeu_si128((__m128i*)(dst+i),_mm_packus_epi16(lo,hi));
+	}
+	for(; i<n; ++i) dst[i]=BlendPixel(color,dst[i],a);
+}
+
+// One pixel per step with its four channels side by side.
+static void FillGradientSSE(uint32_t* dst, int n, float x, float y, const float base[4], const float dx[4], const float dy[4]) {
+	__m128 step=_mm_loadu_ps(dx);
+	__m128 c=_mm_add_ps(_mm_loadu_ps(base),_mm_add_ps(_mm_mul_ps(step,_mm_set1_ps(x)),_mm_mul_ps(_mm_loadu_ps(dy),_mm_set1_ps(y))));
+	__m128 lowest=_mm_setzero_ps(), highest=_mm_set1_ps(255.0f);
+	__m128i zero=_mm_setzero_si128(), full=_mm_set1_epi16(255), half=_mm_set1_epi16(128);
+	for(int p=0; p<n; ++p) {
+		__m128i ci=_mm_cvtps_epi32(_mm_min_ps(highest,_mm_max_ps(lowest,c)));
+		__m128i src=_mm_packs_epi32(ci,ci);
+		__m128i a=_mm_shufflelo_epi16(src,0xff);
+		__m128i d=_mm_unpacklo_epi8(_mm_cvtsi32_si128((int)dst[p]),zero);
+		__m128i t=_mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(src,a),_mm_mullo_epi16(d,_mm_sub_epi16(full,a))),half);
+		t=_mm_srli_epi16(_mm_add_epi16(t,_mm_srli_epi16(t,8)),8);
+		dst[p]=(uint32_t)_mm_cvtsi128_si32(_mm_packus_epi16(t,t));
+		c=_mm_add_ps(c,step);
+	}
+}
+#else
+static void FillSpanScalar(uint32_t* dst, int n, uint32_t color) {
+	int a=(int)(color>>24);
+	if(a==255) std::fill(dst,dst+n,color);
+	else for(int i=0; i<n; ++i) dst[i]=BlendPixel(color,dst[i],a);
+}
+
+static void FillGradientScalar(uint32_t* dst, int n, float x, float y, const float base[4], const float dx[4], const float dy[4]) {
+	float c[4];
+	for(int i=0; i<4; ++i) c[i]=base[i]+dx[i]*x+dy[i]*y;
+	for(int p=0; p<n; ++p) {
+		uint32_t src=PackColor(c);
+		dst[p]=BlendPixel(src,dst[p],(int)(src>>24));
+		for(int i=0; i<4; ++i) c[i]+=dx[i];
+	}
+}
+#endif
+
+static inline void FillSpan(uint32_t* dst, int n, uint32_t color) {
+#ifdef SOFTWARE_RASTER_X86
+	FillSpanSSE(dst,n,color);
+#else
+	FillSpanScalar(dst,n,color);
+#endif
+}
+
+static inline void FillGradient(uint32_t* dst, int n, float x, float y, const float base[4], const float dx[4], const float dy[4]) {
+#ifdef SOFTWARE_RASTER_X86
+	FillGradientSSE(dst,n,x,y,base,dx,dy);
+#else
+	FillGradientScalar(dst,n,x,y,base,dx,dy);
+#endif
+}
+
+// --- Setup and Binning ---
+
+SoftwareRasterizer::SoftwareRasterizer(int threads) : trianglesDrawn(0), tilePasses(0), frameWidth(0), frameHeight(0), tilesX(0), tilesY(0),
+	clearPending(false), pool(std::max(1,threads)) {}
+
+void SoftwareRasterizer::beginFrame() {
+	if(windowWidth!=frameWidth||windowHeight!=frameHeight) {
+		frameWidth=std::max(0,windowWidth);
+		frameHeight=std::max(0,windowHeight);
+		framebuffer.assign((size_t)frameWidth*frameHeight,CLEAR_PIXEL);
+		tilesX=(frameWidth+SOFTWARE_TILE_SIZE-1)/SOFTWARE_TILE_SIZE;
+		tilesY=(frameHeight+SOFTWARE_TILE_SIZE-1)/SOFTWARE_TILE_SIZE;
+		bins.assign((size_t)tilesX*tilesY,std::vector<uint32_t>());
+	}
+	triangles.clear();
+	gradients.clear();
+	for(auto& bin:bins) bin.clear();
+	clearPending=true;
+	trianglesDrawn=0;
+	tilePasses=0;
+}
+
+// The x where the edge from (xa,ya) crosses row center yc. Both triangles sharing an edge
+// see it from its lower corner with the same slope, so they compute the same x.
+static inline float EdgeX(float xa, float ya, float slope, float yc) {
+	return xa+(yc-ya)*slope;
+}
+
+void SoftwareRasterizer::drawTriangles(const BatchVertex* vertices, size_t count) {
+	PROFILE_ZONE("raster.bin");
+	for(size_t v=0; v+3<=count; v+=3) {
+		const BatchVertex* p[3]= {&vertices[v],&vertices[v+1],&vertices[v+2]};
+		if(p[0]->a==0&&p[1]->a==0&&p[2]->a==0) continue;  // Leaves every channel as it was
+		if(p[1]->y<p[0]->y) std::swap(p[0],p[1]);
+		if(p[2]->y<p[1]->y) std::swap(p[1],p[2]);
+		if(p[1]->y<p[0]->y) std::swap(p[0],p[1]);
+		Triangle t;
+		t.x0=p[0]->x;
+		t.y0=p[0]->y;
+		t.x1=p[1]->x;
+		t.y1=p[1]->y;
+		t.x2=p[2]->x;
+		t.y2=p[2]->y;
+		float area=(t.x1-t.x0)*(t.y2-t.y0)-(t.x2-t.x0)*(t.y1-t.y0);
+		if(!(area!=0.0f)) continue;  // Degenerate, or NaN corners
+		// Clamped before converting so far off-screen corners cannot overflow an int
+		float minX=std::max(-1.0f,std::min(t.x0,std::min(t.x1,t.x2))), maxX=std::min(frameWidth+1.0f,std::max(t.x0,std::max(t.x1,t.x2)));
+		t.rowBegin=std::max(0,(int)ceilf(std::max(-1.0f,t.y0)-0.5f));
+		t.rowEnd=std::min(frameHeight,(int)ceilf(std::min(frameHeight+1.0f,t.y2)-0.5f));
+		t.colBegin=std::max(0,(int)ceilf(minX-0.5f));
+		t.colEnd=std::min(frameWidth,(int)ceilf(maxX-0.5f));
+		if(t.rowBegin>=t.rowEnd||t.colBegin>=t.colEnd) continue;
+		t.slope01=t.y1>t.y0 ? (t.x1-t.x0)/(t.y1-t.y0) : 0.0f;
+		t.slope12=t.y2>t.y1 ? (t.x2-t.x1)/(t.y2-t.y1) : 0.0f;
+		t.slope02=(t.x2-t.x0)/(t.y2-t.y0);
+		const uint8_t* c[3]= {&p[0]->r,&p[1]->r,&p[2]->r};
+		if(memcmp(c[0],c[1],4)==0&&memcmp(c[0],c[2],4)==0) {
+			memcpy(&t.color,c[0],4);
+			t.gradient=-1;
+		}
+		else {
+			// Solve channel = base + dx*x + dy*y through the three corners
+			Gradient g;
+			for(int i=0; i<4; ++i) {
+				float d1=(float)c[1][i]-c[0][i], d2=(float)c[2][i]-c[0][i];
+				g.dx[i]=(d1*(t.y2-t.y0)-d2*(t.y1-t.y0))/area;
+				g.dy[i]=(d2*(t.x1-t.x0)-d1*(t.x2-t.x0))/area;
+				g.base[i]=c[0][i]-g.dx[i]*t.x0-g.dy[i]*t.y0;
+			}
+			g.horizontal=g.dx[0]==0.0f&&g.dx[1]==0.0f&&g.dx[2]==0.0f&&g.dx[3]==0.0f;
+			t.gradient=(int)gradients.size();
+			gradients.push_back(g);
+		}
+		uint32_t index=(uint32_t)triangles.size();
+		triangles.push_back(t);
+		int tx0=t.colBegin/SOFTWARE_TILE_SIZE, tx1=(t.colEnd-1)/SOFTWARE_TILE_SIZE;
+		int ty0=t.rowBegin/SOFTWARE_TILE_SIZE, ty1=(t.rowEnd-1)/SOFTWARE_TILE_SIZE;
+		for(int ty=ty0; ty<=ty1; ++ty) {
+			for(int tx=tx0; tx<=tx1; ++tx) bins[(size_t)ty*tilesX+tx].push_back(index);
+		}
+		trianglesDrawn++;
+	}
+	if(triangles.size()>=SOFTWARE_MAX_TRIANGLES) rasterizeBins();
+}
+
+// --- Tiles ---
+
+uint32_t SoftwareRasterizer::rowColor(const Gradient& g, float y) {
+	float c[4];
+	for(int i=0; i<4; ++i) c[i]=g.base[i]+g.dy[i]*y;
+	return PackColor(c);
+}
+
+void SoftwareRasterizer::rasterizeTile(int tile) {
+	int tileX0=(tile%tilesX)*SOFTWARE_TILE_SIZE, tileY0=(tile/tilesX)*SOFTWARE_TILE_SIZE;
+	int tileX1=std::min(frameWidth,tileX0+SOFTWARE_TILE_SIZE), tileY1=std::min(frameHeight,tileY0+SOFTWARE_TILE_SIZE);
+	if(clearPending) {
+		for(int y=tileY0; y<tileY1; ++y) {
+			uint32_t* row=&framebuffer[(size_t)y*frameWidth];
+			std::fill(row+tileX0,row+tileX1,CLEAR_PIXEL);
+		}
+	}
+	float left=tileX0-1.0f, right=tileX1+1.0f;
+	for(uint32_t index:bins[tile]) {
+		const Triangle& t=triangles[index];
+		const Gradient* g=t.gradient>=0 ? &gradients[t.gradient] : nullptr;
+		int y0=std::max(t.rowBegin,tileY0), y1=std::min(t.rowEnd,tileY1);
+		for(int y=y0; y<y1; ++y) {
+			float yc=y+0.5f;
+			float xa=EdgeX(t.x0,t.y0,t.slope02,yc);
+			float xb=yc<t.y1 ? EdgeX(t.x0,t.y0,t.slope01,yc) : EdgeX(t.x1,t.y1,t.slope12,yc);
+			if(xa>xb) std::swap(xa,xb);
+			// Centers in [xa, xb): the left edge's pixels are in, the right edge's are not
+			int x0=std::max(tileX0,(int)ceilf(std::max(left,xa)-0.5f));
+			int x1=std::min(tileX1,(int)ceilf(std::min(right,xb)-0.5f));
+			if(x0>=x1) continue;
+			uint32_t* row=&framebuffer[(size_t)y*frameWidth];
+			if(!g) FillSpan(row+x0,x1-x0,t.color);
+			else if(g->horizontal) FillSpan(row+x0,x1-x0,rowColor(*g,yc));
+			else FillGradient(row+x0,x1-x0,x0+0.5f,yc,g->base,g->dx,g->dy);
+		}
+	}
+}
+
+void SoftwareRasterizer::rasterizeBins() {
+	PROFILE_ZONE("raster.tiles");
+	pool.parallelFor(bins.size(),1,[this](size_t begin, size_t end) {
+		for(size_t tile=begin; tile<end; ++tile) rasterizeTile((int)tile);
+	});
+	for(auto& bin:bins) bin.clear();
+	triangles.clear();
+	gradients.clear();
+	clearPending=false;
+	tilePasses++;
+}
+
+void SoftwareRasterizer::endFrame() {
+	rasterizeBins();
+}
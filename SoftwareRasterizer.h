@@ -0,0 +1,85 @@
+#ifndef SOFTWARERASTERIZER_H_INCLUDED
+#define SOFTWARERASTERIZER_H_INCLUDED
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include "DrawBatch.h"
+#include "ThreadPool.h"
+
+// --- Software Rasterizer ---
+// A BatchTarget that draws into a framebuffer in memory, for machines with no GPU. The batch
+// only ever sends flat or per-vertex colored triangles blended with SRC_ALPHA,
+// ONE_MINUS_SRC_ALPHA, so that is all this draws, without any of a GL's per-call state.
+// drawTriangles() sets each triangle up (corners sorted by y, edge slopes, flat color or a
+// color gradient) and bins it into every SOFTWARE_TILE_SIZE square tile its bounds touch.
+// The tiles are then rasterized in parallel on a ThreadPool, each walking its triangles in
+// submission order, so every pixel is blended in the same order as under GL and no two
+// threads share a pixel. Rows are filled as spans, four pixels at a time with SSE2 (a
+// scalar version covers other CPUs). A pixel is covered when its center is inside the
+// triangle, and an edge shared by two triangles covers its pixels exactly once, so
+// translucent fans show no seams. Past SOFTWARE_MAX_TRIANGLES the bins are rasterized
+// early, which bounds memory at any scene size.
+const int SOFTWARE_TILE_SIZE = 64;
+const size_t SOFTWARE_MAX_TRIANGLES = 1 << 20;
+
+class SoftwareRasterizer : public BatchTarget {
+public:
+	explicit SoftwareRasterizer(int threads);
+
+	bool isGL() const override {
+		return false;
+	}
+	// Sizes the framebuffer to windowWidth x windowHeight and clears it to opaque black.
+	void beginFrame() override;
+	void drawTriangles(const BatchVertex* vertices, size_t count) override;
+	void endFrame() override;
+
+	// RGBA bytes, bottom row first: the layout glReadPixels gives and glDrawPixels takes.
+	const uint8_t* pixels() const {
+		return (const uint8_t*)framebuffer.data();
+	}
+	int width() const {
+		return frameWidth;
+	}
+	int height() const {
+		return frameHeight;
+	}
+	int threadCount() const {
+		return pool.threadCount();
+	}
+
+	long long trianglesDrawn;  // In the last frame, after culling
+	long long tilePasses;      // Times the bins were rasterized in the last frame
+
+private:
+	struct Triangle {
+		float x0, y0, x1, y1, x2, y2;     // Corners sorted by y
+		float slope01, slope12, slope02;  // x per unit y along each edge
+		int rowBegin, rowEnd;             // Pixel rows whose centers fall inside, clipped
+		int colBegin, colEnd;             // Pixel columns likewise
+		uint32_t color;                   // Flat color, RGBA bytes in memory order
+		int gradient;                     // Index into gradients, or -1 when flat
+	};
+	struct Gradient {  // channel = base + dx*x + dy*y, 0..255, at pixel centers
+		float base[4], dx[4], dy[4];
+		bool horizontal;  // dx all zero, as for the sky bands: each row is one flat span
+	};
+
+	void rasterizeBins();
+	void rasterizeTile(int tile);
+	static uint32_t rowColor(const Gradient& g, float y);
+
+	int frameWidth;
+	int frameHeight;
+	int tilesX;
+	int tilesY;
+	bool clearPending;  // The next pass clears each tile before drawing into it
+	std::vector<uint32_t> framebuffer;
+	std::vector<Triangle> triangles;
+	std::vector<Gradient> gradients;
+	std::vector<std::vector<uint32_t>> bins;  // Triangle indices per tile, in submission order
+	ThreadPool pool;
+};
+
+#endif // SOFTWARERASTERIZER_H_INCLUDED
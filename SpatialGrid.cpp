@@ -0,0 +1,42 @@
+#include "SpatialGrid.h"
+#include <cmath>
+#include <algorithm>
+
+SpatialGrid::SpatialGrid() : originX(0.0f), originY(0.0f), limitX(0.0f), limitY(0.0f), inverseCell(1.0f), columns(1), rows(1), cellStart(2,0) {}
+
+void SpatialGrid::reset(float x0, float y0, float x1, float y1, float cellSize) {
+	originX=x0;
+	originY=y0;
+	limitX=x1;
+	limitY=y1;
+	inverseCell=1.0f/cellSize;
+	columns=std::max(1,(int)ceilf((x1-x0)*inverseCell));
+	rows=std::max(1,(int)ceilf((y1-y0)*inverseCell));
+	cellStart.assign((size_t)columns*rows+1,0);
+	items.clear();
+}
+
+int SpatialGrid::cellOf(float x, float y) const {
+	// Clamped as floats first so far-off query corners cannot overflow an int
+	float cx=std::min((float)(columns-1),std::max(0.0f,(x-originX)*inverseCell));
+	float cy=std::min((float)(rows-1),std::max(0.0f,(y-originY)*inverseCell));
+	return (int)cy*columns+(int)cx;
+}
+
+int SpatialGrid::query(float x0, float y0, float x1, float y1, std::vector<uint32_t>& out) const {
+	size_t first=out.size();
+	int c0=cellOf(x0,y0), c1=cellOf(x1,y1);
+	int col0=c0%columns, row0=c0/columns, col1=c1%columns, row1=c1/columns;
+	for(int row=row0; row<=row1; ++row) {
+		for(int col=col0; col<=col1; ++col) {
+			int cell=row*columns+col;
+			for(uint32_t i=cellStart[cell]; i<cellStart[cell+1]; ++i) {
+				const Item& item=items[i];
+				if(item.x>=x0&&item.x<=x1&&item.y>=y0&&item.y<=y1) out.push_back(item.index);
+			}
+		}
+	}
+	// Cells come row by row, so restore drawing order
+	std::sort(out.begin()+first,out.end());
+	return (row1-row0+1)*(col1-col0+1);
+}
@@ -0,0 +1,74 @@
+#ifndef SPATIALGRID_H_INCLUDED
+#define SPATIALGRID_H_INCLUDED
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// --- Uniform Spatial Grid ---
+// Buckets item indices by position into square cells, so a rectangle query visits only the
+// cells it overlaps instead of every item. build() is a counting sort (two passes, no
+// per-cell allocation) and the cells are stored back to back, so rebuilding every tick
+// costs a few array writes per item. Points outside the covered area are left out, so
+// cover everything a query can reach and nothing more: a crowd far off screen costs
+// nothing to query.
+class SpatialGrid {
+public:
+	SpatialGrid();
+
+	// Covers [x0,x1) x [y0,y1) with cells cellSize on a side; empties the grid.
+	void reset(float x0, float y0, float x1, float y1, float cellSize);
+	// locate(i, x, y) sets item i's position and returns true, or returns false to leave
+	// it out. Items outside the covered area are left out too.
+	template<class Locate>
+	void build(size_t count, Locate locate);
+	// Appends, in ascending order, every item whose position is inside [x0,x1] x [y0,y1].
+	// Returns the number of cells visited.
+	int query(float x0, float y0, float x1, float y1, std::vector<uint32_t>& out) const;
+
+	size_t size() const {
+		return items.size();
+	}
+	int cellCount() const {
+		return columns*rows;
+	}
+
+private:
+	struct Item {
+		uint32_t index;
+		float x, y;
+	};
+	int cellOf(float x, float y) const;
+
+	float originX, originY;
+	float limitX, limitY;             // Far corner of the covered area
+	float inverseCell;
+	int columns, rows;
+	std::vector<uint32_t> cellStart;  // columns*rows+1 offsets into items
+	std::vector<Item> items;          // Grouped by cell
+	std::vector<Item> located;        // Scratch for build(), in index order
+	std::vector<int> locatedCell;
+	std::vector<uint32_t> cursor;     // Next free slot per cell while filling
+};
+
+template<class Locate>
+void SpatialGrid::build(size_t count, Locate locate) {
+	located.clear();
+	locatedCell.clear();
+	for(size_t i=0; i<count; ++i) {
+		Item item;
+		if(!locate(i,item.x,item.y)) continue;
+		if(!(item.x>=originX&&item.x<limitX&&item.y>=originY&&item.y<limitY)) continue;
+		item.index=(uint32_t)i;
+		located.push_back(item);
+		locatedCell.push_back(cellOf(item.x,item.y));
+	}
+	cellStart.assign((size_t)columns*rows+1,0);
+	for(int cell:locatedCell) cellStart[cell+1]++;
+	for(size_t c=1; c<cellStart.size(); ++c) cellStart[c]+=cellStart[c-1];
+	cursor.assign(cellStart.begin(),cellStart.end()-1);
+	items.resize(located.size());
+	for(size_t i=0; i<located.size(); ++i) items[cursor[locatedCell[i]]++]=located[i];
+}
+
+#endif // SPATIALGRID_H_INCLUDED
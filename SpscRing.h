@@ -0,0 +1,35 @@
+#ifndef SPSCRING_H_INCLUDED
+#define SPSCRING_H_INCLUDED
+
+#include <atomic>
+#include <cstddef>
+
+// --- Single-Producer Single-Consumer Ring ---
+// One thread pushes, one thread pops; neither blocks. Holds at most N-1 items.
+template<class T, size_t N>
+class SpscRing {
+public:
+	SpscRing() : head(0), tail(0) {}
+	bool push(const T& item) {
+		size_t h=head.load(std::memory_order_relaxed);
+		size_t next=(h+1)%N;
+		if(next==tail.load(std::memory_order_acquire)) return false;
+		items[h]=item;
+		head.store(next,std::memory_order_release);
+		return true;
+	}
+	bool pop(T& item) {
+		size_t t=tail.load(std::memory_order_relaxed);
+		if(t==head.load(std::memory_order_acquire)) return false;
+		item=items[t];
+		tail.store((t+1)%N,std::memory_order_release);
+		return true;
+	}
+
+private:
+	T items[N];
+	std::atomic<size_t> head;
+	std::atomic<size_t> tail;
+};
+
+#endif // SPSCRING_H_INCLUDED
@@ -0,0 +1,95 @@
+#include "ThreadPool.h"
+#include <algorithm> // For std::max
+#include <string>
+#include "Profiler.h"
+
+ThreadPool::ThreadPool(int threads) : job(nullptr), remaining(0), steals(0), generation(0), stopping(false) {
+	threads=std::max(1,threads);
+	for(int i=0; i<threads; ++i) queues.emplace_back(new WorkQueue());
+	for(int i=1; i<threads; ++i) workers.emplace_back(&ThreadPool::workerLoop,this,i);
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> guard(wakeLock);
+		stopping=true;
+	}
+	wake.notify_all();
+	for(auto& t:workers) t.join();
+}
+
+// Pops local work first, then tries every other queue from the opposite end.
+bool ThreadPool::runOne(int id) {
+	Chunk c;
+	bool found=false;
+	{
+		WorkQueue& own=*queues[id];
+		std::lock_guard<std::mutex> guard(own.lock);
+		if(!own.chunks.empty()) {
+			c=own.chunks.back();
+			own.chunks.pop_back();
+			found=true;
+		}
+	}
+	for(size_t k=1; !found&&k<queues.size(); ++k) {
+		WorkQueue& victim=*queues[(id+k)%queues.size()];
+		std::lock_guard<std::mutex> guard(victim.lock);
+		if(!victim.chunks.empty()) {
+			c=victim.chunks.front();
+			victim.chunks.pop_front();
+			found=true;
+			steals++;
+		}
+	}
+	if(!found) return false;
+	(*job)(c.begin,c.end);
+	if(--remaining==0) {
+		std::lock_guard<std::mutex> guard(wakeLock);
+		done.notify_all();
+	}
+	return true;
+}
+
+void ThreadPool::workerLoop(int id) {
+	SetProfileThreadName("worker "+std::to_string(id));
+	unsigned seen=0;
+	for(;;) {
+		{
+			std::unique_lock<std::mutex> guard(wakeLock);
+			wake.wait(guard,[&] {
+				return stopping||generation!=seen;
+			});
+			if(stopping) return;
+			seen=generation;
+		}
+		while(runOne(id)) {}
+	}
+}
+
+void ThreadPool::parallelFor(size_t n, size_t grain, const std::function<void(size_t, size_t)>& fn) {
+	if(n==0) return;
+	grain=std::max<size_t>(1,grain);
+	if(queues.size()==1||n<=grain) {
+		fn(0,n);
+		return;
+	}
+	size_t chunks=(n+grain-1)/grain;
+	job=&fn;
+	remaining=chunks;
+	for(size_t c=0; c<chunks; ++c) {
+		WorkQueue& q=*queues[c%queues.size()];
+		std::lock_guard<std::mutex> guard(q.lock);
+		q.chunks.push_back({c*grain,std::min(n,(c+1)*grain)});
+	}
+	{
+		std::lock_guard<std::mutex> guard(wakeLock);
+		generation++;
+	}
+	wake.notify_all();
+	while(runOne(0)) {}
+	std::unique_lock<std::mutex> guard(wakeLock);
+	done.wait(guard,[&] {
+		return remaining.load()==0;
+	});
+	job=nullptr;
+}
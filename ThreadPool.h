@@ -0,0 +1,57 @@
+#ifndef THREADPOOL_H_INCLUDED
+#define THREADPOOL_H_INCLUDED
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <cstddef>
+
+// --- Work-Stealing Thread Pool ---
+// parallelFor splits [0,n) into grain-sized chunks and deals them round-robin onto
+// per-worker deques. Each worker pops from the back of its own deque and steals
+// from the front of the others once it runs dry, so uneven chunks balance out.
+// The calling thread works as worker 0; a pool of one thread runs inline.
+class ThreadPool {
+public:
+	explicit ThreadPool(int threads);
+	~ThreadPool();
+
+	int threadCount() const {
+		return (int)queues.size();
+	}
+	void parallelFor(size_t n, size_t grain, const std::function<void(size_t, size_t)>& fn);
+	// Number of chunks a worker took from another worker's deque (for tuning).
+	size_t stealCount() const {
+		return steals.load();
+	}
+
+private:
+	struct Chunk {
+		size_t begin, end;
+	};
+	struct WorkQueue {
+		std::mutex lock;
+		std::deque<Chunk> chunks;
+	};
+
+	void workerLoop(int id);
+	bool runOne(int id);
+
+	std::vector<std::unique_ptr<WorkQueue>> queues;
+	std::vector<std::thread> workers;
+	std::mutex wakeLock;
+	std::condition_variable wake;
+	std::condition_variable done;
+	const std::function<void(size_t, size_t)>* job;
+	std::atomic<size_t> remaining;
+	std::atomic<size_t> steals;
+	unsigned generation;
+	bool stopping;
+};
+
+#endif // THREADPOOL_H_INCLUDED
@@ -0,0 +1,794 @@
+#include "Trajectory.h"
+#include "Profiler.h"
+#include <cstring>
+#include <chrono>
+#include <algorithm>
+
+#if defined(__GNUC__) && defined(__SSE2__)
+#define TRAJECTORY_X86 1
+#include <immintrin.h>
+#endif
+
+// --- File Layout ---
+
+struct TrajectoryHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t keyframeInterval;
+	uint64_t seed;
+	int32_t width, height;
+};
+struct BlockHeader {
+	uint32_t magic;
+	uint32_t flags;
+	uint64_t tick;
+	uint32_t rawSize;
+	uint32_t packedSize;
+};
+struct TrajectoryTrailer {
+	uint64_t indexOffset;
+	uint64_t indexCount;
+	uint64_t lastTick;
+	char magic[8];
+};
+
+static const char TRAJECTORY_MAGIC[8] = {'A','C','T','R','A','J','\0','\0'};
+static const char INDEX_MAGIC[8] = {'A','C','T','R','I','D','X','\0'};
+static const uint32_t BLOCK_MAGIC = 0x4b4c4254;  // "TBLK"
+static const uint32_t BLOCK_KEYFRAME = 1;
+static const uint32_t BLOCK_PREDICTED = 2;       // Motion coded against a linear guess
+
+// One tick, as captured. Every section is a whole number of 32-bit words so the byte
+// planes of consecutive records line up.
+struct RecordHeader {
+	uint64_t tick;
+	float timeOfDay;
+	int32_t trafficLightState;
+	uint32_t vehicleSlots;
+	uint32_t spawnCount;
+	uint32_t birdCount;
+	uint32_t sidewalkCount;
+	uint32_t crossingCount;
+	uint32_t cloudCount;
+	uint32_t ellipseCount;
+	uint32_t keyframe;
+};
+struct CloudFrame {
+	Point pos;
+	float speed, scale, shapePhase, alpha;
+	int32_t numEllipses;
+};
+struct SpawnRecord {
+	int32_t slot;
+	Vehicle vehicle;
+};
+
+static size_t WordAlign(size_t n) {
+	return (n+3)&~(size_t)3;
+}
+
+static bool SeekTo(FILE* f, uint64_t offset) {
+#ifdef _WIN32
+	return _fseeki64(f,(__int64)offset,SEEK_SET)==0;
+#else
+	return fseeko(f,(off_t)offset,SEEK_SET)==0;
+#endif
+}
+
+static uint64_t FileSize(FILE* f) {
+#ifdef _WIN32
+	_fseeki64(f,0,SEEK_END);
+	return (uint64_t)_ftelli64(f);
+#else
+	fseeko(f,0,SEEK_END);
+	return (uint64_t)ftello(f);
+#endif
+}
+
+// --- Capture ---
+
+static char* Append(char* out, const void* data, size_t bytes) {
+	if(bytes) memcpy(out,data,bytes);
+	return out+bytes;
+}
+
+// Bytes in the record h heads.
+static size_t RecordSize(const RecordHeader& h) {
+	size_t n=h.vehicleSlots;
+	return sizeof(h)+2*n*sizeof(float)+WordAlign(n)+
+	       h.birdCount*sizeof(Bird)+((size_t)h.sidewalkCount+h.crossingCount)*sizeof(Pedestrian)+
+	       h.cloudCount*sizeof(CloudFrame)+(size_t)h.ellipseCount*(sizeof(Point)+2*sizeof(float))+
+	       (size_t)h.spawnCount*sizeof(SpawnRecord);
+}
+
+// The size of the record at the front of buffer, or 0 for an empty one.
+static size_t RecordSize(const std::vector<char>& buffer) {
+	if(buffer.size()<sizeof(RecordHeader)) return 0;
+	RecordHeader h;
+	memcpy(&h,buffer.data(),sizeof(h));
+	return RecordSize(h);
+}
+
+// Copies one tick of world to the front of out. Keyframes carry every vehicle record, other
+// ticks only the slots spawned during the last step. out keeps the largest size it has had,
+// so a keyframe every few hundred ticks does not have it regrown and zero filled each time.
+static void CaptureRecord(const CityWorld& world, bool keyframe, std::vector<char>& out) {
+	const VehicleStore& vs=world.vehicles;
+	RecordHeader h;
+	memset(&h,0,sizeof(h));
+	h.tick=world.tick;
+	h.timeOfDay=world.timeOfDay;
+	h.trafficLightState=world.trafficLightState;
+	h.vehicleSlots=(uint32_t)vs.size();
+	h.spawnCount=(uint32_t)(keyframe?vs.size():world.spawned.size());
+	h.birdCount=(uint32_t)world.birds.size();
+	h.sidewalkCount=(uint32_t)world.sidewalkPedestrians.size();
+	h.crossingCount=(uint32_t)world.crossingPedestrians.size();
+	h.cloudCount=(uint32_t)world.clouds.size();
+	for(const auto& c:world.clouds) h.ellipseCount+=(uint32_t)c.ellipseOffsets.size();
+	h.keyframe=keyframe?1:0;
+	size_t n=vs.size();
+	if(out.size()<RecordSize(h)) out.resize(RecordSize(h));
+	char* p=Append(out.data(),&h,sizeof(h));
+	p=Append(p,vs.x.data(),n*sizeof(float));
+	p=Append(p,vs.speed.data(),n*sizeof(float));
+	p=Append(p,vs.active.data(),n);
+	for(size_t pad=n; pad<WordAlign(n); ++pad) *p++=0;
+	p=Append(p,world.birds.data(),h.birdCount*sizeof(Bird));
+	p=Append(p,world.sidewalkPedestrians.data(),h.sidewalkCount*sizeof(Pedestrian));
+	p=Append(p,world.crossingPedestrians.data(),h.crossingCount*sizeof(Pedestrian));
+	for(const auto& c:world.clouds) {
+		CloudFrame cf= {c.pos,c.speed,c.scale,c.shapePhase,c.alpha,c.numEllipses};
+		p=Append(p,&cf,sizeof(cf));
+	}
+	for(const auto& c:world.clouds) p=Append(p,c.ellipseOffsets.data(),c.ellipseOffsets.size()*sizeof(Point));
+	for(const auto& c:world.clouds) p=Append(p,c.ellipseRadiiX.data(),c.ellipseRadiiX.size()*sizeof(float));
+	for(const auto& c:world.clouds) p=Append(p,c.ellipseRadiiY.data(),c.ellipseRadiiY.size()*sizeof(float));
+	if(keyframe) {
+		// Field by field rather than through vs.get(), which halves the biggest capture there is
+		for(size_t i=0; i<n; ++i) {
+			SpawnRecord r;
+			r.slot=(int32_t)i;
+			r.vehicle.x=vs.x[i];
+			r.vehicle.y=vs.y[i];
+			r.vehicle.speed=vs.speed[i];
+			r.vehicle.baseSpeed=vs.baseSpeed[i];
+			r.vehicle.width=vs.width[i];
+			r.vehicle.height=vs.height[i];
+			r.vehicle.color=vs.color[i];
+			r.vehicle.type=vs.type[i];
+			r.vehicle.direction=vs.direction[i]>0?1:-1;
+			r.vehicle.id=vs.id[i];
+			p=Append(p,&r,sizeof(r));
+		}
+	}
+	else {
+		for(int slot:world.spawned) {
+			SpawnRecord r= {slot,vs.get(slot)};
+			p=Append(p,&r,sizeof(r));
+		}
+	}
+}
+
+// Rebuilds frame from one record; vehicles not respawned keep their previous record.
+static bool ApplyRecord(const std::vector<char>& in, FrameState& frame) {
+	if(in.size()<sizeof(RecordHeader)) return false;
+	RecordHeader h;
+	memcpy(&h,in.data(),sizeof(h));
+	size_t n=h.vehicleSlots;
+	if(in.size()!=RecordSize(h)) return false;
+	const char* p=in.data()+sizeof(h);
+	const float* x=reinterpret_cast<const float*>(p);
+	const float* speed=x+n;
+	const char* active=reinterpret_cast<const char*>(speed+n);
+	p=active+WordAlign(n);
+	frame.timeOfDay=h.timeOfDay;
+	frame.trafficLightState=(LightState)h.trafficLightState;
+	frame.birds.resize(h.birdCount);
+	if(h.birdCount) memcpy(frame.birds.data(),p,h.birdCount*sizeof(Bird));
+	p+=h.birdCount*sizeof(Bird);
+	frame.sidewalkPedestrians.resize(h.sidewalkCount);
+	if(h.sidewalkCount) memcpy(frame.sidewalkPedestrians.data(),p,h.sidewalkCount*sizeof(Pedestrian));
+	p+=h.sidewalkCount*sizeof(Pedestrian);
+	frame.crossingPedestrians.resize(h.crossingCount);
+	if(h.crossingCount) memcpy(frame.crossingPedestrians.data(),p,h.crossingCount*sizeof(Pedestrian));
+	p+=h.crossingCount*sizeof(Pedestrian);
+	frame.clouds.resize(h.cloudCount);
+	const CloudFrame* cf=reinterpret_cast<const CloudFrame*>(p);
+	p+=h.cloudCount*sizeof(CloudFrame);
+	const Point* offsets=reinterpret_cast<const Point*>(p);
+	const float* radiiX=reinterpret_cast<const float*>(offsets+h.ellipseCount);
+	const float* radiiY=radiiX+h.ellipseCount;
+	p=reinterpret_cast<const char*>(radiiY+h.ellipseCount);
+	size_t e=0;
+	for(size_t i=0; i<h.cloudCount; ++i) {
+		CloudFrame c;
+		memcpy(&c,cf+i,sizeof(c));
+		if(c.numEllipses<0||e+c.numEllipses>h.ellipseCount) return false;
+		Cloud& cloud=frame.clouds[i];
+		cloud.pos=c.pos;
+		cloud.speed=c.speed;
+		cloud.scale=c.scale;
+		cloud.shapePhase=c.shapePhase;
+		cloud.alpha=c.alpha;
+		cloud.numEllipses=c.numEllipses;
+		cloud.ellipseOffsets.assign(offsets+e,offsets+e+c.numEllipses);
+		cloud.ellipseRadiiX.assign(radiiX+e,radiiX+e+c.numEllipses);
+		cloud.ellipseRadiiY.assign(radiiY+e,radiiY+e+c.numEllipses);
+		e+=c.numEllipses;
+	}
+	frame.vehicles.resize(n);
+	for(size_t i=0; i<h.spawnCount; ++i) {
+		SpawnRecord r;
+		memcpy(&r,p+i*sizeof(SpawnRecord),sizeof(r));
+		if(r.slot<0||(size_t)r.slot>=n) return false;
+		frame.vehicles[r.slot]=r.vehicle;
+	}
+	frame.vehicleActive.assign(active,active+n);
+	frame.vehicleSlots=n;
+	for(size_t i=0; i<n; ++i) {
+		memcpy(&frame.vehicles[i].x,x+i,sizeof(float));
+		memcpy(&frame.vehicles[i].speed,speed+i,sizeof(float));
+	}
+	return true;
+}
+
+// --- Block Coding ---
+// A record is XORed against the previous one, so anything that did not change becomes
+// zero. Vehicle positions and speeds change every tick, but mostly by the same step as
+// last tick, so they are XORed against v + (v - vBefore) from the two previous records. The
+// result is split into byte planes (plane b holds byte b of every word) so the zero high
+// bytes line up into long runs.
+
+static void XorBytes(const char* a, const char* b, size_t n, char* out) {
+	size_t i=0;
+	for(; i+8<=n; i+=8) {
+		uint64_t wa, wb;
+		memcpy(&wa,a+i,8);
+		memcpy(&wb,b+i,8);
+		wa^=wb;
+		memcpy(out+i,&wa,8);
+	}
+	for(; i<n; ++i) out[i]=a[i]^b[i];
+}
+
+// XORs count floats of in with their linear prediction from previous and older.
+static void XorPredicted(const char* in, const char* previous, const char* older, size_t count, char* out) {
+	size_t i=0;
+#ifdef TRAJECTORY_X86
+	for(; i+4<=count; i+=4) {
+		__m128 p=_mm_loadu_ps(reinterpret_cast<const float*>(previous+4*i));
+		__m128 o=_mm_loadu_ps(reinterpret_cast<const float*>(older+4*i));
+		__m128i guess=_mm_castps_si128(_mm_add_ps(p,_mm_sub_ps(p,o)));
+		__m128i actual=_mm_loadu_si128(reinterpret_cast<const __m128i*>(in+4*i));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(out+4*i),_mm_xor_si128(actual,guess));
+	}
+#endif
+	for(; i<count; ++i) {
+		float p, o;
+		uint32_t actual, guess;
+		memcpy(&p,previous+4*i,4);
+		memcpy(&o,older+4*i,4);
+		float predicted=p+(p-o);
+		memcpy(&guess,&predicted,4);
+		memcpy(&actual,in+4*i,4);
+		actual^=guess;
+		memcpy(out+4*i,&actual,4);
+	}
+}
+
+// Prediction needs two earlier records of the same fleet size, and the one before must not
+// be a keyframe: a player that seeks to a keyframe has nothing older than it.
+static bool CanPredict(const std::vector<char>& previous, const std::vector<char>& older, uint32_t slots) {
+	if(previous.size()<sizeof(RecordHeader)||older.size()<sizeof(RecordHeader)) return false;
+	RecordHeader p, o;
+	memcpy(&p,previous.data(),sizeof(p));
+	memcpy(&o,older.data(),sizeof(o));
+	return !p.keyframe&&p.vehicleSlots==slots&&o.vehicleSlots==slots;
+}
+
+// Scatters words 32-bit words to byte planes planeSize bytes apart, starting at out.
+static void SplitPlanes(const char* in, size_t words, size_t planeSize, char* out) {
+	unsigned char* p0=(unsigned char*)out;
+	unsigned char* p1=p0+planeSize;
+	unsigned char* p2=p1+planeSize;
+	unsigned char* p3=p2+planeSize;
+	size_t i=0;
+#ifdef TRAJECTORY_X86
+	// Transposes 16 words at a time: three rounds of byte interleaving gather each byte
+	// position of 8 words together, and the 64-bit halves give the planes.
+	for(; i+16<=words; i+=16) {
+		const __m128i* w=reinterpret_cast<const __m128i*>(in+4*i);
+		__m128i a0=_mm_loadu_si128(w), a1=_mm_loadu_si128(w+1), a2=_mm_loadu_si128(w+2), a3=_mm_loadu_si128(w+3);
+		__m128i b0=_mm_unpacklo_epi8(a0,a1), b1=_mm_unpackhi_epi8(a0,a1), b2=_mm_unpacklo_epi8(a2,a3), b3=_mm_unpackhi_epi8(a2,a3);
+		a0=_mm_unpacklo_epi8(b0,b1);
+		a1=_mm_unpackhi_epi8(b0,b1);
+		a2=_mm_unpacklo_epi8(b2,b3);
+		a3=_mm_unpackhi_epi8(b2,b3);
+		b0=_mm_unpacklo_epi8(a0,a1);  // Bytes 0 and 1 of words 0-7
+		b1=_mm_unpackhi_epi8(a0,a1);  // Bytes 2 and 3 of words 0-7
+		b2=_mm_unpacklo_epi8(a2,a3);  // Bytes 0 and 1 of words 8-15
+		b3=_mm_unpackhi_epi8(a2,a3);  // Bytes 2 and 3 of words 8-15
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(p0+i),_mm_unpacklo_epi64(b0,b2));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(p1+i),_mm_unpackhi_epi64(b0,b2));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(p2+i),_mm_unpacklo_epi64(b1,b3));
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(p3+i),_mm_unpackhi_epi64(b1,b3));
+	}
+#endif
+	for(; i<words; ++i) {
+		uint32_t w;
+		memcpy(&w,in+4*i,4);
+		p0[i]=(unsigned char)w;
+		p1[i]=(unsigned char)(w>>8);
+		p2[i]=(unsigned char)(w>>16);
+		p3[i]=(unsigned char)(w>>24);
+	}
+}
+
+static void JoinPlanes(const char* in, size_t size, char* out) {
+	size_t words=size/4;
+	const unsigned char* p0=(const unsigned char*)in;
+	const unsigned char* p1=p0+words;
+	const unsigned char* p2=p1+words;
+	const unsigned char* p3=p2+words;
+	for(size_t i=0; i<words; ++i) {
+		uint32_t w=(uint32_t)p0[i]|((uint32_t)p1[i]<<8)|((uint32_t)p2[i]<<16)|((uint32_t)p3[i]<<24);
+		memcpy(out+4*i,&w,4);
+	}
+}
+
+static const size_t MIN_ZERO_RUN = 8; // Shorter runs stay inside literals
+
+static const size_t MAX_COUNT_BYTES = 10;  // 7 bits a byte
+
+static char* PutCount(char* out, size_t n) {
+	while(n>=0x80) {
+		*out++=(char)(0x80|(n&0x7f));
+		n>>=7;
+	}
+	*out++=(char)n;
+	return out;
+}
+
+static bool GetCount(const char*& p, const char* end, size_t& n) {
+	n=0;
+	for(int shift=0; p<end&&shift<64; shift+=7) {
+		unsigned char b=(unsigned char)*p++;
+		n|=(size_t)(b&0x7f)<<shift;
+		if(!(b&0x80)) return true;
+	}
+	return false;
+}
+
+#ifdef TRAJECTORY_X86
+// One bit per byte of data[0,16), set where the byte is zero.
+static uint32_t ZeroMask(const char* data) {
+	__m128i bytes=_mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+	return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(bytes,_mm_setzero_si128()));
+}
+#endif
+
+static int LowestBit(uint64_t w) {  // w must not be 0
+#ifdef __GNUC__
+	return __builtin_ctzll(w);
+#else
+	int b=0;
+	while(!(w&1)) {
+		w>>=1;
+		b++;
+	}
+	return b;
+#endif
+}
+
+// Bit i%64 of bits[i/64] is set where data[i] is zero. The 64 bits after n are set too, as
+// if the data ran on in zeros, and a clear word ends the array, so every scan stops.
+static void ZeroBits(const char* data, size_t n, std::vector<uint64_t>& bits) {
+	bits.assign(n/64+3,0);
+	size_t i=0;
+#ifdef TRAJECTORY_X86
+	for(; i+64<=n; i+=64) {
+		bits[i/64]=(uint64_t)ZeroMask(data+i)|(uint64_t)ZeroMask(data+i+16)<<16|
+		           (uint64_t)ZeroMask(data+i+32)<<32|(uint64_t)ZeroMask(data+i+48)<<48;
+	}
+#endif
+	for(; i<n; ++i) {
+		if(!data[i]) bits[i/64]|=(uint64_t)1<<(i%64);
+	}
+	for(; i<n+64; ++i) bits[i/64]|=(uint64_t)1<<(i%64);
+}
+
+// Length of the run of set bits from bit i.
+static size_t SetRun(const std::vector<uint64_t>& bits, size_t i) {
+	size_t w=i/64;
+	uint64_t clear=~bits[w]>>(i%64);
+	if(clear) return LowestBit(clear);
+	size_t run=64-i%64;
+	while(bits[++w]==~(uint64_t)0) run+=64;
+	return run+LowestBit(~bits[w]);
+}
+
+// First bit at or after i that starts MIN_ZERO_RUN set bits.
+static size_t NextRunStart(const std::vector<uint64_t>& bits, size_t i) {
+	static_assert(MIN_ZERO_RUN==8,"NextRunStart tests eight bits");
+	for(size_t w=i/64;; ++w) {
+		uint64_t a=bits[w], b=bits[w+1];
+		uint64_t starts=a;
+		for(int k=1; k<8; ++k) starts&=(a>>k)|(b<<(64-k));
+		if(w==i/64) starts&=~(uint64_t)0<<(i%64);
+		if(starts) return w*64+LowestBit(starts);
+	}
+}
+
+// Tokens: 0, count -> count zero bytes; 1, count, bytes -> literal bytes. Zero runs shorter
+// than MIN_ZERO_RUN stay inside literals unless they end the data. Works from bits, the
+// zero bytes of data as ZeroBits marks them, so each token costs a few word operations.
+// out is grown to the worst case and never shrunk; returns the bytes used.
+static size_t PackZeroRuns(const char* data, size_t n, std::vector<uint64_t>& bits, std::vector<char>& out) {
+	ZeroBits(data,n,bits);
+	// Zero runs and literals alternate, so there are at most n/(MIN_ZERO_RUN+1)+1 of each
+	size_t worst=n+(2*(n/(MIN_ZERO_RUN+1))+2)*(1+MAX_COUNT_BYTES);
+	if(out.size()<worst) out.resize(worst);
+	char* p=out.data();
+	size_t i=0;
+	while(i<n) {
+		size_t zeros=SetRun(bits,i);
+		if(zeros>=MIN_ZERO_RUN) {
+			zeros=std::min(zeros,n-i);
+			*p++=0;
+			p=PutCount(p,zeros);
+			i+=zeros;
+			continue;
+		}
+		size_t j=std::min(NextRunStart(bits,i+zeros),n);
+		*p++=1;
+		p=PutCount(p,j-i);
+		memcpy(p,data+i,j-i);
+		p+=j-i;
+		i=j;
+	}
+	return p-out.data();
+}
+
+static bool UnpackZeroRuns(const char* p, size_t size, char* out, size_t n) {
+	const char* end=p+size;
+	size_t i=0;
+	while(p<end) {
+		char token=*p++;
+		size_t count;
+		if(!GetCount(p,end,count)||count>n-i) return false;
+		if(token==0) memset(out+i,0,count);
+		else if(token==1) {
+			if((size_t)(end-p)<count) return false;
+			memcpy(out+i,p,count);
+			p+=count;
+		}
+		else return false;
+		i+=count;
+	}
+	return i==n;
+}
+
+static const size_t ENCODE_CHUNK = 4096;  // Bytes delta coded at a time, so they are split from L1
+
+// Codes the record at the front of record against the two before it (empty buffers when
+// there are none) into byte planes, and packs those into the first packedSize bytes of
+// packed; zeroBits is scratch for the packer. Returns the block flags.
+static uint32_t EncodeRecord(const std::vector<char>& record, const std::vector<char>& previous, const std::vector<char>& older,
+                             std::vector<char>& planes, std::vector<uint64_t>& zeroBits, std::vector<char>& packed, size_t& packedSize) {
+	RecordHeader h;
+	memcpy(&h,record.data(),sizeof(h));
+	size_t size=RecordSize(h);
+	bool keyframe=h.keyframe||previous.empty();
+	bool predict=!keyframe&&CanPredict(previous,older,h.vehicleSlots);
+	// Bytes below common are XORed against previous, those in [motionBegin,motionEnd) against the guess
+	size_t common=keyframe?0:std::min(size,RecordSize(previous));
+	size_t motionBegin=sizeof(RecordHeader);
+	size_t motionEnd=predict?motionBegin+2*(size_t)h.vehicleSlots*sizeof(float):motionBegin;
+	if(planes.size()<size) planes.resize(size);
+	alignas(16) char delta[ENCODE_CHUNK];
+	for(size_t at=0; at<size; at+=ENCODE_CHUNK) {
+		size_t end=std::min(size,at+ENCODE_CHUNK);
+		auto unpredicted=[&](size_t from, size_t to) {
+			if(from>=to) return;
+			size_t split=std::min(std::max(common,from),to);
+			XorBytes(record.data()+from,previous.data()+from,split-from,delta+(from-at));
+			memcpy(delta+(split-at),record.data()+split,to-split);
+		};
+		size_t guessFrom=std::max(at,motionBegin), guessTo=std::min(end,motionEnd);
+		unpredicted(at,std::min(end,motionBegin));
+		if(guessFrom<guessTo) XorPredicted(record.data()+guessFrom,previous.data()+guessFrom,older.data()+guessFrom,(guessTo-guessFrom)/4,delta+(guessFrom-at));
+		unpredicted(std::max(at,motionEnd),end);
+		SplitPlanes(delta,(end-at)/4,size/4,planes.data()+at/4);
+	}
+	packedSize=PackZeroRuns(planes.data(),size,zeroBits,packed);
+	return (h.keyframe?BLOCK_KEYFRAME:0)|(predict?BLOCK_PREDICTED:0);
+}
+
+// --- Recorder ---
+
+static const std::vector<char> NO_RECORD;  // Stands in for the records before the first
+
+TrajectoryRecorder::TrajectoryRecorder() : captureSeconds(0), stallSeconds(0), encodeSeconds(0), closing(false), frames(0), raw(0), failed(false),
+	captured(0), file(nullptr), offset(0), older(-1), previous(-1), lastTick(0) {}
+
+TrajectoryRecorder::~TrajectoryRecorder() {
+	close();
+}
+
+bool TrajectoryRecorder::open(const std::string& path, const CityWorld& world, int encoders, std::string& error) {
+	close();
+	file=fopen(path.c_str(),"wb");
+	if(!file) {
+		error="cannot open "+path+" for writing";
+		return false;
+	}
+	TrajectoryHeader header;
+	memset(&header,0,sizeof(header));
+	memcpy(header.magic,TRAJECTORY_MAGIC,sizeof(header.magic));
+	header.version=TRAJECTORY_VERSION;
+	header.keyframeInterval=KEYFRAME_INTERVAL;
+	header.seed=world.seed;
+	header.width=world.width;
+	header.height=world.height;
+	if(fwrite(&header,sizeof(header),1,file)!=1) {
+		error="cannot write "+path;
+		fclose(file);
+		file=nullptr;
+		return false;
+	}
+	offset=sizeof(header);
+	index.clear();
+	older=-1;
+	previous=-1;
+	lastTick=0;
+	encoders=std::max(1,encoders);
+	pool.reset(new ThreadPool(encoders));
+	coded.resize(encoders);
+	captured=0;
+	captureSeconds=0;
+	stallSeconds=0;
+	encodeSeconds=0;
+	frames=0;
+	raw=0;
+	failed=false;
+	closing=false;
+	int b;
+	while(filled.pop(b)) {}
+	while(empty.pop(b)) {}
+	spare.clear();
+	// Enough for one batch being coded, one queued behind it and the two records the next
+	// batch is coded against
+	for(int i=0; i<std::min(BUFFER_COUNT,std::max(MIN_BUFFERS,2*encoders+2)); ++i) empty.push(i);
+	writer=std::thread(&TrajectoryRecorder::writerLoop,this);
+	return true;
+}
+
+void TrajectoryRecorder::capture(const CityWorld& world) {
+	if(!file) return;
+	auto start=std::chrono::steady_clock::now();
+	int b;
+	while(empty.pop(b)) spare.push_back(b);
+	while(spare.empty()) { // Writer is a whole pool behind
+		std::this_thread::yield();
+		while(empty.pop(b)) spare.push_back(b);
+	}
+	// The newest freed buffer is the one most likely still in cache; the rest only come
+	// into use when the writer falls behind
+	b=spare.back();
+	spare.pop_back();
+	auto copyStart=std::chrono::steady_clock::now();
+	CaptureRecord(world,captured%KEYFRAME_INTERVAL==0,buffers[b]);
+	filled.push(b);
+	captured++;
+	auto end=std::chrono::steady_clock::now();
+	stallSeconds+=std::chrono::duration<double>(copyStart-start).count();
+	captureSeconds+=std::chrono::duration<double>(end-copyStart).count();
+}
+
+bool TrajectoryRecorder::close() {
+	if(!file) return true;
+	closing=true;
+	writer.join();
+	pool.reset();
+	TrajectoryTrailer trailer;
+	memset(&trailer,0,sizeof(trailer));
+	trailer.indexOffset=offset;
+	trailer.indexCount=index.size();
+	trailer.lastTick=lastTick;
+	memcpy(trailer.magic,INDEX_MAGIC,sizeof(trailer.magic));
+	bool ok=!failed;
+	if(!index.empty()) ok=fwrite(index.data(),sizeof(IndexEntry),index.size(),file)==index.size()&&ok;
+	ok=fwrite(&trailer,sizeof(trailer),1,file)==1&&ok;
+	ok=(fclose(file)==0)&&ok;
+	file=nullptr;
+	return ok;
+}
+
+void TrajectoryRecorder::writerLoop() {
+	SetProfileThreadName("trajectory writer");
+	std::vector<int> batch;
+	for(;;) {
+		batch.clear();
+		int b;
+		while((int)batch.size()<pool->threadCount()&&filled.pop(b)) batch.push_back(b);
+		if(batch.empty()) {
+			if(!closing.load()) {
+				std::this_thread::sleep_for(std::chrono::microseconds(200));
+				continue;
+			}
+			if(!filled.pop(b)) return; // Closing and drained
+			batch.push_back(b);
+		}
+		// Each block is coded against the two records before it: earlier ones in the batch,
+		// or the two held back from the last batch
+		pool->parallelFor(batch.size(),1,[&](size_t begin, size_t end) {
+			for(size_t i=begin; i<end; ++i) {
+				PROFILE_ZONE("record.encode_block");
+				auto start=std::chrono::steady_clock::now();
+				int p=i>=1 ? batch[i-1] : previous;
+				int o=i>=2 ? batch[i-2] : i==1 ? previous : older;
+				CodedBlock& block=coded[i];
+				block.flags=EncodeRecord(buffers[batch[i]],p>=0 ? buffers[p] : NO_RECORD,o>=0 ? buffers[o] : NO_RECORD,block.planes,block.zeroBits,block.packed,block.packedSize);
+				block.seconds=std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+			}
+		});
+		// In capture order; a record goes back to capture() once two newer ones are written
+		for(size_t i=0; i<batch.size(); ++i) {
+			writeBlock(buffers[batch[i]],coded[i]);
+			if(older>=0) empty.push(older);
+			older=previous;
+			previous=batch[i];
+		}
+	}
+}
+
+void TrajectoryRecorder::writeBlock(const std::vector<char>& record, const CodedBlock& block) {
+	PROFILE_ZONE("record.write_block");
+	RecordHeader h;
+	memcpy(&h,record.data(),sizeof(h));
+	size_t size=RecordSize(h);
+	BlockHeader header= {BLOCK_MAGIC,block.flags,h.tick,(uint32_t)size,(uint32_t)block.packedSize};
+	if(block.flags&BLOCK_KEYFRAME) index.push_back({h.tick,offset});
+	bool ok=fwrite(&header,sizeof(header),1,file)==1;
+	ok=ok&&fwrite(block.packed.data(),1,block.packedSize,file)==block.packedSize;
+	if(!ok) failed=true;
+	offset+=sizeof(header)+block.packedSize;
+	raw+=size;
+	encodeSeconds+=block.seconds;
+	frames++;
+	lastTick=h.tick;
+}
+
+// --- Player ---
+
+TrajectoryPlayer::TrajectoryPlayer() : seed(0), width(0), height(0), file(nullptr), dataStart(0), dataEnd(0),
+	position(0), current(0), last(0), hasFrame(false) {}
+
+TrajectoryPlayer::~TrajectoryPlayer() {
+	if(file) fclose(file);
+}
+
+bool TrajectoryPlayer::open(const std::string& path, std::string& error) {
+	if(file) fclose(file);
+	file=fopen(path.c_str(),"rb");
+	if(!file) {
+		error="cannot open "+path;
+		return false;
+	}
+	TrajectoryHeader header;
+	if(fread(&header,sizeof(header),1,file)!=1||memcmp(header.magic,TRAJECTORY_MAGIC,sizeof(header.magic))!=0) {
+		error=path+" is not a trajectory recording";
+		return false;
+	}
+	if(header.version!=TRAJECTORY_VERSION) {
+		error=path+" was written by an incompatible version";
+		return false;
+	}
+	seed=header.seed;
+	width=header.width;
+	height=header.height;
+	dataStart=sizeof(header);
+	index.clear();
+	hasFrame=false;
+	// Use the index if the recorder closed cleanly, otherwise rebuild it from the blocks
+	uint64_t size=FileSize(file);
+	TrajectoryTrailer trailer;
+	bool indexed=false;
+	if(size>=dataStart+sizeof(trailer)&&SeekTo(file,size-sizeof(trailer))&&fread(&trailer,sizeof(trailer),1,file)==1&&
+	        memcmp(trailer.magic,INDEX_MAGIC,sizeof(trailer.magic))==0&&
+	        trailer.indexOffset>=dataStart&&trailer.indexOffset+trailer.indexCount*sizeof(IndexEntry)+sizeof(trailer)==size) {
+		index.resize(trailer.indexCount);
+		indexed=SeekTo(file,trailer.indexOffset)&&
+		        (index.empty()||fread(index.data(),sizeof(IndexEntry),index.size(),file)==index.size());
+		dataEnd=trailer.indexOffset;
+		last=trailer.lastTick;
+	}
+	if(!indexed&&!scanBlocks()) {
+		error=path+" has no complete blocks";
+		return false;
+	}
+	if(index.empty()) {
+		error=path+" has no keyframes";
+		return false;
+	}
+	return seek(index.front().tick);
+}
+
+bool TrajectoryPlayer::scanBlocks() {
+	index.clear();
+	uint64_t at=dataStart;
+	bool any=false;
+	BlockHeader block;
+	while(SeekTo(file,at)&&fread(&block,sizeof(block),1,file)==1&&block.magic==BLOCK_MAGIC) {
+		uint64_t end=at+sizeof(block)+block.packedSize;
+		if(!SeekTo(file,end-1)||fgetc(file)==EOF) break; // Truncated last block
+		if(block.flags&BLOCK_KEYFRAME) index.push_back({block.tick,at});
+		last=block.tick;
+		any=true;
+		at=end;
+	}
+	dataEnd=at;
+	return any;
+}
+
+uint64_t TrajectoryPlayer::firstTick() const {
+	return index.empty()?0:index.front().tick;
+}
+
+bool TrajectoryPlayer::readBlock(uint64_t at) {
+	BlockHeader block;
+	if(at>=dataEnd||!SeekTo(file,at)||fread(&block,sizeof(block),1,file)!=1||block.magic!=BLOCK_MAGIC) return false;
+	bool keyframe=(block.flags&BLOCK_KEYFRAME)!=0;
+	if(!keyframe&&!hasFrame) return false;
+	if(block.rawSize<sizeof(RecordHeader)||block.rawSize%4!=0) return false;
+	packed.resize(block.packedSize);
+	if(block.packedSize&&fread(packed.data(),1,block.packedSize,file)!=block.packedSize) return false;
+	planes.resize(block.rawSize);
+	if(!UnpackZeroRuns(packed.data(),packed.size(),planes.data(),planes.size())) return false;
+	// Undo the byte planes, then the XOR against the previous records
+	delta.resize(block.rawSize);
+	JoinPlanes(planes.data(),block.rawSize,delta.data());
+	decoded.resize(block.rawSize);
+	if(keyframe) memcpy(decoded.data(),delta.data(),block.rawSize);
+	else {
+		size_t common=std::min(delta.size(),record.size());
+		XorBytes(delta.data(),record.data(),common,decoded.data());
+		if(delta.size()>common) memcpy(decoded.data()+common,delta.data()+common,delta.size()-common);
+		if(block.flags&BLOCK_PREDICTED) {
+			RecordHeader h;
+			memcpy(&h,decoded.data(),sizeof(h));
+			if(!CanPredict(record,older,h.vehicleSlots)) return false;
+			const size_t at=sizeof(RecordHeader);
+			XorPredicted(delta.data()+at,record.data()+at,older.data()+at,2*(size_t)h.vehicleSlots,decoded.data()+at);
+		}
+	}
+	if(!ApplyRecord(decoded,state)) {
+		hasFrame=false;
+		return false;
+	}
+	older.swap(record);
+	record.swap(decoded);
+	hasFrame=true;
+	current=block.tick;
+	position=at+sizeof(block)+block.packedSize;
+	return true;
+}
+
+bool TrajectoryPlayer::next() {
+	return hasFrame&&readBlock(position);
+}
+
+bool TrajectoryPlayer::seek(uint64_t tick) {
+	auto key=std::upper_bound(index.begin(),index.end(),tick,[](uint64_t t,const IndexEntry& e) {
+		return t<e.tick;
+	});
+	if(key!=index.begin()) --key;
+	// Decode on from where we are when that is closer than the keyframe
+	bool fromHere=hasFrame&&current<=tick&&current>=key->tick;
+	if(!fromHere&&!readBlock(key->offset)) return false;
+	while(current<tick) {
+		if(!next()) return false;
+	}
+	return true;
+}
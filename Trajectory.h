@@ -0,0 +1,151 @@
+#ifndef TRAJECTORY_H_INCLUDED
+#define TRAJECTORY_H_INCLUDED
+
+#include <vector>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <cstdio>
+#include <cstdint>
+#include <cstddef>
+#include "CityWorld.h"
+#include "FrameState.h"
+#include "SpscRing.h"
+#include "ThreadPool.h"
+
+// --- Trajectory Recording ---
+// A recording is a header, one block per tick and a keyframe index at the end. A tick's
+// record holds what drawing needs (vehicle positions and speeds, pedestrians, birds,
+// clouds, light state) plus full vehicle records for slots spawned that tick. Keyframes
+// repeat every vehicle record and stand alone; other blocks are XORed against the previous
+// record, split into byte planes so unchanged high bytes line up, and zero-run packed.
+const uint32_t TRAJECTORY_VERSION = 1;
+const int KEYFRAME_INTERVAL = 300;  // Ticks between keyframes (about 5 simulated seconds)
+
+// Records a CityWorld tick by tick. capture() only copies the tick's arrays into a pooled
+// buffer and queues it. The writer thread takes the queued ticks in batches of one per
+// encoder, codes a batch across a ThreadPool and writes it in order. A block is coded
+// against the two records before it, so those stay out of the pool until the blocks after
+// them are coded. If the writer falls a whole pool behind, capture() waits rather than
+// dropping ticks.
+class TrajectoryRecorder {
+public:
+	TrajectoryRecorder();
+	~TrajectoryRecorder();
+
+	// encoders is the ThreadPool size.
+	bool open(const std::string& path, const CityWorld& world, int encoders, std::string& error);
+	// Call after each world.step().
+	void capture(const CityWorld& world);
+	// Drains the queue and writes the keyframe index; false if any write failed.
+	bool close();
+	bool isOpen() const {
+		return file!=nullptr;
+	}
+
+	uint64_t framesWritten() const {
+		return frames.load();
+	}
+	uint64_t bytesWritten() const {  // Read after close()
+		return offset;
+	}
+	uint64_t rawBytes() const {
+		return raw.load();
+	}
+	double captureSeconds;  // Time capture() spent copying on the simulation thread
+	double stallSeconds;    // Time capture() spent waiting for the writer to free a buffer
+	double encodeSeconds;   // Time the encoders spent coding blocks, all of them together; read after close()
+
+private:
+	static const int BUFFER_COUNT = 64;
+	static const int MIN_BUFFERS = 16;  // Short ticks fill this many while the writer sleeps
+	struct IndexEntry {
+		uint64_t tick;
+		uint64_t offset;
+	};
+	// One per encoder: the block it coded in the current batch.
+	struct CodedBlock {
+		std::vector<char> planes;        // The record's delta, split into byte planes, at the front
+		std::vector<uint64_t> zeroBits;  // The packer's map of zero bytes
+		std::vector<char> packed;        // What goes to disk, in its first packedSize bytes
+		size_t packedSize;
+		uint32_t flags;
+		double seconds;  // Spent coding it
+	};
+
+	void writerLoop();
+	void writeBlock(const std::vector<char>& record, const CodedBlock& block);
+
+	std::vector<char> buffers[BUFFER_COUNT];
+	std::vector<CodedBlock> coded;
+	SpscRing<int,BUFFER_COUNT+1> filled;  // Captured, waiting for the writer
+	SpscRing<int,BUFFER_COUNT+1> empty;   // Written, ready for reuse
+	std::vector<int> spare;               // Taken from empty by capture(), newest last
+	std::unique_ptr<ThreadPool> pool;
+	std::thread writer;
+	std::atomic<bool> closing;
+	std::atomic<uint64_t> frames;
+	std::atomic<uint64_t> raw;
+	std::atomic<bool> failed;
+	uint64_t captured;
+	FILE* file;
+	uint64_t offset;
+	std::vector<IndexEntry> index;
+	int older, previous;  // Buffers of the last two records written, -1 for none; held back from empty
+	uint64_t lastTick;
+};
+
+// Plays a recording back as FrameStates for display(). seek() starts from the nearest
+// keyframe at or before the tick and decodes forward, so any tick is at most
+// KEYFRAME_INTERVAL blocks away.
+class TrajectoryPlayer {
+public:
+	TrajectoryPlayer();
+	~TrajectoryPlayer();
+
+	bool open(const std::string& path, std::string& error);
+	bool seek(uint64_t tick);
+	// Decodes the tick after the current one; false at the end of the recording.
+	bool next();
+	const FrameState& frame() const {
+		return state;
+	}
+	uint64_t tick() const {
+		return current;
+	}
+	uint64_t firstTick() const;
+	uint64_t lastTick() const {
+		return last;
+	}
+	size_t keyframeCount() const {
+		return index.size();
+	}
+
+	// The recorded scene, so the static scenery can be rebuilt around the frames.
+	uint64_t seed;
+	int width;
+	int height;
+
+private:
+	struct IndexEntry {
+		uint64_t tick;
+		uint64_t offset;
+	};
+
+	bool readBlock(uint64_t at);
+	bool scanBlocks();
+
+	FILE* file;
+	uint64_t dataStart;
+	uint64_t dataEnd;
+	uint64_t position;  // Offset of the next block
+	uint64_t current;
+	uint64_t last;
+	bool hasFrame;
+	std::vector<IndexEntry> index;
+	std::vector<char> record, older, decoded, delta, packed, planes;  // record is the current tick
+	FrameState state;  // Holds vehicle records between the ticks that spawned them
+};
+
+#endif // TRAJECTORY_H_INCLUDED
@@ -0,0 +1,44 @@
+#ifndef TRIPLEBUFFER_H_INCLUDED
+#define TRIPLEBUFFER_H_INCLUDED
+
+#include <atomic>
+
+// --- Triple Buffer ---
+// One thread writes whole values, another reads the latest one; neither ever waits. The
+// writer fills back() and publish()es it, the reader takes the newest published value
+// with update() and reads front() until its next update(). Values published in between
+// are skipped, never queued. A slot is only ever held by one side, so the value itself
+// needs no atomics, and slots are reused, so vectors inside keep their capacity.
+template<class T>
+class TripleBuffer {
+public:
+	TripleBuffer() : backIndex(0), middle(1), frontIndex(2) {}
+
+	T& back() {
+		return slots[backIndex];
+	}
+	// Hands back() to the reader and takes the slot it replaces as the new back().
+	void publish() {
+		backIndex=middle.exchange(backIndex|FRESH,std::memory_order_acq_rel)&INDEX;
+	}
+	// Switches front() to the latest published value; false if nothing new was published.
+	bool update() {
+		if(!(middle.load(std::memory_order_relaxed)&FRESH)) return false;
+		frontIndex=middle.exchange(frontIndex,std::memory_order_acq_rel)&INDEX;
+		return true;
+	}
+	const T& front() const {
+		return slots[frontIndex];
+	}
+
+private:
+	static const int INDEX = 3;
+	static const int FRESH = 4;  // Set in middle when it holds a value the reader has not taken
+
+	T slots[3];
+	int backIndex;            // Writer only
+	std::atomic<int> middle;  // Slot index, plus FRESH
+	int frontIndex;           // Reader only
+};
+
+#endif // TRIPLEBUFFER_H_INCLUDED
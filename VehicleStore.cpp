@@ -0,0 +1,206 @@
+#include "VehicleStore.h"
+#include <algorithm> // For std::min/max
+
+#if defined(__GNUC__) && defined(__SSE2__)
+#define VEHICLE_KERNEL_X86 1
+#include <immintrin.h>
+#endif
+
+// --- Vehicle Store ---
+
+void VehicleStore::clear() {
+	x.clear();
+	speed.clear();
+	baseSpeed.clear();
+	width.clear();
+	direction.clear();
+	speedLimit.clear();
+	nextX.clear();
+	nextSpeed.clear();
+	y.clear();
+	height.clear();
+	color.clear();
+	type.clear();
+	id.clear();
+	active.clear();
+}
+
+void VehicleStore::reserve(size_t n) {
+	x.reserve(n);
+	speed.reserve(n);
+	baseSpeed.reserve(n);
+	width.reserve(n);
+	direction.reserve(n);
+	speedLimit.reserve(n);
+	nextX.reserve(n);
+	nextSpeed.reserve(n);
+	y.reserve(n);
+	height.reserve(n);
+	color.reserve(n);
+	type.reserve(n);
+	id.reserve(n);
+	active.reserve(n);
+}
+
+void VehicleStore::add(const Vehicle& v) {
+	x.push_back(v.x);
+	speed.push_back(v.speed);
+	baseSpeed.push_back(v.baseSpeed);
+	width.push_back(v.width);
+	direction.push_back((float)v.direction);
+	speedLimit.push_back(v.baseSpeed);
+	nextX.push_back(v.x);
+	nextSpeed.push_back(v.speed);
+	y.push_back(v.y);
+	height.push_back(v.height);
+	color.push_back(v.color);
+	type.push_back(v.type);
+	id.push_back(v.id);
+	active.push_back(1);
+}
+
+Vehicle VehicleStore::get(size_t i) const {
+	Vehicle v;
+	v.x=x[i];
+	v.y=y[i];
+	v.speed=speed[i];
+	v.baseSpeed=baseSpeed[i];
+	v.width=width[i];
+	v.height=height[i];
+	v.color=color[i];
+	v.type=type[i];
+	v.id=id[i];
+	v.direction=direction[i]>0?1:-1;
+	return v;
+}
+
+void VehicleStore::set(size_t i, const Vehicle& v) {
+	x[i]=v.x;
+	y[i]=v.y;
+	speed[i]=v.speed;
+	baseSpeed[i]=v.baseSpeed;
+	width[i]=v.width;
+	height[i]=v.height;
+	color[i]=v.color;
+	type[i]=v.type;
+	id[i]=v.id;
+	direction[i]=(float)v.direction;
+}
+
+void VehicleStore::erase(size_t begin, size_t end) {
+	x.erase(x.begin()+begin,x.begin()+end);
+	speed.erase(speed.begin()+begin,speed.begin()+end);
+	baseSpeed.erase(baseSpeed.begin()+begin,baseSpeed.begin()+end);
+	width.erase(width.begin()+begin,width.begin()+end);
+	direction.erase(direction.begin()+begin,direction.begin()+end);
+	speedLimit.erase(speedLimit.begin()+begin,speedLimit.begin()+end);
+	nextX.erase(nextX.begin()+begin,nextX.begin()+end);
+	nextSpeed.erase(nextSpeed.begin()+begin,nextSpeed.begin()+end);
+	y.erase(y.begin()+begin,y.begin()+end);
+	height.erase(height.begin()+begin,height.begin()+end);
+	color.erase(color.begin()+begin,color.begin()+end);
+	type.erase(type.begin()+begin,type.begin()+end);
+	id.erase(id.begin()+begin,id.begin()+end);
+	active.erase(active.begin()+begin,active.begin()+end);
+}
+
+void VehicleStore::swapBuffers() {
+	x.swap(nextX);
+	speed.swap(nextSpeed);
+}
+
+// --- Vehicle Types ---
+
+Vehicle RandomVehicle(RandomStream& rng) {
+	Vehicle v;
+	v.type=(VehicleType)randInt(rng,3);
+	v.color=randomColor(rng);
+	const VehicleTraits& traits=VEHICLE_TRAITS[v.type];
+	v.width=traits.width;
+	v.height=traits.height;
+	v.baseSpeed=randFloat(rng,traits.minSpeed,traits.maxSpeed);
+	v.x=v.y=v.speed=0;
+	v.direction=1;
+	v.id=0;
+	return v;
+}
+
+// --- Kinematics Kernel ---
+// Accelerate/decelerate towards the target collapses to a clamp:
+// speed' = max(speed-decel, min(speed+accel, target)), which needs no branches.
+
+void IntegrateVehiclesScalar(const float* x, const float* speed, const float* baseSpeed, const float* speedLimit,
+                             const float* direction, float* xOut, float* speedOut, size_t n,
+                             float accel, float decel, float k) {
+	float a=accel*k, d=decel*k;
+	for(size_t i=0; i<n; ++i) {
+		float target=std::min(baseSpeed[i],speedLimit[i]);
+		float s=std::max(speed[i]-d,std::min(speed[i]+a,target));
+		s=std::max(0.0f,s);
+		speedOut[i]=s;
+		xOut[i]=x[i]+(s*direction[i])*k;
+	}
+}
+
+#ifdef VEHICLE_KERNEL_X86
+static void IntegrateVehiclesSSE(const float* x, const float* speed, const float* baseSpeed, const float* speedLimit,
+                                 const float* direction, float* xOut, float* speedOut, size_t n,
+                                 float accel, float decel, float k) {
+	float a=accel*k, d=decel*k;
+	__m128 va=_mm_set1_ps(a), vd=_mm_set1_ps(d), vk=_mm_set1_ps(k), zero=_mm_setzero_ps();
+	size_t i=0;
+	for(; i+4<=n; i+=4) {
+		__m128 s=_mm_loadu_ps(speed+i);
+		__m128 target=_mm_min_ps(_mm_loadu_ps(baseSpeed+i),_mm_loadu_ps(speedLimit+i));
+		s=_mm_max_ps(_mm_sub_ps(s,vd),_mm_min_ps(_mm_add_ps(s,va),target));
+		s=_mm_max_ps(zero,s);
+		_mm_storeu_ps(speedOut+i,s);
+		__m128 step=_mm_mul_ps(_mm_mul_ps(s,_mm_loadu_ps(direction+i)),vk);
+		_mm_storeu_ps(xOut+i,_mm_add_ps(_mm_loadu_ps(x+i),step));
+	}
+	IntegrateVehiclesScalar(x+i,speed+i,baseSpeed+i,speedLimit+i,direction+i,xOut+i,speedOut+i,n-i,accel,decel,k);
+}
+
+__attribute__((target("avx2")))
+static void IntegrateVehiclesAVX2(const float* x, const float* speed, const float* baseSpeed, const float* speedLimit,
+                                  const float* direction, float* xOut, float* speedOut, size_t n,
+                                  float accel, float decel, float k) {
+	float a=accel*k, d=decel*k;
+	__m256 va=_mm256_set1_ps(a), vd=_mm256_set1_ps(d), vk=_mm256_set1_ps(k), zero=_mm256_setzero_ps();
+	size_t i=0;
+	for(; i+8<=n; i+=8) {
+		__m256 s=_mm256_loadu_ps(speed+i);
+		__m256 target=_mm256_min_ps(_mm256_loadu_ps(baseSpeed+i),_mm256_loadu_ps(speedLimit+i));
+		s=_mm256_max_ps(_mm256_sub_ps(s,vd),_mm256_min_ps(_mm256_add_ps(s,va),target));
+		s=_mm256_max_ps(zero,s);
+		_mm256_storeu_ps(speedOut+i,s);
+		__m256 step=_mm256_mul_ps(_mm256_mul_ps(s,_mm256_loadu_ps(direction+i)),vk);
+		_mm256_storeu_ps(xOut+i,_mm256_add_ps(_mm256_loadu_ps(x+i),step));
+	}
+	IntegrateVehiclesSSE(x+i,speed+i,baseSpeed+i,speedLimit+i,direction+i,xOut+i,speedOut+i,n-i,accel,decel,k);
+}
+
+static bool HasAVX2() {
+	static const bool avx2=__builtin_cpu_supports("avx2");
+	return avx2;
+}
+#endif
+
+void IntegrateVehicles(const float* x, const float* speed, const float* baseSpeed, const float* speedLimit,
+                       const float* direction, float* xOut, float* speedOut, size_t n,
+                       float accel, float decel, float k) {
+#ifdef VEHICLE_KERNEL_X86
+	if(HasAVX2()) IntegrateVehiclesAVX2(x,speed,baseSpeed,speedLimit,direction,xOut,speedOut,n,accel,decel,k);
+	else IntegrateVehiclesSSE(x,speed,baseSpeed,speedLimit,direction,xOut,speedOut,n,accel,decel,k);
+#else
+	IntegrateVehiclesScalar(x,speed,baseSpeed,speedLimit,direction,xOut,speedOut,n,accel,decel,k);
+#endif
+}
+
+const char* IntegrateVehiclesPath() {
+#ifdef VEHICLE_KERNEL_X86
+	return HasAVX2()?"avx2":"sse2";
+#else
+	return "scalar";
+#endif
+}
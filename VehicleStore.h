@@ -0,0 +1,64 @@
+#ifndef VEHICLESTORE_H_INCLUDED
+#define VEHICLESTORE_H_INCLUDED
+
+#include <vector>
+#include <cstddef>
+#include "CityTypes.h"
+#include "Random.h"
+
+// --- Vehicle Store ---
+// Structure-of-arrays fleet. The kinematics kernel streams only the hot arrays;
+// colour/type/height are read by drawing and respawn code.
+struct VehicleStore {
+	// Hot
+	std::vector<float> x;
+	std::vector<float> speed;
+	std::vector<float> baseSpeed;
+	std::vector<float> width;
+	std::vector<float> direction;   // +1.0f / -1.0f so the kernel can multiply by it
+	std::vector<float> speedLimit;  // Per-tick limit from signals and the car ahead
+	// Next-state buffers: a tick reads x/speed and writes these, then swaps
+	std::vector<float> nextX;
+	std::vector<float> nextSpeed;
+	// Cold
+	std::vector<float> y;
+	std::vector<float> height;
+	std::vector<Color> color;
+	std::vector<VehicleType> type;
+	std::vector<unsigned> id;
+	std::vector<char> active;       // 0 for pooled slots waiting to be reused
+
+	size_t size() const {
+		return x.size();
+	}
+	bool empty() const {
+		return x.empty();
+	}
+	void clear();
+	void reserve(size_t n);
+	void add(const Vehicle& v);
+	Vehicle get(size_t i) const;
+	void set(size_t i, const Vehicle& v);
+	void erase(size_t begin, size_t end);
+	void swapBuffers();
+};
+
+// --- Vehicle Types ---
+// Random type and colour, with size and base speed from VEHICLE_TRAITS.
+// Position, lane, speed and id are left to the caller.
+Vehicle RandomVehicle(RandomStream& rng);
+
+// --- Kinematics Kernel ---
+// For each vehicle: target = min(baseSpeed, speedLimit), move speed towards target by at
+// most accel/decel, clamp at zero and integrate x += speed*direction*k. Results go to
+// xOut/speedOut, which may alias x/speed for an in-place update.
+// IntegrateVehicles picks AVX2, SSE2 or the scalar reference at runtime.
+void IntegrateVehiclesScalar(const float* x, const float* speed, const float* baseSpeed, const float* speedLimit,
+                             const float* direction, float* xOut, float* speedOut, size_t n,
+                             float accel, float decel, float k);
+void IntegrateVehicles(const float* x, const float* speed, const float* baseSpeed, const float* speedLimit,
+                       const float* direction, float* xOut, float* speedOut, size_t n,
+                       float accel, float decel, float k);
+const char* IntegrateVehiclesPath();
+
+#endif // VEHICLESTORE_H_INCLUDED
@@ -0,0 +1,135 @@
+#include "WindowLights.h"
+#include <cmath>
+#include <algorithm>
+#include <utility>
+#include "Render.h"
+#include "CityChunks.h"
+#include "Profiler.h"
+
+WindowLights windowLights;
+
+// --- Window Mask ---
+
+WindowMask::WindowMask() : lights(0) {}
+
+void WindowMask::build(size_t count, RandomStream& rng) {
+	std::vector<std::pair<uint16_t,uint32_t>> drawn(count);
+	for(size_t i=0; i<count; ++i) drawn[i]= {(uint16_t)(rng.next()>>16),(uint32_t)i};
+	std::sort(drawn.begin(),drawn.end());
+	order.resize(count);
+	thresholds.resize(count);
+	for(size_t i=0; i<count; ++i) {
+		thresholds[i]=drawn[i].first;
+		order[i]=drawn[i].second;
+	}
+	bits.assign((count+63)/64,0);
+	lights=0;
+}
+
+size_t WindowMask::update(float occupancy) {
+	uint32_t level=(uint32_t)(std::min(std::max(occupancy,0.0f),1.0f)*65536.0f);
+	size_t target=(level>=65536) ? thresholds.size() : (size_t)(std::lower_bound(thresholds.begin(),thresholds.end(),(uint16_t)level)-thresholds.begin());
+	size_t first=std::min(lights,target), last=std::max(lights,target);
+	// The windows between the old and new count are exactly the ones that change
+	for(size_t i=first; i<last; ++i) bits[order[i]>>6]^=(uint64_t)1<<(order[i]&63);
+	lights=target;
+	return last-first;
+}
+
+size_t WindowMask::bytes() const {
+	return bits.capacity()*sizeof(uint64_t)+order.capacity()*sizeof(uint32_t)+thresholds.capacity()*sizeof(uint16_t);
+}
+
+// --- Occupancy ---
+
+struct OccupancyPoint {
+	float time, occupancy;
+};
+
+// Piecewise linear over the day, from 0 to 1
+static const OccupancyPoint HOME_OCCUPANCY[]= {
+	{0.0f,0.35f},{0.1f,0.12f},{0.18f,0.3f},{0.22f,0.15f},{0.26f,0.0f},
+	{0.55f,0.0f},{0.62f,0.5f},{0.7f,0.85f},{0.85f,0.7f},{1.0f,0.35f}
+};
+static const OccupancyPoint OFFICE_OCCUPANCY[]= {
+	{0.0f,0.08f},{0.18f,0.08f},{0.22f,0.3f},{0.26f,0.0f},
+	{0.55f,0.0f},{0.6f,0.9f},{0.7f,0.6f},{0.8f,0.15f},{1.0f,0.08f}
+};
+
+template<size_t N>
+static float evaluate(const OccupancyPoint (&curve)[N], float t) {
+	for(size_t i=1; i<N; ++i) {
+		if(t<=curve[i].time) {
+			float f=(t-curve[i-1].time)/(curve[i].time-curve[i-1].time);
+			return curve[i-1].occupancy+(curve[i].occupancy-curve[i-1].occupancy)*f;
+		}
+	}
+	return curve[N-1].occupancy;
+}
+
+float WindowOccupancy(BuildingKind kind, float timeOfDay) {
+	float t=timeOfDay-floorf(timeOfDay);
+	switch(kind) {
+	case BUILDING_SLAB:
+	case BUILDING_TIERED:
+		return evaluate(HOME_OCCUPANCY,t);
+	case BUILDING_GLASS:
+		return evaluate(OFFICE_OCCUPANCY,t);
+	default:
+		return 0.0f;
+	}
+}
+
+// --- Lit Buildings ---
+
+void BuildLitBuilding(const PlacedBuilding& b, float y, RandomStream& rng, LitBuilding& out) {
+	out.placed=b;
+	out.windows.clear();
+	BuildingWindows(b,y,out.windows);
+	out.mask.build(out.windows.size(),rng);
+}
+
+size_t UpdateWindowLights(std::vector<LitBuilding>& buildings, float timeOfDay) {
+	float t=floorf(timeOfDay/WINDOW_TIME_STEP)*WINDOW_TIME_STEP;
+	size_t flipped=0;
+	for(LitBuilding& b:buildings) {
+		if(b.mask.size()>0) flipped+=b.mask.update(WindowOccupancy(b.placed.kind,t));
+	}
+	return flipped;
+}
+
+// --- Scene ---
+
+WindowLights::WindowLights() : flips(0), windowsInView(0), litInView(0), builtWidth(0), builtY(0.0f), builtSeed(0) {}
+
+bool WindowLights::update(float timeOfDay) {
+	PROFILE_ZONE("windows.update");
+	bool rebuilt=false;
+	if(buildings.empty()||builtWidth!=windowWidth||builtY!=world.upperFootpathTopY||builtSeed!=world.seed) {
+		builtWidth=windowWidth;
+		builtY=world.upperFootpathTopY;
+		builtSeed=world.seed;
+		placed.clear();
+		SceneryBuildings(placed);
+		buildings.resize(placed.size());
+		for(size_t i=0; i<placed.size(); ++i) {
+			RandomStream rng(world.seed,(uint32_t)i,0,STREAM_WINDOW_SCENERY);
+			BuildLitBuilding(placed[i],world.upperFootpathTopY,rng,buildings[i]);
+		}
+		rebuilt=true;
+	}
+	size_t flipped=UpdateWindowLights(buildings,timeOfDay)+cityChunks.lightWindows(timeOfDay);
+	flips+=flipped;
+
+	windowsInView=0;
+	litInView=0;
+	auto count=[this](const std::vector<LitBuilding>& lit) {
+		for(const LitBuilding& b:lit) {
+			windowsInView+=b.mask.size();
+			litInView+=b.mask.litCount();
+		}
+	};
+	count(buildings);
+	for(const CityChunk* chunk:cityChunks.inView()) count(chunk->buildings);
+	return rebuilt||flipped>0;
+}
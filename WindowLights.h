@@ -0,0 +1,94 @@
+#ifndef WINDOWLIGHTS_H_INCLUDED
+#define WINDOWLIGHTS_H_INCLUDED
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include "CityTypes.h"
+#include "Random.h"
+
+// --- Window Lights ---
+// Which windows of a building are lit is one bit per window. Each window draws a threshold
+// when its building is made and is lit while the building's occupancy (the share of its
+// windows lit, from a time-of-day curve) is above it. The windows are kept sorted by
+// threshold, so moving the occupancy flips exactly the windows whose thresholds it passes:
+// an update costs a binary search plus one bit per window that changes, however many
+// windows the building has. Windows come on in their own order through the evening and go
+// off in reverse towards the day.
+class WindowMask {
+public:
+	WindowMask();
+
+	// count windows, all dark, their thresholds drawn from rng.
+	void build(size_t count, RandomStream& rng);
+	// Lights the windows whose threshold is below occupancy (0..1) and darkens the rest.
+	// Returns the number of windows that changed.
+	size_t update(float occupancy);
+	bool lit(size_t window) const {
+		return (bits[window>>6]>>(window&63))&1;
+	}
+	size_t size() const {
+		return order.size();
+	}
+	size_t litCount() const {
+		return lights;
+	}
+	size_t bytes() const;
+
+private:
+	std::vector<uint64_t> bits;
+	std::vector<uint32_t> order;       // Window indices by ascending threshold
+	std::vector<uint16_t> thresholds;  // Sorted, in 65536ths of full occupancy
+	size_t lights;                     // order[0, lights) are lit
+};
+
+// The share of a building's windows lit at timeOfDay: none through the day, homes filling
+// up in the evening and offices emptying, a few of each on through the night.
+float WindowOccupancy(BuildingKind kind, float timeOfDay);
+
+// Occupancy only moves in steps of this much of a day, so the lights change in small
+// batches instead of one window at a time; each change costs SceneryCache a bake.
+const float WINDOW_TIME_STEP = 1.0f / 512.0f;
+
+// A building with its windows and which of them are lit.
+struct LitBuilding {
+	PlacedBuilding placed;
+	std::vector<WindowRect> windows;  // Where its Draw* function puts them
+	WindowMask mask;
+};
+
+// Lays out b's windows standing on y, all dark, their thresholds from rng.
+void BuildLitBuilding(const PlacedBuilding& b, float y, RandomStream& rng, LitBuilding& out);
+// Brings each mask to the occupancy at timeOfDay. Returns the number of windows changed.
+size_t UpdateWindowLights(std::vector<LitBuilding>& buildings, float timeOfDay);
+
+// The hand-placed scene's buildings and the lights of everything in view. update() is
+// called by DrawScene() before the scenery is drawn.
+class WindowLights {
+public:
+	WindowLights();
+
+	// Rebuilds the scene's buildings when the layout changed and brings them and the
+	// streamed chunks in view to timeOfDay. True when a window changed, so the cached
+	// scenery needs a bake.
+	bool update(float timeOfDay);
+	const std::vector<LitBuilding>& scenery() const {
+		return buildings;
+	}
+
+	// For the stats overlay
+	long long flips;
+	size_t windowsInView;
+	size_t litInView;
+
+private:
+	std::vector<LitBuilding> buildings;
+	std::vector<PlacedBuilding> placed;  // Scratch for the rebuild
+	int builtWidth;
+	float builtY;
+	uint64_t builtSeed;
+};
+
+extern WindowLights windowLights;
+
+#endif // WINDOWLIGHTS_H_INCLUDED
@@ -1,171 +1,73 @@
 #include <GL/glut.h>
 #include <cmath>
 #include <vector>
-#include <ctime>
-#include <cstdlib>
 #include <algorithm> // For std::min/max
-#include <limits>    // For numeric_limits
 #include <string>    // For std::to_string
 #include <sstream>   // For string formatting
 #include <iomanip>   // For setprecision
-
-#ifndef M_PI
-#define M_PI 3.14159265358979323846
+#include <iostream>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <climits>
+#include <cstdio>
+#include <ctime>
+#include "CityWorld.h"
+#include "RoadNetwork.h"
+#include "FrameState.h"
+#include "FrameClock.h"
+#include "Snapshot.h"
+#include "Trajectory.h"
+#include "Render.h"
+#include "InstancedMeshes.h"
+#include "LightMap.h"
+#include "Profiler.h"
+#include "SceneryCache.h"
+#include "SoftwareRasterizer.h"
+#include "TripleBuffer.h"
+#include "SpscRing.h"
+#include "SpatialGrid.h"
+#include "Camera.h"
+#include "CityChunks.h"
+#include <thread>
+#include <atomic>
+#ifndef _WIN32
+#include "OffscreenContext.h"
+#include "FrameExport.h"
 #endif
 
-// --- Configuration ---
-bool ENABLE_DAY_NIGHT_CYCLE = true;
-const int NUM_CARS = 8;
-const int NUM_SIDEWALK_PEDESTRIANS = 10;
-const int NUM_CROSSING_PEDESTRIANS = 6;
-const int NUM_TREES = 12;
-const int NUM_STREETLIGHTS = 6;
-const int NUM_CLOUDS = 5;
-const float PEDESTRIAN_WAIT_X_OFFSET = 15.0f;
-const float CAR_MIN_SAFE_DISTANCE = 25.0f;
-const float CAR_DECELERATION = 0.08f;
-const float CAR_ACCELERATION = 0.04f;
-const float STOP_LINE_DISTANCE_BEFORE_CROSSING = 15.0f;
-const float CAR_TIME_PREDICTION_FACTOR = 1.15f;
-const float NIGHT_START_TIME = 0.65f; // Adjust slightly for more overlap with sunset
-const float NIGHT_END_TIME = 0.18f;
-const float DAWN_DURATION = 0.1f; // Duration of dawn/dusk transition for clouds/lights
-const float DUSK_DURATION = 0.1f;
-
 // --- Global Variables ---
 int windowWidth = 1000;
 int windowHeight = 600;
-float timeOfDay = 0.15f;
-float timeSpeed = ENABLE_DAY_NIGHT_CYCLE ? 0.0001f : 0.0f;
-enum LightState { RED, YELLOW, GREEN };
-LightState trafficLightState = GREEN;
-int trafficLightTimer = 0;
-const int RED_DURATION = 250;
-const int YELLOW_DURATION = 50;
-const int GREEN_DURATION = 500;
-float trafficLightX = windowWidth * 0.4f;
-float zebraCrossingX = trafficLightX + 15;
-float zebraCrossingWidth = 40.0f;
-float crossingFrontEdge = zebraCrossingX - zebraCrossingWidth / 2.0f;
-float crossingBackEdge = zebraCrossingX + zebraCrossingWidth / 2.0f;
-float stopLineLeft = crossingFrontEdge - STOP_LINE_DISTANCE_BEFORE_CROSSING;
-float stopLineRight = crossingBackEdge + STOP_LINE_DISTANCE_BEFORE_CROSSING;
-float roadTopY = windowHeight * 0.30f;
-float roadBottomY = windowHeight * 0.15f;
-float footpathHeight = 30.0f;
-float upperFootpathBottomY = roadTopY;
-float upperFootpathTopY = upperFootpathBottomY + footpathHeight;
-float lowerFootpathTopY = roadBottomY;
-float lowerFootpathBottomY = 0;
-float upperSidewalkLevelY = upperFootpathBottomY + footpathHeight * 0.6f;
-float lowerSidewalkLevelY = lowerFootpathBottomY + footpathHeight * 0.4f;
-float crossingStartY = upperFootpathBottomY - 2;
-float crossingEndY = lowerFootpathTopY + 2;
-float crossingWalkX = zebraCrossingX;
-const float LANE_Y1 = roadBottomY + (roadTopY - roadBottomY) * 0.3f;
-const float LANE_Y2 = roadBottomY + (roadTopY - roadBottomY) * 0.7f;
-
-// --- Structures ---
-struct Point {
-	float x, y;
-};
-struct Color {
-	float r, g, b;
-};
-struct Bird {
-	float x,y,speed,flapPhase,flapSpeed,bobPhase;
-};
-std::vector<Bird> birds;
-float birdBaseY = windowHeight*0.8f;
-float birdAmplitudeY = 15.0f;
-enum VehicleType { CAR, BUS, TRUCK };
-struct Vehicle {
-	float x,y,speed,baseSpeed,width,height;
-	Color color;
-	VehicleType type;
-	int direction;
-};
-std::vector<Vehicle> vehicles;
-enum PedestrianState { WALKING_SIDEWALK, WAITING_TO_CROSS, CROSSING, FINISHED_CROSSING };
-struct Pedestrian {
-	float x,y,speed,targetY,legPhase,legSpeed;
-	PedestrianState state;
-	Color clothingColor;
-	bool onUpperPath;
-};
-std::vector<Pedestrian> sidewalkPedestrians;
-std::vector<Pedestrian> crossingPedestrians;
-struct Tree {
-	Point pos;
-	float scale;
-	Color foliageColor;
-	Color trunkColor;
-};
-std::vector<Tree> trees;
-struct StreetLight {
-	Point pos;
-	float height;
-	float armLength;
-	bool onUpper;
-};
-std::vector<StreetLight> streetLights;
-struct Cloud {
-	Point pos;
-	float speed;
-	float scale;
-	int numEllipses;
-	std::vector<Point> ellipseOffsets;
-	std::vector<float> ellipseRadiiX;
-	std::vector<float> ellipseRadiiY;
-	float shapePhase;
-	float alpha;
-}; // Added alpha
-std::vector<Cloud> clouds;
+CityWorld world(windowWidth, windowHeight);
+FixedTimestep simClock(SIM_TICK_SECONDS, MAX_CATCHUP_TICKS); // Owned by the simulation thread once it runs
+FrameHistogram frameTimes;
+FrameState frame;                       // What display() draws, blended from the latest SimFrame
+bool showFrameStats = false;
+long long sceneDrawCalls = 0; // glDrawArrays calls DrawScene() made last frame
+const char* QUICK_SNAPSHOT_PATH = "AnimatedCity.snap"; // S saves, L loads
+SnapshotWriter snapshotWriter;
+TrajectoryRecorder recorder;   // Open when --record was given
+TrajectoryPlayer player;       // Drives the frames instead of world when --replay was given
+bool replaying = false;
+bool replayPaused = false;             // Simulation thread only
+const uint64_t REPLAY_SEEK_TICKS = 600; // Arrow keys jump 10 simulated seconds
+bool showProfiler = false;
+const double PROFILER_WINDOW_SECONDS = 1.0; // The HUD averages zones over the last second
+std::string tracePath = "AnimatedCity.trace.json"; // T writes the trace here; --trace changes it
+SoftwareRasterizer* softwareRasterizer = nullptr; // Draws the scene instead of GL when --software was given
+std::chrono::steady_clock::time_point lastDisplay, nextFrameDeadline;
+const float ENTITY_GRID_CELL = 128.0f;   // Side of a SpatialGrid cell, in world units
+const float VIEW_CULL_MARGIN = 200.0f;   // Entities this far outside the view are still drawn: they are indexed by one corner, and move between ticks
+const float CAMERA_ZOOM_STEP = 1.25f;    // Per wheel notch or +/- key
+const float CAMERA_PAN_STEP = 40.0f;     // Window pixels per arrow key
+const float CAMERA_PAGE_STEP = 10.0f;    // Window widths per Page Up/Down
+FrameSelection visible;                  // The entities display() found in view
+int visibleCells = 0;                    // Grid cells its queries visited, for the stats overlay
+bool dragging = false;
+int dragX = 0, dragY = 0;
 
 // --- Helper Functions ---
-float lerp(float a, float b, float t) {
-	return a + t * (b - a);
-}
-Color lerpColor(Color a, Color b, float t) {
-	Color c;
-	c.r=lerp(a.r,b.r,t);
-	c.g=lerp(a.g,b.g,t);
-	c.b=lerp(a.b,b.b,t);
-	return c;
-}
-float randFloat(float min, float max) {
-	return min + static_cast<float>(rand())/(static_cast<float>(RAND_MAX/(max-min)));
-}
-Color randomColor() {
-	return {randFloat(0.2f,0.9f), randFloat(0.2f,0.9f), randFloat(0.2f,0.9f)};
-}
-void DrawEllipse(float cx, float cy, float rx, float ry, int num_segments) {
-	glBegin(GL_TRIANGLE_FAN);
-	glVertex2f(cx,cy);
-	for(int i=0; i<=num_segments; ++i) {
-		float theta=2.0f*M_PI*float(i)/float(num_segments);
-		float x=rx*cosf(theta);
-		float y=ry*sinf(theta);
-		glVertex2f(x+cx,y+cy);
-	}
-	glEnd();
-}
-void DrawCircle(float cx, float cy, float r, int num_segments) {
-	DrawEllipse(cx, cy, r, r, num_segments);
-}
-float getDarknessFactor() {
-	if (!ENABLE_DAY_NIGHT_CYCLE) return 0.0f;
-	float sunAngle=timeOfDay*M_PI;
-	float sunHeightFactor=sin(sunAngle);
-	float darkness=1.0f-std::max(0.0f,sunHeightFactor);
-	return std::min(1.0f,darkness*1.5f);
-}
-float moveTowards(float current, float target, float maxDelta) {
-	if (fabs(target - current) <= maxDelta) {
-		return target;
-	}
-	return current + ((target > current) ? 1 : -1) * maxDelta;
-}
 void RenderText(float x, float y, void* font, const std::string& text, Color color) {
 	glColor3f(color.r, color.g, color.b);
 	glRasterPos2f(x, y);
@@ -173,1124 +75,475 @@ void RenderText(float x, float y, void* font, const std::string& text, Color col
 		glutBitmapCharacter(font, c);
 	}
 }
-// isNightTime remains simple for logic checks, fading handled separately
-bool isNightTime(float currentTimeOfDay) {
-	return (currentTimeOfDay >= NIGHT_START_TIME || currentTimeOfDay <= NIGHT_END_TIME);
-}
 
-// --- Drawing Functions ---
+// --- Simulation Thread ---
+// The model runs on its own thread, paying real time out as fixed ticks. After each batch
+// of ticks it publishes the state before and after the last one through simFrames, and
+// display() blends the newest pair by the time since, so a slow frame never holds up the
+// model and a slow tick never holds up drawing. The window never touches world while the
+// thread runs: resizes, saves and replay controls are posted to it instead. Loading a
+// snapshot replaces the seed and layout that drawing reads from world, so the window stops
+// the thread for that (LoadQuickSnapshot()).
+struct SimFrame {
+	FrameState previous, current;  // The last two ticks
+	float alpha;                   // Fraction of a tick already due when published
+	std::chrono::steady_clock::time_point published;
+	long long ticks;               // simClock's counters, for the stats overlay
+	long long droppedTicks;
+	unsigned sceneryVersion;       // Changes when a loaded snapshot brings new trees and street lights
+	// current's active vehicles and its pedestrians by position, so display() finds the ones
+	// in view without visiting the rest
+	SpatialGrid vehicleGrid, sidewalkGrid, crossingGrid;
+};
 
-void DrawSkyAndSunMoon(float time) {
-	/* ... Same ... */ Color dayTop= {0.2f,0.6f,0.9f},dayBottom= {0.5f,0.8f,1.0f},nightTop= {0.05f,0.0f,0.15f},nightBottom= {0.1f,0.05f,0.25f},topColor,bottomColor;
-	float darkness=getDarknessFactor();
-	if(ENABLE_DAY_NIGHT_CYCLE) {
-		topColor=lerpColor(dayTop,nightTop,darkness);
-		bottomColor=lerpColor(dayBottom,nightBottom,darkness);
-	}
-	else {
-		topColor=dayTop;
-		bottomColor=dayBottom;
-	}
-	glBegin(GL_QUADS);
-	glColor3f(topColor.r,topColor.g,topColor.b);
-	glVertex2f(0,windowHeight);
-	glVertex2f(windowWidth,windowHeight);
-	glColor3f(bottomColor.r,bottomColor.g,bottomColor.b);
-	glVertex2f(windowWidth,0);
-	glVertex2f(0,0);
-	glEnd();
-	float horizonY=upperFootpathTopY;
-	float skyHeight=windowHeight-horizonY,skyWidth=windowWidth,sunRadius=40.0f,moonRadius=30.0f;
-	if(ENABLE_DAY_NIGHT_CYCLE) {
-		float sunAngle=time*M_PI,sunX=skyWidth*0.5f-skyWidth*0.48f*cos(sunAngle),sunY=horizonY+skyHeight*0.8f*sin(sunAngle),moonAngle=time*M_PI+M_PI,moonX=skyWidth*0.5f-skyWidth*0.48f*cos(moonAngle),moonY=horizonY+skyHeight*0.8f*sin(moonAngle);
-		if(sin(sunAngle)>0.05) {
-			glColor3f(1.0f,1.0f,0.1f);
-			DrawCircle(sunX,sunY,sunRadius,30);
-		}
-		if(sin(moonAngle)>0.05) {
-			glColor3f(0.9f,0.9f,0.95f);
-			DrawCircle(moonX,moonY,moonRadius,30);
-			glColor3f(0.7f,0.7f,0.75f);
-			DrawCircle(moonX+moonRadius*0.3f,moonY+moonRadius*0.1f,moonRadius*0.2f,10);
-			DrawCircle(moonX-moonRadius*0.4f,moonY-moonRadius*0.2f,moonRadius*0.15f,10);
-		}
+enum class SimCommand {
+	SAVE_SNAPSHOT,  // To QUICK_SNAPSHOT_PATH, written in the background
+	TOGGLE_PAUSE,   // Replay only
+	SEEK_FORWARD,   // Replay only, by REPLAY_SEEK_TICKS
+	SEEK_BACK
+};
+
+TripleBuffer<SimFrame> simFrames;
+SpscRing<SimCommand,64> simCommands;  // GLUT thread to simulation thread
+std::atomic<uint64_t> simWindowSize(0); // width<<32 | height; only the latest size matters
+std::atomic<bool> simStopping(false);
+std::thread simThread;
+unsigned sceneryVersion = 0; // Bumped when a loaded snapshot brings new trees and street lights; only changed while simThread is stopped
+
+bool RestoreWorld(const std::string& path);
+
+void RunSimCommand(SimCommand command) {
+	if(command==SimCommand::SAVE_SNAPSHOT) {
+		snapshotWriter.save(world,QUICK_SNAPSHOT_PATH);
 	}
-	else {
-		glColor3f(1.0f,1.0f,0.0f);
-		DrawCircle(windowWidth*0.5f,windowHeight*0.85f,sunRadius,30);
+	else if(command==SimCommand::TOGGLE_PAUSE&&replaying) {
+		replayPaused=!replayPaused;
 	}
-}
-void DrawMountains() {
-	/* ... Same ... */ float darkness=getDarknessFactor();
-	Color baseColorDay= {0.1f,0.35f,0.1f},baseColorNight= {0.02f,0.08f,0.02f},baseColor=lerpColor(baseColorDay,baseColorNight,darkness);
-	Color midColorDay= {0.15f,0.45f,0.15f},midColorNight= {0.03f,0.12f,0.03f},midColor=lerpColor(midColorDay,midColorNight,darkness);
-	Color topColorDay= {0.2f,0.5f,0.2f},topColorNight= {0.05f,0.15f,0.05f},topColor=lerpColor(topColorDay,topColorNight,darkness);
-	glColor3f(baseColor.r,baseColor.g,baseColor.b);
-	glBegin(GL_POLYGON);
-	glVertex2f(windowWidth*0.3f,upperFootpathTopY);
-	glVertex2f(windowWidth*0.45f,windowHeight*0.55f);
-	glVertex2f(windowWidth*0.6f,windowHeight*0.4f);
-	glVertex2f(windowWidth*0.7f,windowHeight*0.65f);
-	glVertex2f(windowWidth*0.9f,windowHeight*0.5f);
-	glVertex2f(windowWidth*1.1f,upperFootpathTopY);
-	glEnd();
-	glColor3f(midColor.r,midColor.g,midColor.b);
-	glBegin(GL_POLYGON);
-	glVertex2f(windowWidth*0.45f,upperFootpathTopY);
-	glVertex2f(windowWidth*0.6f,windowHeight*0.5f);
-	glVertex2f(windowWidth*0.75f,windowHeight*0.35f);
-	glVertex2f(windowWidth*0.85f,windowHeight*0.6f);
-	glVertex2f(windowWidth*1.0f,upperFootpathTopY);
-	glEnd();
-	glColor3f(topColor.r,topColor.g,topColor.b);
-	glBegin(GL_POLYGON);
-	glVertex2f(windowWidth*0.65f,upperFootpathTopY);
-	glVertex2f(windowWidth*0.8f,windowHeight*0.45f);
-	glVertex2f(windowWidth*0.95f,upperFootpathTopY);
-	glEnd();
-}
-void DrawFootpath() {
-	/* ... Same ... */ float darkness = getDarknessFactor();
-	Color pathDay = {0.7f, 0.7f, 0.7f};
-	Color pathNight = {0.3f, 0.3f, 0.3f};
-	Color pathColor = lerpColor(pathDay, pathNight, darkness);
-	glColor3f(pathColor.r, pathColor.g, pathColor.b);
-	glBegin(GL_QUADS);
-	glVertex2f(0, upperFootpathTopY);
-	glVertex2f(windowWidth, upperFootpathTopY);
-	glVertex2f(windowWidth, upperFootpathBottomY);
-	glVertex2f(0, upperFootpathBottomY);
-	glEnd();
-	glBegin(GL_QUADS);
-	glVertex2f(0, lowerFootpathTopY);
-	glVertex2f(windowWidth, lowerFootpathTopY);
-	glVertex2f(windowWidth, lowerFootpathBottomY);
-	glVertex2f(0, lowerFootpathBottomY);
-	glEnd();
-}
-void DrawRoad() {
-	/* ... Same ... */ float darkness=getDarknessFactor();
-	Color roadColorDay= {0.3f,0.3f,0.3f},roadColorNight= {0.1f,0.1f,0.1f},roadColor=lerpColor(roadColorDay,roadColorNight,darkness);
-	Color lineDay= {0.9f,0.9f,0.9f},lineNight= {0.4f,0.4f,0.4f},lineColor=lerpColor(lineDay,lineNight,darkness);
-	glColor3f(roadColor.r,roadColor.g,roadColor.b);
-	glBegin(GL_QUADS);
-	glVertex2f(0,roadTopY);
-	glVertex2f(windowWidth,roadTopY);
-	glVertex2f(windowWidth,roadBottomY);
-	glVertex2f(0,roadBottomY);
-	glEnd();
-	glColor3f(lineColor.r,lineColor.g,lineColor.b);
-	glLineWidth(3.0f);
-	glBegin(GL_LINES);
-	float dashLength=40.0f,gapLength=30.0f,lineY=(roadTopY+roadBottomY)/2.0f;
-	float startOffset=(vehicles.empty()?0.0f:fmod(-timeOfDay*50.0f,dashLength+gapLength));
-	for(float x=startOffset-(dashLength+gapLength); x<windowWidth; x+=dashLength+gapLength) {
-		glVertex2f(x,lineY);
-		glVertex2f(x+dashLength,lineY);
+	else if((command==SimCommand::SEEK_FORWARD||command==SimCommand::SEEK_BACK)&&replaying) {
+		uint64_t target=player.tick();
+		if(command==SimCommand::SEEK_FORWARD) target=std::min(player.lastTick(),target+REPLAY_SEEK_TICKS);
+		else target=(target>player.firstTick()+REPLAY_SEEK_TICKS)?target-REPLAY_SEEK_TICKS:player.firstTick();
+		player.seek(target);
 	}
-	glEnd();
-	glLineWidth(1.0f);
 }
-void DrawZebraCrossing() {
-	/* ... Same ... */ float darkness=getDarknessFactor();
-	Color stripeDay= {0.9f,0.9f,0.9f},stripeNight= {0.5f,0.5f,0.5f},stripeColor=lerpColor(stripeDay,stripeNight,darkness);
-	glColor3f(stripeColor.r,stripeColor.g,stripeColor.b);
-	float stripeWidth=8.0f,gapWidth=6.0f,startY=roadBottomY+2,endY=roadTopY-2,startX=zebraCrossingX-zebraCrossingWidth/2.0f;
-	for(float x=startX; x<startX+zebraCrossingWidth; x+=stripeWidth+gapWidth) {
-		glBegin(GL_QUADS);
-		glVertex2f(x,endY);
-		glVertex2f(x+stripeWidth,endY);
-		glVertex2f(x+stripeWidth,startY);
-		glVertex2f(x,startY);
-		glEnd();
+
+// Runs ticks ticks of the world (or the recording) into out.
+void StepSimulation(int ticks, SimFrame& out) {
+	if(replaying) {
+		PROFILE_ZONE("update.replay_decode");
+		for(int t=0; t<ticks; ++t) {
+			if(t==ticks-1) out.previous=player.frame();
+			if(!replayPaused&&!player.next()) replayPaused=true; // Hold the last frame
+		}
+		out.current=player.frame();
+		CaptureScenery(world,out.previous);
+		CaptureScenery(world,out.current);
 	}
-}
-void DrawBuilding1(float x, float y, float scale) {
-	/* ... Same ... */ float baseW=60*scale, baseH=250*scale, topH=40*scale;
-	float darkness=getDarknessFactor();
-	Color mainDay= {0.7f,0.7f,0.2f}, mainNight= {0.3f,0.3f,0.1f}, mainColor=lerpColor(mainDay,mainNight,darkness);
-	Color accentDay= {0.2f,0.6f,0.4f}, accentNight= {0.1f,0.3f,0.2f}, accentColor=lerpColor(accentDay,accentNight,darkness);
-	bool isNight=isNightTime(timeOfDay);
-	Color windowDay= {0.1f,0.1f,0.1f}, windowNight= {0.8f,0.8f,0.5f}, windowColor=isNight?windowNight:windowDay;
-	glColor3f(mainColor.r,mainColor.g,mainColor.b);
-	glBegin(GL_QUADS);
-	glVertex2f(x,y+baseH);
-	glVertex2f(x+baseW,y+baseH);
-	glVertex2f(x+baseW,y);
-	glVertex2f(x,y);
-	glEnd();
-	glColor3f(accentColor.r,accentColor.g,accentColor.b);
-	glBegin(GL_QUADS);
-	glVertex2f(x-baseW*0.3f,y+baseH*0.9f);
-	glVertex2f(x,y+baseH);
-	glVertex2f(x,y);
-	glVertex2f(x-baseW*0.3f,y+baseH*0.1f);
-	glEnd();
-	glBegin(GL_TRIANGLES);
-	glVertex2f(x-baseW*0.3f,y+baseH*0.9f);
-	glVertex2f(x-baseW*0.15f,y+baseH*0.9f+topH);
-	glVertex2f(x,y+baseH);
-	glEnd();
-	glColor3f(windowColor.r,windowColor.g,windowColor.b);
-	int rows=10,cols=3;
-	float winW=baseW/cols*0.6f,winH=baseH/rows*0.6f;
-	for(int r=0; r<rows; ++r) for(int c=0; c<cols; ++c) {
-			float winX=x+(c+0.2f)*(baseW/cols),winY=y+(r+0.2f)*(baseH/rows);
-			glRectf(winX,winY,winX+winW,winY+winH);
+	else {
+		for(int t=0; t<ticks; ++t) {
+			if(t==ticks-1) CaptureFrame(world,out.previous);
+			world.step(SIM_TICK_SECONDS);
+			PROFILE_ZONE("update.record");
+			recorder.capture(world);
 		}
-}
-void DrawBuilding2(float x, float y, float scale) {
-	/* ... Same ... */ float baseW=80*scale, baseH=300*scale, topH=60*scale;
-	float darkness=getDarknessFactor();
-	Color mainDay= {0.9f,0.9f,0.9f}, mainNight= {0.4f,0.4f,0.4f}, mainColor=lerpColor(mainDay,mainNight,darkness);
-	Color frameDay= {0.1f,0.1f,0.1f}, frameNight= {0.05f,0.05f,0.05f}, frameColor=lerpColor(frameDay,frameNight,darkness);
-	bool isNight=isNightTime(timeOfDay);
-	Color windowDay= {0.4f,0.5f,0.6f}, windowNight= {0.8f,0.8f,0.5f}, windowColor=isNight?windowNight:windowDay;
-	glColor3f(windowColor.r,windowColor.g,windowColor.b);
-	glBegin(GL_QUADS);
-	glVertex2f(x,y+baseH);
-	glVertex2f(x+baseW,y+baseH);
-	glVertex2f(x+baseW,y);
-	glVertex2f(x,y);
-	glEnd();
-	glColor3f(frameColor.r,frameColor.g,frameColor.b);
-	glLineWidth(2.0f);
-	int vLines=6;
-	for(int i=0; i<=vLines; ++i) {
-		float lineX=x+i*(baseW/vLines);
-		glBegin(GL_LINES);
-		glVertex2f(lineX,y);
-		glVertex2f(lineX,y+baseH);
-		glEnd();
+		PROFILE_ZONE("update.capture_frame");
+		CaptureFrame(world,out.current);
 	}
-	int hLines=15;
-	for(int i=0; i<=hLines; ++i) {
-		float lineY=y+i*(baseH/hLines);
-		glBegin(GL_LINES);
-		glVertex2f(x,lineY);
-		glVertex2f(x+baseW,lineY);
-		glEnd();
-	}
-	glLineWidth(1.0f);
-	glColor3f(mainColor.r,mainColor.g,mainColor.b);
-	glBegin(GL_TRIANGLES);
-	glVertex2f(x,y+baseH);
-	glVertex2f(x+baseW/2,y+baseH+topH);
-	glVertex2f(x+baseW,y+baseH);
-	glEnd();
-	glColor3f(frameColor.r,frameColor.g,frameColor.b);
-	glBegin(GL_LINES);
-	glVertex2f(x+baseW/2,y+baseH);
-	glVertex2f(x+baseW/2,y+baseH+topH);
-	glEnd();
 }
-void DrawBuilding3(float x, float y, float scale) {
-	/* ... Same ... */ float currentW=100*scale, currentH=60*scale, currentY=y;
-	int segments=6;
-	float darkness=getDarknessFactor();
-	Color mainDay= {0.2f,0.4f,0.7f}, mainNight= {0.1f,0.2f,0.35f}, mainColor=lerpColor(mainDay,mainNight,darkness);
-	bool isNight=isNightTime(timeOfDay);
-	Color windowDay= {0.9f,0.5f,0.1f}, windowNight= {1.0f,0.8f,0.3f}, windowColor=isNight?windowNight:windowDay;
-	for(int i=0; i<segments; ++i) {
-		glColor3f(mainColor.r,mainColor.g,mainColor.b);
-		glBegin(GL_QUADS);
-		glVertex2f(x,currentY+currentH);
-		glVertex2f(x+currentW,currentY+currentH);
-		glVertex2f(x+currentW,currentY);
-		glVertex2f(x,currentY);
-		glEnd();
-		glColor3f(windowColor.r,windowColor.g,windowColor.b);
-		int numWindows=5-i;
-		float winW=currentW*0.1f, winH=currentH*0.5f, winY=currentY+currentH*0.25f;
-		float spacing=(currentW-numWindows*winW)/(numWindows+1);
-		for(int w=0; w<numWindows; ++w) {
-			float winX=x+spacing*(w+1)+winW*w;
-			glRectf(winX,winY,winX+winW,winY+winH);
-		}
-		currentY+=currentH;
-		x+=currentW*0.1f;
-		currentW*=0.8f;
-		currentH*=0.95f;
-	}
-	glColor3f(0.5f,0.5f,0.5f);
-	glBegin(GL_QUADS);
-	glVertex2f(x+currentW/2-2*scale,currentY+20*scale);
-	glVertex2f(x+currentW/2+2*scale,currentY+20*scale);
-	glVertex2f(x+currentW/2+2*scale,currentY);
-	glVertex2f(x+currentW/2-2*scale,currentY);
-	glEnd();
+
+// Rebuilds out's grids from out.current. They cover as far as the camera can pan, the
+// window's width either side, plus the cull margin; vehicles queued further out to enter
+// are left out, since no view can reach them.
+void IndexFrame(SimFrame& out) {
+	PROFILE_ZONE("update.index");
+	const FrameState& f=out.current;
+	float w=(float)world.width, h=(float)world.height, m=VIEW_CULL_MARGIN;
+	out.vehicleGrid.reset(-w-m,-m,2.0f*w+m,h+m,ENTITY_GRID_CELL);
+	out.vehicleGrid.build(f.vehicles.size(),[&f](size_t i, float& x, float& y) {
+		if(!f.vehicleActive[i]) return false;
+		x=f.vehicles[i].x;
+		y=f.vehicles[i].y;
+		return true;
+	});
+	auto index=[&](const std::vector<Pedestrian>& pedestrians, SpatialGrid& grid) {
+		grid.reset(-w-m,-m,2.0f*w+m,h+m,ENTITY_GRID_CELL);
+		grid.build(pedestrians.size(),[&pedestrians](size_t i, float& x, float& y) {
+			x=pedestrians[i].x;
+			y=pedestrians[i].y;
+			return true;
+		});
+	};
+	index(f.sidewalkPedestrians,out.sidewalkGrid);
+	index(f.crossingPedestrians,out.crossingGrid);
 }
-void DrawControlTower(float x, float y, float scale) {
-	/* ... Same ... */ float baseH=80*scale, baseW=20*scale, platform1R=40*scale, platform1H=10*scale;
-	float platform2R=30*scale, platform2H=8*scale, topR=10*scale;
-	float darkness=getDarknessFactor();
-	Color baseDay= {0.4f,0.4f,0.45f}, baseNight= {0.15f,0.15f,0.2f}, baseColor=lerpColor(baseDay,baseNight,darkness);
-	Color plat1Day= {0.6f,0.6f,0.6f}, plat1Night= {0.3f,0.3f,0.3f}, plat1Color=lerpColor(plat1Day,plat1Night,darkness);
-	Color plat2Day= {0.8f,0.8f,0.3f}, plat2Night= {0.4f,0.4f,0.15f}, plat2Color=lerpColor(plat2Day,plat2Night,darkness);
-	Color topDay= {0.3f,0.8f,0.8f}, topNight= {0.15f,0.4f,0.4f}, topColor=lerpColor(topDay,topNight,darkness);
-	glColor3f(baseColor.r,baseColor.g,baseColor.b);
-	glBegin(GL_QUADS);
-	glVertex2f(x-baseW/2,y+baseH);
-	glVertex2f(x+baseW/2,y+baseH);
-	glVertex2f(x+baseW/2,y);
-	glVertex2f(x-baseW/2,y);
-	glEnd();
-	float plat1Y=y+baseH;
-	glColor3f(plat1Color.r,plat1Color.g,plat1Color.b);
-	glBegin(GL_QUADS);
-	glVertex2f(x-platform1R,plat1Y+platform1H);
-	glVertex2f(x+platform1R,plat1Y+platform1H);
-	glVertex2f(x+platform1R,plat1Y);
-	glVertex2f(x-platform1R,plat1Y);
-	glEnd();
-	float plat2Y=plat1Y+platform1H;
-	glColor3f(plat2Color.r,plat2Color.g,plat2Color.b);
-	glBegin(GL_QUADS);
-	glVertex2f(x-platform2R,plat2Y+platform2H);
-	glVertex2f(x+platform2R,plat2Y+platform2H);
-	glVertex2f(x+platform2R,plat2Y);
-	glVertex2f(x-platform2R,plat2Y);
-	glEnd();
-	float topY=plat2Y+platform2H;
-	glColor3f(topColor.r,topColor.g,topColor.b);
-	DrawCircle(x,topY+topR,topR,20);
-	glColor3f(0.8f,0.8f,0.8f);
-	glBegin(GL_LINES);
-	glVertex2f(x,topY+topR*2);
-	glVertex2f(x,topY+topR*2+10*scale);
-	glEnd();
+
+// Publishes the world as it stands, both ticks the same, for the first frames.
+void PublishInitialFrame() {
+	SimFrame& out=simFrames.back();
+	if(replaying) {
+		out.current=player.frame();
+		CaptureScenery(world,out.current);
+	}
+	else CaptureFrame(world,out.current);
+	IndexFrame(out);
+	out.previous=out.current;
+	out.alpha=0.0f;
+	out.published=std::chrono::steady_clock::now();
+	out.ticks=simClock.ticks;
+	out.droppedTicks=simClock.droppedTicks;
+	out.sceneryVersion=sceneryVersion;
+	simFrames.publish();
 }
-void DrawTrafficLight(float x, float y, float scale) {
-	/* ... Same ... */ float poleW=8*scale, poleH=70*scale, boxW=25*scale, boxH=60*scale, lightR=7*scale;
-	glColor3f(0.2f,0.2f,0.2f);
-	glBegin(GL_QUADS);
-	glVertex2f(x-poleW/2,y+poleH);
-	glVertex2f(x+poleW/2,y+poleH);
-	glVertex2f(x+poleW/2,y);
-	glVertex2f(x-poleW/2,y);
-	glEnd();
-	float boxY=y+poleH*0.3f;
-	glColor3f(0.1f,0.1f,0.1f);
-	glBegin(GL_QUADS);
-	glVertex2f(x-boxW/2,boxY+boxH);
-	glVertex2f(x+boxW/2,boxY+boxH);
-	glVertex2f(x+boxW/2,boxY);
-	glVertex2f(x-boxW/2,boxY);
-	glEnd();
-	float lightSpacing=boxH/4.0f, lightX=x;
-	float redY=boxY+lightSpacing*3, yellowY=boxY+lightSpacing*2, greenY=boxY+lightSpacing*1;
-	glColor3f(0.3f,0.0f,0.0f);
-	DrawCircle(lightX,redY,lightR,15);
-	glColor3f(0.3f,0.3f,0.0f);
-	DrawCircle(lightX,yellowY,lightR,15);
-	glColor3f(0.0f,0.3f,0.0f);
-	DrawCircle(lightX,greenY,lightR,15);
-	switch(trafficLightState) {
-	case RED:
-		glColor3f(1.0f,0.0f,0.0f);
-		DrawCircle(lightX,redY,lightR,15);
-		break;
-	case YELLOW:
-		glColor3f(1.0f,1.0f,0.0f);
-		DrawCircle(lightX,yellowY,lightR,15);
-		break;
-	case GREEN:
-		glColor3f(0.0f,1.0f,0.0f);
-		DrawCircle(lightX,greenY,lightR,15);
-		break;
+
+void SimulationLoop() {
+	SetProfileThreadName("simulation");
+	auto last=std::chrono::steady_clock::now();
+	while(!simStopping.load(std::memory_order_acquire)) {
+		SimCommand command;
+		while(simCommands.pop(command)) RunSimCommand(command);
+		uint64_t size=simWindowSize.load(std::memory_order_relaxed);
+		if(size!=0&&(world.width!=(int)(size>>32)||world.height!=(int)(size&0xffffffffu))) world.resize((int)(size>>32),(int)(size&0xffffffffu));
+		auto now=std::chrono::steady_clock::now();
+		int ticks=simClock.advance(std::chrono::duration<double>(now-last).count());
+		last=now;
+		if(ticks>0) {
+			PROFILE_ZONE("update");
+			SimFrame& out=simFrames.back();
+			StepSimulation(ticks,out);
+			IndexFrame(out);
+			out.alpha=simClock.alpha();
+			out.published=now;
+			out.ticks=simClock.ticks;
+			out.droppedTicks=simClock.droppedTicks;
+			out.sceneryVersion=sceneryVersion;
+			simFrames.publish();
+		}
+		// Sleep until the next tick falls due
+		double wait=(1.0-simClock.alpha())*SIM_TICK_SECONDS;
+		std::this_thread::sleep_until(now+std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(wait)));
 	}
 }
-void DrawVehicle(const Vehicle& v) { // *** Fading Headlights ***
-	float darkness=getDarknessFactor();
-	Color bodyColor=lerpColor(v.color, {v.color.r*0.4f,v.color.g*0.4f,v.color.b*0.4f},darkness);
-	Color windowColor=lerpColor({0.2f,0.2f,0.3f}, {0.1f,0.1f,0.1f},darkness*0.8f);
-	Color wheelColor=lerpColor({0.1f,0.1f,0.1f}, {0.05f,0.05f,0.05f},darkness);
-	Color hubcapColor=lerpColor({0.6f,0.6f,0.6f}, {0.3f,0.3f,0.3f},darkness);
-	float wheelR=v.height*0.2f;
-	// Calculate headlight brightness based on darkness factor
-	float headlightBrightness = std::max(0.0f, (darkness - 0.5f) * 2.0f); // Start fading in after half dark
-	headlightBrightness = std::min(1.0f, headlightBrightness);
-	Color headLightColorDay = {0.3f, 0.3f, 0.3f};
-	Color headLightColorNight = {1.0f, 1.0f, 0.7f};
-	Color headLightColor = lerpColor(headLightColorDay, headLightColorNight, headlightBrightness);
-	float headLightSize=4.0f;
-	glPushMatrix();
-	glTranslatef(v.x,v.y,0.0f);
-	glColor3f(bodyColor.r,bodyColor.g,bodyColor.b);
-	glBegin(GL_QUADS);
-	if(v.type==BUS) {
-		glVertex2f(0,v.height);
-		glVertex2f(v.width,v.height);
-		glVertex2f(v.width*0.98f,0);
-		glVertex2f(v.width*0.02f,0);
-	}
-	else if(v.type==TRUCK) {
-		float cabW=v.width*0.4f,cabH=v.height*0.9f;
-		if(v.direction<0) {
-			glVertex2f(0,v.height);
-			glVertex2f(cabW,v.height);
-			glVertex2f(cabW,v.height-cabH);
-			glVertex2f(0,v.height-cabH);
-			glVertex2f(cabW*1.1f,v.height*0.85f);
-			glVertex2f(v.width,v.height*0.85f);
-			glVertex2f(v.width,0);
-			glVertex2f(cabW*1.1f,0);
-		}
-		else {
-			glVertex2f(v.width-cabW,v.height);
-			glVertex2f(v.width,v.height);
-			glVertex2f(v.width,v.height-cabH);
-			glVertex2f(v.width-cabW,v.height-cabH);
-			glVertex2f(0,v.height*0.85f);
-			glVertex2f(v.width-cabW*1.1f,v.height*0.85f);
-			glVertex2f(v.width-cabW*1.1f,0);
-			glVertex2f(0,0);
-		}
-	}
-	else {
-		glVertex2f(v.width*0.1f,v.height);
-		glVertex2f(v.width*0.9f,v.height);
-		glVertex2f(v.width,v.height*0.5f);
-		glVertex2f(v.width,0);
-		glVertex2f(0,0);
-		glVertex2f(0,v.height*0.5f);
-	}
-	glEnd();
-	glColor3f(windowColor.r,windowColor.g,windowColor.b);
-	if(v.type==BUS) {
-		float winH=v.height*0.4f,winY=v.height*0.4f,winW=v.width*0.12f,spacing=v.width*0.04f;
-		for(int i=0; i<5; ++i) glRectf(v.width*0.1f+i*(winW+spacing),winY,v.width*0.1f+i*(winW+spacing)+winW,winY+winH);
-		glRectf(v.width*0.1f+5*(winW+spacing),winY,v.width*0.9f,winY+winH);
-	}
-	else if(v.type==TRUCK) {
-		if(v.direction<0) glRectf(v.width*0.05f,v.height*0.4f,v.width*0.35f,v.height*0.9f);
-		else glRectf(v.width*0.65f,v.height*0.4f,v.width*0.95f,v.height*0.9f);
-	}
-	else {
-		glBegin(GL_QUADS);
-		glVertex2f(v.width*0.15f,v.height*0.9f);
-		glVertex2f(v.width*0.85f,v.height*0.9f);
-		glVertex2f(v.width*0.9f,v.height*0.5f);
-		glVertex2f(v.width*0.1f,v.height*0.5f);
-		glEnd();
-	}
-	glColor3f(wheelColor.r,wheelColor.g,wheelColor.b);
-	float frontWheelX, backWheelX;
-	if(v.type==TRUCK) {
-		if(v.direction<0) {
-			frontWheelX=v.width*0.2f;
-			backWheelX=v.width*0.8f;
-		}
-		else {
-			frontWheelX=v.width*0.8f;
-			backWheelX=v.width*0.2f;
-		}
-		DrawCircle(frontWheelX,wheelR,wheelR,15);
-		DrawCircle(backWheelX,wheelR,wheelR,15);
-		DrawCircle(backWheelX + (v.direction<0 ? wheelR*2.2f : -wheelR*2.2f), wheelR, wheelR, 15);
-	}
-	else {
-		if(v.direction<0) {
-			frontWheelX=v.width*0.25f;
-			backWheelX=v.width*0.75f;
-		}
-		else {
-			frontWheelX=v.width*0.75f;
-			backWheelX=v.width*0.25f;
-		}
-		DrawCircle(frontWheelX,wheelR,wheelR,15);
-		DrawCircle(backWheelX,wheelR,wheelR,15);
-	}
-	glColor3f(hubcapColor.r,hubcapColor.g,hubcapColor.b);
-	DrawCircle(frontWheelX,wheelR,wheelR*0.4f,8);
-	DrawCircle(backWheelX,wheelR,wheelR*0.4f,8);
-	if(v.type==TRUCK) DrawCircle(backWheelX + (v.direction<0 ? wheelR*2.2f : -wheelR*2.2f), wheelR, wheelR*0.4f, 8);
-	// Draw Headlights using calculated color
-	glColor3f(headLightColor.r, headLightColor.g, headLightColor.b);
-	if(v.direction>0) {
-		if(v.type!=TRUCK) {
-			glRectf(v.width-headLightSize-3,v.height*0.2f,v.width-3,v.height*0.2f+headLightSize);
-			glRectf(v.width-headLightSize*2.5f-3,v.height*0.2f,v.width-headLightSize*1.5f-3,v.height*0.2f+headLightSize);
-		}
-		else {
-			glRectf(v.width-headLightSize-3,v.height*0.3f,v.width-3,v.height*0.3f+headLightSize);
-		}
-	}
-	else {
-		if(v.type!=TRUCK) {
-			glRectf(3,v.height*0.2f,3+headLightSize,v.height*0.2f+headLightSize);
-			glRectf(3+headLightSize*1.5f,v.height*0.2f,3+headLightSize*2.5f,v.height*0.2f+headLightSize);
-		}
-		else {
-			glRectf(3,v.height*0.3f,3+headLightSize,v.height*0.3f+headLightSize);
-		}
-	}
-	glPopMatrix();
+
+void StartSimulation() {
+	simStopping.store(false,std::memory_order_relaxed);
+	PublishInitialFrame();
+	simThread=std::thread(SimulationLoop);
 }
-void DrawBird(const Bird& bird) {
-	/* ... Same ... */ float darkness=getDarknessFactor()*0.8f;
-	Color birdColor=lerpColor({0.1f,0.1f,0.1f}, {0.05f,0.05f,0.05f},darkness);
-	Color beakColor=lerpColor({1.0f,0.2f,0.1f}, {0.5f,0.1f,0.05f},darkness);
-	Color wingColor=lerpColor({0.9f,0.9f,0.9f}, {0.5f,0.5f,0.5f},darkness);
-	glPushMatrix();
-	glTranslatef(bird.x,bird.y,0.0f);
-	glScalef(0.8f,0.8f,1.0f);
-	glColor3f(birdColor.r,birdColor.g,birdColor.b);
-	glBegin(GL_POLYGON);
-	glVertex2f(-15,0);
-	glVertex2f(0,5);
-	glVertex2f(10,3);
-	glVertex2f(15,-2);
-	glVertex2f(0,-5);
-	glEnd();
-	glColor3f(beakColor.r,beakColor.g,beakColor.b);
-	glBegin(GL_TRIANGLES);
-	glVertex2f(15,-2);
-	glVertex2f(22,0);
-	glVertex2f(15,1);
-	glEnd();
-	float wingYOffset=2.0f, wingTipY;
-	float phase=fmod(bird.flapPhase,2.0f*M_PI);
-	wingTipY=10.0f+5.0f*sin(phase);
-	glColor3f(birdColor.r,birdColor.g,birdColor.b);
-	glBegin(GL_TRIANGLES);
-	glVertex2f(-8,wingYOffset);
-	glVertex2f(8,wingYOffset);
-	glVertex2f(0,wingYOffset+wingTipY);
-	glEnd();
-	glColor3f(wingColor.r,wingColor.g,wingColor.b);
-	glBegin(GL_TRIANGLES);
-	glVertex2f(-3,wingYOffset+wingTipY*0.7f);
-	glVertex2f(3,wingYOffset+wingTipY*0.7f);
-	glVertex2f(0,wingYOffset+wingTipY);
-	glEnd();
-	glPopMatrix();
+
+// Registered with atexit, since GLUT leaves its main loop by calling exit().
+void StopSimulation() {
+	if(!simThread.joinable()) return;
+	simStopping.store(true,std::memory_order_release);
+	simThread.join();
 }
-void DrawPedestrian(const Pedestrian& p) { // *** Use darknessFactor for fading alpha ***
-	float darkness=getDarknessFactor();
-	float alpha = 1.0f;
-	if (p.state == WALKING_SIDEWALK) {
-		// Start fading when darkness > 0.5, fully faded (alpha=0.1) when darkness = 1.0
-		alpha = 1.0f - std::max(0.0f, std::min(1.0f, (darkness - 0.5f) * 2.0f)) * 0.9f;
-	}
 
-	Color skinColor=lerpColor({0.9f,0.7f,0.5f}, {0.5f,0.4f,0.3f},darkness);
-	Color clothesColor=lerpColor(p.clothingColor, {p.clothingColor.r*0.4f,p.clothingColor.g*0.4f,p.clothingColor.b*0.4f},darkness);
-	float headR=4.0f, bodyH=12.0f, bodyW=5.0f, legH=8.0f, legW=2.0f;
-	glEnable(GL_BLEND);
-	glBlendFunc(GL_SRC_ALPHA,GL_ONE_MINUS_SRC_ALPHA);
-	glPushMatrix();
-	glTranslatef(p.x,p.y,0.0f);
-	glColor4f(skinColor.r,skinColor.g,skinColor.b,alpha);
-	DrawCircle(0,bodyH+legH+headR,headR,10);
-	glColor4f(clothesColor.r,clothesColor.g,clothesColor.b,alpha);
-	glBegin(GL_QUADS);
-	glVertex2f(-bodyW/2,legH+bodyH);
-	glVertex2f(bodyW/2,legH+bodyH);
-	glVertex2f(bodyW/2,legH);
-	glVertex2f(-bodyW/2,legH);
-	glEnd();
-	float legOffset=2.5f*sin(p.legPhase);
-	glBegin(GL_QUADS);
-	glVertex2f(-legW*1.5f,legH);
-	glVertex2f(-legW*0.5f,legH);
-	glVertex2f(-legW*0.5f+legOffset,0);
-	glVertex2f(-legW*1.5f+legOffset,0);
-	glEnd();
-	glBegin(GL_QUADS);
-	glVertex2f(legW*0.5f,legH);
-	glVertex2f(legW*1.5f,legH);
-	glVertex2f(legW*1.5f-legOffset,0);
-	glVertex2f(legW*0.5f-legOffset,0);
-	glEnd();
-	glPopMatrix();
+// Replaces world with QUICK_SNAPSHOT_PATH. The simulation thread is stopped meanwhile, so
+// nothing draws from a half-loaded layout, and restarted from the loaded state.
+void LoadQuickSnapshot() {
+	if(replaying) return;
+	bool running=simThread.joinable();
+	StopSimulation();
+	snapshotWriter.flush(); // Do not read a file that is still being written
+	int w=world.width, h=world.height;
+	if(RestoreWorld(QUICK_SNAPSHOT_PATH)) {
+		world.resize(w,h);
+		sceneryVersion++; // The trees and street lights come from the snapshot
+	}
+	if(running) StartSimulation();
 }
-void DrawTree(const Tree& tree) {
-	/* ... Same ... */ float darkness=getDarknessFactor();
-	Color currentFoliageColor=lerpColor(tree.foliageColor, {tree.foliageColor.r*0.3f,tree.foliageColor.g*0.3f,tree.foliageColor.b*0.3f},darkness);
-	Color currentTrunkColor=lerpColor(tree.trunkColor, {tree.trunkColor.r*0.3f,tree.trunkColor.g*0.3f,tree.trunkColor.b*0.3f},darkness);
-	float trunkWidth=10.0f*tree.scale,trunkHeight=40.0f*tree.scale,foliageRadius=25.0f*tree.scale,foliageCenterY=tree.pos.y+trunkHeight;
-	glColor3f(currentTrunkColor.r,currentTrunkColor.g,currentTrunkColor.b);
-	glBegin(GL_QUADS);
-	glVertex2f(tree.pos.x-trunkWidth/2,tree.pos.y+trunkHeight);
-	glVertex2f(tree.pos.x+trunkWidth/2,tree.pos.y+trunkHeight);
-	glVertex2f(tree.pos.x+trunkWidth/2,tree.pos.y);
-	glVertex2f(tree.pos.x-trunkWidth/2,tree.pos.y);
-	glEnd();
-	glColor3f(currentFoliageColor.r,currentFoliageColor.g,currentFoliageColor.b);
-	DrawCircle(tree.pos.x,foliageCenterY,foliageRadius,20);
-	DrawCircle(tree.pos.x-foliageRadius*0.4f,foliageCenterY+foliageRadius*0.1f,foliageRadius*0.7f,15);
-	DrawCircle(tree.pos.x+foliageRadius*0.4f,foliageCenterY+foliageRadius*0.1f,foliageRadius*0.7f,15);
-	DrawCircle(tree.pos.x,foliageCenterY+foliageRadius*0.5f,foliageRadius*0.6f,15);
+
+// The world's size follows the window; posted when the simulation thread is running.
+void ResizeWorld(int w, int h) {
+	if(simThread.joinable()) simWindowSize.store((uint64_t)w<<32|(uint32_t)h,std::memory_order_relaxed);
+	else world.resize(w,h);
 }
-void DrawStreetLight(const StreetLight& light) { // *** Simplified Glow ***
-	float poleWidth = 5.0f;
-	float lampHeight = 4.0f;
-	float lampWidth = 10.0f;
-	float armAngle = light.onUpper ? -25.0f : 25.0f;
-	float darkness = getDarknessFactor();
-	Color roadColorDay= {0.3f,0.3f,0.3f},roadColorNight= {0.1f,0.1f,0.1f},poleColor=lerpColor(roadColorDay,roadColorNight,darkness);
-	Color lampColorOff= {0.2f,0.2f,0.2f},lampColorOn= {1.0f,0.95f,0.75f};
-	// Calculate lamp brightness based on darkness factor
-	float lampBrightness = std::max(0.0f, std::min(1.0f, (darkness - 0.4f) * (1.0f / 0.5f) )); // Fade in between darkness 0.4 and 0.9
-	Color lampColor = lerpColor(lampColorOff, lampColorOn, lampBrightness);
 
-	glColor3f(poleColor.r, poleColor.g, poleColor.b);
-	glBegin(GL_QUADS);
-	glVertex2f(light.pos.x-poleWidth/2,light.pos.y+light.height);
-	glVertex2f(light.pos.x+poleWidth/2,light.pos.y+light.height);
-	glVertex2f(light.pos.x+poleWidth/2,light.pos.y);
-	glVertex2f(light.pos.x-poleWidth/2,light.pos.y);
-	glEnd();
-	glPushMatrix();
-	glTranslatef(light.pos.x,light.pos.y+light.height,0.0f);
-	glRotatef(armAngle,0,0,1);
-	glColor3f(poleColor.r,poleColor.g,poleColor.b);
-	glLineWidth(3.0f);
-	glBegin(GL_LINES);
-	glVertex2f(0,0);
-	glVertex2f(light.onUpper?-light.armLength:light.armLength,0);
-	glEnd();
-	glLineWidth(1.0f);
-	float lampPosX=light.onUpper?-light.armLength:light.armLength;
-	float lampPosY=-lampHeight*0.5f;
-	glColor3f(lampColor.r,lampColor.g,lampColor.b);
-	glRectf(lampPosX-lampWidth/2,lampPosY-lampHeight/2,lampPosX+lampWidth/2,lampPosY+lampHeight/2);
+// Asks for a redraw on a steady TARGET_FRAME_SECONDS grid, so timer rounding does not add
+// up to drift. display() draws whatever the simulation last published.
+void RedisplayTimer(int value) {
+	auto now=std::chrono::steady_clock::now();
+	glutPostRedisplay();
+	nextFrameDeadline+=std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(TARGET_FRAME_SECONDS));
+	if(nextFrameDeadline<now) nextFrameDeadline=now; // Fell behind: restart the grid from here
+	long long delayMs=std::chrono::duration_cast<std::chrono::milliseconds>(nextFrameDeadline-std::chrono::steady_clock::now()).count();
+	glutTimerFunc((unsigned)std::max(0LL,delayMs), RedisplayTimer, 0);
+}
 
-	// Glow Effect (Fades with lamp brightness)
-	if (lampBrightness > 0.01f) { // Only draw glow if lamp is somewhat on
-		float angleRad = armAngle * M_PI / 180.0f;
-		float lampWorldX = light.pos.x + cos(angleRad)*lampPosX;
-		float lampWorldY = light.pos.y + light.height + sin(angleRad)*lampPosX + lampPosY;
-		glEnable(GL_BLEND);
-		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-		int glowSegments = 20;
-		float maxRadius = 70.0f;
-		glBegin(GL_TRIANGLE_FAN);
-		glColor4f(1.0f, 0.95f, 0.7f, 0.25f * lampBrightness); // Center alpha depends on brightness
-		glVertex2f(lampWorldX, lampWorldY);
-		glColor4f(1.0f, 0.9f, 0.6f, 0.0f); // Edge always transparent
-		for (int i = 0; i <= glowSegments; ++i) {
-			float angle = M_PI + M_PI * (float)i / (float)glowSegments;
-			glVertex2f(lampWorldX + maxRadius * cos(angle) * 0.7f, lampWorldY + maxRadius * sin(angle) * 1.1f);
-		}
-		glEnd();
-	}
-	glPopMatrix();
+// Restores world from path and reports how long it took; false (with a message) on failure.
+bool RestoreWorld(const std::string& path) {
+	auto start=std::chrono::steady_clock::now();
+	std::string error;
+	if(!LoadSnapshot(path,world,error)) {
+		std::cerr<<"load failed: "<<error<<"\n";
+		return false;
+	}
+	double ms=std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now()-start).count();
+	std::cout<<"loaded "<<path<<" at tick "<<world.tick<<" ("<<world.entityCount()<<" entities) in "<<std::fixed<<std::setprecision(2)<<ms<<" ms\n";
+	return true;
 }
-void DrawClouds(const Cloud& cloud) { // Takes a single cloud
-	// Cloud color with fading alpha
-	glColor4f(1.0f, 1.0f, 1.0f, cloud.alpha); // Use cloud's alpha
 
-	glPushMatrix();
-	glTranslatef(cloud.pos.x, cloud.pos.y, 0.0f);
-	glScalef(cloud.scale, cloud.scale, 1.0f);
-	glEnable(GL_BLEND); // Ensure blend is on for clouds
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-	for (int i = 0; i < cloud.numEllipses; ++i) {
-		float shapeChangeX=1.0f+0.05f*sin(cloud.shapePhase+i*0.8f);
-		float shapeChangeY=1.0f+0.05f*cos(cloud.shapePhase+i*1.1f);
-		DrawEllipse(cloud.ellipseOffsets[i].x, cloud.ellipseOffsets[i].y, cloud.ellipseRadiiX[i]*shapeChangeX, cloud.ellipseRadiiY[i]*shapeChangeY, 15);
+// Opens the --record file, coded on encoders threads; the world's current state is its first frame.
+bool StartRecording(const std::string& path, int encoders) {
+	std::string error;
+	if(!recorder.open(path,world,encoders,error)) {
+		std::cerr<<"record failed: "<<error<<"\n";
+		return false;
 	}
-	glPopMatrix();
+	recorder.capture(world);
+	return true;
 }
 
-// --- Update and Initialization ---
+// Writes the retained zone samples of every thread to tracePath.
+void WriteTrace() {
+	std::string error;
+	if(WriteChromeTrace(tracePath,error)) std::cout<<"trace written to "<<tracePath<<"\n";
+	else std::cerr<<"trace failed: "<<error<<"\n";
+}
 
-void InitializeClouds() {
-	clouds.clear();
-	float cloudBaseY=windowHeight*0.75f;
-	for(int i=0; i<NUM_CLOUDS; ++i) {
-		Cloud c;
-		c.pos= {randFloat(-windowWidth*0.2f,windowWidth*1.2f),cloudBaseY+randFloat(-windowHeight*0.05f,windowHeight*0.1f)};
-		c.speed=randFloat(0.1f,0.4f);
-		c.scale=randFloat(0.8f,1.6f);
-		c.numEllipses=3+rand()%3;
-		c.shapePhase=randFloat(0,2.0f*M_PI);
-		c.alpha = 0.0f; /*Start invisible*/ float totalWidth=0;
-		for(int j=0; j<c.numEllipses; ++j) {
-			float offsetX=totalWidth+randFloat(-5,5);
-			float offsetY=randFloat(-8,8);
-			float radiusX=randFloat(25,40);
-			float radiusY=randFloat(15,30);
-			c.ellipseOffsets.push_back({offsetX,offsetY});
-			c.ellipseRadiiX.push_back(radiusX);
-			c.ellipseRadiiY.push_back(radiusY);
-			totalWidth+=radiusX*randFloat(0.6f,0.9f);
-		}
-		for(int j=0; j<c.numEllipses; ++j) {
-			c.ellipseOffsets[j].x-=totalWidth/2.2f;
-		}
-		clouds.push_back(c);
-	}
+// Batch runs write the trace (when --trace was given) on the way out; the window writes it on T.
+int FinishBatch(int status, bool trace) {
+	if(trace) WriteTrace();
+	return status;
 }
-void InitializeScene() {
-	/* ... Calls InitializeClouds ... */ srand(time(0));
-	birds.clear();
-	int numBirds=3+rand()%3;
-	if (!isNightTime(timeOfDay)) {
-		for(int i=0; i<numBirds; ++i) {
-			Bird b;
-			b.x=randFloat(0,windowWidth);
-			b.y=birdBaseY+randFloat(-birdAmplitudeY,birdAmplitudeY);
-			b.speed=randFloat(0.8f,1.8f);
-			b.flapPhase=randFloat(0,2.0f*M_PI);
-			b.flapSpeed=randFloat(0.15f,0.35f);
-			b.bobPhase=randFloat(0,2.0f*M_PI);
-			birds.push_back(b);
-		}
-	}
-	vehicles.clear();
-	float initialSpacing=150.0f;
-	for(int i=0; i<NUM_CARS; ++i) {
-		Vehicle v;
-		v.type=(VehicleType)(rand()%3);
-		v.color=randomColor();
-		bool goRight=(i%2==0);
-		v.y=goRight?LANE_Y1:LANE_Y2;
-		v.direction=goRight?1:-1;
-		switch(v.type) {
-		case BUS:
-			v.width=100;
-			v.height=40;
-			v.baseSpeed=randFloat(0.6f,1.0f);
-			break;
-		case TRUCK:
-			v.width=120;
-			v.height=45;
-			v.baseSpeed=randFloat(0.5f,0.9f);
-			break;
-		default:
-			v.width=60;
-			v.height=25;
-			v.baseSpeed=randFloat(0.8f,1.6f);
-			break;
-		}
-		v.speed=v.baseSpeed*randFloat(0.5f,1.0f);
-		if(v.direction>0) {
-			v.x=-200.0f-(i/2)*(v.width+initialSpacing+randFloat(0,50));
-		}
-		else {
-			v.x=windowWidth+200.0f+(i/2)*(v.width+initialSpacing+randFloat(0,50));
-		}
-		vehicles.push_back(v);
-	}
-	sidewalkPedestrians.clear();
-	for(int i=0; i<NUM_SIDEWALK_PEDESTRIANS; ++i) {
-		Pedestrian p;
-		p.onUpperPath=(rand()%2==0);
-		p.y=p.onUpperPath?upperSidewalkLevelY:lowerSidewalkLevelY;
-		p.x=randFloat(0,windowWidth);
-		p.speed=randFloat(0.3f,0.7f)*((rand()%2)*2-1);
-		p.state=WALKING_SIDEWALK;
-		p.legPhase=randFloat(0,2.0f*M_PI);
-		p.legSpeed=randFloat(0.08f,0.15f);
-		p.clothingColor=randomColor();
-		sidewalkPedestrians.push_back(p);
-	}
-	crossingPedestrians.clear();
-	float waitX=crossingWalkX;
-	for(int i=0; i<NUM_CROSSING_PEDESTRIANS; ++i) {
-		Pedestrian p;
-		p.onUpperPath=(i%2==0);
-		p.y=p.onUpperPath?upperSidewalkLevelY:lowerSidewalkLevelY;
-		p.x=waitX+randFloat(-zebraCrossingWidth*0.3f,zebraCrossingWidth*0.3f);
-		p.speed=randFloat(0.5f,0.8f);
-		p.state=WAITING_TO_CROSS;
-		p.targetY=p.onUpperPath?lowerSidewalkLevelY:upperSidewalkLevelY;
-		p.legPhase=randFloat(0,2.0f*M_PI);
-		p.legSpeed=randFloat(0.1f,0.18f);
-		p.clothingColor=randomColor();
-		crossingPedestrians.push_back(p);
-	}
-	trees.clear();
-	Color trunkC= {0.4f,0.2f,0.1f};
-	for(int i=0; i<NUM_TREES; ++i) {
-		Tree t;
-		bool onUpper=(rand()%2==0);
-		t.pos.y=onUpper?upperFootpathTopY:lowerFootpathBottomY;
-		t.pos.x=randFloat(20,windowWidth-20);
-		if(fabs(t.pos.x-zebraCrossingX)<zebraCrossingWidth*1.5) {
-			t.pos.x+=(t.pos.x>zebraCrossingX)?zebraCrossingWidth:-zebraCrossingWidth;
-		}
-		t.scale=randFloat(0.8f,1.3f);
-		t.foliageColor= {randFloat(0.0f,0.1f),randFloat(0.3f,0.6f),randFloat(0.0f,0.15f)};
-		t.trunkColor=trunkC;
-		trees.push_back(t);
-	}
-	streetLights.clear();
-	float poleBaseWidth=5.0f;
-	for(int i=0; i<NUM_STREETLIGHTS; ++i) {
-		StreetLight sl;
-		sl.onUpper=(i%2==0);
-		sl.pos.y=sl.onUpper?upperFootpathBottomY:lowerFootpathBottomY;
-		sl.height=85.0f+randFloat(-5.0f,5.0f);
-		sl.armLength=35.0f+randFloat(-3.0f,8.0f);
-		sl.pos.x=(windowWidth/(NUM_STREETLIGHTS+1.0f))*(i+1.0f);
-		sl.pos.x+=randFloat(-35.0f,35.0f);
-		if(fabs(sl.pos.x-zebraCrossingX)<zebraCrossingWidth*1.2) {
-			sl.pos.x+=(sl.pos.x>zebraCrossingX)?zebraCrossingWidth*0.8f:-zebraCrossingWidth*0.8f;
-		}
-		sl.pos.x=std::max(poleBaseWidth,std::min(windowWidth-poleBaseWidth,sl.pos.x));
-		streetLights.push_back(sl);
+
+// Runs the model without a window as fast as possible and reports throughput.
+// Starts from loadPath when given, writes the final state to savePath and every tick
+// to recordPath when those are given.
+int RunHeadless(long long ticks, const std::string& loadPath, const std::string& savePath, const std::string& recordPath, int encoders) {
+	if(loadPath.empty()) {
+		world.initialize();
+		if(world.activeVehicles<(size_t)world.numVehicles) {
+			std::cout<<"started "<<world.activeVehicles<<" of "<<world.numVehicles<<" vehicles requested: the rest do not fit the lanes' approach (see --queue)\n";
+		}
+	}
+	else if(!RestoreWorld(loadPath)) return 1;
+	if(!recordPath.empty()&&!StartRecording(recordPath,encoders)) return 1;
+	auto start=std::chrono::steady_clock::now();
+	double entityUpdates=0;
+	for(long long t=0; t<ticks; ++t) {
+		world.step(SIM_TICK_SECONDS);
+		recorder.capture(world);
+		entityUpdates+=world.entityCount();
+	}
+	double seconds=std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+	if(seconds<=0) seconds=1e-9;
+	std::cout<<std::fixed<<std::setprecision(1);
+	std::cout<<"ticks: "<<ticks<<"  entities: "<<world.entityCount()<<"  threads: "<<world.threadCount()<<"  seed: "<<world.seed<<"  kernel: "<<IntegrateVehiclesPath()<<"  time: "<<std::setprecision(3)<<seconds<<" s\n";
+	std::cout<<std::setprecision(1)<<"ticks/sec: "<<ticks/seconds<<"  entities/sec: "<<entityUpdates/seconds<<"\n";
+	long long spawned=0, dropped=0;
+	for(const auto& lane:world.lanes) {
+		spawned+=lane.arrivals.spawned;
+		dropped+=lane.arrivals.dropped;
+	}
+	std::cout<<"arrivals spawned: "<<spawned<<"  dropped: "<<dropped<<"  vehicle slots: "<<world.vehicles.size()<<"\n";
+	if(recorder.isOpen()) {
+		double stepSeconds=std::max(1e-9,seconds-recorder.captureSeconds-recorder.stallSeconds);
+		if(!recorder.close()) {
+			std::cerr<<"record failed: cannot write "<<recordPath<<"\n";
+			return 1;
+		}
+		double frames=(double)std::max<uint64_t>(1,recorder.framesWritten());
+		std::cout<<std::setprecision(2)<<"recorded "<<recorder.framesWritten()<<" ticks to "<<recordPath<<": "<<recorder.bytesWritten()/1.0e6<<" MB, "
+		         <<recorder.bytesWritten()/frames/1024.0<<" KB/tick ("<<(double)recorder.rawBytes()/std::max<uint64_t>(1,recorder.bytesWritten())<<":1)"
+		         <<"\ncapture: "<<100.0*recorder.captureSeconds/stepSeconds<<"% of tick time  waiting for the writer: "<<100.0*recorder.stallSeconds/stepSeconds<<"%"
+		         <<"  coding: "<<1000.0*recorder.encodeSeconds/frames<<" ms/tick on "<<encoders<<(encoders==1?" encoder\n":" encoders\n");
+	}
+	if(!savePath.empty()) {
+		auto saveStart=std::chrono::steady_clock::now();
+		snapshotWriter.save(world,savePath);
+		double handoffMs=std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now()-saveStart).count();
+		snapshotWriter.flush();
+		double totalMs=std::chrono::duration<double,std::milli>(std::chrono::steady_clock::now()-saveStart).count();
+		std::string error=snapshotWriter.lastError();
+		if(!error.empty()) {
+			std::cerr<<"save failed: "<<error<<"\n";
+			return 1;
+		}
+		std::cout<<std::setprecision(2)<<"saved "<<savePath<<" at tick "<<world.tick<<": copy "<<handoffMs<<" ms, on disk after "<<totalMs<<" ms\n";
 	}
-	InitializeClouds();
+	return 0;
 }
-bool IsCrossingBlocked() {
-	/* ... Same ... */ for(const auto& v:vehicles) {
-		if(v.x<crossingBackEdge && v.x+v.width>crossingFrontEdge) {
-			return true;
-		}
-	}
-	return false;
+
+// Plays a recording through without a window: decode rate and seek time via the keyframe index.
+int RunReplayHeadless(const std::string& path) {
+	std::string error;
+	if(!player.open(path,error)) {
+		std::cerr<<"replay failed: "<<error<<"\n";
+		return 1;
+	}
+	auto start=std::chrono::steady_clock::now();
+	long long frames=1;
+	while(player.next()) frames++;
+	double seconds=std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+	uint64_t first=player.firstTick(), last=player.lastTick();
+	const int SEEKS=50;
+	start=std::chrono::steady_clock::now();
+	for(int i=SEEKS; i>0; --i) { // Backwards, so every seek goes through the index
+		if(!player.seek(first+(last-first)*i/SEEKS)) {
+			std::cerr<<"replay failed: cannot seek to tick "<<first+(last-first)*i/SEEKS<<"\n";
+			return 1;
+		}
+	}
+	double seekSeconds=std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+	std::cout<<std::fixed<<std::setprecision(1);
+	std::cout<<"ticks "<<first<<".."<<last<<"  frames: "<<frames<<"  keyframes: "<<player.keyframeCount()<<"  vehicle slots: "<<player.frame().vehicles.size()<<"\n";
+	std::cout<<"decoded frames/sec: "<<frames/std::max(1e-9,seconds)<<"  average seek: "<<std::setprecision(2)<<1000.0*seekSeconds/SEEKS<<" ms\n";
+	return 0;
 }
 
-void UpdateScene(int value) {
-	bool night = isNightTime(timeOfDay);
-	if(ENABLE_DAY_NIGHT_CYCLE) {
-		timeOfDay+=timeSpeed;
-		if(timeOfDay>=1.0f) timeOfDay-=1.0f;
-	}
-	trafficLightTimer++;
-	bool carsMustStopIntent=false;
-	int remainingTimeInPhase=0;
-	LightState nextLightState=trafficLightState;
-	if(trafficLightState==RED) {
-		carsMustStopIntent=true;
-		remainingTimeInPhase=RED_DURATION-trafficLightTimer;
-		if(trafficLightTimer>=RED_DURATION) {
-			nextLightState=GREEN;
-		}
-	}
-	else if(trafficLightState==YELLOW) {
-		carsMustStopIntent=true;
-		remainingTimeInPhase=YELLOW_DURATION-trafficLightTimer;
-		if(trafficLightTimer>=YELLOW_DURATION) {
-			nextLightState=RED;
-		}
-	}
-	else {
-		carsMustStopIntent=false;
-		remainingTimeInPhase=GREEN_DURATION-trafficLightTimer;
-		if(trafficLightTimer>=GREEN_DURATION) {
-			nextLightState=YELLOW;
-		}
-	}
-	if(nextLightState!=trafficLightState) {
-		trafficLightState=nextLightState;
-		trafficLightTimer=0;
-		if(trafficLightState==RED) {
-			carsMustStopIntent=true;
-			remainingTimeInPhase=RED_DURATION;
-		}
-		else if(trafficLightState==YELLOW) {
-			carsMustStopIntent=true;
-			remainingTimeInPhase=YELLOW_DURATION;
-		}
-		else {
-			carsMustStopIntent=false;
-			remainingTimeInPhase=GREEN_DURATION;
-		}
-	}
-	// Update Vehicles (Logic Same)
-	for(int i=0; i<vehicles.size(); ++i) {
-		Vehicle& v=vehicles[i];
-		float relevantStopLine=(v.direction>0)?stopLineLeft:stopLineRight;
-		float effectiveFrontX=(v.direction>0)?v.x+v.width:v.x;
-		bool shouldConsiderStopping=false;
-		if(carsMustStopIntent) {
-			shouldConsiderStopping=true;
-		}
-		else if(trafficLightState==GREEN) {
-			float predictionSpeed=std::max(0.5f,v.baseSpeed);
-			float distanceToClearCrossing=(v.direction>0)?crossingBackEdge-v.x:(v.x+v.width)-crossingFrontEdge;
-			float timeToClear=(predictionSpeed>0.1f)?(fabs(distanceToClearCrossing)/predictionSpeed):9999.0f;
-			float decisionPoint=relevantStopLine-v.direction*predictionSpeed*60.0f;
-			if((timeToClear*CAR_TIME_PREDICTION_FACTOR>remainingTimeInPhase && ((v.direction>0&&effectiveFrontX>decisionPoint)||(v.direction<0&&effectiveFrontX<decisionPoint))) || (remainingTimeInPhase<40&&fabs(effectiveFrontX-relevantStopLine)<50.0f)) {
-				shouldConsiderStopping=true;
-			}
-		}
-		float maxSpeedTraffic=v.baseSpeed;
-		if(shouldConsiderStopping) {
-			float distToStop=fabs(relevantStopLine-effectiveFrontX);
-			bool isBeforeStopLine=(v.direction>0&&effectiveFrontX<relevantStopLine)||(v.direction<0&&effectiveFrontX>relevantStopLine);
-			if(!isBeforeStopLine&&fabs(effectiveFrontX-relevantStopLine)<10.0f) {
-				maxSpeedTraffic=0.0f;
-			}
-			else if(isBeforeStopLine) {
-				float brakeFactor=std::max(0.0f,std::min(1.0f,distToStop/100.0f));
-				maxSpeedTraffic=std::min(maxSpeedTraffic,v.baseSpeed*brakeFactor*brakeFactor);
-				maxSpeedTraffic=std::max(0.0f,maxSpeedTraffic);
-			}
-			else {
-				if(v.speed<0.1f) maxSpeedTraffic=0.0f;
-			}
-			bool frontNearCrossing=(v.direction>0&&effectiveFrontX+v.width>=crossingFrontEdge-2.0f)||(v.direction<0&&effectiveFrontX<=crossingBackEdge+2.0f);
-			bool rearBeforeCrossing=(v.direction>0&&v.x<crossingBackEdge)||(v.direction<0&&v.x+v.width>crossingFrontEdge);
-			if(isBeforeStopLine&&frontNearCrossing&&rearBeforeCrossing) {
-				maxSpeedTraffic = std::min(maxSpeedTraffic, 0.0f);
-			}
-		}
-		float maxSpeedAhead=v.baseSpeed*1.5f;
-		float minDistAhead=std::numeric_limits<float>::max();
-		int carAheadIndex=-1;
-		for(int j=0; j<vehicles.size(); ++j) {
-			if(i==j)continue;
-			const Vehicle& other=vehicles[j];
-			if(fabs(other.y-v.y)<5.0f&&other.direction==v.direction) {
-				float dist=std::numeric_limits<float>::max();
-				bool isAhead=false;
-				if(v.direction>0&&other.x>v.x) {
-					dist=other.x-(v.x+v.width);
-					isAhead=true;
-				}
-				else if(v.direction<0&&other.x<v.x) {
-					dist=v.x-(other.x+other.width);
-					isAhead=true;
-				}
-				if(isAhead&&dist<minDistAhead) {
-					minDistAhead=dist;
-					carAheadIndex=j;
-				}
-			}
-		}
-		if(carAheadIndex!=-1) {
-			float safeDist=CAR_MIN_SAFE_DISTANCE+v.speed*5.0f;
-			if(minDistAhead<safeDist) {
-				float aheadSpeed=vehicles[carAheadIndex].speed;
-				if(minDistAhead<CAR_MIN_SAFE_DISTANCE) {
-					maxSpeedAhead=std::min(aheadSpeed*0.8f,v.speed*0.5f);
-				}
-				else {
-					maxSpeedAhead=aheadSpeed;
-				}
-				maxSpeedAhead=std::max(0.0f,maxSpeedAhead);
-			}
-		}
-		float targetSpeed = std::min(v.baseSpeed,std::min(maxSpeedTraffic,maxSpeedAhead));
-		if(v.speed<targetSpeed) {
-			v.speed=std::min(targetSpeed,v.speed+CAR_ACCELERATION);
-		}
-		else if(v.speed>targetSpeed) {
-			v.speed=std::max(targetSpeed,v.speed-CAR_DECELERATION);
-		}
-		v.speed=std::max(0.0f,v.speed);
-		v.x+=v.speed*v.direction;
-		if(v.direction>0&&v.x>windowWidth+50) {
-			v.x=-v.width-randFloat(150,400);
-			v.y=LANE_Y1;
-			v.direction=1;
-			v.color=randomColor();
-			v.type=(VehicleType)(rand()%3);
-			switch(v.type) {
-			case BUS:
-				v.width=100;
-				v.height=40;
-				v.baseSpeed=randFloat(0.6f,1.0f);
-				break;
-			case TRUCK:
-				v.width=120;
-				v.height=45;
-				v.baseSpeed=randFloat(0.5f,0.9f);
-				break;
-			default:
-				v.width=60;
-				v.height=25;
-				v.baseSpeed=randFloat(0.8f,1.6f);
-				break;
-			}
-			if(v.speed>0.1f) v.speed=v.baseSpeed*randFloat(0.5f,0.8f);
-			else v.speed=0;
-		}
-		else if(v.direction<0&&v.x+v.width<-50) {
-			v.x=windowWidth+50+randFloat(150,400);
-			v.y=LANE_Y2;
-			v.direction=-1;
-			v.color=randomColor();
-			v.type=(VehicleType)(rand()%3);
-			switch(v.type) {
-			case BUS:
-				v.width=100;
-				v.height=40;
-				v.baseSpeed=randFloat(0.6f,1.0f);
-				break;
-			case TRUCK:
-				v.width=120;
-				v.height=45;
-				v.baseSpeed=randFloat(0.5f,0.9f);
-				break;
-			default:
-				v.width=60;
-				v.height=25;
-				v.baseSpeed=randFloat(0.8f,1.6f);
-				break;
-			}
-			if(v.speed>0.1f) v.speed=v.baseSpeed*randFloat(0.5f,0.8f);
-			else v.speed=0;
-		}
-	}
-	// Update Birds (Logic Same)
-	if (!night) {
-		for(auto& b:birds) {
-			b.x+=b.speed;
-			b.flapPhase+=b.flapSpeed;
-			if(b.flapPhase>2.0f*M_PI)b.flapPhase-=2.0f*M_PI;
-			b.bobPhase+=b.speed*0.01f;
-			b.y=birdBaseY+birdAmplitudeY*sin(b.bobPhase);
-			if(b.x>windowWidth+50) {
-				b.x=-50.0f;
-				b.y=birdBaseY+randFloat(-birdAmplitudeY,birdAmplitudeY);
-				b.bobPhase=randFloat(0,2.0f*M_PI);
-			}
-		}
-	}
-	// Update Sidewalk Pedestrians (Logic Same)
-	for(auto& p:sidewalkPedestrians) {
-		if(!night) {
-			p.x+=p.speed;
-			p.legPhase+=p.legSpeed*fabs(p.speed);
-			if(p.legPhase>2.0f*M_PI)p.legPhase-=2.0f*M_PI;
-			if(p.speed > 0 && p.x > windowWidth + 10) p.x = -10;
-			if(p.speed < 0 && p.x < -10) p.x = windowWidth + 10;
-		}
-		else {
-			p.legPhase = 0;
-		}
-		p.y = p.onUpperPath ? upperSidewalkLevelY : lowerSidewalkLevelY;
-	}
-	// Update Crossing Pedestrians (Logic Same)
-	int crossingCount=0;
-	for(const auto& p:crossingPedestrians) {
-		if(p.state==CROSSING)crossingCount++;
-	}
-	for(auto& p:crossingPedestrians) {
-		float moveDelta=p.speed;
-		float currentLegSpeedFactor=0.1f;
-		bool crossingBlockedByCar=false;
-		switch(p.state) {
-		case WAITING_TO_CROSS:
-			if(!night&&trafficLightState==RED&&crossingCount<2) {
-				crossingBlockedByCar=IsCrossingBlocked();
-				if(!crossingBlockedByCar) {
-					p.state=CROSSING;
-					crossingCount++;
-				}
-			}
-			break;
-		case CROSSING:
-			currentLegSpeedFactor=1.0f;
-			p.x=moveTowards(p.x,crossingWalkX,moveDelta*0.2f);
-			p.y=moveTowards(p.y,p.targetY,moveDelta);
-			if(fabs(p.y-p.targetY)<1.0f) {
-				p.state=FINISHED_CROSSING;
-				p.y=p.targetY;
-				p.x=crossingWalkX+randFloat(-zebraCrossingWidth*0.3f,zebraCrossingWidth*0.3f);
-			}
-			break;
-		case FINISHED_CROSSING:
-			if(trafficLightState!=RED) {
-				p.state=WAITING_TO_CROSS;
-				p.onUpperPath=!p.onUpperPath;
-				p.targetY=p.onUpperPath?lowerSidewalkLevelY:upperSidewalkLevelY;
-				p.x=crossingWalkX+randFloat(-zebraCrossingWidth*0.3f,zebraCrossingWidth*0.3f);
-			}
-			break;
-		case WALKING_SIDEWALK:
-			break;
-		}
-		if(p.state==CROSSING) {
-			currentLegSpeedFactor=1.0f;
-		}
-		p.legPhase+=p.legSpeed*currentLegSpeedFactor;
-		if(p.legPhase>2.0f*M_PI)p.legPhase-=2.0f*M_PI;
-	}
-	// Update Clouds (with alpha fading)
-	for (auto& cloud : clouds) {
-		if (!night) cloud.pos.x += cloud.speed; // Only move if not night
-		cloud.shapePhase += 0.01f;
-		if (cloud.shapePhase > 2.0f * M_PI) cloud.shapePhase -= 2.0f * M_PI;
+// Advances a rows x cols grid of intersections and reports how it compares to real time.
+int RunNetwork(int rows, int cols, long long ticks, int vehicles, int pedestrians, int threads, uint64_t seed) {
+	RoadNetwork network;
+	network.seed=seed;
+	network.setThreadCount(threads);
+	network.buildGrid(rows,cols,300.0f);
+	// By default every segment is filled, as many as fit
+	int placed=network.populate(vehicles<0?INT_MAX:vehicles);
+	network.populatePedestrians(std::max(0,pedestrians));
+	auto start=std::chrono::steady_clock::now();
+	for(long long t=0; t<ticks; ++t) network.step(SIM_TICK_SECONDS);
+	double seconds=std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+	if(seconds<=0) seconds=1e-9;
+	std::cout<<std::fixed<<std::setprecision(1);
+	std::cout<<"intersections: "<<network.intersections.size()<<"  segments: "<<network.segments.size()<<"  vehicles: "<<network.vehicleCount()<<"  threads: "<<threads<<"  seed: "<<seed<<"  kernel: "<<IntegrateVehiclesPath()<<"\n";
+	if(vehicles>=0&&placed<vehicles) std::cout<<"placed "<<placed<<" of "<<vehicles<<" vehicles requested: every segment is full\n";
+	std::cout<<"pedestrians: "<<network.pedestrians.size()<<"  crossing now: "<<network.pedestriansCrossing()<<"\n";
+	std::cout<<"signals: "<<network.signals.size()<<"  phase changes/tick: "<<(ticks>0?(double)network.signals.phaseChanges/ticks:0.0)<<"\n";
+	std::cout<<"ticks/sec: "<<ticks/seconds<<"  real-time factor: "<<std::setprecision(2)<<ticks*SIM_TICK_SECONDS/seconds<<"x\n";
+	return 0;
+}
 
-		// Cloud Alpha Fading Logic
-		float dawnEndTime = NIGHT_END_TIME + DAWN_DURATION;
-		float duskStartTime = NIGHT_START_TIME - DUSK_DURATION;
+// --- OpenGL Display and Setup ---
 
-		if (timeOfDay > NIGHT_END_TIME && timeOfDay < dawnEndTime) { // Fading in (Dawn)
-			cloud.alpha = (timeOfDay - NIGHT_END_TIME) / DAWN_DURATION;
-		} else if (timeOfDay > duskStartTime && timeOfDay < NIGHT_START_TIME) { // Fading out (Dusk)
-			cloud.alpha = 1.0f - (timeOfDay - duskStartTime) / DUSK_DURATION;
-		} else if (timeOfDay >= dawnEndTime && timeOfDay <= duskStartTime) { // Full Day
-			cloud.alpha = 1.0f;
-		} else { // Full Night
-			cloud.alpha = 0.0f;
-		}
-		cloud.alpha = std::max(0.0f, std::min(1.0f, cloud.alpha)); // Clamp alpha
+void DrawFrameStats(const SimFrame& sim) {
+	float x=10, y=windowHeight-20;
+	Color textColor= {1.0f,1.0f,1.0f};
+	RenderText(x, y, GLUT_BITMAP_HELVETICA_12, frameTimes.summary(), textColor);
+	char text[192];
+	snprintf(text,sizeof(text),"sim ticks %lld  dropped %lld  sim time %.1f s  draw calls %lld  scenery bakes %lld  lights %lld",sim.ticks,sim.droppedTicks,sim.ticks*SIM_TICK_SECONDS,sceneDrawCalls,sceneryCache.bakes,lightMap.lightsDrawn);
+	RenderText(x, y-16, GLUT_BITMAP_HELVETICA_12, text, textColor);
+	snprintf(text,sizeof(text),"zoom %.2f  in view: vehicles %d/%d  pedestrians %d/%d  grid cells %d",camera.zoom(),(int)visible.vehicles.size(),(int)std::count(sim.current.vehicleActive.begin(),sim.current.vehicleActive.end(),1),
+	         (int)(visible.sidewalkPedestrians.size()+visible.crossingPedestrians.size()),(int)(sim.current.sidewalkPedestrians.size()+sim.current.crossingPedestrians.size()),visibleCells);
+	RenderText(x, y-32, GLUT_BITMAP_HELVETICA_12, text, textColor);
+	snprintf(text,sizeof(text),"chunks %d resident, %.0f of %.0f KB  generated %lld  evicted %lld",(int)cityChunks.residentCount(),cityChunks.residentBytes/1024.0,cityChunks.memoryBudget/1024.0,cityChunks.generated,cityChunks.evicted);
+	RenderText(x, y-48, GLUT_BITMAP_HELVETICA_12, text, textColor);
+	snprintf(text,sizeof(text),"windows lit %d/%d  flips %lld",(int)windowLights.litInView,(int)windowLights.windowsInView,windowLights.flips);
+	RenderText(x, y-64, GLUT_BITMAP_HELVETICA_12, text, textColor);
+	y-=48;
+	// One bar per 1 ms bucket, scaled to the fullest; the red mark is the frame target
+	long long peak=1;
+	for(int b=0; b<FRAME_HISTOGRAM_BUCKETS; ++b) peak=std::max(peak,frameTimes.buckets[b]);
+	float barW=4.0f, baseY=y-80, maxH=50.0f;
+	glColor4f(0.0f,0.0f,0.0f,0.5f);
+	glBegin(GL_QUADS);
+	glVertex2f(x-2,baseY-2);
+	glVertex2f(x+FRAME_HISTOGRAM_BUCKETS*barW+2,baseY-2);
+	glVertex2f(x+FRAME_HISTOGRAM_BUCKETS*barW+2,baseY+maxH+2);
+	glVertex2f(x-2,baseY+maxH+2);
+	glColor3f(0.9f,0.9f,0.9f);
+	for(int b=0; b<FRAME_HISTOGRAM_BUCKETS; ++b) {
+		float h=maxH*frameTimes.buckets[b]/(float)peak;
+		glVertex2f(x+b*barW,baseY);
+		glVertex2f(x+(b+1)*barW-1,baseY);
+		glVertex2f(x+(b+1)*barW-1,baseY+h);
+		glVertex2f(x+b*barW,baseY+h);
+	}
+	glEnd();
+	float targetX=x+TARGET_FRAME_SECONDS*1000.0f*barW;
+	glColor3f(1.0f,0.2f,0.2f);
+	glBegin(GL_LINES);
+	glVertex2f(targetX,baseY);
+	glVertex2f(targetX,baseY+maxH);
+	glEnd();
+}
 
-		// Wrapping Logic
-		float approxCloudWidth=0;
-		for(float r:cloud.ellipseRadiiX) approxCloudWidth+=r*cloud.scale*0.6f;
-		if (cloud.pos.x - approxCloudWidth > windowWidth) {
-			cloud.pos.x = -approxCloudWidth - randFloat(50, 150);
-			cloud.pos.y = windowHeight * 0.75f + randFloat(-windowHeight*0.05f, windowHeight*0.1f);
-		}
+// One row per zone over the last PROFILER_WINDOW_SECONDS, busiest first: calls per second,
+// mean time per call and share of one core. Nested zones are included in their parents.
+void DrawProfiler() {
+	static std::vector<ZoneStats> zones;
+	SummarizeZones(PROFILER_WINDOW_SECONDS,zones);
+	const size_t maxRows=18;
+	size_t rows=std::min(zones.size(),maxRows);
+	float x=windowWidth-330.0f, y=windowHeight-20.0f, rowH=14.0f;
+	glColor4f(0.0f,0.0f,0.0f,0.6f);
+	glBegin(GL_QUADS);
+	glVertex2f(x-6,y+14);
+	glVertex2f(windowWidth-4.0f,y+14);
+	glVertex2f(windowWidth-4.0f,y-rowH*(rows+1)-4);
+	glVertex2f(x-6,y-rowH*(rows+1)-4);
+	glEnd();
+	Color header= {1.0f,0.85f,0.3f}, textColor= {1.0f,1.0f,1.0f};
+	RenderText(x, y, GLUT_BITMAP_HELVETICA_10, "zone", header);
+	RenderText(x+180, y, GLUT_BITMAP_HELVETICA_10, "calls/s", header);
+	RenderText(x+230, y, GLUT_BITMAP_HELVETICA_10, "us/call", header);
+	RenderText(x+285, y, GLUT_BITMAP_HELVETICA_10, "core %", header);
+	if(zones.empty()) RenderText(x, y-rowH, GLUT_BITMAP_HELVETICA_10, "no samples (built with PROFILE_ZONES=0?)", textColor);
+	char text[32];
+	for(size_t i=0; i<rows; ++i) {
+		const ZoneStats& z=zones[i];
+		float rowY=y-rowH*(i+1);
+		RenderText(x, rowY, GLUT_BITMAP_HELVETICA_10, z.name, textColor);
+		snprintf(text,sizeof(text),"%.0f",z.calls/PROFILER_WINDOW_SECONDS);
+		RenderText(x+180, rowY, GLUT_BITMAP_HELVETICA_10, text, textColor);
+		snprintf(text,sizeof(text),"%.1f",z.totalMs*1000.0/z.calls);
+		RenderText(x+230, rowY, GLUT_BITMAP_HELVETICA_10, text, textColor);
+		snprintf(text,sizeof(text),"%.1f",z.totalMs/(PROFILER_WINDOW_SECONDS*10.0));
+		RenderText(x+285, rowY, GLUT_BITMAP_HELVETICA_10, text, textColor);
 	}
-
-	glutPostRedisplay();
-	glutTimerFunc(16, UpdateScene, 0);
 }
 
-// --- OpenGL Display and Setup ---
-
 void display() {
-	bool night = isNightTime(timeOfDay);
-	glClear(GL_COLOR_BUFFER_BIT);
-	glMatrixMode(GL_MODELVIEW);
-	glLoadIdentity();
-	DrawSkyAndSunMoon(timeOfDay);
-	// Draw Clouds (with alpha)
-	glEnable(GL_BLEND);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA); // Ensure blending for clouds
-	for(const auto& cloud : clouds) {
-		if (cloud.alpha > 0.01f) DrawClouds(cloud);    // Only draw if visible
-	}
-	// Draw Scenery
-	DrawMountains();
-	DrawBuilding1(windowWidth*0.1f, upperFootpathTopY, 1.0f);
-	DrawBuilding2(windowWidth*0.2f, upperFootpathTopY, 1.0f);
-	DrawBuilding3(windowWidth*0.45f, upperFootpathTopY, 1.0f);
-	DrawControlTower(windowWidth*0.85f, upperFootpathTopY, 1.0f);
-	DrawFootpath();
-	for (const auto& sl : streetLights) {
-		DrawStreetLight(sl);
-	}
-	for (const auto& t : trees) {
-		DrawTree(t);
-	}
-	DrawRoad();
-	DrawZebraCrossing();
-	for(const auto& v:vehicles) {
-		DrawVehicle(v);
-	}
-	DrawTrafficLight(trafficLightX, upperFootpathBottomY, 1.0f);
-	for(const auto& p:crossingPedestrians) {
-		if(p.state==CROSSING) DrawPedestrian(p);
-	}
-	for(const auto& p:sidewalkPedestrians) {
-		DrawPedestrian(p);
-	}
-	for(const auto& p:crossingPedestrians) {
-		if(p.state==WAITING_TO_CROSS || p.state==FINISHED_CROSSING) DrawPedestrian(p);
+	PROFILE_ZONE("display");
+	auto now=std::chrono::steady_clock::now();
+	frameTimes.record(std::chrono::duration<double>(now-lastDisplay).count());
+	lastDisplay=now;
+	static unsigned sceneryVersion=0;
+	simFrames.update();
+	const SimFrame& sim=simFrames.front();
+	if(sim.sceneryVersion!=sceneryVersion) {
+		sceneryCache.invalidate();
+		sceneryVersion=sim.sceneryVersion;
+	}
+	// Carries on from the published fraction of a tick by the time since, up to the newer tick
+	float alpha=sim.alpha+(float)(std::chrono::duration<double>(now-sim.published).count()/SIM_TICK_SECONDS);
+	{
+		// Only the grid cells around the view are visited, and only their entities blended and drawn
+		PROFILE_ZONE("display.cull");
+		ViewRect view=camera.view();
+		if(cityChunks.update(view.x0,view.x1,-(float)windowWidth,2.0f*windowWidth)) sceneryCache.invalidate();
+		float x0=view.x0-VIEW_CULL_MARGIN, y0=view.y0-VIEW_CULL_MARGIN, x1=view.x1+VIEW_CULL_MARGIN, y1=view.y1+VIEW_CULL_MARGIN;
+		visible.vehicles.clear();
+		visible.sidewalkPedestrians.clear();
+		visible.crossingPedestrians.clear();
+		visibleCells=sim.vehicleGrid.query(x0,y0,x1,y1,visible.vehicles);
+		visibleCells+=sim.sidewalkGrid.query(x0,y0,x1,y1,visible.sidewalkPedestrians);
+		visibleCells+=sim.crossingGrid.query(x0,y0,x1,y1,visible.crossingPedestrians);
+		InterpolateSelection(sim.previous,sim.current,std::min(1.0f,std::max(0.0f,alpha)),visible,frame);
+	}
+	long long drawCallsBefore=sceneBatch.drawCalls+instancedMeshes.drawCalls;
+	DrawScene();
+	sceneDrawCalls=sceneBatch.drawCalls+instancedMeshes.drawCalls-drawCallsBefore;
+	if(softwareRasterizer) {
+		// The whole frame in one upload; the HUD is still drawn by GL on top
+		PROFILE_ZONE("draw.upload");
+		glDisable(GL_BLEND);
+		glRasterPos2i(0,0);
+		glDrawPixels(softwareRasterizer->width(),softwareRasterizer->height(),GL_RGBA,GL_UNSIGNED_BYTE,softwareRasterizer->pixels());
+		glEnable(GL_BLEND);
 	}
-	if(!night) {
-		for(const auto& bird:birds) {
-			DrawBird(bird);    // Only draw birds if not night
-		}
+	{
+		PROFILE_ZONE("draw.hud");
+		if(showFrameStats) DrawFrameStats(sim);
+		if(showProfiler) DrawProfiler();
 	}
+	PROFILE_ZONE("display.swap");
 	glutSwapBuffers();
 }
 
 void reshape(int w, int h) {
 	/* ... Same ... */ windowWidth = w;
 	windowHeight = h;
+	ResizeWorld(w, h);
 	if (h == 0) h = 1;
 	glViewport(0, 0, w, h);
 	glMatrixMode(GL_PROJECTION);
@@ -1304,18 +557,224 @@ void initGL() {
 	glEnable(GL_BLEND);
 	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 }
+void keyboard(unsigned char key, int x, int y) {
+	if(key=='f'||key=='F') {
+		showFrameStats=!showFrameStats;
+		frameTimes.reset();
+	}
+	else if(key=='s'||key=='S') {
+		simCommands.push(SimCommand::SAVE_SNAPSHOT);
+	}
+	else if(key=='p'||key=='P') {
+		showProfiler=!showProfiler;
+	}
+	else if(key=='t'||key=='T') {
+		WriteTrace();
+	}
+	else if(replaying&&key==' ') {
+		simCommands.push(SimCommand::TOGGLE_PAUSE);
+	}
+	else if(key=='l'||key=='L') {
+		LoadQuickSnapshot();
+	}
+	else if(key=='+'||key=='=') {
+		camera.zoomAt(CAMERA_ZOOM_STEP,windowWidth*0.5f,windowHeight*0.5f);
+	}
+	else if(key=='-'||key=='_') {
+		camera.zoomAt(1.0f/CAMERA_ZOOM_STEP,windowWidth*0.5f,windowHeight*0.5f);
+	}
+	else if(key=='0') {
+		camera.reset();
+	}
+}
+// Arrows pan the camera, Page Up/Down jump along the street and Home resets it. In a replay, left/right seek back and forth
+// through the keyframe index instead.
+void specialKey(int key, int x, int y) {
+	if(replaying&&key==GLUT_KEY_RIGHT) simCommands.push(SimCommand::SEEK_FORWARD);
+	else if(replaying&&key==GLUT_KEY_LEFT) simCommands.push(SimCommand::SEEK_BACK);
+	else if(key==GLUT_KEY_RIGHT) camera.pan(CAMERA_PAN_STEP,0.0f);
+	else if(key==GLUT_KEY_LEFT) camera.pan(-CAMERA_PAN_STEP,0.0f);
+	else if(key==GLUT_KEY_UP) camera.pan(0.0f,CAMERA_PAN_STEP);
+	else if(key==GLUT_KEY_DOWN) camera.pan(0.0f,-CAMERA_PAN_STEP);
+	else if(key==GLUT_KEY_PAGE_UP) camera.pan(CAMERA_PAGE_STEP*windowWidth,0.0f);
+	else if(key==GLUT_KEY_PAGE_DOWN) camera.pan(-CAMERA_PAGE_STEP*windowWidth,0.0f);
+	else if(key==GLUT_KEY_HOME) camera.reset();
+}
+// The wheel zooms about the cursor; dragging with the left button pans. GLUT's y runs down.
+void mouse(int button, int state, int x, int y) {
+	if(button==3&&state==GLUT_DOWN) camera.zoomAt(CAMERA_ZOOM_STEP,(float)x,(float)(windowHeight-y));
+	else if(button==4&&state==GLUT_DOWN) camera.zoomAt(1.0f/CAMERA_ZOOM_STEP,(float)x,(float)(windowHeight-y));
+	else if(button==GLUT_LEFT_BUTTON) {
+		dragging=state==GLUT_DOWN;
+		dragX=x;
+		dragY=y;
+	}
+}
+void mouseMotion(int x, int y) {
+	if(!dragging) return;
+	camera.pan((float)(dragX-x),(float)(y-dragY));
+	dragX=x;
+	dragY=y;
+}
+// --- Offscreen Export ---
+#ifndef _WIN32
+// Draws frames into an EGL context with no window, one per tick, and writes them to
+// directory. The scene starts like a headless run (fresh, or from loadPath), or plays back
+// the recording already opened into player when replaying. With softwareRasterizer set no
+// context is made at all.
+int RunExport(long long frames, const std::string& directory, ExportFormat format, int encoders, const std::string& loadPath) {
+	OffscreenContext context;
+	std::string error;
+	if(softwareRasterizer) world.resize(windowWidth,windowHeight);
+	else {
+		if(!context.create(windowWidth,windowHeight,false,error)) {
+			std::cerr<<"export failed: "<<error<<"\n";
+			return 1;
+		}
+		initGL();
+		reshape(windowWidth,windowHeight);
+	}
+	if(loadPath.empty()||replaying) world.initialize();
+	else if(!RestoreWorld(loadPath)) return 1;
+	FrameExporter exporter;
+	if(!exporter.open(directory,format,windowWidth,windowHeight,1.0/SIM_TICK_SECONDS,encoders,error)) {
+		std::cerr<<"export failed: "<<error<<"\n";
+		return 1;
+	}
+	auto start=std::chrono::steady_clock::now();
+	long long drawn=0;
+	while(drawn<frames) {
+		if(replaying) {
+			frame=player.frame();
+			CaptureScenery(world,frame);
+		}
+		else CaptureFrame(world,frame);
+		DrawScene();
+		if(softwareRasterizer) exporter.capture(softwareRasterizer->pixels());
+		else exporter.capture();
+		drawn++;
+		if(replaying) {
+			if(!player.next()) break;
+		}
+		else world.step(SIM_TICK_SECONDS);
+	}
+	bool ok=exporter.close();
+	double seconds=std::chrono::duration<double>(std::chrono::steady_clock::now()-start).count();
+	if(seconds<=0) seconds=1e-9;
+	if(!ok) {
+		std::cerr<<"export failed: "<<exporter.lastError()<<"\n";
+		return 1;
+	}
+	double perFrame=1.0/std::max<long long>(1,drawn);
+	std::string renderer=softwareRasterizer ? "software, "+std::to_string(softwareRasterizer->threadCount())+" threads" : context.renderer();
+	std::cout<<std::fixed<<std::setprecision(2);
+	std::cout<<"exported "<<exporter.framesWritten()<<" frames ("<<windowWidth<<"x"<<windowHeight<<") to "<<directory<<": "<<exporter.bytesWritten()/1.0e6<<" MB  renderer: "<<renderer<<"\n";
+	std::cout<<"frames/sec: "<<drawn/seconds<<"  real-time factor: "<<drawn*SIM_TICK_SECONDS/seconds<<"x  encoders: "<<encoders<<"\n";
+	std::cout<<"readback: "<<1000.0*exporter.captureSeconds*perFrame<<" ms/frame  waiting for the encoders: "<<1000.0*exporter.stallSeconds*perFrame<<" ms/frame\n";
+	return 0;
+}
+#endif
+
 // --- Main Function ---
 int main(int argc, char** argv) {
-	/* ... Same ... */ glutInit(&argc, argv);
+	SetProfileThreadName("main");
+	bool headless=false, trace=false;
+	long long ticks=10000;
+	int vehicles=-1, pedestrians=-1, threads=1, rows=0, cols=0;
+	long long exportFrames=0;
+	std::string exportDir, exportFormat="png";
+	int encoders=0; // 0: one per hardware thread
+	bool software=false;
+	uint64_t seed=(uint64_t)time(0); // A fresh scene each run unless --seed pins it
+	std::string loadPath, savePath, recordPath, replayPath;
+	for(int i=1; i<argc; ++i) {
+		if(strcmp(argv[i],"--headless")==0) headless=true;
+		else if(strcmp(argv[i],"--ticks")==0&&i+1<argc) ticks=atoll(argv[++i]);
+		else if(strcmp(argv[i],"--vehicles")==0&&i+1<argc) vehicles=atoi(argv[++i]);
+		else if(strcmp(argv[i],"--pedestrians")==0&&i+1<argc) pedestrians=atoi(argv[++i]);
+		else if(strcmp(argv[i],"--threads")==0&&i+1<argc) threads=atoi(argv[++i]);
+		else if(strcmp(argv[i],"--network")==0&&i+1<argc) sscanf(argv[++i],"%dx%d",&rows,&cols);
+		else if(strcmp(argv[i],"--seed")==0&&i+1<argc) seed=strtoull(argv[++i],nullptr,10);
+		else if(strcmp(argv[i],"--demand")==0&&i+1<argc) world.laneDemand=(float)atof(argv[++i]);
+		else if(strcmp(argv[i],"--queue")==0&&i+1<argc) world.startQueueLength=(float)atof(argv[++i]);
+		else if(strcmp(argv[i],"--load")==0&&i+1<argc) loadPath=argv[++i];
+		else if(strcmp(argv[i],"--save")==0&&i+1<argc) savePath=argv[++i];
+		else if(strcmp(argv[i],"--record")==0&&i+1<argc) recordPath=argv[++i];
+		else if(strcmp(argv[i],"--replay")==0&&i+1<argc) replayPath=argv[++i];
+		else if(strcmp(argv[i],"--scenery-quantum")==0&&i+1<argc) sceneryCache.darknessQuantum=(float)atof(argv[++i]);
+		else if(strcmp(argv[i],"--no-instancing")==0) instancedMeshes.enabled=false;
+		else if(strcmp(argv[i],"--no-lightmap")==0) lightMap.enabled=false;
+		else if(strcmp(argv[i],"--software")==0) software=true;
+		else if(strcmp(argv[i],"--city-chunks")==0&&i+1<argc) cityChunks.cityChunks=std::max(0,std::min(MAX_CITY_CHUNKS,atoi(argv[++i])));
+		else if(strcmp(argv[i],"--chunk-budget")==0&&i+1<argc) cityChunks.memoryBudget=(size_t)(std::max(0.0,atof(argv[++i]))*1024.0*1024.0);
+		else if(strcmp(argv[i],"--chunk-threads")==0&&i+1<argc) cityChunks.setThreadCount(atoi(argv[++i]));
+		else if(strcmp(argv[i],"--frames")==0&&i+1<argc) exportFrames=atoll(argv[++i]);
+		else if(strcmp(argv[i],"--out")==0&&i+1<argc) exportDir=argv[++i];
+		else if(strcmp(argv[i],"--format")==0&&i+1<argc) exportFormat=argv[++i];
+		else if(strcmp(argv[i],"--encoders")==0&&i+1<argc) encoders=atoi(argv[++i]);
+		else if(strcmp(argv[i],"--trace")==0&&i+1<argc) {
+			tracePath=argv[++i];
+			trace=true;
+		}
+	}
+	if(encoders<=0) encoders=std::max(1u,std::thread::hardware_concurrency());
+	camera.reach=cityChunks.reach();
+	if(rows>0&&cols>0) return FinishBatch(RunNetwork(rows,cols,ticks,vehicles,pedestrians,threads,seed),trace);
+	if(pedestrians>=0) world.numCrossingPedestrians=pedestrians;
+	world.seed=seed;
+	if(vehicles>=0) world.numVehicles=vehicles;
+	world.setThreadCount(threads);
+	if(headless&&!replayPath.empty()) return FinishBatch(RunReplayHeadless(replayPath),trace);
+	if(headless) return FinishBatch(RunHeadless(ticks,loadPath,savePath,recordPath,encoders),trace);
+	if(!replayPath.empty()) {
+		std::string error;
+		if(!player.open(replayPath,error)) {
+			std::cerr<<"replay failed: "<<error<<"\n";
+			return 1;
+		}
+		// Rebuild the recorded scene so the static scenery matches the frames
+		windowWidth=player.width;
+		windowHeight=player.height;
+		world.resize(windowWidth,windowHeight);
+		world.seed=player.seed;
+		replaying=true;
+	}
+	SoftwareRasterizer rasterizer(software ? (int)std::max(1u,std::thread::hardware_concurrency()) : 1);
+	if(software) {
+		softwareRasterizer=&rasterizer;
+		batchTarget=&rasterizer;
+	}
+	if(exportFrames>0) {
+#ifdef _WIN32
+		std::cerr<<"export failed: --frames needs EGL, which this build does not have\n";
+		return 1;
+#else
+		if(exportDir.empty()) exportDir="frames";
+		if(exportFormat!="png"&&exportFormat!="y4m") {
+			std::cerr<<"export failed: --format must be png or y4m\n";
+			return 1;
+		}
+		return FinishBatch(RunExport(exportFrames,exportDir,exportFormat=="y4m"?ExportFormat::Y4M:ExportFormat::PNG,encoders,loadPath),trace);
+#endif
+	}
+	glutInit(&argc, argv);
 	glutInitDisplayMode(GLUT_DOUBLE | GLUT_RGB);
 	glutInitWindowSize(windowWidth, windowHeight);
 	glutInitWindowPosition(50, 50);
 	glutCreateWindow("Animated City Scenery - Gradual Night");
 	initGL();
-	InitializeScene();
+	if(loadPath.empty()||!RestoreWorld(loadPath)) world.initialize();
+	if(!recordPath.empty()&&!replaying&&!StartRecording(recordPath,encoders)) return 1;
+	StartSimulation();
+	atexit(StopSimulation);
+	lastDisplay=nextFrameDeadline=std::chrono::steady_clock::now();
 	glutDisplayFunc(display);
 	glutReshapeFunc(reshape);
-	glutTimerFunc(25, UpdateScene, 0);
+	glutKeyboardFunc(keyboard);
+	glutSpecialFunc(specialKey);
+	glutMouseFunc(mouse);
+	glutMotionFunc(mouseMotion);
+	glutTimerFunc(0, RedisplayTimer, 0);
 	glutMainLoop();
 	return 0;
 }